@@ -0,0 +1,391 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Micro-benchmarks for the scheduler's and the executor's hot paths. Each
+// benchmark builds its input, times only the operation under test and is
+// repeated --benchmark_repetitions times; the fastest and the median run are
+// reported. Timing lives here rather than in the unit tests, whose run times
+// say little on a loaded build machine.
+
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "base/task_desc.pb.h"
+#include "engine/executors/task_health_checker.h"
+#include "messages/task_heartbeat_message.pb.h"
+#include "misc/map-util.h"
+#include "misc/utils.h"
+#include "misc/wall_time.h"
+#include "platforms/unix/heartbeat_ring.h"
+#include "scheduling/affinity_conflict_index.h"
+#include "scheduling/affinity_placement_engine.h"
+
+DEFINE_string(benchmarks, "",
+              "Comma-separated names of the benchmarks to run. All "
+              "benchmarks are run if empty.");
+DEFINE_uint64(benchmark_repetitions, 5,
+              "Number of times each benchmark is repeated.");
+
+using namespace firmament;  // NOLINT
+using firmament::platform_unix::HeartbeatRing;
+using firmament::platform_unix::TaskHeartbeatRecord;
+using firmament::scheduler::AffinityConflictIndex;
+using firmament::scheduler::AffinityPlacementEngine;
+
+// Number of fake tasks heartbeating concurrently.
+#define NUM_HEARTBEAT_TASKS 32
+// Heartbeats sent by each task.
+#define HEARTBEATS_PER_TASK 2000
+
+namespace {
+
+// Runs one repetition of a benchmark. Returns the time taken by the
+// operation under test in microseconds and sets the number of operations.
+typedef uint64_t (*BenchmarkFunction_t)(WallTime* wall_time,
+                                        uint64_t* num_ops);
+
+struct Benchmark {
+  const char* name;
+  const char* description;
+  BenchmarkFunction_t run;
+};
+
+TaskDescriptor* NewAppTask(TaskID_t task_id, const string& app) {
+  TaskDescriptor* td_ptr = new TaskDescriptor;
+  td_ptr->set_uid(task_id);
+  td_ptr->set_task_namespace("default");
+  Label* label = td_ptr->add_labels();
+  label->set_key("app");
+  label->set_value(app);
+  ResourceVector* request = td_ptr->mutable_resource_request();
+  request->set_cpu_cores(1);
+  request->set_ram_cap(1024);
+  request->set_ephemeral_storage(1);
+  return td_ptr;
+}
+
+void AddAppAffinity(TaskDescriptor* td_ptr, const string& app) {
+  LabelSelectorRequirement* expression =
+    td_ptr->mutable_affinity()->mutable_pod_affinity()
+      ->add_requiredduringschedulingignoredduringexecution()
+      ->mutable_labelselector()->add_matchexpressions();
+  expression->set_key("app");
+  expression->set_operator_("In");
+  expression->add_values(app);
+}
+
+void AddAppAntiAffinity(TaskDescriptor* td_ptr, const string& app) {
+  LabelSelectorRequirementAntiAff* expression =
+    td_ptr->mutable_affinity()->mutable_pod_anti_affinity()
+      ->add_requiredduringschedulingignoredduringexecution()
+      ->mutable_labelselector()->add_matchexpressions();
+  expression->set_key("app");
+  expression->set_operator_("In");
+  expression->add_values(app);
+}
+
+// True if one of the task's "app In" expressions selects the app.
+bool SelectsApp(const TaskDescriptor& td, const string& app) {
+  for (auto& term :
+       td.affinity().pod_affinity()
+         .requiredduringschedulingignoredduringexecution()) {
+    for (auto& expression : term.labelselector().matchexpressions()) {
+      if (expression.values(0) == app)
+        return true;
+    }
+  }
+  for (auto& term :
+       td.affinity().pod_anti_affinity()
+         .requiredduringschedulingignoredduringexecution()) {
+    for (auto& expression : term.labelselector().matchexpressions()) {
+      if (expression.values(0) == app)
+        return true;
+    }
+  }
+  return false;
+}
+
+// Stands in for the scheduler's pairwise check. The tasks built here only
+// use "app In" expressions, which this matches in the same way.
+bool AppsConflict(TaskDescriptor* td_ptr, TaskDescriptor* other_td_ptr) {
+  return SelectsApp(*td_ptr, other_td_ptr->labels(0).value()) ||
+    SelectsApp(*other_td_ptr, td_ptr->labels(0).value());
+}
+
+// Sweeps 10k running tasks, of which every hundredth has exited.
+uint64_t HealthCheckerSweep(WallTime* wall_time, uint64_t* num_ops) {
+  const uint64_t kNumTasks = 10000;
+  TaskHealthChecker checker;
+  for (uint64_t i = 0; i < kNumTasks; ++i) {
+    checker.TaskStarted(i);
+  }
+  for (uint64_t i = 0; i < kNumTasks; i += 100) {
+    checker.TaskExited(i);
+  }
+  vector<TaskID_t> failed_tasks;
+  uint64_t start_time = wall_time->GetCurrentTimestamp();
+  checker.Run(&failed_tasks);
+  uint64_t duration = wall_time->GetCurrentTimestamp() - start_time;
+  CHECK_EQ(failed_tasks.size(), kNumTasks / 100);
+  *num_ops = kNumTasks;
+  return duration;
+}
+
+// Places one anti-affinity pod per machine on a 5k machine cluster.
+uint64_t AffinityPlacement(WallTime* wall_time, uint64_t* num_ops) {
+  const uint32_t kNumMachines = 5000;
+  AffinityPlacementEngine engine;
+  for (uint32_t index = 0; index < kNumMachines; ++index) {
+    string name = "machine" + to_string(index);
+    ResourceDescriptor rd;
+    rd.set_uuid(to_string(GenerateResourceID(name)));
+    rd.set_friendly_name(name);
+    rd.set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    rd.set_max_pods(110);
+    ResourceVector* capacity = rd.mutable_resource_capacity();
+    capacity->set_cpu_cores(16);
+    capacity->set_ram_cap(65536);
+    capacity->set_ephemeral_storage(100000);
+    rd.mutable_available_resources()->CopyFrom(*capacity);
+    engine.AddMachine(rd);
+  }
+  vector<TaskDescriptor*> tasks;
+  for (TaskID_t task_id = 1; task_id <= kNumMachines; ++task_id) {
+    TaskDescriptor* td_ptr = NewAppTask(task_id, "web");
+    AddAppAntiAffinity(td_ptr, "web");
+    tasks.push_back(td_ptr);
+  }
+  uint64_t num_placed = 0;
+  uint64_t start_time = wall_time->GetCurrentTimestamp();
+  for (auto& td_ptr : tasks) {
+    ResourceID_t res_id = engine.BestMachineForTask(*td_ptr);
+    if (!res_id.is_nil()) {
+      engine.TaskPlaced(*td_ptr, res_id);
+      num_placed++;
+    }
+  }
+  uint64_t duration = wall_time->GetCurrentTimestamp() - start_time;
+  CHECK_EQ(num_placed, kNumMachines);
+  for (auto& td_ptr : tasks) {
+    delete td_ptr;
+  }
+  *num_ops = num_placed;
+  return duration;
+}
+
+// Groups 10k pending affinity/anti-affinity tasks of 2k apps on 4 threads.
+uint64_t AffinityConflictGrouping(WallTime* wall_time, uint64_t* num_ops) {
+  const uint32_t kNumTasks = 10000;
+  const uint32_t kNumApps = 2000;
+  uint32_t seed = 42;
+  AffinityConflictIndex index;
+  vector<TaskDescriptor*> tasks;
+  for (TaskID_t task_id = 1; task_id <= kNumTasks; ++task_id) {
+    string app = "app" + to_string(rand_r(&seed) % kNumApps);
+    TaskDescriptor* td_ptr = NewAppTask(task_id, app);
+    string other_app = "app" + to_string(rand_r(&seed) % kNumApps);
+    if (rand_r(&seed) % 3) {
+      AddAppAntiAffinity(td_ptr, other_app);
+    } else {
+      AddAppAffinity(td_ptr, other_app);
+    }
+    index.AddTask(*td_ptr);
+    tasks.push_back(td_ptr);
+  }
+  unordered_map<TaskID_t, vector<TaskID_t>> groups;
+  unordered_map<TaskID_t, TaskID_t> first_group;
+  uint64_t start_time = wall_time->GetCurrentTimestamp();
+  index.GroupTasks(tasks, AppsConflict, 4, &groups, &first_group);
+  uint64_t duration = wall_time->GetCurrentTimestamp() - start_time;
+  CHECK_LT(groups.size(), tasks.size());
+  for (auto& td_ptr : tasks) {
+    delete td_ptr;
+  }
+  *num_ops = kNumTasks;
+  return duration;
+}
+
+string RingName(uint32_t index) {
+  return "/firmament-microbenchmarks-" + to_string(getpid()) + "-" +
+    to_string(index);
+}
+
+// Delivers heartbeats from many task threads to one collector through
+// shared memory rings.
+uint64_t HeartbeatRings(WallTime* wall_time, uint64_t* num_ops) {
+  uint64_t expected = NUM_HEARTBEAT_TASKS * HEARTBEATS_PER_TASK;
+  vector<HeartbeatRing*> executor_rings;
+  for (uint32_t index = 0; index < NUM_HEARTBEAT_TASKS; ++index) {
+    executor_rings.push_back(new HeartbeatRing);
+    CHECK(executor_rings.back()->Create(RingName(index),
+                                        HEARTBEATS_PER_TASK));
+  }
+  uint64_t start_time = wall_time->GetCurrentTimestamp();
+  boost::thread_group task_threads;
+  for (uint32_t index = 0; index < NUM_HEARTBEAT_TASKS; ++index) {
+    task_threads.create_thread([index]() {
+      HeartbeatRing ring;
+      CHECK(ring.Attach(RingName(index)));
+      for (uint64_t seq = 1; seq <= HEARTBEATS_PER_TASK; ++seq) {
+        TaskHeartbeatRecord record = {index, seq, seq, 1024};
+        CHECK(ring.Write(record));
+      }
+    });
+  }
+  uint64_t received = 0;
+  vector<TaskHeartbeatRecord> records;
+  while (received < expected) {
+    uint64_t drained = 0;
+    for (auto& ring : executor_rings) {
+      records.clear();
+      drained += ring->Drain(&records);
+    }
+    received += drained;
+    if (drained == 0)
+      usleep(100);
+  }
+  task_threads.join_all();
+  uint64_t duration = wall_time->GetCurrentTimestamp() - start_time;
+  for (auto& ring : executor_rings) {
+    CHECK_EQ(ring->num_dropped(), 0);
+    delete ring;
+  }
+  *num_ops = expected;
+  return duration;
+}
+
+// Delivers the same heartbeats as serialized messages over sockets, as
+// tasks did before the rings.
+uint64_t HeartbeatSockets(WallTime* wall_time, uint64_t* num_ops) {
+  uint64_t expected = NUM_HEARTBEAT_TASKS * HEARTBEATS_PER_TASK;
+  vector<int> task_fds;
+  vector<struct pollfd> poll_fds;
+  for (uint32_t index = 0; index < NUM_HEARTBEAT_TASKS; ++index) {
+    int fds[2];
+    CHECK_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    task_fds.push_back(fds[1]);
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    poll_fds.push_back(pfd);
+  }
+  uint64_t start_time = wall_time->GetCurrentTimestamp();
+  boost::thread_group task_threads;
+  for (uint32_t index = 0; index < NUM_HEARTBEAT_TASKS; ++index) {
+    int fd = task_fds[index];
+    task_threads.create_thread([fd, index]() {
+      string buffer;
+      for (uint64_t seq = 1; seq <= HEARTBEATS_PER_TASK; ++seq) {
+        TaskHeartbeatMessage heartbeat;
+        heartbeat.set_task_id(index);
+        heartbeat.set_sequence_number(seq);
+        heartbeat.mutable_stats()->set_timestamp(seq);
+        heartbeat.mutable_stats()->set_mem_usage(1024);
+        CHECK(heartbeat.SerializeToString(&buffer));
+        CHECK_EQ(write(fd, buffer.data(), buffer.size()),
+                 static_cast<ssize_t>(buffer.size()));
+      }
+    });
+  }
+  uint64_t received = 0;
+  char buffer[256];
+  while (received < expected) {
+    CHECK_GT(poll(&poll_fds[0], poll_fds.size(), -1), 0);
+    for (auto& pfd : poll_fds) {
+      if (!(pfd.revents & POLLIN))
+        continue;
+      ssize_t len = read(pfd.fd, buffer, sizeof(buffer));
+      CHECK_GT(len, 0);
+      TaskHeartbeatMessage heartbeat;
+      CHECK(heartbeat.ParseFromArray(buffer, len));
+      ++received;
+    }
+  }
+  task_threads.join_all();
+  uint64_t duration = wall_time->GetCurrentTimestamp() - start_time;
+  for (uint32_t index = 0; index < NUM_HEARTBEAT_TASKS; ++index) {
+    close(task_fds[index]);
+    close(poll_fds[index].fd);
+  }
+  *num_ops = expected;
+  return duration;
+}
+
+const Benchmark kBenchmarks[] = {
+  {"health_checker_sweep", "task health sweep over 10k tasks",
+   HealthCheckerSweep},
+  {"affinity_placement", "anti-affinity pod placement on 5k machines",
+   AffinityPlacement},
+  {"affinity_conflict_grouping", "affinity batch grouping of 10k tasks",
+   AffinityConflictGrouping},
+  {"heartbeat_rings", "task heartbeats over shared memory rings",
+   HeartbeatRings},
+  {"heartbeat_sockets", "task heartbeats over sockets", HeartbeatSockets},
+};
+
+void RunBenchmark(const Benchmark& benchmark, WallTime* wall_time) {
+  vector<uint64_t> durations;
+  uint64_t num_ops = 0;
+  for (uint64_t i = 0; i < FLAGS_benchmark_repetitions; ++i) {
+    durations.push_back(benchmark.run(wall_time, &num_ops));
+  }
+  sort(durations.begin(), durations.end());
+  uint64_t median = durations[durations.size() / 2];
+  printf("%-28s %10" PRIu64 " ops  min %10" PRIu64 " us  median %10" PRIu64
+         " us  %12.0f ops/s  (%s)\n", benchmark.name, num_ops, durations[0],
+         median, num_ops * 1000000.0 / (median + 1), benchmark.description);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  common::InitFirmament(argc, argv);
+  CHECK_GT(FLAGS_benchmark_repetitions, 0);
+  vector<string> names;
+  if (!FLAGS_benchmarks.empty()) {
+    boost::split(names, FLAGS_benchmarks, boost::is_any_of(","));
+  }
+  for (auto& name : names) {
+    bool known = false;
+    for (auto& benchmark : kBenchmarks) {
+      known = known || name == benchmark.name;
+    }
+    if (!known) {
+      LOG(FATAL) << "Unknown benchmark: " << name;
+    }
+  }
+  WallTime wall_time;
+  for (auto& benchmark : kBenchmarks) {
+    if (names.empty() ||
+        find(names.begin(), names.end(), benchmark.name) != names.end()) {
+      RunBenchmark(benchmark, &wall_time);
+    }
+  }
+  return 0;
+}
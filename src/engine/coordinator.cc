@@ -273,8 +273,18 @@ void Coordinator::Run() {
       machine_monitor_.CreateStatistics(&stats);
       // Record this sample locally
       scheduler_->knowledge_base()->AddMachineSample(stats);
+      // Sample the usage of the tasks running locally
+      vector<TaskHeartbeatMessage> task_reports;
+      scheduler_->CollectTaskStats(parent_chan_ != NULL ? &task_reports
+                                                        : NULL);
       if (parent_chan_ != NULL) {
+        // The parent sees the samples only if we forward them: tasks report
+        // their usage to us rather than to it.
+        for (auto& report : task_reports) {
+          task_heartbeat_aggregator_.AddHeartbeat(report);
+        }
         SendHeartbeatToParent(stats);
+        SendTaskHeartbeatsToParent();
       }
       last_heartbeat_time = cur_time;
     }
@@ -341,6 +351,12 @@ void Coordinator::HandleIncomingMessage(BaseMessage *bm,
     HandleTaskHeartbeat(msg);
     handled_extensions++;
   }
+  // Aggregated task heartbeats from a subordinate coordinator
+  if (bm->has_task_heartbeat_batch()) {
+    const TaskHeartbeatBatchMessage& msg = bm->task_heartbeat_batch();
+    HandleTaskHeartbeatBatch(msg);
+    handled_extensions++;
+  }
   // Task state change message
   if (bm->has_task_state()) {
     const TaskStateMessage& msg = bm->task_state();
@@ -463,38 +479,34 @@ void Coordinator::HandleRegistrationRequest(
 }
 
 void Coordinator::HandleTaskHeartbeat(const TaskHeartbeatMessage& msg) {
-  TaskID_t task_id = msg.task_id();
-  TaskDescriptor* tdp = FindPtrOrNull(*task_table_, task_id);
-  if (!tdp) {
-    LOG(WARNING) << "HEARTBEAT from UNKNOWN task (ID: "
-                 << task_id << ")!";
-  } else {
-    VLOG(1) << "HEARTBEAT from task " << task_id;
-    // Remember the current location from which this task reports
-    tdp->set_last_heartbeat_location(msg.location());
-    // Remember the heartbeat time
-    tdp->set_last_heartbeat_time(time_manager_->GetCurrentTimestamp());
+  VLOG(1) << "HEARTBEAT from task " << msg.task_id();
+  if (UpdateTaskFromHeartbeat(msg) && msg.has_stats()) {
     // Process the profiling information submitted by the task, add it to
     // the knowledge base
     scheduler_->knowledge_base()->AddTaskStatsSample(msg.stats());
   }
-
   // If we have a parent coordinator on whose behalf we are managing this task,
-  // forward the message.
-  // TODO(malte): this does not currently perform any aggregation, so we're
-  // likely to DoS the parent coordinator on a large deployment. Instead, we
-  // should only selectively forward heartbeats and aggregate them.
+  // buffer the heartbeat; it gets forwarded with the next batch.
   if (parent_chan_ != NULL) {
-    BaseMessage bm;
-    bm.mutable_task_heartbeat()->CopyFrom(msg);
-    if (!SendMessageToRemote(parent_chan_, &bm)) {
-      LOG(ERROR) << "Failed to forward heartbeat to parent coordinator!";
-      // Try to re-register
-      RegisterWithCoordinator(parent_chan_);
+    task_heartbeat_aggregator_.AddHeartbeat(msg);
+  }
+}
+
+void Coordinator::HandleTaskHeartbeatBatch(
+    const TaskHeartbeatBatchMessage& msg) {
+  VLOG(1) << "HEARTBEAT batch of " << msg.heartbeats_size()
+          << " tasks from resource " << msg.uuid();
+  vector<const TaskStats*> samples;
+  samples.reserve(msg.heartbeats_size());
+  for (auto& heartbeat : msg.heartbeats()) {
+    if (UpdateTaskFromHeartbeat(heartbeat) && heartbeat.has_stats()) {
+      samples.push_back(&heartbeat.stats());
+    }
+    if (parent_chan_ != NULL) {
+      task_heartbeat_aggregator_.AddHeartbeat(heartbeat);
     }
-  } else {
-    scheduler_->knowledge_base()->AddTaskStatsSample(msg.stats());
   }
+  scheduler_->knowledge_base()->AddTaskStatsSamples(samples);
 }
 
 void Coordinator::HandleTaskDelegationRequest(
@@ -857,6 +869,21 @@ void Coordinator::SendHeartbeatToParent(const ResourceStats& stats) {
   }
 }
 
+void Coordinator::SendTaskHeartbeatsToParent() {
+  BaseMessage bm;
+  if (!task_heartbeat_aggregator_.Flush(
+          to_string(uuid_), bm.mutable_task_heartbeat_batch())) {
+    return;
+  }
+  VLOG(2) << "Forwarding " << bm.task_heartbeat_batch().heartbeats_size()
+          << " task heartbeats to parent coordinator!";
+  if (!SendMessageToRemote(parent_chan_, &bm)) {
+    LOG(ERROR) << "Failed to forward task heartbeats to parent coordinator!";
+    // Try to re-register
+    RegisterWithCoordinator(parent_chan_);
+  }
+}
+
 const string Coordinator::SubmitJob(const JobDescriptor& job_descriptor) {
   // Generate a job ID
   // TODO(malte): This should become deterministic, and based on the
@@ -926,4 +953,20 @@ void Coordinator::Shutdown(const string& reason) {
   exit_ = true;
 }
 
+bool Coordinator::UpdateTaskFromHeartbeat(const TaskHeartbeatMessage& msg) {
+  TaskDescriptor* tdp = FindPtrOrNull(*task_table_, msg.task_id());
+  if (!tdp) {
+    LOG(WARNING) << "HEARTBEAT from UNKNOWN task (ID: "
+                 << msg.task_id() << ")!";
+    return false;
+  }
+  // Remember the current location from which this task reports. Usage
+  // samples forwarded by a subordinate coordinator carry no location.
+  if (!msg.location().empty())
+    tdp->set_last_heartbeat_location(msg.location());
+  // Remember the heartbeat time
+  tdp->set_last_heartbeat_time(time_manager_->GetCurrentTimestamp());
+  return true;
+}
+
 } // namespace firmament
@@ -49,6 +49,7 @@
 #include "base/resource_topology_node_desc.pb.h"
 #include "engine/health_monitor.h"
 #include "engine/node.h"
+#include "engine/task_heartbeat_aggregator.h"
 #include "messages/heartbeat_message.pb.h"
 #include "messages/registration_message.pb.h"
 #include "messages/task_delegation_message.pb.h"
@@ -202,13 +203,13 @@ class Coordinator : public Node,
     }
     return res_vec;
   }
-  vector<JobDescriptor> active_jobs() {
-    vector<JobDescriptor> jd_vec;
+  vector<const JobDescriptor*> active_jobs() {
+    vector<const JobDescriptor*> jd_vec;
     for (JobMap_t::const_iterator job_iter =
          job_table_->begin();
          job_iter != job_table_->end();
          ++job_iter) {
-      jd_vec.push_back(job_iter->second);
+      jd_vec.push_back(&job_iter->second);
     }
     return jd_vec;
   }
@@ -262,6 +263,7 @@ class Coordinator : public Node,
   void HandleTaskDelegationResponse(const TaskDelegationResponseMessage& msg,
                                     const string& endpoint);
   void HandleTaskHeartbeat(const TaskHeartbeatMessage& msg);
+  void HandleTaskHeartbeatBatch(const TaskHeartbeatBatchMessage& msg);
   void HandleTaskInfoRequest(const TaskInfoRequestMessage& msg,
                              const string& remote_endpoint);
   void HandleTaskSpawn(const TaskSpawnMessage& msg);
@@ -271,6 +273,8 @@ class Coordinator : public Node,
   void InitHTTPUI();
 #endif
   void SendHeartbeatToParent(const ResourceStats& stats);
+  void SendTaskHeartbeatsToParent();
+  bool UpdateTaskFromHeartbeat(const TaskHeartbeatMessage& msg);
 
 #ifdef __HTTP_UI__
   scoped_ptr<CoordinatorHTTPUI> c_http_ui_;
@@ -308,6 +312,9 @@ class Coordinator : public Node,
   string parent_uri_;
   // Pointer to channel to the parent coordinator
   StreamSocketsChannel<BaseMessage>* parent_chan_;
+  // Task heartbeats received since the last heartbeat to the parent
+  // coordinator; forwarded to it as one batch per heartbeat interval.
+  TaskHeartbeatAggregator task_heartbeat_aggregator_;
   // Machine statistics monitor
   ProcFSMachine machine_monitor_;
   ResourceID_t machine_uuid_;
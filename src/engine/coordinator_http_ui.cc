@@ -29,6 +29,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/functional/hash.hpp>
 #include <google/protobuf/util/json_util.h>
 
 #include "base/job_desc.pb.h"
@@ -51,6 +53,11 @@ DECLARE_bool(debug_flow_graph);
 
 DEFINE_string(http_ui_template_dir, "src/webui",
               "Path to the directory where the web UI templates are located.");
+DEFINE_uint64(http_ui_snapshot_max_age, 1000000,
+              "Maximum age (in microseconds) of the job, task and resource "
+              "lists and of the flow graph served by the web UI.");
+DEFINE_uint64(http_ui_json_chunk_entries, 1000,
+              "Number of list entries sent per chunk of a JSON response.");
 
 using google::protobuf::util::MessageToJsonString;
 
@@ -65,9 +72,70 @@ using ctemplate::TemplateDictionary;
 
 using store::DataObjectMap_t;
 
+// Sends a response as a sequence of HTTP chunks. Each chunk is produced
+// once the previous one has been written to the connection, so only one
+// chunk is held in memory at a time.
+class ChunkedResponseSender
+  : public boost::enable_shared_from_this<ChunkedResponseSender> {
+ public:
+  // Appends the next chunk to the string and returns true if more follow
+  typedef boost::function<bool(string*)> ChunkProducer;
+
+  static void Send(const http::response_writer_ptr& writer,
+                   const ChunkProducer& producer) {
+    shared_ptr<ChunkedResponseSender> sender(
+        new ChunkedResponseSender(writer, producer));
+    sender->SendNextChunk();
+  }
+
+ private:
+  ChunkedResponseSender(const http::response_writer_ptr& writer,
+                        const ChunkProducer& producer)
+    : writer_(writer), producer_(producer) {
+  }
+
+  void HandleWrite(const boost::system::error_code& write_error,
+                   size_t bytes_written) {
+    if (write_error) {
+      LOG(WARNING) << "Failed to send response chunk: "
+                   << write_error.message();
+      writer_->get_connection()->set_lifecycle(
+          tcp::connection::LIFECYCLE_CLOSE);
+      writer_->get_connection()->finish();
+      return;
+    }
+    SendNextChunk();
+  }
+
+  void SendNextChunk() {
+    string chunk;
+    bool more = producer_(&chunk);
+    // Drop the previous chunk, which has been written by now
+    writer_->clear();
+    writer_->write(chunk);
+    if (more) {
+      writer_->send_chunk(boost::bind(&ChunkedResponseSender::HandleWrite,
+                                      shared_from_this(),
+                                      boost::asio::placeholders::error,
+                                      boost::asio::placeholders::
+                                        bytes_transferred));
+    } else {
+      writer_->send_final_chunk();
+    }
+  }
+
+  http::response_writer_ptr writer_;
+  ChunkProducer producer_;
+};
+
 CoordinatorHTTPUI::CoordinatorHTTPUI(shared_ptr<Coordinator> coordinator)
   : coordinator_(coordinator),
-    active_(true) { }
+    active_(true),
+    jobs_snapshot_(&time_manager_, FLAGS_http_ui_snapshot_max_age),
+    resources_snapshot_(&time_manager_, FLAGS_http_ui_snapshot_max_age),
+    tasks_snapshot_(&time_manager_, FLAGS_http_ui_snapshot_max_age),
+    flow_graph_json_seq_(0),
+    flow_graph_json_time_(0) { }
 
 CoordinatorHTTPUI::~CoordinatorHTTPUI() {
   // Kill the server without waiting for connections to terminate
@@ -120,6 +188,96 @@ void CoordinatorHTTPUI::AddFooterToTemplate(TemplateDictionary* dict) {
       FLAGS_http_ui_template_dir + "/page_footer.tpl");
 }
 
+void CoordinatorHTTPUI::BuildJobList(vector<JobListEntry>* entries) {
+  vector<const JobDescriptor*> jobs = coordinator_->active_jobs();
+  entries->reserve(jobs.size());
+  for (auto& jd : jobs) {
+    JobListEntry entry;
+    entry.id = jd->uuid();
+    entry.name = jd->name();
+    entry.state = ENUM_TO_STRING(JobDescriptor::JobState, jd->state());
+    entry.root_task_id = jd->root_task().uid();
+    entries->push_back(entry);
+  }
+}
+
+void CoordinatorHTTPUI::BuildResourceList(
+    vector<ResourceListEntry>* entries) {
+  vector<ResourceStatus*> resources = coordinator_->associated_resources();
+  entries->reserve(resources.size());
+  for (auto& rs : resources) {
+    const ResourceDescriptor& rd = rs->descriptor();
+    ResourceListEntry entry;
+    entry.id = rd.uuid();
+    entry.name = rd.friendly_name();
+    entry.state = ENUM_TO_STRING(ResourceDescriptor::ResourceState,
+                                 rd.state());
+    entry.schedulable = rd.schedulable();
+    entries->push_back(entry);
+  }
+}
+
+void CoordinatorHTTPUI::BuildTaskList(vector<TaskListEntry>* entries) {
+  vector<TaskDescriptor*> tasks = coordinator_->active_tasks();
+  entries->reserve(tasks.size());
+  for (auto& td : tasks) {
+    TaskListEntry entry;
+    entry.id = td->uid();
+    entry.job_id = td->job_id();
+    entry.name = td->name();
+    entry.state = ENUM_TO_STRING(TaskDescriptor::TaskState, td->state());
+    entries->push_back(entry);
+  }
+}
+
+shared_ptr<const string> CoordinatorHTTPUI::FlowGraphJSON(string* etag) {
+  const FlowScheduler* sched =
+    dynamic_cast<const FlowScheduler*>(coordinator_->scheduler());
+  boost::lock_guard<boost::mutex> lock(flow_graph_json_lock_);
+  uint64_t now = time_manager_.GetCurrentTimestamp();
+  if (!flow_graph_json_ ||
+      flow_graph_json_seq_ != sched->dispatcher().seq_num() ||
+      now >= flow_graph_json_time_ + FLAGS_http_ui_snapshot_max_age) {
+    string* json_flow_graph = new string;
+    sched->dispatcher().ExportJSON(json_flow_graph);
+    flow_graph_json_.reset(json_flow_graph);
+    flow_graph_json_seq_ = sched->dispatcher().seq_num();
+    flow_graph_json_time_ = now;
+    flow_graph_json_etag_ =
+      "\"" + to_string(flow_graph_json_seq_) + "-" +
+      to_string(boost::hash<string>()(*json_flow_graph)) + "\"";
+  }
+  *etag = flow_graph_json_etag_;
+  return flow_graph_json_;
+}
+
+template<typename T>
+void CoordinatorHTTPUI::SendJSONList(
+    shared_ptr<const ListSnapshot<T> > snapshot,
+    const string& open, const string& close,
+    const http::request_ptr& http_request,
+    const tcp::connection_ptr& tcp_conn) {
+  string etag = snapshot->etag();
+  if (http_request->get_header("If-None-Match") == etag) {
+    NotModifiedResponse(http_request, tcp_conn, etag);
+    return;
+  }
+  uint64_t begin;
+  uint64_t end;
+  PageBounds(http_request->get_query("offset"),
+             http_request->get_query("limit"),
+             snapshot->entries.size(), &begin, &end);
+  http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
+  http::response& r = writer->get_response();
+  r.add_header("ETag", etag);
+  r.add_header("X-Total-Count", to_string(snapshot->entries.size()));
+  shared_ptr<JSONListChunker<T> > chunker(
+      new JSONListChunker<T>(snapshot, begin, end, open, close,
+                             FLAGS_http_ui_json_chunk_entries));
+  ChunkedResponseSender::Send(
+      writer, boost::bind(&JSONListChunker<T>::NextChunk, chunker, _1));
+}
+
 void CoordinatorHTTPUI::HandleCollectlGraphsURI(
     const http::request_ptr& http_request,
     const tcp::connection_ptr& tcp_conn) {
@@ -258,36 +416,34 @@ void CoordinatorHTTPUI::HandleFaviconURI(const http::request_ptr& http_request,
 void CoordinatorHTTPUI::HandleJobsListURI(const http::request_ptr& http_request,
                                           const tcp::connection_ptr& tcp_conn) {
   LogRequest(http_request);
+  // Get job list snapshot
+  shared_ptr<const ListSnapshot<JobListEntry> > jobs = jobs_snapshot_.Get(
+      boost::bind(&CoordinatorHTTPUI::BuildJobList, this, _1));
+  if (!http_request->get_query("json").empty()) {
+    SendJSONList(jobs, "{", "}", http_request, tcp_conn);
+    return;
+  }
   http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
-  // Get job list from coordinator
-  vector<JobDescriptor> jobs = coordinator_->active_jobs();
-  int64_t i = 0;
+  uint64_t begin;
+  uint64_t end;
+  PageBounds(http_request->get_query("offset"),
+             http_request->get_query("limit"),
+             jobs->entries.size(), &begin, &end);
   TemplateDictionary dict("jobs_list");
   AddHeaderToTemplate(&dict, coordinator_->uuid(), NULL);
   AddFooterToTemplate(&dict);
-  for (vector<JobDescriptor>::const_iterator jd_iter =
-       jobs.begin();
-       jd_iter != jobs.end();
-       ++jd_iter) {
+  for (uint64_t i = begin; i < end; ++i) {
+    const JobListEntry& job = jobs->entries[i];
     TemplateDictionary* sect_dict = dict.AddSectionDictionary("JOB_DATA");
-    sect_dict->SetIntValue("JOB_NUM", i);
-    sect_dict->SetValue("JOB_ID", to_string(jd_iter->uuid()));
-    sect_dict->SetValue("JOB_FRIENDLY_NAME", jd_iter->name());
-    sect_dict->SetFormattedValue("JOB_ROOT_TASK_ID", "%ju",
-                                 TaskID_t(jd_iter->root_task().uid()));
-    sect_dict->SetValue("JOB_STATE",
-                        ENUM_TO_STRING(JobDescriptor::JobState,
-                                       jd_iter->state()));
-    ++i;
+    sect_dict->SetIntValue("JOB_NUM", static_cast<int64_t>(i));
+    sect_dict->SetValue("JOB_ID", job.id);
+    sect_dict->SetValue("JOB_FRIENDLY_NAME", job.name);
+    sect_dict->SetFormattedValue("JOB_ROOT_TASK_ID", "%ju", job.root_task_id);
+    sect_dict->SetValue("JOB_STATE", job.state);
   }
   string output;
-  if (!http_request->get_query("json").empty()) {
-    ExpandTemplate(FLAGS_http_ui_template_dir + "/json_jobs_list.tpl",
-                   ctemplate::DO_NOT_STRIP, &dict, &output);
-  } else {
-    ExpandTemplate(FLAGS_http_ui_template_dir + "/jobs_list.tpl",
-                   ctemplate::DO_NOT_STRIP, &dict, &output);
-  }
+  ExpandTemplate(FLAGS_http_ui_template_dir + "/jobs_list.tpl",
+                 ctemplate::DO_NOT_STRIP, &dict, &output);
   writer->write(output);
   FinishOkResponse(writer);
 }
@@ -467,31 +623,34 @@ void CoordinatorHTTPUI::HandleResourcesListURI(
     const http::request_ptr& http_request,
     const tcp::connection_ptr& tcp_conn) {
   LogRequest(http_request);
+  // Get resource list snapshot
+  shared_ptr<const ListSnapshot<ResourceListEntry> > resources =
+    resources_snapshot_.Get(
+        boost::bind(&CoordinatorHTTPUI::BuildResourceList, this, _1));
+  if (!http_request->get_query("json").empty()) {
+    SendJSONList(resources, "[", "]", http_request, tcp_conn);
+    return;
+  }
   http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
-  // Get resource information from coordinator
-  const vector<ResourceStatus*> resources =
-      coordinator_->associated_resources();
-  int64_t i = 0;
+  uint64_t begin;
+  uint64_t end;
+  PageBounds(http_request->get_query("offset"),
+             http_request->get_query("limit"),
+             resources->entries.size(), &begin, &end);
   TemplateDictionary dict("resources_list");
   AddHeaderToTemplate(&dict, coordinator_->uuid(), NULL);
   AddFooterToTemplate(&dict);
-  for (vector<ResourceStatus*>::const_iterator rd_iter =
-       resources.begin();
-       rd_iter != resources.end();
-       ++rd_iter) {
+  for (uint64_t i = begin; i < end; ++i) {
+    const ResourceListEntry& res = resources->entries[i];
     TemplateDictionary* sect_dict = dict.AddSectionDictionary("RES_DATA");
-    sect_dict->SetIntValue("RES_NUM", i);
-    sect_dict->SetValue("RES_ID", to_string((*rd_iter)->descriptor().uuid()));
-    sect_dict->SetValue("RES_FRIENDLY_NAME",
-                        (*rd_iter)->descriptor().friendly_name());
-    sect_dict->SetValue("RES_STATE",
-                        ENUM_TO_STRING(ResourceDescriptor::ResourceState,
-                                       (*rd_iter)->descriptor().state()));
+    sect_dict->SetIntValue("RES_NUM", static_cast<int64_t>(i));
+    sect_dict->SetValue("RES_ID", res.id);
+    sect_dict->SetValue("RES_FRIENDLY_NAME", res.name);
+    sect_dict->SetValue("RES_STATE", res.state);
     // N.B.: We make the assumption that only PU type resources are schedulable
     // here!
-    if (!(*rd_iter)->descriptor().schedulable())
+    if (!res.schedulable)
       sect_dict->AddSectionDictionary("RES_NON_SCHEDULABLE");
-    ++i;
   }
   string output;
   ExpandTemplate(FLAGS_http_ui_template_dir + "/resources_list.tpl",
@@ -790,7 +949,6 @@ void CoordinatorHTTPUI::HandleSchedFlowGraphURI(
     const http::request_ptr& http_request,
     const tcp::connection_ptr& tcp_conn) {
   LogRequest(http_request);
-  http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
   // Get resource information from coordinator
   if (!http_request->get_query("json").empty()) {
     if (FLAGS_scheduler != "flow") {
@@ -798,13 +956,26 @@ void CoordinatorHTTPUI::HandleSchedFlowGraphURI(
                     tcp_conn);
       return;
     }
-    const FlowScheduler* sched =
-      dynamic_cast<const FlowScheduler*>(coordinator_->scheduler());
-    string json_flow_graph;
-    sched->dispatcher().ExportJSON(&json_flow_graph);
-    writer->write(json_flow_graph);
-    FinishOkResponse(writer);
+    string etag;
+    shared_ptr<const string> json_flow_graph = FlowGraphJSON(&etag);
+    if (http_request->get_header("If-None-Match") == etag) {
+      NotModifiedResponse(http_request, tcp_conn, etag);
+      return;
+    }
+    http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
+    writer->get_response().add_header("ETag", etag);
+    // Stream the export in chunks rather than copying it into one response
+    shared_ptr<size_t> offset(new size_t(0));
+    ChunkedResponseSender::Send(writer,
+        [json_flow_graph, offset](string* chunk) -> bool {
+          size_t chunk_len = min(json_flow_graph->size() - *offset,
+                                 static_cast<size_t>(64 * 1024));
+          chunk->append(*json_flow_graph, *offset, chunk_len);
+          *offset += chunk_len;
+          return *offset < json_flow_graph->size();
+        });
   } else {
+    http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
     TemplateDictionary dict("flow_graph_view");
     AddHeaderToTemplate(&dict, coordinator_->uuid(), NULL);
     AddFooterToTemplate(&dict);
@@ -812,8 +983,8 @@ void CoordinatorHTTPUI::HandleSchedFlowGraphURI(
     ExpandTemplate(FLAGS_http_ui_template_dir + "/flow_graph.tpl",
                    ctemplate::DO_NOT_STRIP, &dict, &output);
     writer->write(output);
+    FinishOkResponse(writer);
   }
-  FinishOkResponse(writer);
 }
 
 void CoordinatorHTTPUI::HandleStatisticsURI(
@@ -939,32 +1110,33 @@ void CoordinatorHTTPUI::HandleTasksListURI(
     const http::request_ptr& http_request,
     const tcp::connection_ptr& tcp_conn) {
   LogRequest(http_request);
+  // Get task list snapshot
+  shared_ptr<const ListSnapshot<TaskListEntry> > tasks = tasks_snapshot_.Get(
+      boost::bind(&CoordinatorHTTPUI::BuildTaskList, this, _1));
+  if (!http_request->get_query("json").empty()) {
+    SendJSONList(tasks, "[", "]", http_request, tcp_conn);
+    return;
+  }
   http::response_writer_ptr writer = InitOkResponse(http_request, tcp_conn);
-  // Get task list from coordinator
-  vector<TaskDescriptor*> tasks = coordinator_->active_tasks();
+  uint64_t begin;
+  uint64_t end;
+  PageBounds(http_request->get_query("offset"),
+             http_request->get_query("limit"),
+             tasks->entries.size(), &begin, &end);
   TemplateDictionary dict("tasks_list");
   AddHeaderToTemplate(&dict, coordinator_->uuid(), NULL);
   AddFooterToTemplate(&dict);
-  for (vector<TaskDescriptor*>::const_iterator td_iter =
-       tasks.begin();
-       td_iter != tasks.end();
-       ++td_iter) {
+  for (uint64_t i = begin; i < end; ++i) {
+    const TaskListEntry& task = tasks->entries[i];
     TemplateDictionary* sect_dict = dict.AddSectionDictionary("TASK_DATA");
-    sect_dict->SetFormattedValue("TASK_ID", "%ju", (*td_iter)->uid());
-    sect_dict->SetValue("TASK_JOB_ID", (*td_iter)->job_id());
-    sect_dict->SetValue("TASK_FRIENDLY_NAME", (*td_iter)->name());
-    sect_dict->SetValue("TASK_STATE",
-                        ENUM_TO_STRING(TaskDescriptor::TaskState,
-                                       (*td_iter)->state()));
+    sect_dict->SetFormattedValue("TASK_ID", "%ju", task.id);
+    sect_dict->SetValue("TASK_JOB_ID", task.job_id);
+    sect_dict->SetValue("TASK_FRIENDLY_NAME", task.name);
+    sect_dict->SetValue("TASK_STATE", task.state);
   }
   string output;
-  if (!http_request->get_query("json").empty()) {
-    ExpandTemplate(FLAGS_http_ui_template_dir + "/json_tasks_list.tpl",
-                   ctemplate::DO_NOT_STRIP, &dict, &output);
-  } else {
-    ExpandTemplate(FLAGS_http_ui_template_dir + "/tasks_list.tpl",
-                   ctemplate::DO_NOT_STRIP, &dict, &output);
-  }
+  ExpandTemplate(FLAGS_http_ui_template_dir + "/tasks_list.tpl",
+                 ctemplate::DO_NOT_STRIP, &dict, &output);
   writer->write(output);
   FinishOkResponse(writer);
 }
@@ -1204,6 +1376,20 @@ void CoordinatorHTTPUI::ErrorResponse(
   writer->send();
 }
 
+void CoordinatorHTTPUI::NotModifiedResponse(
+    const http::request_ptr& http_request,
+    const tcp::connection_ptr& tcp_conn,
+    const string& etag) {
+  http::response_writer_ptr writer = http::response_writer::create(
+      tcp_conn, *http_request, boost::bind(&tcp::connection::finish,
+                                           tcp_conn));
+  http::response& r = writer->get_response();
+  r.set_status_code(http::types::RESPONSE_CODE_NOT_MODIFIED);
+  r.set_status_message(http::types::RESPONSE_MESSAGE_NOT_MODIFIED);
+  r.add_header("ETag", etag);
+  writer->send();
+}
+
 void CoordinatorHTTPUI::RedirectResponse(
     const http::request_ptr& http_request,
     const tcp::connection_ptr& tcp_conn,
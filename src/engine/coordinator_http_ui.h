@@ -34,6 +34,8 @@
 #include "platforms/unix/common.h"
 #include "misc/messaging_interface.h"
 #include "engine/coordinator.h"
+#include "engine/http_ui_snapshot.h"
+#include "misc/wall_time.h"
 #include "platforms/common.h"
 #include "platforms/unix/stream_sockets_adapter.h"
 
@@ -112,6 +114,9 @@ class CoordinatorHTTPUI {
                         const tcp::connection_ptr& tcp_conn);
   void HandleShutdownURI(const http::request_ptr& http_request,
                          const tcp::connection_ptr& tcp_conn);
+  void NotModifiedResponse(const http::request_ptr& http_request,
+                           const tcp::connection_ptr& tcp_conn,
+                           const string& etag);
   void RedirectResponse(const http::request_ptr& http_request,
                         const tcp::connection_ptr& tcp_conn,
                         const string& location);
@@ -127,10 +132,42 @@ class CoordinatorHTTPUI {
   void AddHeaderToTemplate(TemplateDictionary* dict, ResourceID_t uuid,
                            ErrorMessage_t* err);
   void AddFooterToTemplate(TemplateDictionary* dict);
+  void BuildJobList(vector<JobListEntry>* entries);
+  void BuildResourceList(vector<ResourceListEntry>* entries);
+  void BuildTaskList(vector<TaskListEntry>* entries);
+  /**
+   * Gets the JSON export of the flow graph, which is cached until the next
+   * solver run or until it is older than the maximum snapshot age.
+   * @param etag set to the entity tag of the export
+   * @return the JSON export
+   */
+  shared_ptr<const string> FlowGraphJSON(string* etag);
+  /**
+   * Sends a JSON list response for a range of a snapshot, unless the client
+   * already has the current version of the snapshot. The response is
+   * streamed in chunks.
+   */
+  template<typename T>
+  void SendJSONList(shared_ptr<const ListSnapshot<T> > snapshot,
+                    const string& open, const string& close,
+                    const http::request_ptr& http_request,
+                    const tcp::connection_ptr& tcp_conn);
   http::server_ptr coordinator_http_server_;
   shared_ptr<Coordinator> coordinator_;
   bool active_;
   uint16_t port_;
+  WallTime time_manager_;
+  // Snapshots of the lists served, rebuilt at most once per maximum age
+  SnapshotSlot<JobListEntry> jobs_snapshot_;
+  SnapshotSlot<ResourceListEntry> resources_snapshot_;
+  SnapshotSlot<TaskListEntry> tasks_snapshot_;
+  // Cached JSON export of the flow graph, along with the solver run and time
+  // at which it was exported
+  boost::mutex flow_graph_json_lock_;
+  shared_ptr<const string> flow_graph_json_;
+  string flow_graph_json_etag_;
+  uint64_t flow_graph_json_seq_;
+  uint64_t flow_graph_json_time_;
 };
 
 }  // namespace webui
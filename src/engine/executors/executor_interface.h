@@ -30,6 +30,8 @@
 #include "base/common.h"
 #include "base/types.h"
 #include "base/task_final_report.pb.h"
+#include "base/task_stats.pb.h"
+#include "messages/task_heartbeat_message.pb.h"
 
 namespace firmament {
 namespace executor {
@@ -37,6 +39,14 @@ namespace executor {
 class ExecutorInterface : public PrintableInterface {
  public:
   virtual bool CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks) = 0;
+  /**
+   * Collects heartbeats that tasks reported to the executor directly, rather
+   * than to the coordinator.
+   * @param heartbeats vector to which the heartbeats are appended
+   */
+  virtual void CollectTaskHeartbeats(
+      vector<TaskHeartbeatMessage>* heartbeats) = 0;
+  virtual void CollectTaskStats(vector<TaskStats>* task_stats) = 0;
   virtual void HandleTaskCompletion(TaskDescriptor* td,
                                     TaskFinalReport* report) = 0;
   virtual void HandleTaskEviction(TaskDescriptor* td) = 0;
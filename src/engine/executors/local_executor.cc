@@ -59,6 +59,18 @@ DEFINE_string(task_perf_dir, "/tmp/firmament-perf",
               "Path where tasks' perf logs should be written.");
 DEFINE_string(task_data_dir, "/tmp/firmament-data",
               "Path where tasks' perf logs should be written.");
+DEFINE_string(task_cgroup_root, "/sys/fs/cgroup/firmament",
+              "cgroup v2 directory under which each task gets its own cgroup "
+              "for resource accounting. Task usage is sampled from ProcFS if "
+              "it is empty or not writable.");
+DEFINE_uint32(task_launch_threads, 4,
+              "Number of threads that launch task processes.");
+DEFINE_bool(task_heartbeat_ring, false,
+            "Tasks report heartbeats through a shared-memory ring drained by "
+            "the local executor, rather than over a connection to the "
+            "coordinator.");
+DEFINE_uint32(task_heartbeat_ring_capacity, 64,
+              "Number of heartbeats a task's heartbeat ring can hold.");
 DEFINE_string(perf_event_list,
               "cpu-clock,task-clock,context-switches,cpu-migrations,"
               "page-faults,cycles,instructions,branches,branch-misses,"
@@ -76,10 +88,16 @@ LocalExecutor::LocalExecutor(ResourceID_t resource_id,
                              TimeInterface* time_manager)
     : local_resource_id_(resource_id),
       coordinator_uri_(coordinator_uri),
-      health_checker_(&task_handler_threads_, &handler_map_mutex_),
+      health_checker_(),
       time_manager_(time_manager),
       topology_manager_(shared_ptr<TopologyManager>()),  // NULL
-      heartbeat_interval_(1000000000ULL) {  // 1 billios nanosec = 1 sec
+      heartbeat_interval_(1000000000ULL),  // 1 billios nanosec = 1 sec
+      usage_collector_(FLAGS_task_cgroup_root),
+      launcher_(new TaskLauncher(
+          FLAGS_task_launch_threads,
+          boost::bind(&LocalExecutor::HandleTaskProcessLaunch, this, _1, _2),
+          boost::bind(&LocalExecutor::HandleTaskProcessExit, this, _1, _2,
+                      _3))) {
   VLOG(1) << "Executor for resource " << resource_id << " is up: " << *this;
   VLOG(1) << "No topology manager passed, so will not bind to resource.";
   CreateDirectories();
@@ -91,41 +109,109 @@ LocalExecutor::LocalExecutor(ResourceID_t resource_id,
                              shared_ptr<TopologyManager> topology_mgr)
     : local_resource_id_(resource_id),
       coordinator_uri_(coordinator_uri),
-      health_checker_(&task_handler_threads_, &handler_map_mutex_),
+      health_checker_(),
       time_manager_(time_manager),
       topology_manager_(topology_mgr),
-      heartbeat_interval_(1000000000ULL) {  // 1 billios nanosec = 1 sec
+      heartbeat_interval_(1000000000ULL),  // 1 billios nanosec = 1 sec
+      usage_collector_(FLAGS_task_cgroup_root),
+      launcher_(new TaskLauncher(
+          FLAGS_task_launch_threads,
+          boost::bind(&LocalExecutor::HandleTaskProcessLaunch, this, _1, _2),
+          boost::bind(&LocalExecutor::HandleTaskProcessExit, this, _1, _2,
+                      _3))) {
   VLOG(1) << "Executor for resource " << resource_id << " is up: " << *this;
   VLOG(1) << "Tasks will be bound to the resource by the topology manager"
           << "at " << topology_manager_;
   CreateDirectories();
 }
 
-char* LocalExecutor::AddPerfMonitoringToCommandLine(
+LocalExecutor::~LocalExecutor() {
+  // Unlink the heartbeat rings of any tasks that are still running
+  boost::lock_guard<boost::mutex> ring_lock(heartbeat_rings_lock_);
+  for (auto& task_ring : heartbeat_rings_) {
+    delete task_ring.second;
+  }
+  heartbeat_rings_.clear();
+}
+
+void LocalExecutor::AddPerfMonitoringToCommandLine(
     const unordered_map<string, string>& env,
-    vector<char*>* argv) {
-  // Define the string prefix for performance monitoring
-  //string perf_string = "perf stat -x, -o ";
+    vector<string>* argv) {
+  // Define the prefix for performance monitoring
   VLOG(2) << "Enabling performance monitoring...";
-  string perf_string = "perf stat -o ";
   const string* perf_fname = FindOrNull(env, "PERF_FNAME");
   CHECK_NOTNULL(perf_fname);
-  perf_string += *perf_fname;
-  perf_string += " -e ";
-  perf_string += FLAGS_perf_event_list;
-  perf_string += " -- ";
-  return TokenizeIntoArgv(perf_string, argv);
+  argv->push_back("perf");
+  argv->push_back("stat");
+  argv->push_back("-o");
+  argv->push_back(*perf_fname);
+  argv->push_back("-e");
+  argv->push_back(FLAGS_perf_event_list);
+  argv->push_back("--");
 }
 
-char* LocalExecutor::AddDebuggingToCommandLine(vector<char*>* argv) {
-  // Define the string prefix for debugging
-  string dbg_string;
+void LocalExecutor::AddDebuggingToCommandLine(vector<string>* argv) {
+  // Define the prefix for debugging
   VLOG(2) << "Enabling debugging...";
-  if (FLAGS_debug_tasks)
-    dbg_string = "gdb -batch -ex run --args ";
-  else if (FLAGS_debug_interactively != 0)
-    dbg_string = "gdb '-ex run --args ";
-  return TokenizeIntoArgv(dbg_string, argv);
+  if (FLAGS_debug_tasks) {
+    argv->push_back("gdb");
+    argv->push_back("-batch");
+    argv->push_back("-ex");
+    argv->push_back("run");
+    argv->push_back("--args");
+  } else if (FLAGS_debug_interactively != 0) {
+    argv->push_back("gdb");
+    argv->push_back("'-ex");
+    argv->push_back("run");
+    argv->push_back("--args");
+  }
+}
+
+TaskLaunchRequest* LocalExecutor::BuildLaunchRequest(
+    TaskID_t task_id,
+    const string& cmdline,
+    const vector<string>& args,
+    const unordered_map<string, string>& env,
+    bool perf_monitoring,
+    bool debug,
+    bool default_args,
+    const string& tasklog) {
+  TaskLaunchRequest* request = new TaskLaunchRequest;
+  request->task_id = task_id;
+  // N.B.: only one of debug and perf_monitoring can be active at a time;
+  // debug takes priority here.
+  if (debug) {
+    AddDebuggingToCommandLine(&request->argv);
+  } else if (perf_monitoring) {
+    AddPerfMonitoringToCommandLine(env, &request->argv);
+  }
+  request->argv.push_back(cmdline);
+  if (default_args)
+    request->argv.push_back(
+        "--tryfromenv=coordinator_uri,resource_id,task_id");
+  for (auto& arg : args) {
+    VLOG(1) << "Adding extra argument \"" << arg << "\"";
+    request->argv.push_back(arg);
+  }
+  request->env.reserve(env.size());
+  for (auto& env_var : env) {
+    request->env.push_back(env_var.first + "=" + env_var.second);
+  }
+  // Get paths for task logs
+  request->stdout_path = tasklog + "-stdout";
+  request->stderr_path = tasklog + "-stderr";
+  // Place the task in its own cgroup (if any), so that its usage, including
+  // that of its children, is accounted there.
+  request->cgroup_procs = usage_collector_.AddTask(task_id);
+  // Print the whole command line
+  string full_cmd_line;
+  for (auto& arg : request->argv) {
+    full_cmd_line += arg;
+    full_cmd_line += " ";
+  }
+  LOG(INFO) << "COMMAND LINE for task " << task_id << ": "
+            << full_cmd_line;
+  return request;
 }
 
 bool LocalExecutor::CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks) {
@@ -133,19 +219,66 @@ bool LocalExecutor::CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks) {
 }
 
 void LocalExecutor::CleanUpCompletedTask(const TaskDescriptor& td) {
-  // Drop task handler thread
-  boost::unique_lock<boost::shared_mutex> handler_lock(handler_map_mutex_);
-  boost::unique_lock<boost::shared_mutex> pid_lock(pid_map_mutex_);
-  task_handler_threads_.erase(td.uid());
-  // Issue a kill to make double-sure that the task has finished
-  // XXX(malte): this is a hack!
-  pid_t* pid = FindOrNull(task_pids_, td.uid());
-  CHECK_NOTNULL(pid);
-  int ret = kill(*pid, SIGKILL);
-  LOG(INFO) << "kill(2) for task " << td.uid() << " returned " << ret;
-  task_pids_.erase(td.uid());
+  {
+    boost::unique_lock<boost::shared_mutex> pid_lock(pid_map_mutex_);
+    pid_t* pid = FindOrNull(task_pids_, td.uid());
+    if (!pid) {
+      LOG(WARNING) << "No process known for task " << td.uid();
+    } else if (*pid == 0) {
+      // The launch is still pending; the launcher kills the process when it
+      // finds the task gone.
+      VLOG(1) << "Cancelling pending launch of task " << td.uid();
+    } else {
+      // Issue a kill to make double-sure that the task has finished
+      // XXX(malte): this is a hack!
+      int ret = kill(*pid, SIGKILL);
+      LOG(INFO) << "kill(2) for task " << td.uid() << " returned " << ret;
+    }
+    task_pids_.erase(td.uid());
+  }
+  health_checker_.TaskRemoved(td.uid());
+  usage_collector_.RemoveTask(td.uid());
+  boost::lock_guard<boost::mutex> ring_lock(heartbeat_rings_lock_);
+  HeartbeatRing* ring = FindPtrOrNull(heartbeat_rings_, td.uid());
+  if (ring) {
+    delete ring;
+    heartbeat_rings_.erase(td.uid());
+  }
+}
+
+void LocalExecutor::CollectTaskHeartbeats(
+    vector<TaskHeartbeatMessage>* heartbeats) {
+  vector<platform_unix::TaskHeartbeatRecord> records;
+  {
+    boost::lock_guard<boost::mutex> ring_lock(heartbeat_rings_lock_);
+    for (auto& task_ring : heartbeat_rings_) {
+      size_t first_record = records.size();
+      task_ring.second->Drain(&records);
+      // The task can write any task id into the ring; report its own.
+      for (size_t index = first_record; index < records.size(); ++index) {
+        records[index].task_id = task_ring.first;
+      }
+    }
+  }
+  for (auto& record : records) {
+    TaskHeartbeatMessage heartbeat;
+    heartbeat.set_task_id(record.task_id);
+    heartbeat.set_sequence_number(record.sequence_number);
+    // Records without a usage sample only signal that the task is alive
+    if (record.mem_usage > 0) {
+      TaskStats* stats = heartbeat.mutable_stats();
+      stats->set_task_id(record.task_id);
+      stats->set_timestamp(record.timestamp);
+      stats->set_mem_usage(record.mem_usage);
+    }
+    heartbeats->push_back(heartbeat);
+  }
 }
 
+void LocalExecutor::CollectTaskStats(vector<TaskStats>* task_stats) {
+  usage_collector_.CollectTaskStats(time_manager_->GetCurrentTimestamp(),
+                                    task_stats);
+}
 
 void LocalExecutor::CreateDirectories() {
   struct stat st;
@@ -253,6 +386,47 @@ void LocalExecutor::HandleTaskFailure(TaskDescriptor* td) {
   CleanUpCompletedTask(*td);
 }
 
+void LocalExecutor::HandleTaskProcessExit(TaskID_t task_id, pid_t pid,
+                                          int32_t status) {
+  if (status < 0) {
+    LOG(ERROR) << "Exit status of task process with PID " << pid
+               << " is unknown";
+  } else if (WIFEXITED(status)) {
+    VLOG(1) << "Task process with PID " << pid << " exited with status "
+            << WEXITSTATUS(status);
+  } else if (WIFSIGNALED(status)) {
+    VLOG(1) << "Task process with PID " << pid << " exited due to uncaught "
+            << "signal " << WTERMSIG(status);
+  } else {
+    LOG(ERROR) << "Unexpected exit status: " << hex << status;
+  }
+  health_checker_.TaskExited(task_id);
+}
+
+void LocalExecutor::HandleTaskProcessLaunch(TaskID_t task_id, pid_t pid) {
+  if (pid < 0) {
+    LOG(ERROR) << "Failed to launch process for task " << task_id;
+    health_checker_.TaskExited(task_id);
+    return;
+  }
+  {
+    boost::unique_lock<boost::shared_mutex> pid_lock(pid_map_mutex_);
+    pid_t* task_pid = FindOrNull(task_pids_, task_id);
+    if (!task_pid) {
+      // The task was cleaned up while its launch was pending
+      LOG(INFO) << "Task " << task_id << " was cancelled before its process "
+                << "started; killing PID " << pid;
+      kill(pid, SIGKILL);
+      return;
+    }
+    *task_pid = pid;
+  }
+  usage_collector_.SetTaskPID(task_id, pid);
+  // Pin the task to the appropriate resource
+  if (topology_manager_ && FLAGS_pin_tasks_to_cores)
+    topology_manager_->BindPIDToResource(pid, local_resource_id_);
+}
+
 void LocalExecutor::RunTask(TaskDescriptor* td,
                             bool firmament_binary) {
   CHECK(td);
@@ -261,18 +435,6 @@ void LocalExecutor::RunTask(TaskDescriptor* td,
   // Mark the start time of the task.
   td->set_start_time(start_time);
   td->set_total_unscheduled_time(UpdateTaskTotalUnscheduledTime(*td));
-  // XXX(malte): Move this over to use RunProcessAsync, instead of custom thread
-  // spawning.
-  boost::unique_lock<boost::mutex> exec_lock(exec_mutex_);
-  boost::unique_lock<boost::shared_mutex> handler_lock(handler_map_mutex_);
-  boost::thread* task_thread = new boost::thread(
-      boost::bind(&LocalExecutor::_RunTask, this, td, firmament_binary));
-  CHECK(InsertIfNotPresent(&task_handler_threads_, td->uid(), task_thread));
-  exec_condvar_.wait(exec_lock);
-}
-
-bool LocalExecutor::_RunTask(TaskDescriptor* td,
-                             bool firmament_binary) {
   // Convert arguments as specified in TD into a string vector that we can munge
   // into an actual argv[].
   vector<string> args;
@@ -283,6 +445,8 @@ bool LocalExecutor::_RunTask(TaskDescriptor* td,
   }
   // Environment variables
   SetUpEnvironmentForTask(*td, &env);
+  if (FLAGS_task_heartbeat_ring)
+    SetUpHeartbeatRing(td->uid(), &env);
   // Path for task log files (stdout/stderr)
   string tasklog = FLAGS_task_log_dir + "/" + td->job_id() +
                    "-" + to_string(td->uid());
@@ -290,13 +454,11 @@ bool LocalExecutor::_RunTask(TaskDescriptor* td,
   // arguments: binary (path + name), arguments, performance monitoring on/off,
   // debugging flags, is this a Firmament task binary? (on/off; will cause
   // default arugments to be passed)
-  bool res = (RunProcessSync(
+  RunProcessAsync(
       td->uid(), td->binary(), args, env, FLAGS_perf_monitoring,
       (FLAGS_debug_tasks || ((FLAGS_debug_interactively != 0) &&
                              (td->uid() == FLAGS_debug_interactively))),
-      firmament_binary, tasklog) == 0);
-  VLOG(1) << "Result of RunProcessSync was " << res;
-  return res;
+      firmament_binary, tasklog);
 }
 
 int32_t LocalExecutor::RunProcessAsync(TaskID_t task_id,
@@ -307,13 +469,17 @@ int32_t LocalExecutor::RunProcessAsync(TaskID_t task_id,
                                        bool debug,
                                        bool default_args,
                                        const string& tasklog) {
-  // TODO(malte): We lose the thread reference here, so we can never join this
-  // thread. Need to return or store if we ever need it for anythign again.
-  boost::thread async_process_thread(
-      boost::bind(&LocalExecutor::RunProcessSync, this, task_id, cmdline, args,
-                  env, perf_monitoring, debug, default_args, tasklog));
-  // We hard-code the return to zero here; maybe should return a thread
-  // reference instead.
+  TaskLaunchRequest* request =
+    BuildLaunchRequest(task_id, cmdline, args, env, perf_monitoring, debug,
+                       default_args, tasklog);
+  {
+    boost::unique_lock<boost::shared_mutex> pid_lock(pid_map_mutex_);
+    // The PID is filled in once the process has been launched
+    CHECK(InsertIfNotPresent(&task_pids_, task_id, 0));
+  }
+  health_checker_.TaskStarted(task_id);
+  // The process is created and later reaped by the launcher's threads
+  launcher_->Launch(request);
   return 0;
 }
 
@@ -325,157 +491,22 @@ int32_t LocalExecutor::RunProcessSync(TaskID_t task_id,
                                       bool debug,
                                       bool default_args,
                                       const string& tasklog) {
-  pid_t pid;
-  /*int pipe_to[2];    // pipe to feed input data to task
-  int pipe_from[3];  // pipe to receive output data from task
-  if (pipe(pipe_to) != 0) {
-    PLOG(ERROR) << "Failed to create pipe to task.";
-  }
-  if (pipe(pipe_from) != 0) {
-    PLOG(ERROR) << "Failed to create pipe from task.";
-  }*/
-  vector<char*> argv;
-  vector<char*> envv;
-  // Get paths for task logs
-  string tasklog_stdout = tasklog + "-stdout";
-  string tasklog_stderr = tasklog + "-stderr";
-  // N.B.: only one of debug and perf_monitoring can be active at a time;
-  // debug takes priority here.
-  if (debug) {
-    // task debugging is active, so reserve extra space for the
-    // gdb invocation prefix.
-    argv.reserve(args.size() + (default_args ? 4 : 3));
-    AddDebuggingToCommandLine(&argv);
-  } else if (perf_monitoring) {
-    // performance monitoring is active, so reserve extra space for the
-    // "perf" invocation prefix.
-    argv.reserve(args.size() + (default_args ? 11 : 10));
-    AddPerfMonitoringToCommandLine(env, &argv);
-  } else {
-    // no performance monitoring, so we only need to reserve space for the
-    // default and NULL args
-    argv.reserve(args.size() + (default_args ? 2 : 1));
-  }
-  argv.push_back((char*)(cmdline.c_str()));  // NOLINT
-  if (default_args)
-    argv.push_back(
-        (char*)"--tryfromenv=coordinator_uri,resource_id,task_id");  // NOLINT
-  for (uint32_t i = 0; i < args.size(); ++i) {
-    // N.B.: This casts away the const qualifier on the c_str() result.
-    // Unsafe, but okay since args lives beyond the execvpe call.
-    VLOG(1) << "Adding extra argument \"" << args[i] << "\"";
-    argv.push_back((char*)(args[i].c_str()));  // NOLINT
-  }
-  vector<string> env_strings(env.size());
-  uint64_t i = 0;
-  for (unordered_map<string, string>::const_iterator it = env.begin();
-       it != env.end();
-       ++it) {
-    env_strings[i] = it->first + "=" + it->second;
-    // N.B.: This casts away the const qualifier on the c_str() result.
-    // Unsafe, but okay since env_str lives beyond the execvpe call.
-    envv.push_back((char*)(env_strings[i].c_str()));  // NOLINT
-    ++i;
-  }
-  // The last item in the argv and envp for execvpe is always NULL.
-  argv.push_back(NULL);
-  envv.push_back(NULL);
-  // Print the whole command line
-  string full_cmd_line;
-  for (vector<char*>::const_iterator arg_iter = argv.begin();
-       arg_iter != argv.end();
-       ++arg_iter) {
-    if (*arg_iter != NULL) {
-      full_cmd_line += *arg_iter;
-      full_cmd_line += " ";
-    }
-  }
-  LOG(INFO) << "COMMAND LINE for task " << task_id << ": "
-            << full_cmd_line;
-  VLOG(1) << "About to fork child process for task execution of "
-          << task_id << "!";
-  pid = fork();
-  switch (pid) {
-    case -1:
-      // Error
-      LOG(ERROR) << "Failed to fork child process.";
-      break;
-    case 0: {
-      // Child
-      // Set up stderr and stdout log redirections to files
-      int stdout_fd = open(tasklog_stdout.c_str(),
-                           O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-      dup2(stdout_fd, STDOUT_FILENO);
-      int stderr_fd = open(tasklog_stderr.c_str(),
-                           O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-      dup2(stderr_fd, STDERR_FILENO);
-      if (close(stdout_fd) != 0)
-        PLOG(FATAL) << "Failed to close stdout FD in child";
-      if (close(stderr_fd) != 0)
-        PLOG(FATAL) << "Failed to close stderr FD in child";
-
-      // Change to task's working directory
-      if (!FindOrNull(env, "FLAGS_task_data_dir") &&
-          !env["FLAGS_task_data_dir"].empty()) {
-        CHECK_EQ(chdir(env["FLAGS_task_data_dir"].c_str()), 0);
-      }
-
-      // Close the open FDs in the child before exec-ing, so that the task does
-      // not inherit all of the coordinator's sockets and FDs.
-      // We start from 3 here in order to avoid closing stdin/stdout/stderr.
-      int fd;
-      int fds;
-      if ((fds = getdtablesize()) == -1) fds = OPEN_MAX_GUESS;
-      for (fd = 3; fd < fds; fd++) {
-        if (close(fd) == -EBADF)
-          break;
-      }
-
-      // kill child process if parent terminates
-      // SOMEDAY(adam): make this portable beyond Linux?
-#ifdef __linux__
-      prctl(PR_SET_PDEATHSIG, SIGHUP);
-#endif
-
-      // Run the task binary
-      execvpe(argv[0], &argv[0], &envv[0]);
-      // execl only returns if there was an error
-      PLOG(ERROR) << "execvp failed for task command '" << full_cmd_line << "'";
-      //ReportTaskExecutionFailure();
-      _exit(1);
-    }
-    default:
-      // Parent
-      VLOG(1) << "Task process with PID " << pid << " created.";
-      {
-        boost::unique_lock<boost::shared_mutex> handler_lock(pid_map_mutex_);
-        CHECK(InsertIfNotPresent(&task_pids_, task_id, pid));
-      }
-      // Pin the task to the appropriate resource
-      if (topology_manager_ && FLAGS_pin_tasks_to_cores)
-        topology_manager_->BindPIDToResource(pid, local_resource_id_);
-      // Notify any other threads waiting to execute processes (?)
-      exec_condvar_.notify_one();
-      // Wait for task to terminate
-      int status;
-      while (waitpid(pid, &status, 0) != pid) {
-        VLOG(3) << "Waiting for child process " << pid << " to exit...";
-      }
-      if (WIFEXITED(status)) {
-        VLOG(1) << "Task process with PID " << pid << " exited with status "
-                << WEXITSTATUS(status);
-      } else if (WIFSIGNALED(status)) {
-        VLOG(1) << "Task process with PID " << pid << " exited due to uncaught "
-                << "signal " << WTERMSIG(status);
-      } else if (WIFSTOPPED(status)) {
-        VLOG(1) << "Task process with PID " << pid << " is stopped due to "
-                << "signal " << WSTOPSIG(status);
-      } else {
-        LOG(ERROR) << "Unexpected exit status: " << hex << status;
-      }
-      return status;
+  scoped_ptr<TaskLaunchRequest> request(
+      BuildLaunchRequest(task_id, cmdline, args, env, perf_monitoring, debug,
+                         default_args, tasklog));
+  pid_t pid = TaskLauncher::Spawn(*request);
+  if (pid < 0)
+    return -1;
+  {
+    boost::unique_lock<boost::shared_mutex> pid_lock(pid_map_mutex_);
+    CHECK(InsertIfNotPresent(&task_pids_, task_id, pid));
   }
-  return -1;
+  usage_collector_.SetTaskPID(task_id, pid);
+  // Pin the task to the appropriate resource
+  if (topology_manager_ && FLAGS_pin_tasks_to_cores)
+    topology_manager_->BindPIDToResource(pid, local_resource_id_);
+  // Wait for task to terminate
+  return WaitForFinish(pid);
 }
 
 string LocalExecutor::PerfDataFileName(const TaskDescriptor& td) {
@@ -484,6 +515,22 @@ string LocalExecutor::PerfDataFileName(const TaskDescriptor& td) {
   return fname;
 }
 
+void LocalExecutor::SetUpHeartbeatRing(TaskID_t task_id,
+                                       unordered_map<string, string>* env) {
+  HeartbeatRing* ring = new HeartbeatRing;
+  string ring_name = "/firmament-heartbeats-" + to_string(task_id);
+  if (!ring->Create(ring_name, FLAGS_task_heartbeat_ring_capacity)) {
+    // The task falls back to sending heartbeats to the coordinator
+    delete ring;
+    return;
+  }
+  {
+    boost::lock_guard<boost::mutex> ring_lock(heartbeat_rings_lock_);
+    CHECK(InsertIfNotPresent(&heartbeat_rings_, task_id, ring));
+  }
+  InsertIfNotPresent(env, "FLAGS_tasklib_heartbeat_ring", ring_name);
+}
+
 void LocalExecutor::SetUpEnvironmentForTask(
     const TaskDescriptor& td,
     unordered_map<string, string>* env) {
@@ -507,6 +554,9 @@ void LocalExecutor::SetUpEnvironmentForTask(
   InsertIfNotPresent(env, "FLAGS_heartbeat_interval",
                      to_string(heartbeat_interval_));
   InsertIfNotPresent(env, "FLAGS_task_data_dir", data_dir);
+  // The executor samples the task's resource usage, so the task library does
+  // not need to poll ProcFS itself.
+  InsertIfNotPresent(env, "FLAGS_tasklib_use_procfs", "false");
   if (td.inject_task_lib()) {
     InsertIfNotPresent(env, "LD_LIBRARY_PATH", FLAGS_task_lib_dir +
                        ":/usr/local/lib/");
@@ -527,24 +577,6 @@ void LocalExecutor::SetUpEnvironmentForTask(
   }
 }
 
-char* LocalExecutor::TokenizeIntoArgv(const string& str, vector<char*>* argv) {
-  // Ugly parsing code to transform str into an argv representation
-  char* str_c_string = (char*)malloc(str.size()+1);  // NOLINT
-  snprintf(str_c_string, str.size(), "%s", str.c_str());
-  char* piece;
-  char* tmp_ptr = NULL;
-  piece = strtok_r(str_c_string, " ", &tmp_ptr);
-  while (piece != NULL) {
-    argv->push_back(piece);
-    piece = strtok_r(NULL, " ", &tmp_ptr);
-  }
-  // Return pointer to the allocated string in order to be able to delete it
-  // later.
-  VLOG(1) << "After adding tokenized version of '" << str
-          << "', size of argv is " << argv->size();
-  return str_c_string;
-}
-
 bool LocalExecutor::WaitForPerfFile(const string& file_name) {
   // This hack is required to avoid a race between the data file being
   // written by the perf utility and it being opened for reading.
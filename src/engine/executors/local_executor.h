@@ -44,13 +44,17 @@
 #include "base/types.h"
 #include "base/task_final_report.pb.h"
 #include "engine/executors/task_health_checker.h"
+#include "engine/executors/task_launcher.h"
+#include "engine/executors/task_usage_collector.h"
 #include "engine/executors/topology_manager.h"
 #include "misc/time_interface.h"
+#include "platforms/unix/heartbeat_ring.h"
 
 namespace firmament {
 namespace executor {
 
 using machine::topology::TopologyManager;
+using platform_unix::HeartbeatRing;
 
 class LocalExecutor : public ExecutorInterface {
  public:
@@ -61,7 +65,10 @@ class LocalExecutor : public ExecutorInterface {
                 const string& coordinator_uri,
                 TimeInterface* time_manager,
                 shared_ptr<TopologyManager> topology_mgr);
+  ~LocalExecutor();
   bool CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks);
+  void CollectTaskHeartbeats(vector<TaskHeartbeatMessage>* heartbeats);
+  void CollectTaskStats(vector<TaskStats>* task_stats);
   void HandleTaskCompletion(TaskDescriptor* td,
                             TaskFinalReport* report);
   void HandleTaskEviction(TaskDescriptor* td);
@@ -83,13 +90,24 @@ class LocalExecutor : public ExecutorInterface {
   FRIEND_TEST(LocalExecutorTest, SimpleTaskExecutionTest);
   FRIEND_TEST(LocalExecutorTest, TaskExecutionWithArgsTest);
   ResourceID_t local_resource_id_;
-  char* AddPerfMonitoringToCommandLine(const unordered_map<string, string>&,
-                                       vector<char*>* argv);
-  char* AddDebuggingToCommandLine(vector<char*>* argv);
+  void AddPerfMonitoringToCommandLine(const unordered_map<string, string>&,
+                                      vector<string>* argv);
+  void AddDebuggingToCommandLine(vector<string>* argv);
+  TaskLaunchRequest* BuildLaunchRequest(
+      TaskID_t task_id,
+      const string& cmdline,
+      const vector<string>& args,
+      const unordered_map<string, string>& env,
+      bool perf_monitoring,
+      bool debug,
+      bool default_args,
+      const string& tasklog);
   void CleanUpCompletedTask(const TaskDescriptor& td);
   void CreateDirectories();
   void GetPerfDataFromLine(TaskFinalReport* report,
                            const string& line);
+  void HandleTaskProcessExit(TaskID_t task_id, pid_t pid, int32_t status);
+  void HandleTaskProcessLaunch(TaskID_t task_id, pid_t pid);
   int32_t RunProcessAsync(TaskID_t task_id,
                           const string& cmdline,
                           vector<string> args,
@@ -106,13 +124,12 @@ class LocalExecutor : public ExecutorInterface {
                          bool debug,
                          bool default_args,
                          const string& tasklog);
-  bool _RunTask(TaskDescriptor* td,
-                bool firmament_binary);
   string PerfDataFileName(const TaskDescriptor& td);
   void ReadFromPipe(int fd);
   void SetUpEnvironmentForTask(const TaskDescriptor& td,
                                unordered_map<string, string>* env);
-  char* TokenizeIntoArgv(const string& str, vector<char*>* argv);
+  void SetUpHeartbeatRing(TaskID_t task_id,
+                          unordered_map<string, string>* env);
   bool WaitForPerfFile(const string& file_name);
   void WriteToPipe(int fd, void* data, size_t len);
   // This holds the currently configured URI of the coordinator for this
@@ -128,13 +145,17 @@ class LocalExecutor : public ExecutorInterface {
   // Heartbeat interval for tasks running on the associated resource, in
   // nanoseconds.
   uint64_t heartbeat_interval_;
-  boost::mutex exec_mutex_;
-  boost::shared_mutex handler_map_mutex_;
   boost::shared_mutex pid_map_mutex_;
-  boost::condition_variable exec_condvar_;
-  // Map to each task's local handler thread
-  unordered_map<TaskID_t, boost::thread*> task_handler_threads_;
+  // Samples the resource usage of the tasks run by this executor.
+  TaskUsageCollector usage_collector_;
+  // PIDs of the tasks' processes; 0 while a task's launch is pending.
   unordered_map<TaskID_t, pid_t> task_pids_;
+  // Shared-memory rings through which local tasks report heartbeats
+  boost::mutex heartbeat_rings_lock_;
+  unordered_map<TaskID_t, HeartbeatRing*> heartbeat_rings_;
+  // Launches and reaps the task processes. Declared last, so that its threads
+  // are stopped before the state that its callbacks touch is destroyed.
+  scoped_ptr<TaskLauncher> launcher_;
 };
 
 }  // namespace executor
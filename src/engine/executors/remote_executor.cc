@@ -57,6 +57,17 @@ bool RemoteExecutor::CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks) {
   return true;
 }
 
+void RemoteExecutor::CollectTaskHeartbeats(
+    vector<TaskHeartbeatMessage>* heartbeats) {
+  // Remote tasks send their heartbeats to the coordinator.
+}
+
+void RemoteExecutor::CollectTaskStats(vector<TaskStats>* task_stats) {
+  // The remote coordinator's local executor samples the tasks' usage. The
+  // remote coordinator forwards the samples in its task heartbeat batches,
+  // which the coordinator adds to the knowledge base on receipt.
+}
+
 void RemoteExecutor::HandleTaskCompletion(TaskDescriptor* td,
                                           TaskFinalReport* report) {
   // All of the actual cleanup is done at the remote coordinator's
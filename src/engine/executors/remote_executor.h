@@ -45,6 +45,8 @@ class RemoteExecutor : public ExecutorInterface {
                  MessagingAdapterInterface<BaseMessage>* m_adapter_ptr,
                  TimeInterface* time_manager);
   bool CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks);
+  void CollectTaskHeartbeats(vector<TaskHeartbeatMessage>* heartbeats);
+  void CollectTaskStats(vector<TaskStats>* task_stats);
   void HandleTaskCompletion(TaskDescriptor* td,
                             TaskFinalReport* report);
   void HandleTaskEviction(TaskDescriptor* td);
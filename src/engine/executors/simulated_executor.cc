@@ -38,6 +38,13 @@ bool SimulatedExecutor::CheckRunningTasksHealth(
   return true;
 }
 
+void SimulatedExecutor::CollectTaskHeartbeats(
+    vector<TaskHeartbeatMessage>* heartbeats) {
+}
+
+void SimulatedExecutor::CollectTaskStats(vector<TaskStats>* task_stats) {
+}
+
 void SimulatedExecutor::HandleTaskCompletion(TaskDescriptor* td_ptr,
                                              TaskFinalReport* task_report) {
   // NOTE: We do not have information to set instructions, cycles, llc_refs
@@ -37,6 +37,8 @@ class SimulatedExecutor : public ExecutorInterface {
   SimulatedExecutor(ResourceID_t resource_id,
                     const string& coordinator_uri);
   bool CheckRunningTasksHealth(vector<TaskID_t>* failed_tasks);
+  void CollectTaskHeartbeats(vector<TaskHeartbeatMessage>* heartbeats);
+  void CollectTaskStats(vector<TaskStats>* task_stats);
   void HandleTaskCompletion(TaskDescriptor* td,
                             TaskFinalReport* report);
   void HandleTaskEviction(TaskDescriptor* td);
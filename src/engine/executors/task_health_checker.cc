@@ -22,51 +22,45 @@
 
 #include <vector>
 
-#if BOOST_VERSION <= 104800
-#include <boost/chrono.hpp>
-#endif
-
 #include "misc/map-util.h"
 #include "misc/utils.h"
 
 namespace firmament {
 
-TaskHealthChecker::TaskHealthChecker(
-    const unordered_map<TaskID_t, boost::thread*>* handler_thread_map,
-    boost::shared_mutex* handler_map_lock)
-  : handler_thread_map_(handler_thread_map),
-    handler_map_lock_(handler_map_lock) {
+TaskHealthChecker::TaskHealthChecker() {
 }
 
 bool TaskHealthChecker::Run(vector<TaskID_t>* failed_tasks) {
   bool all_good = true;
-  boost::shared_lock<boost::shared_mutex> map_lock(*handler_map_lock_);
-  for (unordered_map<TaskID_t, boost::thread*>::const_iterator
-       it = handler_thread_map_->begin();
-       it != handler_thread_map_->end();
-       ++it) {
-    VLOG(2) << "Checking liveness of task " << it->first;
-    if (!CheckTaskLiveness(it->first, it->second)) {
+  boost::shared_lock<boost::shared_mutex> lock(task_exited_lock_);
+  for (auto& task : task_exited_) {
+    VLOG(2) << "Checking liveness of task " << task.first;
+    if (task.second->load(std::memory_order_acquire)) {
       all_good = false;
-      LOG(ERROR) << "Task " << it->first << " has failed!";
-      failed_tasks->push_back(it->first);
+      LOG(ERROR) << "Task " << task.first << " has failed!";
+      failed_tasks->push_back(task.first);
     }
   }
   return all_good;
 }
 
-bool TaskHealthChecker::CheckTaskLiveness(TaskID_t task_id,
-                                          boost::thread* handler_thread) {
-  if (!handler_thread)
-    return false;
-#if BOOST_VERSION <= 104800
-  if (handler_thread->timed_join(boost::posix_time::seconds(1)))
-    return false;
-#else
-  if (handler_thread->try_join_for(boost::chrono::seconds(1)))
-    return false;
-#endif
-  return true;
+void TaskHealthChecker::TaskExited(TaskID_t task_id) {
+  boost::shared_lock<boost::shared_mutex> lock(task_exited_lock_);
+  shared_ptr<std::atomic<bool> > exited =
+    FindPtrOrNull(task_exited_, task_id);
+  if (exited)
+    exited->store(true, std::memory_order_release);
+}
+
+void TaskHealthChecker::TaskRemoved(TaskID_t task_id) {
+  boost::unique_lock<boost::shared_mutex> lock(task_exited_lock_);
+  task_exited_.erase(task_id);
+}
+
+void TaskHealthChecker::TaskStarted(TaskID_t task_id) {
+  boost::unique_lock<boost::shared_mutex> lock(task_exited_lock_);
+  InsertOrUpdate(&task_exited_, task_id,
+                 shared_ptr<std::atomic<bool> >(new std::atomic<bool>(false)));
 }
 
 }  // namespace firmament
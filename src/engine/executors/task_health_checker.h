@@ -21,6 +21,7 @@
 #ifndef FIRMAMENT_ENGINE_EXECUTORS_TASK_HEALTH_CHECKER_H
 #define FIRMAMENT_ENGINE_EXECUTORS_TASK_HEALTH_CHECKER_H
 
+#include <atomic>
 #include <string>
 #include <map>
 #include <vector>
@@ -43,16 +44,42 @@ namespace firmament {
 
 class TaskHealthChecker {
  public:
-  TaskHealthChecker(
-      const unordered_map<TaskID_t, boost::thread*>* handler_thread_map,
-      boost::shared_mutex* handler_map_lock);
+  TaskHealthChecker();
+  /**
+   * Sweeps over all checked tasks and reports those whose process has exited.
+   * The sweep only reads each task's liveness flag and never blocks on the
+   * tasks themselves.
+   * @param failed_tasks vector to which the IDs of failed tasks are appended
+   * @return true if all tasks are alive
+   */
   bool Run(vector<TaskID_t>* failed_tasks);
+  /**
+   * Starts checking on a task whose process is being launched.
+   * @param task_id the ID of the task
+   */
+  void TaskStarted(TaskID_t task_id);
+  /**
+   * Records that a task's process has exited (or could not be launched).
+   * @param task_id the ID of the task
+   */
+  void TaskExited(TaskID_t task_id);
+  /**
+   * Stops checking on a task that has been cleaned up.
+   * @param task_id the ID of the task
+   */
+  void TaskRemoved(TaskID_t task_id);
 
- protected:
-  bool CheckTaskLiveness(TaskID_t task_id, boost::thread* handler_thread);
+  inline uint64_t num_tasks() {
+    boost::shared_lock<boost::shared_mutex> lock(task_exited_lock_);
+    return task_exited_.size();
+  }
 
-  const unordered_map<TaskID_t, boost::thread*>* handler_thread_map_;
-  boost::shared_mutex* handler_map_lock_;
+ protected:
+  // Maps each checked task to whether its process has exited. The flags are
+  // atomic so that exit notifications only need a shared lock on the map; the
+  // exclusive lock is taken only when tasks are added or removed.
+  unordered_map<TaskID_t, shared_ptr<std::atomic<bool> > > task_exited_;
+  boost::shared_mutex task_exited_lock_;
 };
 
 }  // namespace firmament
@@ -0,0 +1,86 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Task health checker tests.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/common.h"
+#include "engine/executors/task_health_checker.h"
+#include "misc/wall_time.h"
+
+namespace firmament {
+
+// Tests that exited tasks are reported until they are removed.
+TEST(TaskHealthCheckerTest, ReportsExitedTasks) {
+  TaskHealthChecker checker;
+  checker.TaskStarted(1);
+  checker.TaskStarted(2);
+  vector<TaskID_t> failed_tasks;
+  CHECK(checker.Run(&failed_tasks));
+  CHECK_EQ(failed_tasks.size(), 0);
+  checker.TaskExited(2);
+  // Exit notifications for unknown tasks are ignored
+  checker.TaskExited(3);
+  CHECK(!checker.Run(&failed_tasks));
+  CHECK_EQ(failed_tasks.size(), 1);
+  CHECK_EQ(failed_tasks[0], 2);
+  checker.TaskRemoved(2);
+  failed_tasks.clear();
+  CHECK(checker.Run(&failed_tasks));
+  CHECK_EQ(failed_tasks.size(), 0);
+  CHECK_EQ(checker.num_tasks(), 1);
+}
+
+// Tests that a sweep over thousands of running tasks reports exactly the
+// exited ones without blocking on any of them. The bound on the sweep time
+// is generous, as the sweep logs an error for every exited task.
+TEST(TaskHealthCheckerTest, SweepManyTasks) {
+  const uint64_t kNumTasks = 10000;
+  TaskHealthChecker checker;
+  for (uint64_t i = 0; i < kNumTasks; ++i) {
+    checker.TaskStarted(i);
+  }
+  // Every hundredth task has exited
+  for (uint64_t i = 0; i < kNumTasks; i += 100) {
+    checker.TaskExited(i);
+  }
+  vector<TaskID_t> failed_tasks;
+  WallTime wall_time;
+  uint64_t start_time = wall_time.GetCurrentTimestamp();
+  CHECK(!checker.Run(&failed_tasks));
+  uint64_t sweep_time = wall_time.GetCurrentTimestamp() - start_time;
+  CHECK_EQ(failed_tasks.size(), kNumTasks / 100);
+  for (auto& task_id : failed_tasks) {
+    CHECK_EQ(task_id % 100, 0);
+  }
+  CHECK_EQ(checker.num_tasks(), kNumTasks);
+  // The timestamp is in microseconds
+  CHECK_LT(sweep_time, 1000000);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,309 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Launches task processes from a small, fixed pool of threads and reaps them
+// from a single thread.
+
+#include "engine/executors/task_launcher.h"
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+
+namespace firmament {
+namespace executor {
+
+// How long the reaper blocks for; processes without a pidfd are polled at
+// this interval.
+static const int32_t kReaperWaitMs = 10;
+
+static int OpenPIDFD(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+TaskLauncher::TaskLauncher(uint32_t num_threads,
+                           LaunchCallback launch_callback,
+                           ExitCallback exit_callback)
+  : launch_callback_(launch_callback),
+    exit_callback_(exit_callback),
+    stopping_(false) {
+  CHECK_GT(num_threads, 0);
+  for (uint32_t i = 0; i < num_threads; ++i) {
+    launcher_threads_.create_thread(
+        boost::bind(&TaskLauncher::LaunchLoop, this));
+  }
+  reaper_thread_ = new boost::thread(
+      boost::bind(&TaskLauncher::ReapLoop, this));
+}
+
+TaskLauncher::~TaskLauncher() {
+  {
+    boost::lock_guard<boost::mutex> lock(queue_lock_);
+    stopping_ = true;
+  }
+  queue_cond_.notify_all();
+  launcher_threads_.join_all();
+  reaper_thread_->join();
+  delete reaper_thread_;
+  for (auto& request : launch_queue_) {
+    delete request;
+  }
+  launch_queue_.clear();
+  // Processes that are still running are no longer watched
+  for (auto& process : watched_) {
+    if (process.second.pidfd >= 0) {
+      reactor_.Deregister(process.second.pidfd);
+      CHECK_EQ(close(process.second.pidfd), 0);
+    }
+  }
+  watched_.clear();
+}
+
+void TaskLauncher::Launch(TaskLaunchRequest* request) {
+  {
+    boost::lock_guard<boost::mutex> lock(queue_lock_);
+    launch_queue_.push_back(request);
+  }
+  queue_cond_.notify_one();
+}
+
+void TaskLauncher::LaunchLoop() {
+  while (true) {
+    TaskLaunchRequest* request;
+    {
+      boost::unique_lock<boost::mutex> lock(queue_lock_);
+      while (launch_queue_.empty() && !stopping_) {
+        queue_cond_.wait(lock);
+      }
+      if (stopping_)
+        return;
+      request = launch_queue_.front();
+      launch_queue_.pop_front();
+    }
+    pid_t pid = Spawn(*request);
+    // The launch callback runs before the process is watched, so that it
+    // always precedes the exit callback.
+    launch_callback_(request->task_id, pid);
+    if (pid > 0)
+      WatchProcess(request->task_id, pid);
+    delete request;
+  }
+}
+
+void TaskLauncher::ReapLoop() {
+  vector<void*> ready;
+  vector<pid_t> polled;
+  while (!stopping_) {
+    ready.clear();
+    reactor_.Wait(kReaperWaitMs, &ready);
+    for (auto& context : ready) {
+      TryReap(static_cast<pid_t>(reinterpret_cast<intptr_t>(context)));
+    }
+    // Poll any processes for which we could not get a pidfd
+    polled.clear();
+    {
+      boost::lock_guard<boost::mutex> lock(watched_lock_);
+      for (auto& process : watched_) {
+        if (process.second.pidfd < 0)
+          polled.push_back(process.first);
+      }
+    }
+    for (auto& pid : polled) {
+      TryReap(pid);
+    }
+  }
+}
+
+pid_t TaskLauncher::Spawn(const TaskLaunchRequest& request) {
+  // N.B.: These cast away the const qualifier on the c_str() results, which
+  // is safe since the request outlives the execvpe call.
+  vector<char*> argv;
+  argv.reserve(request.argv.size() + 1);
+  for (auto& arg : request.argv) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(NULL);
+  vector<char*> envv;
+  envv.reserve(request.env.size() + 1);
+  for (auto& env_var : request.env) {
+    envv.push_back(const_cast<char*>(env_var.c_str()));
+  }
+  envv.push_back(NULL);
+  CHECK_NOTNULL(argv[0]);
+  const char* stdout_path = request.stdout_path.c_str();
+  const char* stderr_path = request.stderr_path.c_str();
+  const char* cgroup_procs =
+    request.cgroup_procs.empty() ? NULL : request.cgroup_procs.c_str();
+  // N.B.: vfork() should only be used if it is shortly followed by an exec()
+  // call. The child shares our memory until then, so it must only make
+  // system calls: no allocation, no locks and no logging.
+  // The child also inherits our signal handlers, which would run on our
+  // memory. Hence, all signals stay blocked until the child has reset their
+  // dispositions.
+  sigset_t all_signals;
+  sigset_t old_mask;
+  sigfillset(&all_signals);
+  CHECK_EQ(pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask), 0);
+  pid_t pid = vfork();
+  if (pid == 0) {
+    // Child
+    struct sigaction default_action;
+    memset(&default_action, 0, sizeof(default_action));
+    default_action.sa_handler = SIG_DFL;
+    for (int sig = 1; sig < NSIG; ++sig) {
+      // Fails for SIGKILL, SIGSTOP and the signals reserved by libc, which
+      // we cannot change anyway.
+      sigaction(sig, &default_action, NULL);
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    // Set up stderr and stdout log redirections to files
+    int stdout_fd = open(stdout_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (stdout_fd >= 0) {
+      dup2(stdout_fd, STDOUT_FILENO);
+      close(stdout_fd);
+    }
+    int stderr_fd = open(stderr_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (stderr_fd >= 0) {
+      dup2(stderr_fd, STDERR_FILENO);
+      close(stderr_fd);
+    }
+    // Join the task's cgroup, so that all processes the task creates are
+    // accounted in it from the start.
+    if (cgroup_procs) {
+      int cgroup_fd = open(cgroup_procs, O_WRONLY);
+      if (cgroup_fd >= 0) {
+        if (write(cgroup_fd, "0", 1) != 1) {
+          // Usage is then only partially accounted
+        }
+        close(cgroup_fd);
+      }
+    }
+    // Close the open FDs in the child before exec-ing, so that the task does
+    // not inherit all of the coordinator's sockets and FDs.
+    // We start from 3 here in order to avoid closing stdin/stdout/stderr.
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, 0) != 0)
+#endif
+    {
+      int fds = getdtablesize();
+      if (fds == -1)
+        fds = OPEN_MAX_GUESS;
+      for (int fd = 3; fd < fds; fd++) {
+        close(fd);
+      }
+    }
+    // kill child process if parent terminates
+    // SOMEDAY(adam): make this portable beyond Linux?
+#ifdef __linux__
+    prctl(PR_SET_PDEATHSIG, SIGHUP);
+#endif
+    // Run the task binary
+    execvpe(argv[0], &argv[0], &envv[0]);
+    // execvpe only returns if there was an error
+    const char kExecFailed[] = "execvpe failed for task command\n";
+    if (write(STDERR_FILENO, kExecFailed, sizeof(kExecFailed) - 1) < 0) {
+      // Nothing more we can do
+    }
+    _exit(127);
+  }
+  CHECK_EQ(pthread_sigmask(SIG_SETMASK, &old_mask, NULL), 0);
+  if (pid < 0) {
+    PLOG(ERROR) << "Failed to fork child process for task "
+                << request.task_id;
+    return -1;
+  }
+  VLOG(1) << "Task process with PID " << pid << " created for task "
+          << request.task_id;
+  return pid;
+}
+
+bool TaskLauncher::TryReap(pid_t pid) {
+  int status = 0;
+  pid_t result = waitpid(pid, &status, WNOHANG);
+  if (result == 0)
+    return false;
+  if (result < 0) {
+    if (errno == EINTR)
+      return false;
+    // Somebody else reaped the process
+    PLOG(WARNING) << "Failed to reap process " << pid;
+    status = -1;
+  }
+  WatchedProcess process;
+  {
+    boost::lock_guard<boost::mutex> lock(watched_lock_);
+    WatchedProcess* watched_process = FindOrNull(watched_, pid);
+    if (!watched_process)
+      return false;
+    process = *watched_process;
+    watched_.erase(pid);
+  }
+  if (process.pidfd >= 0) {
+    reactor_.Deregister(process.pidfd);
+    CHECK_EQ(close(process.pidfd), 0);
+  }
+  exit_callback_(process.task_id, pid, status);
+  return true;
+}
+
+void TaskLauncher::WatchProcess(TaskID_t task_id, pid_t pid) {
+  WatchedProcess process;
+  process.task_id = task_id;
+  process.pidfd = OpenPIDFD(pid);
+  if (process.pidfd < 0) {
+    VLOG(1) << "No pidfd for process " << pid << "; polling it instead";
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(watched_lock_);
+    CHECK(InsertIfNotPresent(&watched_, pid, process));
+  }
+  if (process.pidfd >= 0 &&
+      !reactor_.Register(process.pidfd,
+                         reinterpret_cast<void*>(
+                             static_cast<intptr_t>(pid)))) {
+    // Fall back to polling the process
+    boost::lock_guard<boost::mutex> lock(watched_lock_);
+    CHECK_EQ(close(process.pidfd), 0);
+    watched_[pid].pidfd = -1;
+  }
+}
+
+}  // namespace executor
+}  // namespace firmament
@@ -0,0 +1,127 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Launches task processes from a small, fixed pool of threads and reaps them
+// from a single thread, instead of dedicating a thread to every task.
+
+#ifndef FIRMAMENT_ENGINE_EXECUTORS_TASK_LAUNCHER_H
+#define FIRMAMENT_ENGINE_EXECUTORS_TASK_LAUNCHER_H
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+#ifdef __PLATFORM_HAS_BOOST__
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#else
+#error Boost not available!
+#endif
+
+#include "base/common.h"
+#include "base/types.h"
+#include "platforms/unix/epoll_reactor.h"
+
+namespace firmament {
+namespace executor {
+
+using platform_unix::EpollReactor;
+
+// Everything needed to start a task process. All strings are prepared before
+// the process is forked, since the child may only make system calls.
+struct TaskLaunchRequest {
+  TaskID_t task_id;
+  vector<string> argv;
+  // Environment as "NAME=value" strings
+  vector<string> env;
+  string stdout_path;
+  string stderr_path;
+  // cgroup.procs file that the child joins before exec; empty for none
+  string cgroup_procs;
+};
+
+class TaskLauncher : private boost::noncopyable {
+ public:
+  // Invoked on a launcher thread once a task's process has been created, or
+  // with a PID of -1 if it could not be created.
+  typedef boost::function<void(TaskID_t, pid_t)> LaunchCallback;
+  // Invoked on the reaper thread with the wait status of an exited process.
+  typedef boost::function<void(TaskID_t, pid_t, int32_t)> ExitCallback;
+
+  TaskLauncher(uint32_t num_threads, LaunchCallback launch_callback,
+               ExitCallback exit_callback);
+  ~TaskLauncher();
+
+  /**
+   * Queues a task process for launch on one of the launcher threads.
+   * @param request the launch request; the launcher takes ownership
+   */
+  void Launch(TaskLaunchRequest* request);
+
+  /**
+   * Creates a task process using vfork and exec, which avoids copying the
+   * page tables of a large parent process.
+   * @param request the process to create
+   * @return the PID of the new process, or -1 on failure
+   */
+  static pid_t Spawn(const TaskLaunchRequest& request);
+
+  /**
+   * Hands a process that was not created by a launcher thread to the reaper.
+   * @param task_id the ID of the task the process belongs to
+   * @param pid the PID of the process
+   */
+  void WatchProcess(TaskID_t task_id, pid_t pid);
+
+ private:
+  // A child process being watched by the reaper.
+  struct WatchedProcess {
+    TaskID_t task_id;
+    // pidfd for the process; -1 if pidfds are unsupported, in which case the
+    // process is polled.
+    int pidfd;
+  };
+
+  void LaunchLoop();
+  void ReapLoop();
+  // Reaps the process if it has exited; returns true if it was reaped.
+  bool TryReap(pid_t pid);
+
+  LaunchCallback launch_callback_;
+  ExitCallback exit_callback_;
+  std::atomic<bool> stopping_;
+  // Launch requests waiting for a launcher thread
+  boost::mutex queue_lock_;
+  boost::condition_variable queue_cond_;
+  deque<TaskLaunchRequest*> launch_queue_;
+  boost::thread_group launcher_threads_;
+  // Processes that have not yet exited, keyed by PID
+  boost::mutex watched_lock_;
+  unordered_map<pid_t, WatchedProcess> watched_;
+  EpollReactor reactor_;
+  boost::thread* reaper_thread_;
+};
+
+}  // namespace executor
+}  // namespace firmament
+
+#endif  // FIRMAMENT_ENGINE_EXECUTORS_TASK_LAUNCHER_H
@@ -0,0 +1,161 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Task launcher tests.
+
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include "base/common.h"
+#include "engine/executors/task_launcher.h"
+
+namespace firmament {
+namespace executor {
+
+class TaskLauncherTest : public ::testing::Test {
+ public:
+  TaskLauncherTest()
+    : num_launched_(0),
+      num_exited_(0),
+      num_failed_(0) {
+  }
+
+  void OnLaunch(TaskID_t task_id, pid_t pid) {
+    boost::lock_guard<boost::mutex> lock(lock_);
+    if (pid < 0)
+      num_failed_++;
+    else
+      num_launched_++;
+  }
+
+  void OnExit(TaskID_t task_id, pid_t pid, int32_t status) {
+    boost::lock_guard<boost::mutex> lock(lock_);
+    // Exit is only ever reported after launch
+    CHECK_GT(num_launched_, num_exited_);
+    CHECK(WIFEXITED(status));
+    exit_codes_.push_back(WEXITSTATUS(status));
+    num_exited_++;
+    cond_.notify_all();
+  }
+
+ protected:
+  // Waits until num_tasks exit notifications have arrived; returns false on
+  // timeout.
+  bool WaitForExits(uint64_t num_tasks) {
+    boost::unique_lock<boost::mutex> lock(lock_);
+    while (num_exited_ < num_tasks) {
+      if (!cond_.timed_wait(lock, boost::posix_time::seconds(30)))
+        return false;
+    }
+    return true;
+  }
+
+  TaskLaunchRequest* MakeRequest(TaskID_t task_id, const string& binary) {
+    TaskLaunchRequest* request = new TaskLaunchRequest;
+    request->task_id = task_id;
+    request->argv.push_back(binary);
+    request->stdout_path = "/dev/null";
+    request->stderr_path = "/dev/null";
+    return request;
+  }
+
+  boost::mutex lock_;
+  boost::condition_variable cond_;
+  uint64_t num_launched_;
+  uint64_t num_exited_;
+  uint64_t num_failed_;
+  vector<int32_t> exit_codes_;
+};
+
+// Launches a burst of short-lived tasks and checks that every one of them is
+// launched and reaped exactly once.
+TEST_F(TaskLauncherTest, LaunchBurst) {
+  const uint64_t kNumTasks = 200;
+  TaskLauncher launcher(
+      4, boost::bind(&TaskLauncherTest::OnLaunch, this, _1, _2),
+      boost::bind(&TaskLauncherTest::OnExit, this, _1, _2, _3));
+  for (uint64_t i = 0; i < kNumTasks; ++i) {
+    launcher.Launch(MakeRequest(i, "/bin/true"));
+  }
+  CHECK(WaitForExits(kNumTasks));
+  CHECK_EQ(num_launched_, kNumTasks);
+  CHECK_EQ(num_failed_, 0);
+  for (auto& exit_code : exit_codes_) {
+    CHECK_EQ(exit_code, 0);
+  }
+}
+
+// A binary that does not exist still produces a process, which exits with
+// status 127 once exec fails.
+TEST_F(TaskLauncherTest, MissingBinary) {
+  TaskLauncher launcher(
+      1, boost::bind(&TaskLauncherTest::OnLaunch, this, _1, _2),
+      boost::bind(&TaskLauncherTest::OnExit, this, _1, _2, _3));
+  launcher.Launch(MakeRequest(1, "/nonexistent/firmament_task"));
+  CHECK(WaitForExits(1));
+  CHECK_EQ(exit_codes_.size(), 1);
+  CHECK_EQ(exit_codes_[0], 127);
+}
+
+// The task process starts with the default signal dispositions, not with
+// those of the launching process, and spawning it leaves the launching
+// thread's signal mask unchanged.
+TEST_F(TaskLauncherTest, SpawnResetsSignalDispositions) {
+  struct sigaction ignore_action;
+  struct sigaction old_action;
+  memset(&ignore_action, 0, sizeof(ignore_action));
+  ignore_action.sa_handler = SIG_IGN;
+  CHECK_EQ(sigaction(SIGUSR1, &ignore_action, &old_action), 0);
+  sigset_t mask_before;
+  CHECK_EQ(pthread_sigmask(SIG_SETMASK, NULL, &mask_before), 0);
+  TaskLaunchRequest* request = MakeRequest(1, "/bin/sh");
+  request->argv.push_back("-c");
+  request->argv.push_back("kill -USR1 $$; exit 0");
+  pid_t pid = TaskLauncher::Spawn(*request);
+  delete request;
+  CHECK_GT(pid, 0);
+  sigset_t mask_after;
+  CHECK_EQ(pthread_sigmask(SIG_SETMASK, NULL, &mask_after), 0);
+  for (int sig = 1; sig < NSIG; ++sig) {
+    CHECK_EQ(sigismember(&mask_before, sig), sigismember(&mask_after, sig))
+      << "Mask of signal " << sig << " changed";
+  }
+  int status;
+  CHECK_EQ(waitpid(pid, &status, 0), pid);
+  CHECK_EQ(sigaction(SIGUSR1, &old_action, NULL), 0);
+  // The task would exit normally if it had inherited SIG_IGN.
+  CHECK(WIFSIGNALED(status));
+  CHECK_EQ(WTERMSIG(status), SIGUSR1);
+}
+
+}  // namespace executor
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,273 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Resource usage collector for the tasks run by a local executor.
+
+#include "engine/executors/task_usage_collector.h"
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+}
+
+#include "base/units.h"
+#include "misc/map-util.h"
+
+namespace firmament {
+namespace executor {
+
+using platform_unix::ProcFSScanner;
+
+// Writes a string to a cgroup control file.
+static bool WriteCgroupFile(const string& path, const string& value) {
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool success = write(fd, value.data(), value.size()) ==
+    static_cast<ssize_t>(value.size());
+  CHECK_EQ(close(fd), 0);
+  return success;
+}
+
+TaskUsageCollector::TaskUsageCollector(const string& cgroup_root)
+  : cgroup_root_(cgroup_root),
+    cgroups_enabled_(false),
+    procfs_monitor_(0) {
+  if (cgroup_root_.empty())
+    return;
+  string parent = cgroup_root_.substr(0, cgroup_root_.rfind('/'));
+  struct statfs fs;
+  if (statfs(parent.c_str(), &fs) != 0 || fs.f_type != CGROUP2_SUPER_MAGIC) {
+    LOG(INFO) << parent << " is not a cgroup v2 hierarchy; sampling task "
+              << "usage from ProcFS.";
+    return;
+  }
+  if (mkdir(cgroup_root_.c_str(), 0755) != 0 && errno != EEXIST) {
+    PLOG(INFO) << "Cannot create " << cgroup_root_ << "; sampling task "
+               << "usage from ProcFS";
+    return;
+  }
+  if (access((cgroup_root_ + "/cgroup.procs").c_str(), W_OK) != 0) {
+    LOG(INFO) << cgroup_root_ << " is not writable; sampling task usage "
+              << "from ProcFS.";
+    return;
+  }
+  // The controllers must be enabled on every level above the task cgroups.
+  EnableControllers(parent);
+  EnableControllers(cgroup_root_);
+  cgroups_enabled_ = true;
+  LOG(INFO) << "Tasks are accounted in cgroups under " << cgroup_root_;
+}
+
+TaskUsageCollector::~TaskUsageCollector() {
+  for (auto& task : tasks_) {
+    delete task.second;
+  }
+  tasks_.clear();
+}
+
+string TaskUsageCollector::AddTask(TaskID_t task_id) {
+  TaskUsage* usage = new TaskUsage;
+  usage->task_id = task_id;
+  usage->pid = 0;
+  usage->last_cpu_usec = 0;
+  usage->last_timestamp = 0;
+  if (cgroups_enabled_) {
+    string cgroup_path = cgroup_root_ + "/task-" + to_string(task_id);
+    if (mkdir(cgroup_path.c_str(), 0755) == 0 || errno == EEXIST) {
+      usage->cgroup_path = cgroup_path;
+      usage->cpu_stat.SetPath(cgroup_path + "/cpu.stat");
+      usage->memory_current.SetPath(cgroup_path + "/memory.current");
+      usage->io_stat.SetPath(cgroup_path + "/io.stat");
+    } else {
+      PLOG(WARNING) << "Failed to create cgroup for task " << task_id
+                    << "; sampling its usage from ProcFS";
+    }
+  }
+  boost::lock_guard<boost::mutex> lock(tasks_lock_);
+  TaskUsage** existing = FindOrNull(tasks_, task_id);
+  if (existing) {
+    // The task is being restarted
+    delete *existing;
+    *existing = usage;
+  } else {
+    CHECK(InsertIfNotPresent(&tasks_, task_id, usage));
+  }
+  if (usage->cgroup_path.empty())
+    return "";
+  return usage->cgroup_path + "/cgroup.procs";
+}
+
+void TaskUsageCollector::CollectTaskStats(uint64_t timestamp,
+                                          vector<TaskStats>* task_stats) {
+  boost::lock_guard<boost::mutex> lock(tasks_lock_);
+  procfs_pids_.clear();
+  procfs_tasks_.clear();
+  for (auto& task : tasks_) {
+    TaskUsage* usage = task.second;
+    if (usage->cgroup_path.empty()) {
+      // Sampled in a single ProcFS pass below
+      if (usage->pid != 0) {
+        procfs_pids_.push_back(usage->pid);
+        procfs_tasks_.push_back(usage);
+      }
+      continue;
+    }
+    task_stats->push_back(TaskStats());
+    TaskStats* stats = &task_stats->back();
+    stats->set_task_id(task.first);
+    stats->set_timestamp(timestamp);
+    uint64_t cpu_usec;
+    // usage_usec includes the CPU time of all processes in the cgroup
+    if (ReadCgroupStats(usage, stats, &cpu_usec))
+      SetCPUUsage(cpu_usec, timestamp, usage, stats);
+  }
+  // Also run with no PIDs, so that the files of exited tasks get closed
+  procfs_monitor_.ProcessInformation(procfs_pids_, &procfs_stats_);
+  uint64_t page_size = procfs_monitor_.page_size();
+  uint64_t ticks_per_sec = procfs_monitor_.ticks_per_sec();
+  for (uint64_t i = 0; i < procfs_pids_.size(); ++i) {
+    const ProcFSMonitor::ProcessStatistics_t& proc_stats = procfs_stats_[i];
+    // The process has already exited
+    if (proc_stats.pid == 0)
+      continue;
+    TaskUsage* usage = procfs_tasks_[i];
+    task_stats->push_back(TaskStats());
+    TaskStats* stats = &task_stats->back();
+    stats->set_task_id(usage->task_id);
+    stats->set_timestamp(timestamp);
+    stats->set_mem_usage(proc_stats.rss * page_size / BYTES_TO_KB);
+    stats->set_mem_rss(proc_stats.rss * page_size / BYTES_TO_KB);
+    stats->set_mem_page_faults(proc_stats.minflt + proc_stats.majflt);
+    stats->set_major_page_faults(proc_stats.majflt);
+    uint64_t cpu_ticks = proc_stats.utime + proc_stats.stime +
+      proc_stats.cutime + proc_stats.cstime;
+    SetCPUUsage(cpu_ticks * SECONDS_TO_MICROSECONDS / ticks_per_sec,
+                timestamp, usage, stats);
+  }
+}
+
+void TaskUsageCollector::EnableControllers(const string& cgroup_path) {
+  // Each controller is enabled separately, as the write fails as a whole if
+  // any of them is unavailable. Failures are tolerated: cpu.stat is present
+  // without the cpu controller, and missing files are skipped when sampling.
+  const char* controllers[] = {"+cpu", "+memory", "+io"};
+  for (const char* controller : controllers) {
+    if (!WriteCgroupFile(cgroup_path + "/cgroup.subtree_control",
+                         controller)) {
+      VLOG(1) << "Failed to enable " << controller << " controller in "
+              << cgroup_path;
+    }
+  }
+}
+
+bool TaskUsageCollector::ReadCgroupStats(TaskUsage* usage, TaskStats* stats,
+                                         uint64_t* cpu_usec) {
+  bool found_cpu_usage = false;
+  size_t len;
+  const char* data = usage->cpu_stat.Read(NULL);
+  if (data) {
+    ProcFSScanner scanner(data);
+    const char* key;
+    while ((key = scanner.NextToken(&len)) != NULL) {
+      uint64_t value;
+      if (scanner.NextUInt64(&value) && len == 10 &&
+          strncmp(key, "usage_usec", len) == 0) {
+        *cpu_usec = value;
+        found_cpu_usage = true;
+        break;
+      }
+      scanner.SkipLine();
+    }
+  }
+  data = usage->memory_current.Read(NULL);
+  if (data) {
+    uint64_t bytes;
+    ProcFSScanner scanner(data);
+    if (scanner.NextUInt64(&bytes))
+      stats->set_mem_usage(bytes / BYTES_TO_KB);
+  }
+  data = usage->io_stat.Read(NULL);
+  if (data) {
+    // One line per device: "MAJ:MIN rbytes=N wbytes=N rios=N wios=N ..."
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+    ProcFSScanner scanner(data);
+    const char* token;
+    while ((token = scanner.NextToken(&len)) != NULL) {
+      uint64_t value;
+      if (len > 7 && strncmp(token, "rbytes=", 7) == 0) {
+        ProcFSScanner value_scanner(token + 7);
+        if (value_scanner.NextUInt64(&value))
+          read_bytes += value;
+      } else if (len > 7 && strncmp(token, "wbytes=", 7) == 0) {
+        ProcFSScanner value_scanner(token + 7);
+        if (value_scanner.NextUInt64(&value))
+          write_bytes += value;
+      }
+    }
+    stats->set_disk_read(read_bytes / BYTES_TO_KB);
+    stats->set_disk_write(write_bytes / BYTES_TO_KB);
+  }
+  return found_cpu_usage;
+}
+
+void TaskUsageCollector::RemoveTask(TaskID_t task_id) {
+  boost::lock_guard<boost::mutex> lock(tasks_lock_);
+  TaskUsage** usage = FindOrNull(tasks_, task_id);
+  if (!usage)
+    return;
+  if (!(*usage)->cgroup_path.empty()) {
+    // Kill any processes that the task left behind (Linux 5.14+); rmdir
+    // fails while the cgroup still has members.
+    WriteCgroupFile((*usage)->cgroup_path + "/cgroup.kill", "1");
+    if (rmdir((*usage)->cgroup_path.c_str()) != 0) {
+      PLOG(WARNING) << "Failed to remove cgroup " << (*usage)->cgroup_path;
+    }
+  }
+  delete *usage;
+  tasks_.erase(task_id);
+}
+
+void TaskUsageCollector::SetCPUUsage(uint64_t cpu_usec, uint64_t timestamp,
+                                     TaskUsage* usage, TaskStats* stats) {
+  if (usage->last_timestamp != 0 && timestamp > usage->last_timestamp &&
+      cpu_usec >= usage->last_cpu_usec) {
+    // CPU usage in millicores over the interval since the previous sample
+    stats->set_cpu_usage((cpu_usec - usage->last_cpu_usec) * 1000 /
+                         (timestamp - usage->last_timestamp));
+  }
+  usage->last_cpu_usec = cpu_usec;
+  usage->last_timestamp = timestamp;
+}
+
+void TaskUsageCollector::SetTaskPID(TaskID_t task_id, pid_t pid) {
+  boost::lock_guard<boost::mutex> lock(tasks_lock_);
+  TaskUsage** usage = FindOrNull(tasks_, task_id);
+  if (usage)
+    (*usage)->pid = pid;
+}
+
+}  // namespace executor
+}  // namespace firmament
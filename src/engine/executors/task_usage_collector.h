@@ -0,0 +1,131 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Resource usage collector for the tasks run by a local executor. Each task
+// is placed in its own cgroup v2 subtree if the cgroup root is writable, and
+// the usage of all tasks is sampled in one sweep over their cgroups'
+// cpu.stat, memory.current and io.stat files. Otherwise, the collector falls
+// back to sampling the tasks' process trees from ProcFS.
+
+#ifndef FIRMAMENT_ENGINE_EXECUTORS_TASK_USAGE_COLLECTOR_H
+#define FIRMAMENT_ENGINE_EXECUTORS_TASK_USAGE_COLLECTOR_H
+
+#include <string>
+#include <vector>
+
+#ifdef __PLATFORM_HAS_BOOST__
+#include <boost/thread.hpp>
+#else
+#error Boost not available!
+#endif
+
+#include "base/common.h"
+#include "base/types.h"
+#include "base/task_stats.pb.h"
+#include "platforms/unix/procfs_monitor.h"
+#include "platforms/unix/procfs_reader.h"
+
+namespace firmament {
+namespace executor {
+
+using platform_unix::ProcFSFile;
+using platform_unix::ProcFSMonitor;
+
+class TaskUsageCollector {
+ public:
+  /**
+   * @param cgroup_root cgroup v2 directory under which the per-task cgroups
+   * are created; created if it does not exist. Cgroups are not used if the
+   * path is empty or not writable.
+   */
+  explicit TaskUsageCollector(const string& cgroup_root);
+  ~TaskUsageCollector();
+
+  /**
+   * Starts tracking a task, creating its cgroup if cgroups are enabled.
+   * @param task_id the ID of the task
+   * @return the path of the cgroup.procs file that the task's process must
+   * write "0" to before it execs, or an empty string if the task is tracked
+   * via ProcFS
+   */
+  string AddTask(TaskID_t task_id);
+
+  /**
+   * Sets the PID of a task's root process, used when sampling from ProcFS.
+   * @param task_id the ID of the task
+   * @param pid the PID of the task's root process
+   */
+  void SetTaskPID(TaskID_t task_id, pid_t pid);
+
+  /**
+   * Stops tracking a task. Any processes left in the task's cgroup are
+   * killed, and the cgroup is removed.
+   * @param task_id the ID of the task
+   */
+  void RemoveTask(TaskID_t task_id);
+
+  /**
+   * Samples the resource usage of all tracked tasks in one sweep.
+   * @param timestamp the current time, in microseconds
+   * @param task_stats vector to which one sample per task is appended
+   */
+  void CollectTaskStats(uint64_t timestamp, vector<TaskStats>* task_stats);
+
+  inline bool cgroups_enabled() const {
+    return cgroups_enabled_;
+  }
+
+ private:
+  FRIEND_TEST(TaskUsageCollectorTest, SamplesCgroupFiles);
+  struct TaskUsage {
+    TaskID_t task_id;
+    pid_t pid;
+    // Empty if the task is tracked via ProcFS
+    string cgroup_path;
+    ProcFSFile cpu_stat;
+    ProcFSFile memory_current;
+    ProcFSFile io_stat;
+    // CPU time used by the task up to the previous sample, in microseconds
+    uint64_t last_cpu_usec;
+    uint64_t last_timestamp;
+  };
+
+  void EnableControllers(const string& cgroup_path);
+  bool ReadCgroupStats(TaskUsage* usage, TaskStats* stats, uint64_t* cpu_usec);
+  void SetCPUUsage(uint64_t cpu_usec, uint64_t timestamp, TaskUsage* usage,
+                   TaskStats* stats);
+
+  const string cgroup_root_;
+  bool cgroups_enabled_;
+  // Protects tasks_, which is updated by the executor's task handler threads
+  // while the coordinator samples it.
+  boost::mutex tasks_lock_;
+  unordered_map<TaskID_t, TaskUsage*> tasks_;
+  ProcFSMonitor procfs_monitor_;
+  // Buffers reused across ProcFS sampling passes
+  vector<pid_t> procfs_pids_;
+  vector<TaskUsage*> procfs_tasks_;
+  vector<ProcFSMonitor::ProcessStatistics_t> procfs_stats_;
+};
+
+}  // namespace executor
+}  // namespace firmament
+
+#endif  // FIRMAMENT_ENGINE_EXECUTORS_TASK_USAGE_COLLECTOR_H
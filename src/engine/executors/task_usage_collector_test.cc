@@ -0,0 +1,136 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Task usage collector tests.
+
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/common.h"
+#include "engine/executors/task_usage_collector.h"
+#include "misc/map-util.h"
+
+namespace firmament {
+namespace executor {
+
+using std::ofstream;
+
+static void WriteFile(const string& path, const string& contents) {
+  ofstream file(path.c_str());
+  file << contents;
+  file.close();
+}
+
+// Tests that the ProcFS fallback samples a running task's process and stops
+// reporting it once it has been removed.
+TEST(TaskUsageCollectorTest, ProcFSFallback) {
+  // An empty cgroup root disables cgroups
+  TaskUsageCollector collector("");
+  CHECK(!collector.cgroups_enabled());
+  pid_t pid = fork();
+  CHECK_GE(pid, 0);
+  if (pid == 0) {
+    // Child: spin until killed
+    while (true) {
+    }
+  }
+  CHECK_EQ(collector.AddTask(42), "");
+  collector.SetTaskPID(42, pid);
+  vector<TaskStats> task_stats;
+  collector.CollectTaskStats(1000000, &task_stats);
+  usleep(200000);
+  collector.CollectTaskStats(1200000, &task_stats);
+  CHECK_EQ(task_stats.size(), 2);
+  CHECK_EQ(task_stats[1].task_id(), 42);
+  CHECK_GT(task_stats[1].mem_usage(), 0);
+  // The child spins on a core, so it used some CPU in the interval
+  CHECK_GT(task_stats[1].cpu_usage(), 0);
+  collector.RemoveTask(42);
+  task_stats.clear();
+  collector.CollectTaskStats(1400000, &task_stats);
+  CHECK_EQ(task_stats.size(), 0);
+  CHECK_EQ(kill(pid, SIGKILL), 0);
+  CHECK_EQ(waitpid(pid, NULL, 0), pid);
+}
+
+// Tests that a task accounted in a cgroup v2 is sampled from its cpu.stat,
+// memory.current and io.stat files. The files are written to a temporary
+// directory, as the test cannot rely on having a writable cgroup hierarchy.
+TEST(TaskUsageCollectorTest, SamplesCgroupFiles) {
+  char cgroup_dir[] = "/tmp/task_usage_collector_test_XXXXXX";
+  CHECK_NOTNULL(mkdtemp(cgroup_dir));
+  string cgroup_path = cgroup_dir;
+  TaskUsageCollector collector("");
+  TaskUsageCollector::TaskUsage* usage = new TaskUsageCollector::TaskUsage;
+  usage->task_id = 42;
+  usage->pid = 0;
+  usage->cgroup_path = cgroup_path;
+  usage->cpu_stat.SetPath(cgroup_path + "/cpu.stat");
+  usage->memory_current.SetPath(cgroup_path + "/memory.current");
+  usage->io_stat.SetPath(cgroup_path + "/io.stat");
+  usage->last_cpu_usec = 0;
+  usage->last_timestamp = 0;
+  CHECK(InsertIfNotPresent(&collector.tasks_, 42, usage));
+  WriteFile(cgroup_path + "/cpu.stat",
+            "usage_usec 1000000\nuser_usec 600000\nsystem_usec 400000\n");
+  WriteFile(cgroup_path + "/memory.current", "8388608\n");
+  WriteFile(cgroup_path + "/io.stat",
+            "8:0 rbytes=1048576 wbytes=2048 rios=10 wios=1 dbytes=0 dios=0\n"
+            "8:16 rbytes=1024 wbytes=1024 rios=1 wios=1 dbytes=0 dios=0\n");
+  vector<TaskStats> task_stats;
+  collector.CollectTaskStats(1000000, &task_stats);
+  CHECK_EQ(task_stats.size(), 1);
+  CHECK_EQ(task_stats[0].task_id(), 42);
+  CHECK_EQ(task_stats[0].timestamp(), 1000000);
+  CHECK_EQ(task_stats[0].mem_usage(), 8192);
+  CHECK_EQ(task_stats[0].disk_read(), 1025);
+  CHECK_EQ(task_stats[0].disk_write(), 3);
+  // The CPU usage is a rate, so the first sample has none
+  CHECK_EQ(task_stats[0].cpu_usage(), 0);
+  // The task used half a core over the next 200ms
+  WriteFile(cgroup_path + "/cpu.stat",
+            "usage_usec 1100000\nuser_usec 650000\nsystem_usec 450000\n");
+  WriteFile(cgroup_path + "/memory.current", "4194304\n");
+  collector.CollectTaskStats(1200000, &task_stats);
+  CHECK_EQ(task_stats.size(), 2);
+  CHECK_EQ(task_stats[1].cpu_usage(), 500);
+  CHECK_EQ(task_stats[1].mem_usage(), 4096);
+  // Removing the task does not touch the directory: the cgroup.kill write
+  // and the rmdir fail, as it is not a cgroup.
+  collector.RemoveTask(42);
+  boost::filesystem::remove_all(cgroup_path);
+}
+
+}  // namespace executor
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -32,8 +32,12 @@ namespace firmament {
 namespace machine {
 namespace topology {
 
+boost::mutex TopologyManager::topology_cache_lock_;
+hwloc_topology_t TopologyManager::local_topology_ = NULL;
+map<string, ResourceTopologyNodeDescriptor>
+  TopologyManager::synthetic_topologies_;
+
 TopologyManager::TopologyManager() {
-  hwloc_topology_init(&topology_);
   VLOG(1) << "Topology manager initialized.";
 
   LoadAndParseTopology();
@@ -48,7 +52,7 @@ void TopologyManager::AsProtobuf(hwloc_topology_t topology,
   ResourceDescriptor* root_resource = topology_pb->mutable_resource_desc();
   root_resource->set_type(ResourceDescriptor::RESOURCE_MACHINE);
   hwloc_obj_t root_obj = hwloc_get_root_obj(topology);
-  MakeProtobufTree(topology, root_obj, topology_pb, NULL);
+  MakeProtobufTree(topology, root_obj, topology_pb, NULL, true);
   VLOG(3) << topology_pb->DebugString();
 }
 
@@ -91,9 +95,14 @@ bool TopologyManager::BindSelfToResource(ResourceID_t res_id) {
 }
 
 void TopologyManager::LoadAndParseTopology() {
-  VLOG(1) << "Analyzing machine topology...";
-  // library call to perform topology detection
-  hwloc_topology_load(topology_);
+  boost::lock_guard<boost::mutex> lock(topology_cache_lock_);
+  if (!local_topology_) {
+    VLOG(1) << "Analyzing machine topology...";
+    hwloc_topology_init(&local_topology_);
+    // library call to perform topology detection
+    hwloc_topology_load(local_topology_);
+  }
+  topology_ = local_topology_;
   topology_depth_ = hwloc_topology_get_depth(topology_);
 }
 
@@ -114,6 +123,39 @@ uint32_t TopologyManager::LoadAndParseSyntheticTopology(
 #endif
 }
 
+void TopologyManager::SyntheticTopologyAsProtobuf(
+    const string& topology_desc,
+    ResourceTopologyNodeDescriptor* topology_pb) {
+  bool cached = false;
+  {
+    boost::lock_guard<boost::mutex> lock(topology_cache_lock_);
+    const ResourceTopologyNodeDescriptor* cached_pb =
+      FindOrNull(synthetic_topologies_, topology_desc);
+    if (cached_pb) {
+      topology_pb->CopyFrom(*cached_pb);
+      cached = true;
+    }
+  }
+  if (!cached) {
+    // First use of this description, so build the tree using hwloc. The
+    // hwloc objects are not tracked, since the topology is discarded.
+    ResourceTopologyNodeDescriptor tmpl_pb;
+    hwloc_topology_t topology;
+    hwloc_topology_init(&topology);
+    LoadAndParseSyntheticTopology(topology_desc, topology);
+    tmpl_pb.mutable_resource_desc()->set_type(
+        ResourceDescriptor::RESOURCE_MACHINE);
+    MakeProtobufTree(topology, hwloc_get_root_obj(topology), &tmpl_pb, NULL,
+                     false);
+    hwloc_topology_destroy(topology);
+    topology_pb->CopyFrom(tmpl_pb);
+    boost::lock_guard<boost::mutex> lock(topology_cache_lock_);
+    InsertIfNotPresent(&synthetic_topologies_, topology_desc, tmpl_pb);
+  }
+  // Every caller gets its own resource IDs
+  RegenerateUUIDs(topology_pb, "");
+}
+
 vector<ResourceDescriptor> TopologyManager::FlatResourceSet() {
   // N.B.: This only returns resources corresponding to the CPU cores available
   // on the machine, and does not relate them in any kind of hierarchy.
@@ -134,18 +176,21 @@ void TopologyManager::MakeProtobufTree(
     hwloc_topology_t topology,
     hwloc_obj_t node,
     ResourceTopologyNodeDescriptor* obj_pb,
-    ResourceTopologyNodeDescriptor* parent_pb) {
+    ResourceTopologyNodeDescriptor* parent_pb,
+    bool track_objects) {
   char obj_string[128];
   // Add this object
   hwloc_obj_snprintf(obj_string, sizeof(obj_string), topology, node, " #", 0);
   const ResourceID_t* res_id = FindOrNull(obj_to_resourceID_, node);
   string obj_id;
-  if (!res_id) {
+  if (!res_id || !track_objects) {
     // If this object is not already known, we generate a new resource ID.
     ResourceID_t new_rid = GenerateResourceID();
     obj_id = to_string(new_rid);
-    InsertIfNotPresent(&obj_to_resourceID_, node, new_rid);
-    InsertIfNotPresent(&resourceID_to_obj_, new_rid, node);
+    if (track_objects) {
+      InsertIfNotPresent(&obj_to_resourceID_, node, new_rid);
+      InsertIfNotPresent(&resourceID_to_obj_, new_rid, node);
+    }
   } else {
     obj_id = to_string(*res_id);
   }
@@ -165,7 +210,7 @@ void TopologyManager::MakeProtobufTree(
     hwloc_obj_t next_child_obj = hwloc_get_next_child(topology, node,
                                                       prev_child_obj);
     ResourceTopologyNodeDescriptor* child = obj_pb->add_children();
-    MakeProtobufTree(topology, next_child_obj, child, obj_pb);
+    MakeProtobufTree(topology, next_child_obj, child, obj_pb, track_objects);
     prev_child_obj = next_child_obj;
   }
 }
@@ -181,6 +226,17 @@ uint32_t TopologyManager::NumProcessingUnits() const {
   return count;
 }
 
+void TopologyManager::RegenerateUUIDs(ResourceTopologyNodeDescriptor* rtnd,
+                                      const string& parent_id) {
+  rtnd->mutable_resource_desc()->set_uuid(to_string(GenerateResourceID()));
+  if (!parent_id.empty()) {
+    rtnd->set_parent_id(parent_id);
+  }
+  for (auto& child : *rtnd->mutable_children()) {
+    RegenerateUUIDs(&child, rtnd->resource_desc().uuid());
+  }
+}
+
 ResourceDescriptor::ResourceType TopologyManager::TranslateHwlocType(
     hwloc_obj_type_t obj_type) const {
   switch (obj_type) {
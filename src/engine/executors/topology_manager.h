@@ -37,6 +37,12 @@ extern "C" {
 #include <hwloc.h>
 }
 
+#ifdef __PLATFORM_HAS_BOOST__
+#include <boost/thread/mutex.hpp>
+#else
+#error Boost not available!
+#endif
+
 #include "base/common.h"
 #include "base/types.h"
 #include "base/resource_desc.pb.h"
@@ -58,6 +64,15 @@ class TopologyManager {
   void LoadAndParseTopology();
   uint32_t LoadAndParseSyntheticTopology(const string& topology_desc,
                                          hwloc_topology_t topology);
+  /**
+   * Generates the resource tree of a synthetic machine. hwloc is only used
+   * the first time a description is seen; the resulting tree is cached and
+   * later calls clone it with fresh UUIDs.
+   * @param topology_desc hwloc synthetic topology description
+   * @param topology_pb the resource tree to replace with the machine's tree
+   */
+  void SyntheticTopologyAsProtobuf(const string& topology_desc,
+                                   ResourceTopologyNodeDescriptor* topology_pb);
   void DebugPrintRawTopology();
   uint32_t NumProcessingUnits() const;
 
@@ -66,7 +81,10 @@ class TopologyManager {
   void MakeProtobufTree(hwloc_topology_t topology,
                         hwloc_obj_t node,
                         ResourceTopologyNodeDescriptor* obj_pb,
-                        ResourceTopologyNodeDescriptor* parent_pb);
+                        ResourceTopologyNodeDescriptor* parent_pb,
+                        bool track_objects);
+  void RegenerateUUIDs(ResourceTopologyNodeDescriptor* rtnd,
+                       const string& parent_id);
   ResourceDescriptor::ResourceType TranslateHwlocType(
       hwloc_obj_type_t obj_type) const;
   // Local fields holding topology information
@@ -75,6 +93,12 @@ class TopologyManager {
   uint32_t topology_depth_;
   map<hwloc_obj_t, ResourceID_t> obj_to_resourceID_;
   map<ResourceID_t, hwloc_obj_t> resourceID_to_obj_;
+  // The local machine's topology is only detected once per process and
+  // shared by all topology managers; hwloc allows concurrent read-only use.
+  static boost::mutex topology_cache_lock_;
+  static hwloc_topology_t local_topology_;
+  // Resource trees of synthetic topologies, keyed by their description
+  static map<string, ResourceTopologyNodeDescriptor> synthetic_topologies_;
 };
 
 }  // namespace topology
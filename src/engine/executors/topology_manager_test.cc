@@ -85,6 +85,69 @@ TEST_F(TopologyManagerTest, ParseSyntheticTopology) {
   fclose(fd);
 }
 
+// Tests that synthetic machines generated from the same description have the
+// same structure, but distinct and consistently linked resource IDs.
+TEST_F(TopologyManagerTest, CachedSyntheticTopology) {
+  TopologyManager t;
+  string topo_description = "NUMANode:2 Socket:2 Cache:3 Core:1 PU:2";
+  ResourceTopologyNodeDescriptor machine1;
+  ResourceTopologyNodeDescriptor machine2;
+  // The first call builds the tree with hwloc, the second clones it
+  t.SyntheticTopologyAsProtobuf(topo_description, &machine1);
+  t.SyntheticTopologyAsProtobuf(topo_description, &machine2);
+  vector<const ResourceTopologyNodeDescriptor*> nodes1;
+  vector<const ResourceTopologyNodeDescriptor*> nodes2;
+  nodes1.push_back(&machine1);
+  nodes2.push_back(&machine2);
+  unordered_set<string> uuids;
+  while (!nodes1.empty()) {
+    const ResourceTopologyNodeDescriptor* node1 = nodes1.back();
+    const ResourceTopologyNodeDescriptor* node2 = nodes2.back();
+    nodes1.pop_back();
+    nodes2.pop_back();
+    CHECK_EQ(node1->resource_desc().type(), node2->resource_desc().type());
+    CHECK_EQ(node1->children_size(), node2->children_size());
+    CHECK(uuids.insert(node1->resource_desc().uuid()).second);
+    CHECK(uuids.insert(node2->resource_desc().uuid()).second);
+    for (int32_t i = 0; i < node1->children_size(); ++i) {
+      CHECK_EQ(node1->children(i).parent_id(), node1->resource_desc().uuid());
+      CHECK_EQ(node2->children(i).parent_id(), node2->resource_desc().uuid());
+      nodes1.push_back(&node1->children(i));
+      nodes2.push_back(&node2->children(i));
+    }
+  }
+  // 1 machine, 2 NUMA nodes, 4 sockets, 12 caches, 12 cores and 24 PUs each
+  CHECK_EQ(uuids.size(), 2 * 55);
+}
+
+// Tests that many machines cloned from the cache, as a simulated cluster
+// builds them, all get resource IDs of their own.
+TEST_F(TopologyManagerTest, ManyMachinesFromCachedSyntheticTopology) {
+  TopologyManager t;
+  const uint32_t kNumMachines = 1000;
+  string topo_description = "node:2 core:6 pu:1";
+  unordered_set<string> uuids;
+  uint32_t num_pus = 0;
+  for (uint32_t i = 0; i < kNumMachines; ++i) {
+    ResourceTopologyNodeDescriptor machine;
+    t.SyntheticTopologyAsProtobuf(topo_description, &machine);
+    vector<const ResourceTopologyNodeDescriptor*> nodes(1, &machine);
+    while (!nodes.empty()) {
+      const ResourceTopologyNodeDescriptor* node = nodes.back();
+      nodes.pop_back();
+      CHECK(uuids.insert(node->resource_desc().uuid()).second);
+      if (node->resource_desc().type() == ResourceDescriptor::RESOURCE_PU) {
+        ++num_pus;
+      }
+      for (int32_t j = 0; j < node->children_size(); ++j) {
+        CHECK_EQ(node->children(j).parent_id(), node->resource_desc().uuid());
+        nodes.push_back(&node->children(j));
+      }
+    }
+  }
+  CHECK_EQ(num_pus, kNumMachines * 12);
+}
+
 // Tests that we can parse a synthetic topology.
 TEST_F(TopologyManagerTest, GetNumPUs) {
   FLAGS_v = 2;
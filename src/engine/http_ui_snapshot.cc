@@ -0,0 +1,126 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Snapshots of the lists served by the coordinator's HTTP UI.
+
+#include "engine/http_ui_snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace firmament {
+namespace webui {
+
+uint64_t HashListEntry(const JobListEntry& entry) {
+  size_t hash = 0;
+  boost::hash_combine(hash, entry.id);
+  boost::hash_combine(hash, entry.name);
+  boost::hash_combine(hash, entry.state);
+  boost::hash_combine(hash, entry.root_task_id);
+  return hash;
+}
+
+uint64_t HashListEntry(const TaskListEntry& entry) {
+  size_t hash = 0;
+  boost::hash_combine(hash, entry.id);
+  boost::hash_combine(hash, entry.job_id);
+  boost::hash_combine(hash, entry.name);
+  boost::hash_combine(hash, entry.state);
+  return hash;
+}
+
+uint64_t HashListEntry(const ResourceListEntry& entry) {
+  size_t hash = 0;
+  boost::hash_combine(hash, entry.id);
+  boost::hash_combine(hash, entry.name);
+  boost::hash_combine(hash, entry.state);
+  boost::hash_combine(hash, entry.schedulable);
+  return hash;
+}
+
+void AppendJSONString(const string& str, string* output) {
+  output->push_back('"');
+  for (auto c : str) {
+    switch (c) {
+      case '"':
+        output->append("\\\"");
+        break;
+      case '\\':
+        output->append("\\\\");
+        break;
+      case '\n':
+        output->append("\\n");
+        break;
+      case '\r':
+        output->append("\\r");
+        break;
+      case '\t':
+        output->append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          output->append(escaped);
+        } else {
+          output->push_back(c);
+        }
+    }
+  }
+  output->push_back('"');
+}
+
+void AppendJSONListEntry(const JobListEntry& entry, string* output) {
+  AppendJSONString(entry.name, output);
+  output->append(": ");
+  AppendJSONString(entry.id, output);
+}
+
+void AppendJSONListEntry(const TaskListEntry& entry, string* output) {
+  output->append(to_string(entry.id));
+}
+
+void AppendJSONListEntry(const ResourceListEntry& entry, string* output) {
+  output->append("{\"id\": ");
+  AppendJSONString(entry.id, output);
+  output->append(", \"name\": ");
+  AppendJSONString(entry.name, output);
+  output->append(", \"state\": ");
+  AppendJSONString(entry.state, output);
+  output->append(entry.schedulable ? ", \"schedulable\": true}"
+                                   : ", \"schedulable\": false}");
+}
+
+void PageBounds(const string& offset_param, const string& limit_param,
+                uint64_t num_entries, uint64_t* begin, uint64_t* end) {
+  uint64_t offset = strtoull(offset_param.c_str(), NULL, 10);
+  uint64_t limit = strtoull(limit_param.c_str(), NULL, 10);
+  *begin = min(offset, num_entries);
+  if (limit == 0 || limit > num_entries - *begin) {
+    *end = num_entries;
+  } else {
+    *end = *begin + limit;
+  }
+}
+
+}  // namespace webui
+}  // namespace firmament
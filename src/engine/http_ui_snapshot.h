@@ -0,0 +1,245 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Immutable, versioned snapshots of the lists served by the coordinator's
+// HTTP UI, so that polling clients do not walk the coordinator's maps on
+// every request.
+
+#ifndef FIRMAMENT_ENGINE_HTTP_UI_SNAPSHOT_H
+#define FIRMAMENT_ENGINE_HTTP_UI_SNAPSHOT_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef __PLATFORM_HAS_BOOST__
+#include <boost/function.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
+#else
+#error Boost not available!
+#endif
+
+#include "base/common.h"
+#include "base/types.h"
+#include "misc/time_interface.h"
+
+namespace firmament {
+namespace webui {
+
+struct JobListEntry {
+  string id;
+  string name;
+  string state;
+  TaskID_t root_task_id;
+};
+
+struct TaskListEntry {
+  TaskID_t id;
+  string job_id;
+  string name;
+  string state;
+};
+
+struct ResourceListEntry {
+  string id;
+  string name;
+  string state;
+  bool schedulable;
+};
+
+uint64_t HashListEntry(const JobListEntry& entry);
+uint64_t HashListEntry(const TaskListEntry& entry);
+uint64_t HashListEntry(const ResourceListEntry& entry);
+
+/**
+ * Appends the JSON string literal for a string, including quotes, to output.
+ * @param str the string to encode
+ * @param output the string to append to
+ */
+void AppendJSONString(const string& str, string* output);
+
+/**
+ * Appends the JSON encoding of a list entry to output.
+ * @param entry the entry to encode
+ * @param output the string to append to
+ */
+void AppendJSONListEntry(const JobListEntry& entry, string* output);
+void AppendJSONListEntry(const TaskListEntry& entry, string* output);
+void AppendJSONListEntry(const ResourceListEntry& entry, string* output);
+
+// An immutable view of a list. The version only changes when the contents
+// of the list do, so it doubles as an HTTP entity tag.
+template<typename T>
+struct ListSnapshot {
+  uint64_t version;
+  uint64_t fingerprint;
+  vector<T> entries;
+
+  string etag() const {
+    return "\"" + to_string(version) + "-" + to_string(fingerprint) + "\"";
+  }
+};
+
+/**
+ * Holds the most recent snapshot of a list and rebuilds it once it is older
+ * than the maximum age. Only one caller rebuilds at a time; concurrent
+ * callers are served the previous snapshot in the meantime.
+ */
+template<typename T>
+class SnapshotSlot {
+ public:
+  typedef boost::function<void(vector<T>*)> Builder;
+
+  SnapshotSlot(TimeInterface* time_manager, uint64_t max_age)
+    : time_manager_(time_manager), max_age_(max_age), last_build_(0) {
+  }
+
+  /**
+   * Gets a snapshot that is at most max_age microseconds old.
+   * @param builder callback that fills in the current list entries
+   * @return the snapshot
+   */
+  shared_ptr<const ListSnapshot<T> > Get(const Builder& builder) {
+    {
+      boost::lock_guard<boost::mutex> lock(snapshot_lock_);
+      if (snapshot_ && !Expired())
+        return snapshot_;
+    }
+    boost::unique_lock<boost::mutex> build_lock(build_lock_,
+                                                boost::try_to_lock);
+    if (!build_lock.owns_lock()) {
+      // Someone else is rebuilding; serve the old snapshot if there is one.
+      {
+        boost::lock_guard<boost::mutex> lock(snapshot_lock_);
+        if (snapshot_)
+          return snapshot_;
+      }
+      build_lock.lock();
+    }
+    {
+      // The snapshot may have been rebuilt while we waited for the lock
+      boost::lock_guard<boost::mutex> lock(snapshot_lock_);
+      if (snapshot_ && !Expired())
+        return snapshot_;
+    }
+    ListSnapshot<T>* snapshot = new ListSnapshot<T>;
+    builder(&snapshot->entries);
+    snapshot->fingerprint = snapshot->entries.size();
+    for (auto& entry : snapshot->entries) {
+      boost::hash_combine(snapshot->fingerprint, HashListEntry(entry));
+    }
+    boost::lock_guard<boost::mutex> lock(snapshot_lock_);
+    last_build_ = time_manager_->GetCurrentTimestamp();
+    if (snapshot_ && snapshot_->fingerprint == snapshot->fingerprint) {
+      // Unchanged; keep the old snapshot so that its version remains valid
+      delete snapshot;
+      return snapshot_;
+    }
+    snapshot->version = snapshot_ ? snapshot_->version + 1 : 1;
+    snapshot_.reset(snapshot);
+    return snapshot_;
+  }
+
+  /**
+   * Forces the next Get() to rebuild the snapshot.
+   */
+  void Invalidate() {
+    boost::lock_guard<boost::mutex> lock(snapshot_lock_);
+    last_build_ = 0;
+  }
+
+ private:
+  inline bool Expired() {
+    return time_manager_->GetCurrentTimestamp() >= last_build_ + max_age_;
+  }
+
+  TimeInterface* time_manager_;
+  uint64_t max_age_;
+  // Protects snapshot_ and last_build_
+  boost::mutex snapshot_lock_;
+  // Held while rebuilding the snapshot
+  boost::mutex build_lock_;
+  shared_ptr<const ListSnapshot<T> > snapshot_;
+  uint64_t last_build_;
+};
+
+/**
+ * Works out the range of list entries to serve from "offset" and "limit"
+ * query parameters. A missing or zero limit selects all remaining entries.
+ * @param offset_param the value of the offset parameter (may be empty)
+ * @param limit_param the value of the limit parameter (may be empty)
+ * @param num_entries the number of entries in the list
+ * @param begin set to the index of the first entry to serve
+ * @param end set to one past the index of the last entry to serve
+ */
+void PageBounds(const string& offset_param, const string& limit_param,
+                uint64_t num_entries, uint64_t* begin, uint64_t* end);
+
+/**
+ * Produces the JSON encoding of a range of a list snapshot in chunks of a
+ * bounded number of entries, so that a large list is never rendered into a
+ * single string.
+ */
+template<typename T>
+class JSONListChunker {
+ public:
+  JSONListChunker(shared_ptr<const ListSnapshot<T> > snapshot,
+                  uint64_t begin, uint64_t end, const string& open,
+                  const string& close, uint64_t entries_per_chunk)
+    : snapshot_(snapshot), begin_(begin), end_(end), pos_(begin),
+      open_(open), close_(close), entries_per_chunk_(entries_per_chunk) {
+    CHECK_GT(entries_per_chunk_, 0);
+  }
+
+  /**
+   * Produces the next chunk.
+   * @param chunk the string to append the chunk to
+   * @return true if more chunks follow
+   */
+  bool NextChunk(string* chunk) {
+    if (pos_ == begin_)
+      chunk->append(open_);
+    uint64_t chunk_end = min(end_, pos_ + entries_per_chunk_);
+    for (; pos_ < chunk_end; ++pos_) {
+      if (pos_ != begin_)
+        chunk->append(", ");
+      AppendJSONListEntry(snapshot_->entries[pos_], chunk);
+    }
+    if (pos_ < end_)
+      return true;
+    chunk->append(close_);
+    return false;
+  }
+
+ private:
+  shared_ptr<const ListSnapshot<T> > snapshot_;
+  uint64_t begin_;
+  uint64_t end_;
+  uint64_t pos_;
+  string open_;
+  string close_;
+  uint64_t entries_per_chunk_;
+};
+
+}  // namespace webui
+}  // namespace firmament
+
+#endif  // FIRMAMENT_ENGINE_HTTP_UI_SNAPSHOT_H
@@ -0,0 +1,158 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// HTTP UI snapshot tests.
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include "base/common.h"
+#include "engine/http_ui_snapshot.h"
+
+namespace firmament {
+namespace webui {
+
+// Time source whose clock only moves when told to.
+class ManualTime : public TimeInterface {
+ public:
+  ManualTime() : now_(0) {}
+  uint64_t GetCurrentTimestamp() {
+    return now_;
+  }
+  void UpdateCurrentTimestamp(uint64_t timestamp) {
+    now_ = timestamp;
+  }
+
+ private:
+  uint64_t now_;
+};
+
+class HTTPUISnapshotTest : public ::testing::Test {
+ public:
+  HTTPUISnapshotTest() : num_builds_(0) {}
+
+  void BuildTaskList(vector<TaskListEntry>* entries) {
+    num_builds_++;
+    for (auto& task_id : task_ids_) {
+      TaskListEntry entry;
+      entry.id = task_id;
+      entry.job_id = "job";
+      entry.name = "task" + to_string(task_id);
+      entry.state = "RUNNING";
+      entries->push_back(entry);
+    }
+  }
+
+ protected:
+  vector<TaskID_t> task_ids_;
+  uint64_t num_builds_;
+};
+
+// Tests that snapshots are only rebuilt once they are too old, and that the
+// version only changes when the contents do.
+TEST_F(HTTPUISnapshotTest, RebuildAndVersioning) {
+  ManualTime time;
+  SnapshotSlot<TaskListEntry> slot(&time, 1000);
+  SnapshotSlot<TaskListEntry>::Builder builder =
+    boost::bind(&HTTPUISnapshotTest::BuildTaskList, this, _1);
+  task_ids_.push_back(1);
+  shared_ptr<const ListSnapshot<TaskListEntry> > first = slot.Get(builder);
+  CHECK_EQ(num_builds_, 1);
+  CHECK_EQ(first->entries.size(), 1);
+  // Within the maximum age, the same snapshot is served without a rebuild
+  task_ids_.push_back(2);
+  time.UpdateCurrentTimestamp(500);
+  CHECK_EQ(slot.Get(builder), first);
+  CHECK_EQ(num_builds_, 1);
+  // Once expired, the snapshot is rebuilt and gets a new version
+  time.UpdateCurrentTimestamp(1000);
+  shared_ptr<const ListSnapshot<TaskListEntry> > second = slot.Get(builder);
+  CHECK_EQ(num_builds_, 2);
+  CHECK_EQ(second->entries.size(), 2);
+  CHECK_EQ(second->version, first->version + 1);
+  CHECK_NE(second->etag(), first->etag());
+  // The old snapshot is unaffected
+  CHECK_EQ(first->entries.size(), 1);
+  // Rebuilding unchanged contents keeps the version, and hence the ETag
+  time.UpdateCurrentTimestamp(2000);
+  CHECK_EQ(slot.Get(builder)->etag(), second->etag());
+  CHECK_EQ(num_builds_, 3);
+  // Invalidation forces a rebuild
+  task_ids_.pop_back();
+  slot.Invalidate();
+  CHECK_EQ(slot.Get(builder)->entries.size(), 1);
+}
+
+// Tests that chunked JSON output matches the whole list and respects the
+// page bounds.
+TEST_F(HTTPUISnapshotTest, ChunkedJSONPages) {
+  ManualTime time;
+  SnapshotSlot<TaskListEntry> slot(&time, 1000);
+  for (TaskID_t task_id = 1; task_id <= 10; ++task_id) {
+    task_ids_.push_back(task_id);
+  }
+  shared_ptr<const ListSnapshot<TaskListEntry> > snapshot =
+    slot.Get(boost::bind(&HTTPUISnapshotTest::BuildTaskList, this, _1));
+  uint64_t begin;
+  uint64_t end;
+  PageBounds("", "", 10, &begin, &end);
+  CHECK_EQ(begin, 0);
+  CHECK_EQ(end, 10);
+  JSONListChunker<TaskListEntry> chunker(snapshot, begin, end, "[", "]", 3);
+  string json;
+  uint64_t num_chunks = 1;
+  while (chunker.NextChunk(&json)) {
+    num_chunks++;
+  }
+  CHECK_EQ(num_chunks, 4);
+  CHECK_EQ(json, "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10]");
+  // Second page of four entries
+  PageBounds("4", "4", 10, &begin, &end);
+  CHECK_EQ(begin, 4);
+  CHECK_EQ(end, 8);
+  JSONListChunker<TaskListEntry> page_chunker(snapshot, begin, end, "[", "]",
+                                              100);
+  json.clear();
+  CHECK(!page_chunker.NextChunk(&json));
+  CHECK_EQ(json, "[5, 6, 7, 8]");
+  // Pages past the end are empty
+  PageBounds("20", "5", 10, &begin, &end);
+  CHECK_EQ(begin, 10);
+  CHECK_EQ(end, 10);
+}
+
+// Tests that strings are escaped in JSON output.
+TEST(HTTPUISnapshotJSONTest, EscapeStrings) {
+  string json;
+  AppendJSONString("a \"quoted\"\n\\name", &json);
+  CHECK_EQ(json, "\"a \\\"quoted\\\"\\n\\\\name\"");
+}
+
+}  // namespace webui
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,74 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Aggregation buffer for task heartbeats that a subordinate coordinator
+// forwards to its parent.
+
+#include "engine/task_heartbeat_aggregator.h"
+
+#include "misc/map-util.h"
+
+namespace firmament {
+
+TaskHeartbeatAggregator::TaskHeartbeatAggregator() {
+}
+
+void TaskHeartbeatAggregator::AddHeartbeat(const TaskHeartbeatMessage& msg) {
+  boost::lock_guard<boost::mutex> lock(pending_lock_);
+  TaskHeartbeatMessage* pending =
+    FindOrNull(pending_heartbeats_, msg.task_id());
+  if (!pending) {
+    CHECK(InsertIfNotPresent(&pending_heartbeats_, msg.task_id(), msg));
+    return;
+  }
+  // Usage samples taken by the executor carry no sequence number, and task
+  // heartbeats need not carry stats, so the latest stats are picked by their
+  // timestamp.
+  bool newer_stats = msg.has_stats() &&
+    (!pending->has_stats() ||
+     msg.stats().timestamp() >= pending->stats().timestamp());
+  if (msg.sequence_number() >= pending->sequence_number()) {
+    if (newer_stats || !pending->has_stats()) {
+      pending->CopyFrom(msg);
+    } else {
+      TaskStats pending_stats;
+      pending_stats.Swap(pending->mutable_stats());
+      pending->CopyFrom(msg);
+      pending->mutable_stats()->Swap(&pending_stats);
+    }
+  } else if (newer_stats) {
+    pending->mutable_stats()->CopyFrom(msg.stats());
+  }
+}
+
+bool TaskHeartbeatAggregator::Flush(const string& uuid,
+                                    TaskHeartbeatBatchMessage* batch) {
+  boost::lock_guard<boost::mutex> lock(pending_lock_);
+  if (pending_heartbeats_.empty())
+    return false;
+  batch->set_uuid(uuid);
+  for (auto& task_heartbeat : pending_heartbeats_) {
+    batch->add_heartbeats()->Swap(&task_heartbeat.second);
+  }
+  pending_heartbeats_.clear();
+  return true;
+}
+
+}  // namespace firmament
@@ -0,0 +1,76 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Aggregation buffer for task heartbeats that a subordinate coordinator
+// forwards to its parent.
+
+#ifndef FIRMAMENT_ENGINE_TASK_HEARTBEAT_AGGREGATOR_H
+#define FIRMAMENT_ENGINE_TASK_HEARTBEAT_AGGREGATOR_H
+
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "messages/task_heartbeat_message.pb.h"
+
+namespace firmament {
+
+class TaskHeartbeatAggregator {
+ public:
+  TaskHeartbeatAggregator();
+
+  /**
+   * Buffers a task heartbeat until the next flush. One heartbeat is retained
+   * for each task, so a task that heartbeats several times in one interval
+   * is forwarded once. It carries the most recent heartbeat (by sequence
+   * number) and the most recent stats (by timestamp), which may come from a
+   * usage sample taken by the executor rather than from a heartbeat. The
+   * stats are forwarded as sampled rather than merged with earlier samples:
+   * they are point-in-time usage samples, and the parent's knowledge base
+   * keeps them per task.
+   * @param msg the heartbeat received from the task, or a usage sample
+   */
+  void AddHeartbeat(const TaskHeartbeatMessage& msg);
+
+  /**
+   * Moves all buffered heartbeats into a batch message and empties the
+   * buffer.
+   * @param uuid the resource ID of the forwarding coordinator
+   * @param batch the message to populate
+   * @return true if the batch contains at least one heartbeat
+   */
+  bool Flush(const string& uuid, TaskHeartbeatBatchMessage* batch);
+
+  size_t num_pending() {
+    boost::lock_guard<boost::mutex> lock(pending_lock_);
+    return pending_heartbeats_.size();
+  }
+
+ private:
+  // Latest heartbeat received from each task since the last flush.
+  unordered_map<TaskID_t, TaskHeartbeatMessage> pending_heartbeats_;
+  boost::mutex pending_lock_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_ENGINE_TASK_HEARTBEAT_AGGREGATOR_H
@@ -0,0 +1,228 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Task heartbeat aggregation tests.
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "engine/task_heartbeat_aggregator.h"
+#include "messages/base_message.pb.h"
+#include "misc/protobuf_envelope.h"
+#include "platforms/unix/stream_sockets_channel.h"
+#include "platforms/unix/tcp_connection.h"
+#include "scheduling/knowledge_base.h"
+
+namespace firmament {
+
+using platform_unix::streamsockets::StreamSocketsChannel;
+using platform_unix::streamsockets::TCPConnection;
+using boost::asio::io_service;
+using boost::asio::ip::tcp;
+
+class TaskHeartbeatAggregatorTest : public ::testing::Test {
+ protected:
+  TaskHeartbeatAggregatorTest()
+    : parent_io_service_(new io_service),
+      child_channel_(StreamSocketsChannel<BaseMessage>::SS_TCP) {
+  }
+
+  virtual void SetUp() {
+    // Connect the child coordinator's channel to its parent over loopback.
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 0);
+    tcp::acceptor acceptor(*parent_io_service_, endpoint);
+    string uri = "tcp:127.0.0.1:" +
+      to_string(acceptor.local_endpoint().port());
+    CHECK(child_channel_.Establish(uri));
+    connection_.reset(new TCPConnection(parent_io_service_));
+    acceptor.accept(*connection_->socket());
+    connection_->Start(shared_ptr<tcp::endpoint>(
+        new tcp::endpoint(connection_->socket()->remote_endpoint())));
+    parent_channel_.reset(new StreamSocketsChannel<BaseMessage>(connection_));
+  }
+
+  TaskHeartbeatMessage MakeHeartbeat(TaskID_t task_id, uint64_t seq) {
+    TaskHeartbeatMessage msg;
+    msg.set_task_id(task_id);
+    msg.set_location("tcp:localhost:8088");
+    msg.set_sequence_number(seq);
+    msg.mutable_stats()->set_task_id(task_id);
+    msg.mutable_stats()->set_timestamp(seq);
+    msg.mutable_stats()->set_cpu_usage(task_id * 1000 + seq);
+    return msg;
+  }
+
+  shared_ptr<io_service> parent_io_service_;
+  StreamSocketsChannel<BaseMessage> child_channel_;
+  TCPConnection::connection_ptr connection_;
+  scoped_ptr<StreamSocketsChannel<BaseMessage> > parent_channel_;
+};
+
+// Tests that only the latest heartbeat of each task is kept and that the
+// buffer is empty after a flush.
+TEST_F(TaskHeartbeatAggregatorTest, KeepsLatestHeartbeatPerTask) {
+  TaskHeartbeatAggregator aggregator;
+  aggregator.AddHeartbeat(MakeHeartbeat(1, 2));
+  aggregator.AddHeartbeat(MakeHeartbeat(1, 1));
+  aggregator.AddHeartbeat(MakeHeartbeat(2, 1));
+  CHECK_EQ(aggregator.num_pending(), 2);
+  TaskHeartbeatBatchMessage batch;
+  CHECK(aggregator.Flush("child", &batch));
+  CHECK_EQ(batch.uuid(), "child");
+  CHECK_EQ(batch.heartbeats_size(), 2);
+  for (auto& heartbeat : batch.heartbeats()) {
+    if (heartbeat.task_id() == 1)
+      CHECK_EQ(heartbeat.sequence_number(), 2);
+  }
+  CHECK_EQ(aggregator.num_pending(), 0);
+  TaskHeartbeatBatchMessage empty_batch;
+  CHECK(!aggregator.Flush("child", &empty_batch));
+}
+
+// Tests that the kept heartbeat is the latest one as sent by the task. Its
+// stats are not merged with those of the heartbeats it replaces, so the
+// parent records exactly the sample the task reported last.
+TEST_F(TaskHeartbeatAggregatorTest, LatestHeartbeatIsNotMerged) {
+  TaskHeartbeatAggregator aggregator;
+  TaskHeartbeatMessage first = MakeHeartbeat(1, 1);
+  first.mutable_stats()->set_mem_usage(4096);
+  first.mutable_stats()->set_net_rx_rate(10);
+  TaskHeartbeatMessage latest = MakeHeartbeat(1, 3);
+  latest.mutable_stats()->set_mem_usage(1024);
+  TaskHeartbeatMessage reordered = MakeHeartbeat(1, 2);
+  reordered.mutable_stats()->set_mem_usage(8192);
+  aggregator.AddHeartbeat(first);
+  aggregator.AddHeartbeat(latest);
+  // Arrives after the latest one and must not replace it.
+  aggregator.AddHeartbeat(reordered);
+  CHECK_EQ(aggregator.num_pending(), 1);
+  TaskHeartbeatBatchMessage batch;
+  CHECK(aggregator.Flush("child", &batch));
+  CHECK_EQ(batch.heartbeats_size(), 1);
+  CHECK_EQ(batch.heartbeats(0).SerializeAsString(),
+           latest.SerializeAsString());
+  CHECK_EQ(batch.heartbeats(0).stats().mem_usage(), 1024);
+  CHECK_EQ(batch.heartbeats(0).stats().net_rx_rate(), 0);
+  // A heartbeat with the same sequence number replaces the pending one.
+  aggregator.AddHeartbeat(latest);
+  TaskHeartbeatMessage resent = MakeHeartbeat(1, 3);
+  resent.mutable_stats()->set_mem_usage(2048);
+  aggregator.AddHeartbeat(resent);
+  TaskHeartbeatBatchMessage next_batch;
+  CHECK(aggregator.Flush("child", &next_batch));
+  CHECK_EQ(next_batch.heartbeats_size(), 1);
+  CHECK_EQ(next_batch.heartbeats(0).stats().mem_usage(), 2048);
+}
+
+// Tests that a usage sample taken by the executor, which has no sequence
+// number, is forwarded along with the latest heartbeat, and that a later
+// heartbeat without stats does not drop it.
+TEST_F(TaskHeartbeatAggregatorTest, KeepsLatestStatsAcrossSamples) {
+  TaskHeartbeatAggregator aggregator;
+  aggregator.AddHeartbeat(MakeHeartbeat(1, 3));
+  TaskHeartbeatMessage sample;
+  sample.set_task_id(1);
+  sample.mutable_stats()->set_task_id(1);
+  sample.mutable_stats()->set_timestamp(5);
+  sample.mutable_stats()->set_mem_usage(4096);
+  aggregator.AddHeartbeat(sample);
+  TaskHeartbeatMessage no_stats;
+  no_stats.set_task_id(1);
+  no_stats.set_sequence_number(4);
+  aggregator.AddHeartbeat(no_stats);
+  TaskHeartbeatBatchMessage batch;
+  CHECK(aggregator.Flush("child", &batch));
+  CHECK_EQ(batch.heartbeats_size(), 1);
+  CHECK_EQ(batch.heartbeats(0).sequence_number(), 4);
+  CHECK_EQ(batch.heartbeats(0).stats().SerializeAsString(),
+           sample.stats().SerializeAsString());
+  // A sample older than the pending stats does not replace them.
+  aggregator.AddHeartbeat(MakeHeartbeat(1, 6));
+  sample.mutable_stats()->set_timestamp(2);
+  aggregator.AddHeartbeat(sample);
+  TaskHeartbeatBatchMessage next_batch;
+  CHECK(aggregator.Flush("child", &next_batch));
+  CHECK_EQ(next_batch.heartbeats(0).SerializeAsString(),
+           MakeHeartbeat(1, 6).SerializeAsString());
+}
+
+// Tests that a child forwarding heartbeats to its parent over loopback sends
+// one message per interval, and that the parent's knowledge base ends up
+// with the same samples as if the latest heartbeats had been added directly.
+TEST_F(TaskHeartbeatAggregatorTest, ForwardsOneBatchPerInterval) {
+  const uint64_t kNumTasks = 50;
+  const uint64_t kHeartbeatsPerInterval = 5;
+  const uint64_t kNumIntervals = 4;
+  TaskHeartbeatAggregator aggregator;
+  KnowledgeBase parent_kb;
+  KnowledgeBase reference_kb;
+  uint64_t seq = 0;
+  for (uint64_t interval = 0; interval < kNumIntervals; ++interval) {
+    for (uint64_t i = 0; i < kHeartbeatsPerInterval; ++i) {
+      ++seq;
+      for (TaskID_t task_id = 1; task_id <= kNumTasks; ++task_id) {
+        aggregator.AddHeartbeat(MakeHeartbeat(task_id, seq));
+      }
+    }
+    for (TaskID_t task_id = 1; task_id <= kNumTasks; ++task_id) {
+      reference_kb.AddTaskStatsSample(MakeHeartbeat(task_id, seq).stats());
+    }
+    BaseMessage bm;
+    CHECK(aggregator.Flush("child", bm.mutable_task_heartbeat_batch()));
+    Envelope<BaseMessage> envelope(&bm);
+    CHECK(child_channel_.SendS(envelope));
+  }
+  // The parent receives exactly one message per interval.
+  for (uint64_t interval = 0; interval < kNumIntervals; ++interval) {
+    BaseMessage bm;
+    Envelope<BaseMessage> envelope(&bm);
+    CHECK(parent_channel_->RecvS(&envelope));
+    CHECK(bm.has_task_heartbeat_batch());
+    CHECK_EQ(bm.task_heartbeat_batch().heartbeats_size(), kNumTasks);
+    vector<const TaskStats*> samples;
+    for (auto& heartbeat : bm.task_heartbeat_batch().heartbeats()) {
+      samples.push_back(&heartbeat.stats());
+    }
+    parent_kb.AddTaskStatsSamples(samples);
+  }
+  for (TaskID_t task_id = 1; task_id <= kNumTasks; ++task_id) {
+    const deque<TaskStats>* parent_samples = parent_kb.GetStatsForTask(task_id);
+    const deque<TaskStats>* reference_samples =
+      reference_kb.GetStatsForTask(task_id);
+    CHECK_NOTNULL(parent_samples);
+    CHECK_NOTNULL(reference_samples);
+    CHECK_EQ(parent_samples->size(), kNumIntervals);
+    CHECK_EQ(parent_samples->size(), reference_samples->size());
+    for (uint64_t i = 0; i < parent_samples->size(); ++i) {
+      CHECK_EQ(parent_samples->at(i).SerializeAsString(),
+               reference_samples->at(i).SerializeAsString());
+    }
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
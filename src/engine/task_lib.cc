@@ -108,7 +108,17 @@ TaskLib::TaskLib()
     CHECK_EQ(fclose(pid_file), 0);
   }
 
-  use_procfs_ = true;
+  // The executor may sample our resource usage itself, in which case we do
+  // not need to poll ProcFS.
+  char* use_procfs_env = getenv("FLAGS_tasklib_use_procfs");
+  use_procfs_ = !use_procfs_env || strcmp(use_procfs_env, "false") != 0;
+
+  // The executor may have set up a shared-memory ring for our heartbeats
+  char* heartbeat_ring_env = getenv("FLAGS_tasklib_heartbeat_ring");
+  if (heartbeat_ring_env && !heartbeat_ring_.Attach(heartbeat_ring_env)) {
+    LOG(WARNING) << "Failed to attach to heartbeat ring " << heartbeat_ring_env
+                 << "; sending heartbeats to the coordinator instead";
+  }
 }
 
 TaskLib::~TaskLib() {
@@ -311,7 +321,11 @@ void TaskLib::RunMonitor(boost::thread::id main_thread_id) {
     if (use_procfs_) {
       task_perf_monitor_.ProcessInformation(pid_, &current_stats);
     }
-    SendHeartbeat(current_stats);
+    if (heartbeat_ring_.is_open() && heartbeat_seq_number_ > 0) {
+      WriteHeartbeatToRing(current_stats);
+    } else {
+      SendHeartbeat(current_stats);
+    }
 
     // TODO(malte): We'll need to receive any potential messages from the
     // coordinator here, too. This is probably best done by a simple RecvA on
@@ -347,9 +361,10 @@ void TaskLib::SendHeartbeat(
   BaseMessage bm;
   SUBMSG_WRITE(bm, task_heartbeat, task_id, task_id_);
   // Add current set of procfs statistics
-
-  TaskStats* task_stats = bm.mutable_task_heartbeat()->mutable_stats();
-  AddTaskStatisticsToHeartbeat(proc_stats, task_stats);
+  if (use_procfs_) {
+    TaskStats* task_stats = bm.mutable_task_heartbeat()->mutable_stats();
+    AddTaskStatisticsToHeartbeat(proc_stats, task_stats);
+  }
 
   // TODO(malte): we do not always need to send the location string; it
   // sufficies to send it if our location changed (which should be rare).
@@ -360,6 +375,20 @@ void TaskLib::SendHeartbeat(
   SendMessageToCoordinator(&bm);
 }
 
+void TaskLib::WriteHeartbeatToRing(
+  const ProcFSMonitor::ProcessStatistics_t& proc_stats) {
+  platform_unix::TaskHeartbeatRecord record;
+  record.task_id = task_id_;
+  record.sequence_number = heartbeat_seq_number_++;
+  record.timestamp = time_manager_.GetCurrentTimestamp();
+  record.mem_usage =
+    use_procfs_ ? proc_stats.rss * getpagesize() / BYTES_TO_KB : 0;
+  if (!heartbeat_ring_.Write(record)) {
+    VLOG(1) << "Heartbeat ring is full, dropped heartbeat "
+            << record.sequence_number;
+  }
+}
+
 bool TaskLib::SendMessageToCoordinator(BaseMessage* msg) {
   Envelope<BaseMessage> envelope(msg);
   return chan_->SendS(envelope);
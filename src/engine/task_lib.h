@@ -41,6 +41,7 @@
 #include "misc/protobuf_envelope.h"
 #include "misc/wall_time.h"
 #include "platforms/common.h"
+#include "platforms/unix/heartbeat_ring.h"
 #include "platforms/unix/procfs_monitor.h"
 #include "platforms/unix/stream_sockets_adapter.h"
 #include "platforms/unix/stream_sockets_channel.h"
@@ -49,6 +50,7 @@
 
 namespace firmament {
 
+using platform_unix::HeartbeatRing;
 using platform_unix::ProcFSMonitor;
 using platform_unix::streamsockets::StreamSocketsAdapter;
 using platform_unix::streamsockets::StreamSocketsChannel;
@@ -102,6 +104,7 @@ class TaskLib {
                                           TaskDescriptor* desc);
   void SendFinalizeMessage(bool success);
   void SendHeartbeat(const ProcFSMonitor::ProcessStatistics_t& stats);
+  void WriteHeartbeatToRing(const ProcFSMonitor::ProcessStatistics_t& stats);
   bool SendMessageToCoordinator(BaseMessage* msg);
   void setUpStorageEngine();
 
@@ -117,6 +120,10 @@ class TaskLib {
   // If set, gives the fraction of task completed.
   volatile double completed_;
   ProcFSMonitor task_perf_monitor_;
+  // Shared-memory ring set up by the executor, if any. Once the first
+  // heartbeat has told the coordinator where to reach us, heartbeats are
+  // written there instead of being sent over the channel.
+  HeartbeatRing heartbeat_ring_;
 };
 
 }  // namespace firmament
@@ -37,85 +37,65 @@ DEFINE_string(generated_trace_path, "",
               "Path to where the trace will be generated");
 DEFINE_bool(generate_quincy_cost_model_trace, false,
             "A trace containing information specific to the Quincy cost model");
+DEFINE_bool(trace_binary_format, false,
+            "Write the generated trace in binary form instead of CSV");
+DEFINE_uint64(trace_buffer_size, 1 << 20,
+              "Number of 64-bit words buffered for the trace writer thread");
+DEFINE_uint64(trace_max_dropped_records, 0,
+              "Number of trace records that may be dropped when the trace "
+              "writer falls behind. With 0, the scheduler waits instead.");
 
 namespace firmament {
 
 TraceGenerator::TraceGenerator(TimeInterface* time_manager)
-  : time_manager_(time_manager), unscheduled_tasks_cnt_(0),
+  : time_manager_(time_manager), files_(NUM_TRACE_FILES, NULL),
+    trace_writer_(NULL), unscheduled_tasks_cnt_(0),
     running_tasks_cnt_(0), evicted_tasks_cnt_(0), migrated_tasks_cnt_(0),
-    task_events_cnt_per_round_(0), machine_events_cnt_per_round_(0) {
+    restoring_(false), task_events_cnt_per_round_(0),
+    machine_events_cnt_per_round_(0) {
   if (FLAGS_generate_trace) {
     MkdirIfNotPresent(FLAGS_generated_trace_path);
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/machine_events");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/task_events");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/scheduler_events");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/task_runtime_events");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/jobs_num_tasks");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/task_usage_stat");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/dfs_events");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/tasks_to_blocks");
-    MkdirIfNotPresent(FLAGS_generated_trace_path + "/machines_to_racks");
-    string path =
-      FLAGS_generated_trace_path + "/machine_events/part-00000-of-00001.csv";
-    machine_events_ = fopen(path.c_str(), "w");
-    CHECK(machine_events_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path +
-      "/scheduler_events/scheduler_events.csv";
-    scheduler_events_ = fopen(path.c_str(), "w");
-    CHECK(scheduler_events_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path + "/task_events/part-00000-of-00500.csv";
-    task_events_ = fopen(path.c_str(), "w");
-    CHECK(task_events_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path +
-      "/task_runtime_events/task_runtime_events.csv";
-    task_runtime_events_ = fopen(path.c_str(), "w");
-    CHECK(task_runtime_events_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path + "/jobs_num_tasks/jobs_num_tasks.csv";
-    jobs_num_tasks_ = fopen(path.c_str(), "w");
-    CHECK(jobs_num_tasks_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path + "/task_usage_stat/task_usage_stat.csv";
-    task_usage_stat_ = fopen(path.c_str(), "w");
-    CHECK(task_usage_stat_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path + "/dfs_events/dfs_events.csv";
-    dfs_events_ = fopen(path.c_str(), "w");
-    CHECK(dfs_events_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path + "/tasks_to_blocks/tasks_to_blocks.csv";
-    tasks_to_blocks_ = fopen(path.c_str(), "w");
-    CHECK(tasks_to_blocks_ != NULL) << "Failed to open: " << path;
-    path = FLAGS_generated_trace_path + "/machines_to_racks/machines_to_racks.csv";
-    machines_to_racks_ = fopen(path.c_str(), "w");
-    CHECK(machines_to_racks_ != NULL) << "Failed to open: " << path;
+    OpenTraceFile(MACHINE_EVENTS_FILE, "machine_events",
+                  "part-00000-of-00001");
+    OpenTraceFile(SCHEDULER_EVENTS_FILE, "scheduler_events",
+                  "scheduler_events");
+    OpenTraceFile(TASK_EVENTS_FILE, "task_events", "part-00000-of-00500");
+    OpenTraceFile(TASK_RUNTIME_EVENTS_FILE, "task_runtime_events",
+                  "task_runtime_events");
+    OpenTraceFile(JOBS_NUM_TASKS_FILE, "jobs_num_tasks", "jobs_num_tasks");
+    OpenTraceFile(TASK_USAGE_STAT_FILE, "task_usage_stat", "task_usage_stat");
+    OpenTraceFile(DFS_EVENTS_FILE, "dfs_events", "dfs_events");
+    OpenTraceFile(TASKS_TO_BLOCKS_FILE, "tasks_to_blocks", "tasks_to_blocks");
+    OpenTraceFile(MACHINES_TO_RACKS_FILE, "machines_to_racks",
+                  "machines_to_racks");
     if (FLAGS_generate_quincy_cost_model_trace) {
-      MkdirIfNotPresent(FLAGS_generated_trace_path + "/quincy_tasks");
-      path = FLAGS_generated_trace_path + "/quincy_tasks/quincy_tasks.csv";
-      quincy_tasks_ = fopen(path.c_str(), "w");
-      CHECK(quincy_tasks_ != NULL) << "Failed to open: " << path;
+      OpenTraceFile(QUINCY_TASKS_FILE, "quincy_tasks", "quincy_tasks");
     }
+    trace_writer_ = new TraceWriter(files_, FLAGS_trace_buffer_size,
+                                    FLAGS_trace_max_dropped_records,
+                                    FLAGS_trace_binary_format);
+    trace_writer_->Start();
   }
 }
 
 TraceGenerator::~TraceGenerator() {
   if (FLAGS_generate_trace) {
-    fclose(machine_events_);
-    fclose(scheduler_events_);
-    fclose(task_events_);
     // Print runtime for service tasks or tasks that haven't completed.
     for (auto& task_id_runtime : task_to_runtime_) {
       uint64_t* job_id_ptr = FindOrNull(task_to_job_, task_id_runtime.first);
       TaskRuntime task_runtime = task_id_runtime.second;
       // NOTE: We are using the job id as the job logical name.
-      fprintf(task_runtime_events_, "%ju,%ju,%ju,%ju,%ju,%ju,%ju\n",
-              *job_id_ptr, task_runtime.task_id_, *job_id_ptr,
-              task_runtime.start_time_, task_runtime.total_runtime_,
-              task_runtime.runtime_, task_runtime.num_runs_);
+      uint64_t fields[] = {*job_id_ptr, task_runtime.task_id_, *job_id_ptr,
+                           task_runtime.start_time_,
+                           task_runtime.total_runtime_, task_runtime.runtime_,
+                           task_runtime.num_runs_};
+      trace_writer_->Append(TASK_RUNTIME_EVENTS_FILE, FIELDS_RECORD, fields);
     }
-    fclose(task_runtime_events_);
     // Print number of tasks for service jobs or jobs that haven't completed.
     for (auto& job_to_num_tasks : job_num_tasks_) {
-      fprintf(jobs_num_tasks_, "%ju,%ju\n", job_to_num_tasks.first,
-              job_to_num_tasks.second);
+      uint64_t fields[] = {job_to_num_tasks.first, job_to_num_tasks.second};
+      trace_writer_->Append(JOBS_NUM_TASKS_FILE, FIELDS_RECORD, fields);
     }
-    fclose(jobs_num_tasks_);
     // TODO(ionel): Collect task usage stats.
     // for (auto& task_to_job : task_to_job_) {
     //   uint64_t* job_id_ptr = FindOrNull(task_to_job_, task_to_job.first);
@@ -123,12 +103,13 @@ TraceGenerator::~TraceGenerator() {
     //           "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0\n", *job_id_ptr,
     //           task_to_job.first);
     // }
-    fclose(task_usage_stat_);
-    fclose(dfs_events_);
-    fclose(tasks_to_blocks_);
-    fclose(machines_to_racks_);
-    if (FLAGS_generate_quincy_cost_model_trace) {
-      fclose(quincy_tasks_);
+    // Write out all the buffered records before closing the files.
+    trace_writer_->Stop();
+    delete trace_writer_;
+    for (auto& file : files_) {
+      if (file) {
+        fclose(file);
+      }
     }
   }
   // time_manager is not owned by this class. We don't have to delete it here.
@@ -141,8 +122,9 @@ void TraceGenerator::AddBlock(ResourceID_t machine_res_id,
     uint64_t* machine_id =
       FindOrNull(machine_res_id_to_trace_id_, machine_res_id);
     CHECK_NOTNULL(machine_id);
-    fprintf(dfs_events_, "%ju,%d,%ju,%ju,%ju\n", timestamp, BLOCK_ADD,
-            *machine_id, block_id, block_size);
+    uint64_t fields[] = {timestamp, BLOCK_ADD, *machine_id, block_id,
+                         block_size};
+    trace_writer_->Append(DFS_EVENTS_FILE, FIELDS_RECORD, fields);
   }
 }
 
@@ -154,8 +136,8 @@ void TraceGenerator::AddMachine(const ResourceDescriptor& rd) {
     CHECK(InsertIfNotPresent(&machine_res_id_to_trace_id_,
                              ResourceIDFromString(rd.uuid()),
                              machine_id));
-    fprintf(machine_events_, "%ju,%ju,%d,,,\n",
-            timestamp, machine_id, MACHINE_ADD);
+    uint64_t fields[] = {timestamp, machine_id, MACHINE_ADD};
+    trace_writer_->Append(MACHINE_EVENTS_FILE, MACHINE_EVENT_RECORD, fields);
   }
 }
 
@@ -166,8 +148,8 @@ void TraceGenerator::AddMachineToRack(ResourceID_t machine_res_id,
     uint64_t* machine_id =
       FindOrNull(machine_res_id_to_trace_id_, machine_res_id);
     CHECK_NOTNULL(machine_id);
-    fprintf(machines_to_racks_, "%ju,%d,%ju,%ju\n", timestamp, MACHINE_ADD,
-            *machine_id, rack_id);
+    uint64_t fields[] = {timestamp, MACHINE_ADD, *machine_id, rack_id};
+    trace_writer_->Append(MACHINES_TO_RACKS_FILE, FIELDS_RECORD, fields);
   }
 }
 
@@ -183,8 +165,8 @@ void TraceGenerator::AddTaskInputBlock(const TaskDescriptor& td,
       trace_job_id = HashString(td.job_id());
       trace_task_id = td.uid();
     }
-    fprintf(tasks_to_blocks_, "%ju,%ju,%ju\n",
-            trace_job_id, trace_task_id, block_id);
+    uint64_t fields[] = {trace_job_id, trace_task_id, block_id};
+    trace_writer_->Append(TASKS_TO_BLOCKS_FILE, FIELDS_RECORD, fields);
   }
 }
 
@@ -204,10 +186,15 @@ void TraceGenerator::AddTaskQuincy(
       trace_job_id = HashString(td.job_id());
       trace_task_id = td.uid();
     }
-    fprintf(quincy_tasks_, "%ju,%ju,%ju,%ju,%jd,%jd,%jd,%jd,%ju,%ju\n",
-            timestamp, trace_job_id, trace_task_id, input_size,
-            worst_cluster_cost, best_rack_cost, best_machine_cost,
-            cost_to_unsched, num_pref_machines, num_pref_racks);
+    // The signed costs are stored as uint64_t and converted back when the
+    // record is written.
+    uint64_t fields[] = {timestamp, trace_job_id, trace_task_id, input_size,
+                         static_cast<uint64_t>(worst_cluster_cost),
+                         static_cast<uint64_t>(best_rack_cost),
+                         static_cast<uint64_t>(best_machine_cost),
+                         static_cast<uint64_t>(cost_to_unsched),
+                         num_pref_machines, num_pref_racks};
+    trace_writer_->Append(QUINCY_TASKS_FILE, QUINCY_TASK_RECORD, fields);
   }
 }
 
@@ -219,6 +206,15 @@ uint64_t TraceGenerator::GetMachineId(const ResourceDescriptor& rd) {
   }
 }
 
+void TraceGenerator::OpenTraceFile(TraceFile file, const string& dir,
+                                   const string& name) {
+  MkdirIfNotPresent(FLAGS_generated_trace_path + "/" + dir);
+  string path = FLAGS_generated_trace_path + "/" + dir + "/" + name +
+    (FLAGS_trace_binary_format ? ".bin" : ".csv");
+  files_[file] = fopen(path.c_str(), "w");
+  CHECK(files_[file] != NULL) << "Failed to open: " << path;
+}
+
 void TraceGenerator::RemoveBlock(ResourceID_t machine_res_id,
                                  uint64_t block_id, uint64_t block_size) {
   if (FLAGS_generate_trace) {
@@ -226,8 +222,9 @@ void TraceGenerator::RemoveBlock(ResourceID_t machine_res_id,
     uint64_t* machine_id =
       FindOrNull(machine_res_id_to_trace_id_, machine_res_id);
     CHECK_NOTNULL(machine_id);
-    fprintf(dfs_events_, "%ju,%d,%ju,%ju,%ju\n", timestamp, BLOCK_REMOVE,
-            *machine_id, block_id, block_size);
+    uint64_t fields[] = {timestamp, BLOCK_REMOVE, *machine_id, block_id,
+                         block_size};
+    trace_writer_->Append(DFS_EVENTS_FILE, FIELDS_RECORD, fields);
   }
 }
 
@@ -237,8 +234,8 @@ void TraceGenerator::RemoveMachine(const ResourceDescriptor& rd) {
     uint64_t timestamp = time_manager_->GetCurrentTimestamp();
     uint64_t machine_id = GetMachineId(rd);
     machine_res_id_to_trace_id_.erase(ResourceIDFromString(rd.uuid()));
-    fprintf(machine_events_, "%ju,%ju,%d,,,\n",
-            timestamp, machine_id, MACHINE_REMOVE);
+    uint64_t fields[] = {timestamp, machine_id, MACHINE_REMOVE};
+    trace_writer_->Append(MACHINE_EVENTS_FILE, MACHINE_EVENT_RECORD, fields);
   }
 }
 
@@ -249,8 +246,8 @@ void TraceGenerator::RemoveMachineFromRack(ResourceID_t machine_res_id,
     uint64_t* machine_id =
       FindOrNull(machine_res_id_to_trace_id_, machine_res_id);
     CHECK_NOTNULL(machine_id);
-    fprintf(machines_to_racks_, "%ju,%d,%ju,%ju\n", timestamp, MACHINE_REMOVE,
-            *machine_id, rack_id);
+    uint64_t fields[] = {timestamp, MACHINE_REMOVE, *machine_id, rack_id};
+    trace_writer_->Append(MACHINES_TO_RACKS_FILE, FIELDS_RECORD, fields);
   }
 }
 
@@ -265,26 +262,32 @@ void TraceGenerator::SchedulerRun(
                    << "% of tasks are unscheduled";
     }
     uint64_t timestamp = time_manager_->GetCurrentTimestamp();
-    fprintf(scheduler_events_, "%ju,%ju,%ju,%ju,%ju,%ju,%ju,%ju,%ju,%ju,%s\n",
-            timestamp, scheduler_stats.scheduler_runtime_,
-            scheduler_stats.algorithm_runtime_,
-            scheduler_stats.total_runtime_,
-            unscheduled_tasks_cnt_, evicted_tasks_cnt_, migrated_tasks_cnt_,
-            unscheduled_tasks_cnt_ + running_tasks_cnt_,
-            task_events_cnt_per_round_, machine_events_cnt_per_round_,
-            dimacs_stats.GetStatsString().c_str());
+    // The record contains the same fields as
+    // DIMACSChangeStats::GetStatsString, without the string formatting.
+    uint64_t fields[10 + 5 + NUM_CHANGE_TYPES] = {
+      timestamp, scheduler_stats.scheduler_runtime_,
+      scheduler_stats.algorithm_runtime_,
+      scheduler_stats.total_runtime_,
+      unscheduled_tasks_cnt_, evicted_tasks_cnt_, migrated_tasks_cnt_,
+      unscheduled_tasks_cnt_ + running_tasks_cnt_,
+      task_events_cnt_per_round_, machine_events_cnt_per_round_,
+      dimacs_stats.nodes_added_, dimacs_stats.nodes_removed_,
+      dimacs_stats.arcs_added_, dimacs_stats.arcs_changed_,
+      dimacs_stats.arcs_removed_};
+    for (uint32_t index = 0; index < NUM_CHANGE_TYPES; index++) {
+      fields[15 + index] = dimacs_stats.num_changes_of_type_[index];
+    }
+    trace_writer_->Append(SCHEDULER_EVENTS_FILE, FIELDS_RECORD, fields);
     evicted_tasks_cnt_ = 0;
     migrated_tasks_cnt_ = 0;
     task_events_cnt_per_round_ = 0;
     machine_events_cnt_per_round_ = 0;
-    fflush(scheduler_events_);
   }
 }
 
 void TraceGenerator::TaskSubmitted(TaskDescriptor* td_ptr) {
   if (FLAGS_generate_trace) {
     unscheduled_tasks_cnt_++;
-    task_events_cnt_per_round_++;
     // NOTE: We do not use time_manager_ because the task already has a
     // submit time which was set by the coordinator or the simulator.
     uint64_t timestamp = td_ptr->submit_time();
@@ -312,16 +315,22 @@ void TraceGenerator::TaskSubmitted(TaskDescriptor* td_ptr) {
         *num_tasks = *num_tasks + 1;
       }
     }
-    fprintf(task_events_, "%ju,,%ju,%ju,,%d,,,,,,,\n",
-            timestamp, job_id, trace_task_id, TASK_SUBMIT_EVENT);
-    fflush(task_events_);
+    if (!restoring_) {
+      task_events_cnt_per_round_++;
+      uint64_t fields[] = {timestamp, job_id, trace_task_id,
+                           TASK_SUBMIT_EVENT};
+      trace_writer_->Append(TASK_EVENTS_FILE, TASK_SUBMIT_EVENT_RECORD,
+                            fields);
+    }
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     if (tr_ptr == NULL) {
       TaskRuntime task_runtime;
       task_runtime.task_id_ = trace_task_id;
       task_runtime.start_time_ = timestamp;
       task_runtime.num_runs_ = 0;
-      task_runtime.last_schedule_time_ = 0;
+      // A restored task keeps running from the time it was started
+      task_runtime.last_schedule_time_ =
+        restoring_ ? td_ptr->start_time() : 0;
       InsertIfNotPresent(&task_to_runtime_, task_id, task_runtime);
     }
   }
@@ -338,17 +347,18 @@ void TraceGenerator::TaskCompleted(TaskID_t task_id,
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     CHECK_NOTNULL(tr_ptr);
     uint64_t machine_id = GetMachineId(rd);
-    fprintf(task_events_, "%ju,,%ju,%ju,%ju,%d,,,,,,,\n",
-            timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
-            TASK_FINISH_EVENT);
-    fflush(task_events_);
+    uint64_t fields[] = {timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
+                         TASK_FINISH_EVENT};
+    trace_writer_->Append(TASK_EVENTS_FILE, TASK_EVENT_RECORD, fields);
     // XXX(ionel): This assumes that only one task with task_id is running
     // at a time.
     tr_ptr->total_runtime_ += timestamp - tr_ptr->last_schedule_time_;
     tr_ptr->runtime_ = timestamp - tr_ptr->last_schedule_time_;
-    fprintf(task_runtime_events_, "%ju,%ju,%ju,%ju,%ju,%ju,%ju\n",
-            *job_id_ptr, tr_ptr->task_id_, *job_id_ptr, tr_ptr->start_time_,
-            tr_ptr->total_runtime_, tr_ptr->runtime_, tr_ptr->num_runs_);
+    uint64_t runtime_fields[] = {*job_id_ptr, tr_ptr->task_id_, *job_id_ptr,
+                                 tr_ptr->start_time_, tr_ptr->total_runtime_,
+                                 tr_ptr->runtime_, tr_ptr->num_runs_};
+    trace_writer_->Append(TASK_RUNTIME_EVENTS_FILE, FIELDS_RECORD,
+                          runtime_fields);
     task_to_job_.erase(task_id);
     task_to_runtime_.erase(task_id);
   }
@@ -369,10 +379,9 @@ void TraceGenerator::TaskEvicted(TaskID_t task_id,
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     CHECK_NOTNULL(tr_ptr);
     uint64_t machine_id = GetMachineId(rd);
-    fprintf(task_events_, "%ju,,%ju,%ju,%ju,%d,,,,,,,\n",
-            timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
-            TASK_EVICT_EVENT);
-    fflush(task_events_);
+    uint64_t fields[] = {timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
+                         TASK_EVICT_EVENT};
+    trace_writer_->Append(TASK_EVENTS_FILE, TASK_EVENT_RECORD, fields);
     // XXX(ionel): This assumes that only one task with task_id is running
     // at a time.
     tr_ptr->total_runtime_ += timestamp - tr_ptr->last_schedule_time_;
@@ -390,16 +399,17 @@ void TraceGenerator::TaskFailed(TaskID_t task_id,
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     CHECK_NOTNULL(tr_ptr);
     uint64_t machine_id = GetMachineId(rd);
-    fprintf(task_events_, "%ju,,%ju,%ju,%ju,%d,,,,,,,\n",
-            timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
-            TASK_FAIL_EVENT);
-    fflush(task_events_);
+    uint64_t fields[] = {timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
+                         TASK_FAIL_EVENT};
+    trace_writer_->Append(TASK_EVENTS_FILE, TASK_EVENT_RECORD, fields);
     // XXX(ionel): This assumes that only one task with task_id is running
     // at a time.
     tr_ptr->total_runtime_ += timestamp - tr_ptr->last_schedule_time_;
-    fprintf(task_runtime_events_, "%ju,%ju,%ju,%ju,%ju,%ju,%ju\n",
-            *job_id_ptr, tr_ptr->task_id_, *job_id_ptr, tr_ptr->start_time_,
-            tr_ptr->total_runtime_, tr_ptr->runtime_, tr_ptr->num_runs_);
+    uint64_t runtime_fields[] = {*job_id_ptr, tr_ptr->task_id_, *job_id_ptr,
+                                 tr_ptr->start_time_, tr_ptr->total_runtime_,
+                                 tr_ptr->runtime_, tr_ptr->num_runs_};
+    trace_writer_->Append(TASK_RUNTIME_EVENTS_FILE, FIELDS_RECORD,
+                          runtime_fields);
     task_to_job_.erase(task_id);
     task_to_runtime_.erase(task_id);
   }
@@ -416,16 +426,17 @@ void TraceGenerator::TaskKilled(TaskID_t task_id,
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     CHECK_NOTNULL(tr_ptr);
     uint64_t machine_id = GetMachineId(rd);
-    fprintf(task_events_, "%ju,,%ju,%ju,%ju,%d,,,,,,,\n",
-            timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
-            TASK_KILL_EVENT);
-    fflush(task_events_);
+    uint64_t fields[] = {timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
+                         TASK_KILL_EVENT};
+    trace_writer_->Append(TASK_EVENTS_FILE, TASK_EVENT_RECORD, fields);
     // XXX(ionel): This assumes that only one task with task_id is running
     // at a time.
     tr_ptr->total_runtime_ += timestamp - tr_ptr->last_schedule_time_;
-    fprintf(task_runtime_events_, "%ju,%ju,%ju,%ju,%ju,%ju,%ju\n",
-            *job_id_ptr, tr_ptr->task_id_, *job_id_ptr, tr_ptr->start_time_,
-            tr_ptr->total_runtime_, tr_ptr->runtime_, tr_ptr->num_runs_);
+    uint64_t runtime_fields[] = {*job_id_ptr, tr_ptr->task_id_, *job_id_ptr,
+                                 tr_ptr->start_time_, tr_ptr->total_runtime_,
+                                 tr_ptr->runtime_, tr_ptr->num_runs_};
+    trace_writer_->Append(TASK_RUNTIME_EVENTS_FILE, FIELDS_RECORD,
+                          runtime_fields);
     task_to_job_.erase(task_id);
     task_to_runtime_.erase(task_id);
   }
@@ -455,9 +466,9 @@ void TraceGenerator::TaskRemoved(TaskID_t task_id, bool was_running) {
     CHECK_NOTNULL(job_id_ptr);
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     CHECK_NOTNULL(tr_ptr);
-    fprintf(task_events_, "%ju,,%ju,%ju,,,%d,,,,,,,\n",
-            timestamp, *job_id_ptr, tr_ptr->task_id_, TASK_REMOVED_EVENT);
-    fflush(task_events_);
+    uint64_t fields[] = {timestamp, *job_id_ptr, tr_ptr->task_id_,
+                         TASK_REMOVED_EVENT};
+    trace_writer_->Append(TASK_EVENTS_FILE, TASK_REMOVED_EVENT_RECORD, fields);
     task_to_job_.erase(task_id);
     task_to_runtime_.erase(task_id);
   }
@@ -473,12 +484,14 @@ void TraceGenerator::TaskScheduled(TaskID_t task_id,
     CHECK_NOTNULL(job_id_ptr);
     TaskRuntime* tr_ptr = FindOrNull(task_to_runtime_, task_id);
     CHECK_NOTNULL(tr_ptr);
-    uint64_t machine_id = GetMachineId(rd);
-    fprintf(task_events_, "%ju,,%ju,%ju,%ju,%d,,,,,,,\n",
-            timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
-            TASK_SCHEDULE_EVENT);
-    fflush(task_events_);
     tr_ptr->num_runs_++;
+    if (restoring_) {
+      return;
+    }
+    uint64_t machine_id = GetMachineId(rd);
+    uint64_t fields[] = {timestamp, *job_id_ptr, tr_ptr->task_id_, machine_id,
+                         TASK_SCHEDULE_EVENT};
+    trace_writer_->Append(TASK_EVENTS_FILE, TASK_EVENT_RECORD, fields);
     tr_ptr->last_schedule_time_ = timestamp;
   }
 }
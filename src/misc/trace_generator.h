@@ -23,8 +23,12 @@
 #ifndef FIRMAMENT_MISC_TRACE_GENERATOR_H
 #define FIRMAMENT_MISC_TRACE_GENERATOR_H
 
+#include <string>
+#include <vector>
+
 #include "base/types.h"
 #include "misc/time_interface.h"
+#include "misc/trace_writer.h"
 #include "scheduling/flow/dimacs_change_stats.h"
 #include "scheduling/scheduler_interface.h"
 
@@ -111,8 +115,18 @@ class TraceGenerator {
                     const ResourceDescriptor& new_rd);
   void TaskScheduled(TaskID_t task_id, const ResourceDescriptor& rd);
 
+  /**
+   * While set, task submissions and placements update the generator's state
+   * but are not written to the trace. Used when restoring tasks from a
+   * checkpoint, whose events are in the trace of the run that took it.
+   */
+  inline void set_restoring(bool restoring) {
+    restoring_ = restoring;
+  }
+
  private:
   uint64_t GetMachineId(const ResourceDescriptor& rd);
+  void OpenTraceFile(TraceFile file, const string& dir, const string& name);
 
   TimeInterface* time_manager_;
   unordered_map<TaskID_t, uint64_t> task_to_job_;
@@ -123,20 +137,15 @@ class TraceGenerator {
   unordered_map<TaskID_t, TaskRuntime> task_to_runtime_;
   unordered_map<ResourceID_t, uint64_t,
       boost::hash<ResourceID_t>> machine_res_id_to_trace_id_;
-  FILE* machine_events_;
-  FILE* scheduler_events_;
-  FILE* task_events_;
-  FILE* task_runtime_events_;
-  FILE* jobs_num_tasks_;
-  FILE* task_usage_stat_;
-  FILE* dfs_events_;
-  FILE* tasks_to_blocks_;
-  FILE* machines_to_racks_;
-  FILE* quincy_tasks_;
+  // The trace files indexed by TraceFile.
+  vector<FILE*> files_;
+  // Writes the trace records to files_ in the background.
+  TraceWriter* trace_writer_;
   uint64_t unscheduled_tasks_cnt_;
   uint64_t running_tasks_cnt_;
   uint64_t evicted_tasks_cnt_;
   uint64_t migrated_tasks_cnt_;
+  bool restoring_;
   // It includes task submissions, completions, evictions, failures, kills,
   // placements and migrations
   uint64_t task_events_cnt_per_round_;
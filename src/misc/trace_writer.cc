@@ -0,0 +1,205 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Asynchronous writer for the trace files generated by the TraceGenerator.
+
+#include "misc/trace_writer.h"
+
+#include <cstdio>
+#include <vector>
+
+// Time the writer thread sleeps for when there are no records to write.
+#define TRACE_WRITER_IDLE_SLEEP_MS 1
+
+namespace firmament {
+
+TraceWriter::TraceWriter(const vector<FILE*>& files, uint64_t buffer_size,
+                         uint64_t max_dropped_records, bool binary_format)
+  : files_(files), files_dirty_(files.size(), false),
+    binary_format_(binary_format), head_(0), tail_(0), stopping_(false),
+    max_dropped_records_(max_dropped_records), num_dropped_records_(0),
+    writer_thread_(NULL) {
+  CHECK_EQ(files_.size(), NUM_TRACE_FILES);
+  // Round the buffer size up to a power of two so that positions can be
+  // mapped to buffer indices with a mask.
+  uint64_t capacity = 1;
+  while (capacity < buffer_size) {
+    capacity <<= 1;
+  }
+  buffer_.resize(capacity);
+  buffer_mask_ = capacity - 1;
+}
+
+TraceWriter::~TraceWriter() {
+  Stop();
+  if (num_dropped_records_ > 0) {
+    LOG(WARNING) << "Dropped " << num_dropped_records_ << " trace records "
+                 << "because the trace writer fell behind";
+  }
+}
+
+void TraceWriter::Append(TraceFile file, TraceRecordFormat format,
+                         const uint64_t* fields, uint32_t num_fields) {
+  uint64_t record_size = num_fields + 1;
+  CHECK_LE(record_size, buffer_.size());
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  while (head + record_size - tail_.load(std::memory_order_acquire) >
+         buffer_.size()) {
+    // The writer has fallen behind.
+    if (num_dropped_records_ < max_dropped_records_) {
+      num_dropped_records_++;
+      return;
+    }
+    CHECK_NOTNULL(writer_thread_);
+    boost::this_thread::yield();
+  }
+  buffer_[head & buffer_mask_] = static_cast<uint64_t>(file) << 40 |
+    static_cast<uint64_t>(format) << 32 | num_fields;
+  for (uint32_t index = 0; index < num_fields; ++index) {
+    buffer_[(head + 1 + index) & buffer_mask_] = fields[index];
+  }
+  head_.store(head + record_size, std::memory_order_release);
+}
+
+void TraceWriter::FlushFiles() {
+  for (uint32_t index = 0; index < files_.size(); ++index) {
+    if (files_dirty_[index]) {
+      fflush(files_[index]);
+      files_dirty_[index] = false;
+    }
+  }
+}
+
+void TraceWriter::Start() {
+  CHECK(writer_thread_ == NULL);
+  writer_thread_ =
+    new boost::thread(boost::bind(&TraceWriter::WriterLoop, this));
+}
+
+void TraceWriter::Stop() {
+  if (writer_thread_) {
+    stopping_.store(true, std::memory_order_release);
+    writer_thread_->join();
+    delete writer_thread_;
+    writer_thread_ = NULL;
+  } else {
+    // The writer was never started. Write the buffered records here.
+    WriteRecords(head_.load(std::memory_order_acquire));
+    FlushFiles();
+  }
+}
+
+void TraceWriter::WriteBinaryRecord(FILE* file, TraceRecordFormat format,
+                                    uint64_t* fields, uint32_t num_fields) {
+  uint8_t header[2] = {static_cast<uint8_t>(format),
+                       static_cast<uint8_t>(num_fields)};
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(fields, sizeof(uint64_t), num_fields, file);
+}
+
+void TraceWriter::WriteRecords(uint64_t head) {
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  uint64_t fields[UINT8_MAX];
+  while (tail != head) {
+    uint64_t header = buffer_[tail & buffer_mask_];
+    uint32_t file_index = static_cast<uint32_t>(header >> 40);
+    TraceRecordFormat format =
+      static_cast<TraceRecordFormat>((header >> 32) & 0xff);
+    uint32_t num_fields = static_cast<uint32_t>(header & 0xffffffff);
+    CHECK_LE(num_fields, UINT8_MAX);
+    for (uint32_t index = 0; index < num_fields; ++index) {
+      fields[index] = buffer_[(tail + 1 + index) & buffer_mask_];
+    }
+    tail += num_fields + 1;
+    FILE* file = files_[file_index];
+    if (!file) {
+      continue;
+    }
+    if (binary_format_) {
+      WriteBinaryRecord(file, format, fields, num_fields);
+    } else {
+      WriteTextRecord(file, format, fields, num_fields);
+    }
+    files_dirty_[file_index] = true;
+  }
+  tail_.store(tail, std::memory_order_release);
+}
+
+void TraceWriter::WriteTextRecord(FILE* file, TraceRecordFormat format,
+                                  uint64_t* fields, uint32_t num_fields) {
+  switch (format) {
+    case FIELDS_RECORD:
+    case QUINCY_TASK_RECORD:
+      for (uint32_t index = 0; index < num_fields; ++index) {
+        if (index > 0) {
+          fputc(',', file);
+        }
+        if (format == QUINCY_TASK_RECORD && index >= 4 && index <= 7) {
+          fprintf(file, "%jd", static_cast<int64_t>(fields[index]));
+        } else {
+          fprintf(file, "%ju", fields[index]);
+        }
+      }
+      fputc('\n', file);
+      break;
+    case MACHINE_EVENT_RECORD:
+      CHECK_EQ(num_fields, 3);
+      fprintf(file, "%ju,%ju,%ju,,,\n", fields[0], fields[1], fields[2]);
+      break;
+    case TASK_EVENT_RECORD:
+      CHECK_EQ(num_fields, 5);
+      fprintf(file, "%ju,,%ju,%ju,%ju,%ju,,,,,,,\n",
+              fields[0], fields[1], fields[2], fields[3], fields[4]);
+      break;
+    case TASK_SUBMIT_EVENT_RECORD:
+      CHECK_EQ(num_fields, 4);
+      fprintf(file, "%ju,,%ju,%ju,,%ju,,,,,,,\n",
+              fields[0], fields[1], fields[2], fields[3]);
+      break;
+    case TASK_REMOVED_EVENT_RECORD:
+      CHECK_EQ(num_fields, 4);
+      fprintf(file, "%ju,,%ju,%ju,,,%ju,,,,,,,\n",
+              fields[0], fields[1], fields[2], fields[3]);
+      break;
+    default:
+      LOG(FATAL) << "Unexpected trace record format: " << format;
+  }
+}
+
+void TraceWriter::WriterLoop() {
+  while (true) {
+    // Read the stop flag before the head so that all the records appended
+    // before Stop was called are written.
+    bool stopping = stopping_.load(std::memory_order_acquire);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    if (head == tail_.load(std::memory_order_relaxed)) {
+      FlushFiles();
+      if (stopping) {
+        break;
+      }
+      boost::this_thread::sleep(
+          boost::posix_time::milliseconds(TRACE_WRITER_IDLE_SLEEP_MS));
+      continue;
+    }
+    WriteRecords(head);
+  }
+}
+
+}  // namespace firmament
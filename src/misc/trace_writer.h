@@ -0,0 +1,138 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Asynchronous writer for the trace files generated by the TraceGenerator.
+
+#ifndef FIRMAMENT_MISC_TRACE_WRITER_H
+#define FIRMAMENT_MISC_TRACE_WRITER_H
+
+#include <atomic>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+
+namespace firmament {
+
+// The files of a generated trace.
+enum TraceFile {
+  MACHINE_EVENTS_FILE = 0,
+  SCHEDULER_EVENTS_FILE = 1,
+  TASK_EVENTS_FILE = 2,
+  TASK_RUNTIME_EVENTS_FILE = 3,
+  JOBS_NUM_TASKS_FILE = 4,
+  TASK_USAGE_STAT_FILE = 5,
+  DFS_EVENTS_FILE = 6,
+  TASKS_TO_BLOCKS_FILE = 7,
+  MACHINES_TO_RACKS_FILE = 8,
+  QUINCY_TASKS_FILE = 9,
+  NUM_TRACE_FILES = 10,
+};
+
+// Layouts of the text records. Every field of a record is a uint64_t.
+enum TraceRecordFormat {
+  // Comma-separated fields.
+  FIELDS_RECORD = 0,
+  // timestamp,machine_id,event,,,
+  MACHINE_EVENT_RECORD = 1,
+  // timestamp,,job_id,task_id,machine_id,event,,,,,,,
+  TASK_EVENT_RECORD = 2,
+  // timestamp,,job_id,task_id,,event,,,,,,,
+  TASK_SUBMIT_EVENT_RECORD = 3,
+  // timestamp,,job_id,task_id,,,event,,,,,,,
+  TASK_REMOVED_EVENT_RECORD = 4,
+  // Comma-separated fields, of which fields 4 to 7 are signed costs.
+  QUINCY_TASK_RECORD = 5,
+};
+
+class TraceWriter {
+ public:
+  /**
+   * @param files the trace files indexed by TraceFile. NULL entries are not
+   * written. The files are owned by the caller.
+   * @param buffer_size the capacity of the record buffer in 64-bit words
+   * @param max_dropped_records the number of records that may be dropped when
+   * the buffer is full; once exhausted, appending waits for the writer
+   * @param binary_format true if records are written in binary form
+   */
+  TraceWriter(const vector<FILE*>& files, uint64_t buffer_size,
+              uint64_t max_dropped_records, bool binary_format);
+  ~TraceWriter();
+
+  /**
+   * Appends a record to the buffer. Records are written by a background
+   * thread. Calls must be serialized, like all the TraceGenerator calls.
+   * @param file the file to which to write the record
+   * @param format the layout of the record
+   * @param fields the fields of the record
+   * @param num_fields the number of fields
+   */
+  void Append(TraceFile file, TraceRecordFormat format,
+              const uint64_t* fields, uint32_t num_fields);
+  template<size_t N>
+  void Append(TraceFile file, TraceRecordFormat format,
+              const uint64_t (&fields)[N]) {
+    Append(file, format, fields, N);
+  }
+
+  /**
+   * Starts the background writer thread.
+   */
+  void Start();
+
+  /**
+   * Writes all the buffered records and stops the writer thread.
+   */
+  void Stop();
+
+  inline uint64_t num_dropped_records() const {
+    return num_dropped_records_;
+  }
+
+ private:
+  void FlushFiles();
+  void WriteBinaryRecord(FILE* file, TraceRecordFormat format,
+                         uint64_t* fields, uint32_t num_fields);
+  void WriteRecords(uint64_t head);
+  void WriteTextRecord(FILE* file, TraceRecordFormat format,
+                       uint64_t* fields, uint32_t num_fields);
+  void WriterLoop();
+
+  vector<FILE*> files_;
+  vector<bool> files_dirty_;
+  bool binary_format_;
+  // Ring buffer of 64-bit words. Every record consists of a header word
+  // followed by its fields.
+  vector<uint64_t> buffer_;
+  uint64_t buffer_mask_;
+  // Position of the next word to append. Only updated by the producer.
+  std::atomic<uint64_t> head_;
+  // Position of the next word to write. Only updated by the writer thread.
+  std::atomic<uint64_t> tail_;
+  std::atomic<bool> stopping_;
+  uint64_t max_dropped_records_;
+  uint64_t num_dropped_records_;
+  boost::thread* writer_thread_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_TRACE_WRITER_H
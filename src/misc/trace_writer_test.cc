@@ -0,0 +1,123 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Trace writer unit tests.
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "misc/trace_writer.h"
+
+namespace firmament {
+
+class TraceWriterTest : public ::testing::Test {
+ protected:
+  TraceWriterTest() : files_(NUM_TRACE_FILES, NULL) {
+  }
+
+  virtual void SetUp() {
+    files_[MACHINE_EVENTS_FILE] = tmpfile();
+    files_[TASK_EVENTS_FILE] = tmpfile();
+  }
+
+  virtual void TearDown() {
+    for (auto& file : files_) {
+      if (file) {
+        fclose(file);
+      }
+    }
+  }
+
+  string ReadFile(FILE* file) {
+    string contents;
+    rewind(file);
+    char buffer[256];
+    size_t num_read;
+    while ((num_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      contents.append(buffer, num_read);
+    }
+    return contents;
+  }
+
+  vector<FILE*> files_;
+};
+
+TEST_F(TraceWriterTest, WriteTextRecords) {
+  // A small buffer makes the writer thread wrap around the ring.
+  TraceWriter trace_writer(files_, 16, 0, false);
+  trace_writer.Start();
+  for (uint64_t index = 0; index < 100; ++index) {
+    uint64_t machine_fields[] = {index, 42, 0};
+    trace_writer.Append(MACHINE_EVENTS_FILE, MACHINE_EVENT_RECORD,
+                        machine_fields);
+  }
+  uint64_t task_fields[] = {7, 1, 2, 3, 4};
+  trace_writer.Append(TASK_EVENTS_FILE, TASK_EVENT_RECORD, task_fields);
+  uint64_t submit_fields[] = {7, 1, 2, 0};
+  trace_writer.Append(TASK_EVENTS_FILE, TASK_SUBMIT_EVENT_RECORD,
+                      submit_fields);
+  trace_writer.Stop();
+  string expected_machine_events;
+  for (uint64_t index = 0; index < 100; ++index) {
+    expected_machine_events += to_string(index) + ",42,0,,,\n";
+  }
+  CHECK_EQ(ReadFile(files_[MACHINE_EVENTS_FILE]), expected_machine_events);
+  CHECK_EQ(ReadFile(files_[TASK_EVENTS_FILE]),
+           "7,,1,2,3,4,,,,,,,\n7,,1,2,,0,,,,,,,\n");
+  CHECK_EQ(trace_writer.num_dropped_records(), 0);
+}
+
+TEST_F(TraceWriterTest, WriteBinaryRecords) {
+  TraceWriter trace_writer(files_, 64, 0, true);
+  trace_writer.Start();
+  uint64_t fields[] = {1, 2, 3};
+  trace_writer.Append(MACHINE_EVENTS_FILE, MACHINE_EVENT_RECORD, fields);
+  trace_writer.Stop();
+  string contents = ReadFile(files_[MACHINE_EVENTS_FILE]);
+  CHECK_EQ(contents.size(), 2 + sizeof(fields));
+  CHECK_EQ(contents[0], MACHINE_EVENT_RECORD);
+  CHECK_EQ(contents[1], 3);
+  CHECK_EQ(memcmp(contents.data() + 2, fields, sizeof(fields)), 0);
+}
+
+TEST_F(TraceWriterTest, DropRecordsWhenFull) {
+  // The writer thread is not started, so the buffer fills up and the records
+  // that do not fit are dropped.
+  TraceWriter trace_writer(files_, 8, 10, false);
+  for (uint64_t index = 0; index < 5; ++index) {
+    uint64_t fields[] = {index, 42, 0};
+    trace_writer.Append(MACHINE_EVENTS_FILE, MACHINE_EVENT_RECORD, fields);
+  }
+  CHECK_EQ(trace_writer.num_dropped_records(), 3);
+  trace_writer.Stop();
+  CHECK_EQ(ReadFile(files_[MACHINE_EVENTS_FILE]), "0,42,0,,,\n1,42,0,,,\n");
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
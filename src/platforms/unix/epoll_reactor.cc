@@ -0,0 +1,86 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Linux epoll-based readiness notification.
+
+#include "platforms/unix/epoll_reactor.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// Maximum number of ready descriptors returned by a single Wait call.
+#define EPOLL_REACTOR_MAX_EVENTS 1024
+
+namespace firmament {
+namespace platform_unix {
+
+EpollReactor::EpollReactor()
+  : events_(EPOLL_REACTOR_MAX_EVENTS), num_registered_(0) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  PCHECK(epoll_fd_ >= 0) << "Failed to create epoll instance";
+}
+
+EpollReactor::~EpollReactor() {
+  close(epoll_fd_);
+}
+
+bool EpollReactor::Register(int fd, void* context) {
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  // Level-triggered, so that a descriptor with more than one pending message
+  // is reported again by the next Wait call.
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.ptr = context;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    PLOG(ERROR) << "Failed to register fd " << fd << " with epoll";
+    return false;
+  }
+  num_registered_++;
+  return true;
+}
+
+void EpollReactor::Deregister(int fd) {
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL) != 0) {
+    // The descriptor may already have been closed, which removes it from the
+    // epoll set implicitly.
+    VLOG(1) << "Failed to deregister fd " << fd << " from epoll: "
+            << strerror(errno);
+  }
+  num_registered_--;
+}
+
+uint32_t EpollReactor::Wait(int32_t timeout_ms, vector<void*>* ready) {
+  int num_events = epoll_wait(epoll_fd_, &events_[0], events_.size(),
+                              timeout_ms);
+  if (num_events < 0) {
+    if (errno != EINTR) {
+      PLOG(ERROR) << "epoll_wait failed";
+    }
+    return 0;
+  }
+  for (int index = 0; index < num_events; ++index) {
+    ready->push_back(events_[index].data.ptr);
+  }
+  return static_cast<uint32_t>(num_events);
+}
+
+}  // namespace platform_unix
+}  // namespace firmament
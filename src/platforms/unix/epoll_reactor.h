@@ -0,0 +1,83 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Readiness notification for file descriptors using Linux epoll.
+
+#ifndef FIRMAMENT_PLATFORMS_UNIX_EPOLL_REACTOR_H
+#define FIRMAMENT_PLATFORMS_UNIX_EPOLL_REACTOR_H
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "base/common.h"
+
+namespace firmament {
+namespace platform_unix {
+
+class EpollReactor : private boost::noncopyable {
+ public:
+  EpollReactor();
+  ~EpollReactor();
+
+  /**
+   * Registers a file descriptor, which is then watched until it is
+   * deregistered. Safe to call while another thread is in Wait.
+   * @param fd the file descriptor to watch for readability
+   * @param context pointer returned by Wait when the descriptor is ready
+   * @return true if the descriptor was registered
+   */
+  bool Register(int fd, void* context);
+
+  /**
+   * Stops watching a file descriptor. Must be called before the descriptor
+   * is closed or shut down, as epoll otherwise keeps reporting it.
+   * @param fd the file descriptor to stop watching
+   */
+  void Deregister(int fd);
+
+  /**
+   * Blocks until at least one registered descriptor is readable, has hung up
+   * or has an error, or until the timeout expires.
+   * @param timeout_ms the maximum time to block for in milliseconds
+   * @param ready vector to which the contexts of the ready descriptors are
+   * appended
+   * @return the number of ready descriptors
+   */
+  uint32_t Wait(int32_t timeout_ms, vector<void*>* ready);
+
+  inline uint64_t num_registered() const {
+    return num_registered_;
+  }
+
+ private:
+  int epoll_fd_;
+  // Buffer for the events returned by epoll_wait.
+  vector<struct epoll_event> events_;
+  std::atomic<uint64_t> num_registered_;
+};
+
+}  // namespace platform_unix
+}  // namespace firmament
+
+#endif  // FIRMAMENT_PLATFORMS_UNIX_EPOLL_REACTOR_H
@@ -0,0 +1,112 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Epoll reactor unit tests.
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <vector>
+
+#include "base/common.h"
+#include "misc/wall_time.h"
+#include "platforms/unix/epoll_reactor.h"
+
+// Number of idle pipes registered alongside the ready ones.
+#define NUM_IDLE_PIPES 500
+
+namespace firmament {
+namespace platform_unix {
+
+class EpollReactorTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    pipes_.resize(NUM_IDLE_PIPES);
+    for (uint32_t index = 0; index < pipes_.size(); ++index) {
+      CHECK_EQ(pipe(pipes_[index].fds), 0);
+      CHECK(reactor_.Register(pipes_[index].fds[0], &pipes_[index]));
+    }
+  }
+
+  virtual void TearDown() {
+    for (auto& pipe_fds : pipes_) {
+      close(pipe_fds.fds[0]);
+      close(pipe_fds.fds[1]);
+    }
+  }
+
+  struct PipeFDs {
+    int fds[2];
+  };
+
+  EpollReactor reactor_;
+  vector<PipeFDs> pipes_;
+};
+
+// Tests that Wait blocks for the timeout when no descriptor is ready.
+TEST_F(EpollReactorTest, WaitTimesOutWhenIdle) {
+  WallTime wall_time;
+  uint64_t start_time = wall_time.GetCurrentTimestamp();
+  vector<void*> ready;
+  CHECK_EQ(reactor_.Wait(50, &ready), 0);
+  CHECK_EQ(ready.size(), 0);
+  CHECK_GE(wall_time.GetCurrentTimestamp() - start_time, 40000);
+}
+
+// Tests that only the ready descriptors are returned, and that they are
+// reported until drained.
+TEST_F(EpollReactorTest, WaitReturnsOnlyReadyDescriptors) {
+  CHECK_EQ(reactor_.num_registered(), NUM_IDLE_PIPES);
+  char data = 'x';
+  CHECK_EQ(write(pipes_[7].fds[1], &data, 1), 1);
+  CHECK_EQ(write(pipes_[42].fds[1], &data, 1), 1);
+  vector<void*> ready;
+  CHECK_EQ(reactor_.Wait(1000, &ready), 2);
+  CHECK((ready[0] == &pipes_[7] && ready[1] == &pipes_[42]) ||
+        (ready[0] == &pipes_[42] && ready[1] == &pipes_[7]));
+  // Level-triggered: the data has not been read yet.
+  ready.clear();
+  CHECK_EQ(reactor_.Wait(0, &ready), 2);
+  CHECK_EQ(read(pipes_[7].fds[0], &data, 1), 1);
+  CHECK_EQ(read(pipes_[42].fds[0], &data, 1), 1);
+  ready.clear();
+  CHECK_EQ(reactor_.Wait(0, &ready), 0);
+}
+
+// Tests that hang-ups are reported and that deregistered descriptors are not.
+TEST_F(EpollReactorTest, HangUpAndDeregister) {
+  close(pipes_[3].fds[1]);
+  pipes_[3].fds[1] = -1;
+  vector<void*> ready;
+  CHECK_EQ(reactor_.Wait(1000, &ready), 1);
+  CHECK_EQ(ready[0], &pipes_[3]);
+  reactor_.Deregister(pipes_[3].fds[0]);
+  CHECK_EQ(reactor_.num_registered(), NUM_IDLE_PIPES - 1);
+  ready.clear();
+  CHECK_EQ(reactor_.Wait(0, &ready), 0);
+}
+
+}  // namespace platform_unix
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,183 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Shared-memory heartbeat ring implementation.
+
+#include "platforms/unix/heartbeat_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+namespace firmament {
+namespace platform_unix {
+
+#define HEARTBEAT_RING_MAGIC 0x4642485452494e47ULL
+
+HeartbeatRing::HeartbeatRing()
+  : owner_(false), header_(NULL), records_(NULL), mapping_size_(0),
+    capacity_(0), tail_(0) {
+}
+
+HeartbeatRing::~HeartbeatRing() {
+  Close();
+}
+
+bool HeartbeatRing::Attach(const string& name) {
+  CHECK(!is_open());
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    PLOG(WARNING) << "Failed to open heartbeat ring " << name;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(RingHeader)) {
+    LOG(WARNING) << "Heartbeat ring " << name << " is truncated";
+    close(fd);
+    return false;
+  }
+  if (!Map(fd, st.st_size))
+    return false;
+  capacity_ = header_->capacity;
+  if (header_->magic != HEARTBEAT_RING_MAGIC ||
+      header_->record_size != sizeof(TaskHeartbeatRecord) ||
+      capacity_ == 0 || MappingSize(capacity_) > mapping_size_) {
+    LOG(WARNING) << "Heartbeat ring " << name << " has an unexpected layout";
+    Close();
+    return false;
+  }
+  name_ = name;
+  return true;
+}
+
+void HeartbeatRing::Close() {
+  if (!is_open())
+    return;
+  munmap(header_, mapping_size_);
+  if (owner_ && shm_unlink(name_.c_str()) != 0) {
+    PLOG(WARNING) << "Failed to unlink heartbeat ring " << name_;
+  }
+  header_ = NULL;
+  records_ = NULL;
+  mapping_size_ = 0;
+  capacity_ = 0;
+  tail_ = 0;
+  owner_ = false;
+}
+
+bool HeartbeatRing::Create(const string& name, uint32_t capacity) {
+  CHECK(!is_open());
+  CHECK_GT(capacity, 0);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL,
+                    S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    PLOG(WARNING) << "Failed to create heartbeat ring " << name;
+    return false;
+  }
+  size_t length = MappingSize(capacity);
+  if (ftruncate(fd, length) != 0) {
+    PLOG(WARNING) << "Failed to size heartbeat ring " << name;
+    close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  if (!Map(fd, length)) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+  name_ = name;
+  owner_ = true;
+  capacity_ = capacity;
+  tail_ = 0;
+  header_->capacity = capacity;
+  header_->record_size = sizeof(TaskHeartbeatRecord);
+  new (&header_->head) std::atomic<uint64_t>(0);
+  new (&header_->dropped) std::atomic<uint64_t>(0);
+  new (&header_->tail) std::atomic<uint64_t>(0);
+  // Publish the magic last, so that an attaching task sees a complete header
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = HEARTBEAT_RING_MAGIC;
+  return true;
+}
+
+uint64_t HeartbeatRing::Drain(vector<TaskHeartbeatRecord>* records) {
+  CHECK(is_open());
+  uint64_t head = header_->head.load(std::memory_order_acquire);
+  // Wraps around if the task moved the head backwards.
+  uint64_t num_records = head - tail_;
+  if (num_records > capacity_) {
+    LOG(WARNING) << "Heartbeat ring " << name_ << " is corrupt: head "
+                 << head << ", tail " << tail_ << ", capacity " << capacity_;
+    num_records = 0;
+  }
+  for (uint64_t pos = tail_; pos < tail_ + num_records; ++pos) {
+    records->push_back(records_[pos % capacity_]);
+  }
+  // Hand the slots back to the producer
+  tail_ = head;
+  header_->tail.store(head, std::memory_order_release);
+  return num_records;
+}
+
+bool HeartbeatRing::Map(int fd, size_t length) {
+  void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    PLOG(WARNING) << "Failed to map heartbeat ring";
+    return false;
+  }
+  header_ = reinterpret_cast<RingHeader*>(addr);
+  records_ = reinterpret_cast<TaskHeartbeatRecord*>(
+      reinterpret_cast<char*>(addr) + sizeof(RingHeader));
+  mapping_size_ = length;
+  return true;
+}
+
+size_t HeartbeatRing::MappingSize(uint32_t capacity) {
+  return sizeof(RingHeader) +
+    static_cast<size_t>(capacity) * sizeof(TaskHeartbeatRecord);
+}
+
+uint64_t HeartbeatRing::num_dropped() const {
+  CHECK(is_open());
+  return header_->dropped.load(std::memory_order_relaxed);
+}
+
+bool HeartbeatRing::Write(const TaskHeartbeatRecord& record) {
+  CHECK(is_open());
+  uint64_t head = header_->head.load(std::memory_order_relaxed);
+  uint64_t tail = header_->tail.load(std::memory_order_acquire);
+  if (head - tail >= capacity_) {
+    // The executor has not drained the ring for a while; drop the record
+    // rather than block the task.
+    header_->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  records_[head % capacity_] = record;
+  header_->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+}  // namespace platform_unix
+}  // namespace firmament
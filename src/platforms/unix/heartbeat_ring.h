@@ -0,0 +1,127 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Shared-memory ring through which a task reports heartbeats to the executor
+// on the same host, without a socket round-trip per heartbeat.
+
+#ifndef FIRMAMENT_PLATFORMS_UNIX_HEARTBEAT_RING_H
+#define FIRMAMENT_PLATFORMS_UNIX_HEARTBEAT_RING_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+namespace platform_unix {
+
+// Fixed-size heartbeat record written by a task.
+struct TaskHeartbeatRecord {
+  TaskID_t task_id;
+  uint64_t sequence_number;
+  // Time of the sample in microseconds since the epoch
+  uint64_t timestamp;
+  // Resident memory in KB; 0 if the task did not sample it
+  uint64_t mem_usage;
+};
+
+/**
+ * Single-producer, single-consumer ring of heartbeat records in a POSIX
+ * shared memory object. The executor creates (and owns) the ring; the task
+ * attaches to it by name. Neither side makes a system call per record.
+ */
+class HeartbeatRing {
+ public:
+  HeartbeatRing();
+  ~HeartbeatRing();
+  /**
+   * Creates a new ring. The shared memory object is unlinked again when the
+   * ring is closed.
+   * @param name the name of the shared memory object, starting with '/'
+   * @param capacity the number of records the ring can hold
+   * @return true on success
+   */
+  bool Create(const string& name, uint32_t capacity);
+  /**
+   * Attaches to a ring created by another process.
+   * @param name the name of the shared memory object
+   * @return true on success
+   */
+  bool Attach(const string& name);
+  void Close();
+  /**
+   * Appends a record to the ring (producer side only).
+   * @param record the record to append
+   * @return false if the ring was full and the record was dropped
+   */
+  bool Write(const TaskHeartbeatRecord& record);
+  /**
+   * Removes all available records from the ring (consumer side only). The
+   * task can write to the whole ring, so the records' contents must not be
+   * trusted. If the task moved the head by more than the ring's capacity,
+   * the ring is treated as corrupt: its records are discarded and the
+   * consumer skips ahead to the head.
+   * @param records vector to which the records are appended
+   * @return the number of records drained
+   */
+  uint64_t Drain(vector<TaskHeartbeatRecord>* records);
+  uint64_t num_dropped() const;
+
+  inline bool is_open() const {
+    return header_ != NULL;
+  }
+  inline const string& name() const {
+    return name_;
+  }
+
+ private:
+  struct RingHeader {
+    uint64_t magic;
+    uint32_t capacity;
+    uint32_t record_size;
+    // Producer and consumer positions are on separate cache lines
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<uint64_t> dropped;
+    alignas(64) std::atomic<uint64_t> tail;
+  };
+
+  FRIEND_TEST(HeartbeatRingTest, CorruptHeaderIsNotTrusted);
+
+  bool Map(int fd, size_t length);
+  static size_t MappingSize(uint32_t capacity);
+
+  string name_;
+  bool owner_;
+  RingHeader* header_;
+  TaskHeartbeatRecord* records_;
+  size_t mapping_size_;
+  // Number of records the ring holds, fixed when it is created or attached.
+  // The copy in the header can be overwritten by the other process.
+  uint32_t capacity_;
+  // Consumer position. The header's tail only publishes it to the producer.
+  uint64_t tail_;
+};
+
+}  // namespace platform_unix
+}  // namespace firmament
+
+#endif  // FIRMAMENT_PLATFORMS_UNIX_HEARTBEAT_RING_H
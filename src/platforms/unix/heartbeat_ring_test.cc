@@ -0,0 +1,160 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Shared-memory heartbeat ring unit tests.
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "base/common.h"
+#include "platforms/unix/heartbeat_ring.h"
+
+// Number of fake tasks heartbeating concurrently.
+#define NUM_TASKS 32
+// Heartbeats sent by each task.
+#define HEARTBEATS_PER_TASK 2000
+
+namespace firmament {
+namespace platform_unix {
+
+class HeartbeatRingTest : public ::testing::Test {
+ protected:
+  string RingName(uint32_t index) {
+    return "/firmament-heartbeat-ring-test-" + to_string(getpid()) + "-" +
+      to_string(index);
+  }
+};
+
+TEST_F(HeartbeatRingTest, AttachAndDrain) {
+  HeartbeatRing executor_ring;
+  CHECK(executor_ring.Create(RingName(0), 8));
+  HeartbeatRing task_ring;
+  CHECK(task_ring.Attach(RingName(0)));
+  for (uint64_t seq = 1; seq <= 5; ++seq) {
+    TaskHeartbeatRecord record = {42, seq, seq * 1000, 512};
+    CHECK(task_ring.Write(record));
+  }
+  vector<TaskHeartbeatRecord> records;
+  CHECK_EQ(executor_ring.Drain(&records), 5);
+  CHECK_EQ(records.size(), 5);
+  for (uint64_t index = 0; index < records.size(); ++index) {
+    CHECK_EQ(records[index].task_id, 42);
+    CHECK_EQ(records[index].sequence_number, index + 1);
+  }
+  CHECK_EQ(executor_ring.Drain(&records), 0);
+  task_ring.Close();
+  executor_ring.Close();
+  // The executor owns the ring, so it is gone once closed
+  CHECK(!task_ring.Attach(RingName(0)));
+}
+
+TEST_F(HeartbeatRingTest, FullRingDropsRecords) {
+  HeartbeatRing ring;
+  CHECK(ring.Create(RingName(0), 4));
+  TaskHeartbeatRecord record = {1, 0, 0, 0};
+  for (uint32_t index = 0; index < 4; ++index) {
+    record.sequence_number = index;
+    CHECK(ring.Write(record));
+  }
+  CHECK(!ring.Write(record));
+  CHECK_EQ(ring.num_dropped(), 1);
+  vector<TaskHeartbeatRecord> records;
+  CHECK_EQ(ring.Drain(&records), 4);
+  // Draining frees up the slots again
+  CHECK(ring.Write(record));
+}
+
+// The task can overwrite the ring's header. The executor must keep using
+// the capacity it created the ring with and must not drain more records
+// than that.
+TEST_F(HeartbeatRingTest, CorruptHeaderIsNotTrusted) {
+  HeartbeatRing executor_ring;
+  CHECK(executor_ring.Create(RingName(0), 4));
+  HeartbeatRing task_ring;
+  CHECK(task_ring.Attach(RingName(0)));
+  TaskHeartbeatRecord record = {7, 1, 1000, 0};
+  CHECK(task_ring.Write(record));
+  task_ring.header_->capacity = 0;
+  vector<TaskHeartbeatRecord> records;
+  CHECK_EQ(executor_ring.Drain(&records), 1);
+  CHECK_EQ(records[0].sequence_number, 1);
+  // A head far beyond the tail is discarded rather than drained.
+  task_ring.header_->head.store(1ULL << 40);
+  records.clear();
+  CHECK_EQ(executor_ring.Drain(&records), 0);
+  CHECK(records.empty());
+  // So is a head that moved backwards.
+  task_ring.header_->head.store(0);
+  CHECK_EQ(executor_ring.Drain(&records), 0);
+  CHECK(records.empty());
+  // The ring works again once the task writes sane records.
+  record.sequence_number = 2;
+  CHECK(task_ring.Write(record));
+  CHECK_EQ(executor_ring.Drain(&records), 1);
+  CHECK_EQ(records[0].sequence_number, 2);
+}
+
+// Many tasks heartbeat concurrently to one collector, which must receive
+// every heartbeat without any ring dropping records.
+TEST_F(HeartbeatRingTest, ManyTasksDeliverEveryHeartbeat) {
+  uint64_t expected = NUM_TASKS * HEARTBEATS_PER_TASK;
+  vector<HeartbeatRing*> executor_rings;
+  for (uint32_t index = 0; index < NUM_TASKS; ++index) {
+    executor_rings.push_back(new HeartbeatRing);
+    CHECK(executor_rings.back()->Create(RingName(index),
+                                        HEARTBEATS_PER_TASK));
+  }
+  boost::thread_group ring_tasks;
+  for (uint32_t index = 0; index < NUM_TASKS; ++index) {
+    ring_tasks.create_thread([this, index]() {
+      HeartbeatRing ring;
+      CHECK(ring.Attach(RingName(index)));
+      for (uint64_t seq = 1; seq <= HEARTBEATS_PER_TASK; ++seq) {
+        TaskHeartbeatRecord record = {index, seq, seq, 1024};
+        CHECK(ring.Write(record));
+      }
+    });
+  }
+  uint64_t ring_received = 0;
+  vector<TaskHeartbeatRecord> records;
+  while (ring_received < expected) {
+    uint64_t drained = 0;
+    for (auto& ring : executor_rings) {
+      records.clear();
+      drained += ring->Drain(&records);
+    }
+    ring_received += drained;
+    if (drained == 0)
+      usleep(100);
+  }
+  ring_tasks.join_all();
+  for (auto& ring : executor_rings) {
+    CHECK_EQ(ring->num_dropped(), 0);
+    delete ring;
+  }
+  CHECK_EQ(ring_received, expected);
+}
+
+}  // namespace platform_unix
+}  // namespace firmament
@@ -46,7 +46,18 @@ DECLARE_uint64(heartbeat_interval);
 namespace firmament {
 namespace platform_unix {
 
-ProcFSMachine::ProcFSMachine() {
+ProcFSMachine::ProcFSMachine()
+  : proc_stat_("/proc/stat"),
+    proc_meminfo_("/proc/meminfo") {
+  string path;
+  spf(&path, "/sys/class/block/%s/stat", FLAGS_monitor_blockdev.c_str());
+  blockdev_stat_.SetPath(path);
+  spf(&path, "/sys/class/net/%s/statistics/tx_bytes",
+      FLAGS_monitor_netif.c_str());
+  netif_tx_bytes_.SetPath(path);
+  spf(&path, "/sys/class/net/%s/statistics/rx_bytes",
+      FLAGS_monitor_netif.c_str());
+  netif_rx_bytes_.SetPath(path);
   cpu_stats_ = GetCPUStats();
   disk_stats_ = GetDiskStats();
   net_stats_ = GetNetworkStats();
@@ -95,34 +106,37 @@ const ResourceStats* ProcFSMachine::CreateStatistics(ResourceStats* stats) {
 }
 
 vector<CPUStatistics_t> ProcFSMachine::GetCPUStats() {
-  FILE* proc_stat = fopen("/proc/stat", "r");
+  const char* data = proc_stat_.Read(NULL);
+  CHECK_NOTNULL(data);
   vector<CPUStatistics_t> cpus_now;
   CPUStatistics_t cpu_now;
-  int proc_stat_cpu;
-  CHECK_NOTNULL(proc_stat);
-
-  for (int cpu_num = -1; ; cpu_num++) {
-    string read_expr;
-    if (cpu_num >= 0) {
-      read_expr = "cpu" + to_string(cpu_num) + " %lld %lld %lld %lld %lld " +
-           "%lld %lld %lld %lld %lld\n";
-    } else {
-      read_expr = "cpu %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld\n";
-    }
-    proc_stat_cpu = fscanf(proc_stat, read_expr.c_str(),
-        &cpu_now.user, &cpu_now.nice, &cpu_now.system, &cpu_now.idle,
-        &cpu_now.iowait, &cpu_now.irq, &cpu_now.soft_irq, &cpu_now.steal,
-        &cpu_now.guest, &cpu_now.guest_nice);
-    if (proc_stat_cpu != 10) {
+  ProcFSScanner scanner(data);
+  // The aggregate "cpu" line comes first, followed by one "cpuN" line per
+  // core; the remaining lines contain other statistics.
+  while (true) {
+    size_t len;
+    const char* label = scanner.NextToken(&len);
+    if (!label || len < 3 || strncmp(label, "cpu", 3) != 0)
+      break;
+    if (!scanner.NextUInt64(&cpu_now.user) ||
+        !scanner.NextUInt64(&cpu_now.nice) ||
+        !scanner.NextUInt64(&cpu_now.system) ||
+        !scanner.NextUInt64(&cpu_now.idle) ||
+        !scanner.NextUInt64(&cpu_now.iowait) ||
+        !scanner.NextUInt64(&cpu_now.irq) ||
+        !scanner.NextUInt64(&cpu_now.soft_irq) ||
+        !scanner.NextUInt64(&cpu_now.steal) ||
+        !scanner.NextUInt64(&cpu_now.guest) ||
+        !scanner.NextUInt64(&cpu_now.guest_nice)) {
       break;
     }
+    scanner.SkipLine();
     cpu_now.total = cpu_now.user + cpu_now.nice + cpu_now.system +
         cpu_now.idle + cpu_now.iowait + cpu_now.irq + cpu_now.soft_irq +
         cpu_now.steal + cpu_now.guest + cpu_now.guest_nice;
     cpu_now.systime = time(NULL);
     cpus_now.push_back(cpu_now);
   }
-  CHECK_EQ(fclose(proc_stat), 0);
   return cpus_now;
 }
 
@@ -156,14 +170,12 @@ DiskStatistics_t ProcFSMachine::GetDiskStats() {
   // /sys/block/<dev> or 'mount'.
   DiskStatistics_t disk_stats;
   bzero(&disk_stats, sizeof(DiskStatistics_t));
-  string dev_path;
-  spf(&dev_path, "/sys/class/block/%s/",
-      FLAGS_monitor_blockdev.c_str());
-  FILE* blockdev_stat_fd = fopen((dev_path + "/stat").c_str(), "r");
-  if (blockdev_stat_fd) {
+  const char* data = blockdev_stat_.Read(NULL);
+  if (data) {
+    ProcFSScanner scanner(data);
     uint64_t tmp_value;
     for (uint64_t i = 0; i < 11; i++) {
-      CHECK_EQ(readunsigned(blockdev_stat_fd, &tmp_value), 0);
+      CHECK(scanner.NextUInt64(&tmp_value));
       if (i == 2)
         // read sector count
         disk_stats.read = tmp_value * 512;
@@ -171,7 +183,6 @@ DiskStatistics_t ProcFSMachine::GetDiskStats() {
         // write sector count
         disk_stats.write = tmp_value * 512;
     }
-    CHECK_EQ(fclose(blockdev_stat_fd), 0);
   }
   return disk_stats;
 }
@@ -230,27 +241,30 @@ void ProcFSMachine::GetMachineCapacity(ResourceVector* cap) {
 
 MemoryStatistics_t ProcFSMachine::GetMemoryStats() {
   MemoryStatistics_t mem_stats;
-  FILE* mem_stat_fd = fopen("/proc/meminfo", "r");
-  CHECK_NOTNULL(mem_stat_fd);
-  while (!feof(mem_stat_fd)) {
-    char label[100];
+  bzero(&mem_stats, sizeof(MemoryStatistics_t));
+  const char* data = proc_meminfo_.Read(NULL);
+  CHECK_NOTNULL(data);
+  ProcFSScanner scanner(data);
+  size_t len;
+  const char* label;
+  while ((label = scanner.NextToken(&len)) != NULL) {
     uint64_t val = 0;
     // Ignore invalid lines
-    if (fscanf(mem_stat_fd, "%s", label) <= 0)
-      continue;
-    if (fscanf(mem_stat_fd, "%ju", &val) <= 0)
+    if (!scanner.NextUInt64(&val)) {
+      scanner.SkipLine();
       continue;
-    if (strncmp(label, "MemTotal:", 100) == 0) {
+    }
+    scanner.SkipLine();
+    if (len == 9 && strncmp(label, "MemTotal:", len) == 0) {
       mem_stats.mem_total = val * 1024;
-    } else if (strncmp(label, "MemFree:", 100) == 0) {
+    } else if (len == 8 && strncmp(label, "MemFree:", len) == 0) {
       mem_stats.mem_free = val * 1024;
-    } else if (strncmp(label, "Buffers:", 100) == 0) {
+    } else if (len == 8 && strncmp(label, "Buffers:", len) == 0) {
       mem_stats.mem_buffers = val * 1024;
-    } else if (strncmp(label, "Cached:", 100) == 0) {
+    } else if (len == 7 && strncmp(label, "Cached:", len) == 0) {
       mem_stats.mem_pagecache = val * 1024;
     }
   }
-  CHECK_EQ(fclose(mem_stat_fd), 0);
   return mem_stats;
 }
 
@@ -261,21 +275,17 @@ NetworkStatistics_t ProcFSMachine::GetNetworkStats() {
   // /proc/net/dev.
   NetworkStatistics_t net_stats;
   bzero(&net_stats, sizeof(NetworkStatistics_t));
-  string interface_path;
-  spf(&interface_path, "/sys/class/net/%s/statistics/",
-      FLAGS_monitor_netif.c_str());
-
   // Send
-  FILE* tx_stat_fd = fopen((interface_path + "/tx_bytes").c_str(), "r");
-  if (tx_stat_fd) {
-    CHECK_EQ(readunsigned(tx_stat_fd, &net_stats.send), 0);
-    CHECK_EQ(fclose(tx_stat_fd), 0);
+  const char* tx_data = netif_tx_bytes_.Read(NULL);
+  if (tx_data) {
+    ProcFSScanner scanner(tx_data);
+    CHECK(scanner.NextUInt64(&net_stats.send));
   }
   // Recv
-  FILE* rx_stat_fd = fopen((interface_path + "/rx_bytes").c_str(), "r");
-  if (rx_stat_fd) {
-    CHECK_EQ(readunsigned(rx_stat_fd, &net_stats.recv), 0);
-    CHECK_EQ(fclose(rx_stat_fd), 0);
+  const char* rx_data = netif_rx_bytes_.Read(NULL);
+  if (rx_data) {
+    ProcFSScanner scanner(rx_data);
+    CHECK(scanner.NextUInt64(&net_stats.recv));
   }
   return net_stats;
 }
@@ -27,6 +27,7 @@
 
 #include "base/resource_stats.pb.h"
 #include "platforms/unix/common.h"
+#include "platforms/unix/procfs_reader.h"
 
 namespace firmament {
 namespace platform_unix {
@@ -85,6 +86,12 @@ class ProcFSMachine {
   vector<CPUStatistics_t> cpu_stats_;
   DiskStatistics_t disk_stats_;
   NetworkStatistics_t net_stats_;
+  // Files sampled on every heartbeat; kept open between samples.
+  ProcFSFile proc_stat_;
+  ProcFSFile proc_meminfo_;
+  ProcFSFile blockdev_stat_;
+  ProcFSFile netif_tx_bytes_;
+  ProcFSFile netif_rx_bytes_;
 };
 
 }  // namespace platform_unix
@@ -29,73 +29,43 @@
 
 #include <boost/regex.hpp>
 
+#include "misc/map-util.h"
+
 namespace firmament {
 namespace platform_unix {
 
+// Number of fields in /proc/[pid]/stat that we parse; see proc(5).
+static const uint32_t kNumStatFields = 41;
+
 ProcFSMonitor::ProcFSMonitor(uint64_t polling_frequency)
-  : polling_frequency_(polling_frequency) {
+  : polling_frequency_(polling_frequency),
+    sample_pass_(0) {
   ticks_per_sec_ = sysconf(_SC_CLK_TCK);
   page_size_ = getpagesize();
 }
 
-void ProcFSMonitor::AddSchedStatsForPID(pid_t pid, ProcessStatistics_t* stats) {
-  // /proc/[pid]/schedstat parsing
-  string filename = "/proc/" + to_string(pid) + "/schedstat";
-  FILE* input = fopen(filename.c_str(), "r");
-  // The procfs file may no longer be there if the process has finished
-  if (!input)
-    return;
-  uint64_t tmp;
-  readunsigned(input, &tmp);
-  stats->sched_run_ticks += tmp;
-  readunsigned(input, &tmp);
-  stats->sched_wait_runnable_ticks += tmp;
-  readunsigned(input, &tmp);
-  stats->sched_run_timeslices += tmp;
-  CHECK_EQ(fclose(input), 0);
+ProcFSMonitor::~ProcFSMonitor() {
+  for (auto& pid_files : pid_files_) {
+    delete pid_files.second;
+  }
+  pid_files_.clear();
 }
 
-void ProcFSMonitor::AddStatsForPID(pid_t pid, ProcessStatistics_t* stats) {
-  // /proc/[pid]/stat parsing
-  string filename = "/proc/" + to_string(pid) + "/stat";
-  FILE* input = fopen(filename.c_str(), "r");
+void ProcFSMonitor::AddSchedStatsForPID(PIDFiles* files,
+                                        ProcessStatistics_t* stats) {
+  // /proc/[pid]/schedstat parsing
+  const char* data = files->schedstat.Read(NULL);
   // The procfs file may no longer be there if the process has finished
-  if (!input)
+  if (!data)
     return;
+  ProcFSScanner scanner(data);
   uint64_t tmp;
-  char tmp_str[PATH_MAX];
-  readone(input, &tmp);  // skip
-  readstr(input, tmp_str);  // skip
-  readchar(input, &tmp_str[0]);  // skip
-  skip(input, sizeof(uint64_t) * 6);
-  readone(input, &tmp);
-  stats->minflt += tmp;
-  readone(input, &tmp);
-  stats->cminflt += tmp;
-  readone(input, &tmp);
-  stats->majflt += tmp;
-  readone(input, &tmp);
-  stats->cmajflt += tmp;
-  readone(input, &tmp);
-  stats->utime += tmp;
-  readone(input, &tmp);
-  stats->stime += tmp;
-  readone(input, &tmp);
-  stats->cutime += tmp;
-  readone(input, &tmp);
-  stats->cstime += tmp;
-  readone(input, &tmp);
-  stats->num_threads += tmp;
-  readone(input, &tmp);  // skip
-  readunsigned(input, &tmp);  // skip
-  readone(input, &tmp);
-  stats->vsize += tmp;
-  readone(input, &tmp);
-  stats->rss += tmp;
-  readone(input, &tmp);
-  stats->rsslim += tmp;
-  skip(input, sizeof(uint64_t) * 16);  // skip remaining 16 fields
-  CHECK_EQ(fclose(input), 0);
+  if (scanner.NextUInt64(&tmp))
+    stats->sched_run_ticks += tmp;
+  if (scanner.NextUInt64(&tmp))
+    stats->sched_wait_runnable_ticks += tmp;
+  if (scanner.NextUInt64(&tmp))
+    stats->sched_run_timeslices += tmp;
 }
 
 void ProcFSMonitor::AggregateStatsForPIDTree(
@@ -103,79 +73,149 @@ void ProcFSMonitor::AggregateStatsForPIDTree(
     bool root,
     ProcessStatistics_t* stats) {
   VLOG(1) << "Adding stats for PID " << pid;
+  PIDFiles* files = GetPIDFiles(pid);
   // Grab information from /proc/[pid]/stat
-  if (root)
-    GetStatsForPID(pid, stats);
-  else
-    AddStatsForPID(pid, stats);
+  if (!GetStatsForPID(files, root, stats)) {
+    // The process has finished. Its files are reopened if the PID is reused.
+    ClosePIDFiles(pid);
+    return;
+  }
   // Grab information from /proc/[pid]/schedstat
-  AddSchedStatsForPID(pid, stats);
+  AddSchedStatsForPID(files, stats);
   // Now also aggregate from children
-  string filename = "/proc/" + to_string(pid) + "/task/" + to_string(pid)
-                    + "/children";
-  FILE* chld_input = fopen(filename.c_str(), "r");
-  if (!chld_input)
+  const char* data = files->children.Read(NULL);
+  if (!data)
     return;
   vector<uint64_t> children;
+  ProcFSScanner scanner(data);
   uint64_t tmp;
-  while (fscanf(chld_input, "%ju ", &tmp) > 0) {
+  while (scanner.NextUInt64(&tmp)) {
     VLOG(1) << "Found child " << tmp << " for " << pid;
     children.push_back(tmp);
   }
-  CHECK_EQ(fclose(chld_input), 0);
   for (uint64_t i = 0; i < children.size(); i++)
     AggregateStatsForPIDTree(children[i], false, stats);
 }
 
-void ProcFSMonitor::GetStatsForPID(pid_t pid, ProcessStatistics_t* stats) {
+void ProcFSMonitor::ClosePIDFiles(pid_t pid) {
+  PIDFiles* files = FindPtrOrNull(pid_files_, pid);
+  if (files) {
+    delete files;
+    pid_files_.erase(pid);
+  }
+}
+
+void ProcFSMonitor::ClosePIDFilesNotInPass() {
+  for (auto it = pid_files_.begin(); it != pid_files_.end();) {
+    if (it->second->last_pass != sample_pass_) {
+      delete it->second;
+      it = pid_files_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+ProcFSMonitor::PIDFiles* ProcFSMonitor::GetPIDFiles(pid_t pid) {
+  PIDFiles* files = FindPtrOrNull(pid_files_, pid);
+  if (!files) {
+    files = new PIDFiles;
+    string prefix = "/proc/" + to_string(pid);
+    files->stat.SetPath(prefix + "/stat");
+    files->schedstat.SetPath(prefix + "/schedstat");
+    files->children.SetPath(prefix + "/task/" + to_string(pid) + "/children");
+    CHECK(InsertIfNotPresent(&pid_files_, pid, files));
+  }
+  files->last_pass = sample_pass_;
+  return files;
+}
+
+bool ProcFSMonitor::GetStatsForPID(PIDFiles* files, bool root,
+                                   ProcessStatistics_t* stats) {
   // /proc/[pid]/stat parsing
-  string filename = "/proc/" + to_string(pid) + "/stat";
-  FILE* input = fopen(filename.c_str(), "r");
+  const char* data = files->stat.Read(NULL);
   // The procfs file may no longer be there if the process has finished
-  if (!input)
-    return;
-  readone(input, &stats->pid);
-  readstr(input, stats->comm);
-  readchar(input, &stats->state);
-  readone(input, &stats->ppid);
-  readone(input, &stats->pgid);
-  readone(input, &stats->sid);
-  readone(input, &stats->tty_nr);
-  readone(input, &stats->tpgid);
-  readone(input, &stats->flags);
-  readone(input, &stats->minflt);
-  readone(input, &stats->cminflt);
-  readone(input, &stats->majflt);
-  readone(input, &stats->cmajflt);
-  readone(input, &stats->utime);
-  readone(input, &stats->stime);
-  readone(input, &stats->cutime);
-  readone(input, &stats->cstime);
-  readone(input, &stats->priority);
-  readone(input, &stats->nice);
-  readone(input, &stats->num_threads);
-  readone(input, &stats->zero1);  // skip unmaintained itrealvalue field
-  readunsigned(input, &stats->starttime);
-  readone(input, &stats->vsize);
-  readone(input, &stats->rss);
-  readone(input, &stats->rsslim);
-  readone(input, &stats->startcode);
-  readone(input, &stats->endcode);
-  readone(input, &stats->startstack);
-  readone(input, &stats->esp);
-  readone(input, &stats->eip);
-  readone(input, &stats->pending);
-  readone(input, &stats->blocked);
-  readone(input, &stats->sigign);
-  readone(input, &stats->sigcatch);
-  readone(input, &stats->wchan);
-  readone(input, &stats->zero1);  // skip unmaintained nswap field
-  readone(input, &stats->zero2);  // skip unmaintained cnswap field
-  readone(input, &stats->exit_signal);
-  readone(input, &stats->cpu);
-  readone(input, &stats->rt_priority);
-  readone(input, &stats->policy);
-  CHECK_EQ(fclose(input), 0);
+  if (!data)
+    return false;
+  // The command name is in parentheses and may itself contain spaces and
+  // parentheses, so the fields after it are found from the last ')'.
+  // Fields are numbered from 1, as in proc(5)
+  uint64_t fields[kNumStatFields + 1];
+  const char* comm_start = strchr(data, '(');
+  ProcFSScanner scanner(data);
+  if (!scanner.NextUInt64(&fields[1]) || !comm_start ||
+      !scanner.SkipPastLast(')'))
+    return true;
+  const char* comm_end = scanner.position();
+  size_t len;
+  const char* state = scanner.NextToken(&len);
+  CHECK_NOTNULL(state);
+  for (uint32_t i = 4; i <= kNumStatFields; ++i) {
+    CHECK(scanner.NextUInt64(&fields[i])) << "Failed to parse field " << i
+                                          << " of " << files->stat.path();
+  }
+  if (root) {
+    size_t comm_len = min(static_cast<size_t>(comm_end - comm_start),
+                          static_cast<size_t>(PATH_MAX - 1));
+    memcpy(stats->comm, comm_start, comm_len);
+    stats->comm[comm_len] = '\0';
+    stats->pid = fields[1];
+    stats->state = state[0];
+    stats->ppid = fields[4];
+    stats->pgid = fields[5];
+    stats->sid = fields[6];
+    stats->tty_nr = fields[7];
+    stats->tpgid = fields[8];
+    stats->flags = fields[9];
+    stats->minflt = fields[10];
+    stats->cminflt = fields[11];
+    stats->majflt = fields[12];
+    stats->cmajflt = fields[13];
+    stats->utime = fields[14];
+    stats->stime = fields[15];
+    stats->cutime = fields[16];
+    stats->cstime = fields[17];
+    stats->priority = fields[18];
+    stats->nice = fields[19];
+    stats->num_threads = fields[20];
+    // Field 21 (itrealvalue) is no longer maintained
+    stats->starttime = fields[22];
+    stats->vsize = fields[23];
+    stats->rss = fields[24];
+    stats->rsslim = fields[25];
+    stats->startcode = fields[26];
+    stats->endcode = fields[27];
+    stats->startstack = fields[28];
+    stats->esp = fields[29];
+    stats->eip = fields[30];
+    stats->pending = fields[31];
+    stats->blocked = fields[32];
+    stats->sigign = fields[33];
+    stats->sigcatch = fields[34];
+    stats->wchan = fields[35];
+    // Fields 36 (nswap) and 37 (cnswap) are no longer maintained
+    stats->zero1 = fields[36];
+    stats->zero2 = fields[37];
+    stats->exit_signal = fields[38];
+    stats->cpu = fields[39];
+    stats->rt_priority = fields[40];
+    stats->policy = fields[41];
+  } else {
+    // Descendants' resource usage is added to the root's
+    stats->minflt += fields[10];
+    stats->cminflt += fields[11];
+    stats->majflt += fields[12];
+    stats->cmajflt += fields[13];
+    stats->utime += fields[14];
+    stats->stime += fields[15];
+    stats->cutime += fields[16];
+    stats->cstime += fields[17];
+    stats->num_threads += fields[20];
+    stats->vsize += fields[23];
+    stats->rss += fields[24];
+    stats->rsslim += fields[25];
+  }
+  return true;
 }
 
 vector<string>* ProcFSMonitor::FindMatchingLine(
@@ -201,13 +241,25 @@ const ProcFSMonitor::ProcessStatistics_t* ProcFSMonitor::ProcessInformation(
     pid_t pid, ProcessStatistics_t* stats) {
   if (stats == NULL) {
     stats = new ProcessStatistics_t;
-    bzero(stats, sizeof(ProcessStatistics_t));
   }
+  bzero(stats, sizeof(ProcessStatistics_t));
   // Grab information recursively for PID and its children
   AggregateStatsForPIDTree(pid, true, stats);
   return stats;
 }
 
+void ProcFSMonitor::ProcessInformation(const vector<pid_t>& pids,
+                                       vector<ProcessStatistics_t>* stats) {
+  stats->resize(pids.size());
+  ++sample_pass_;
+  for (uint64_t i = 0; i < pids.size(); ++i) {
+    ProcessStatistics_t* pid_stats = &(*stats)[i];
+    bzero(pid_stats, sizeof(ProcessStatistics_t));
+    AggregateStatsForPIDTree(pids[i], true, pid_stats);
+  }
+  ClosePIDFilesNotInPass();
+}
+
 void ProcFSMonitor::Run() {
   // Keep going until we're told to stop
   boost::unique_lock<boost::mutex> lock(stop_mut_);
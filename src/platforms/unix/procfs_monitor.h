@@ -32,6 +32,9 @@
 
 #include <boost/thread/condition.hpp>
 
+#include "base/common.h"
+#include "platforms/unix/procfs_reader.h"
+
 namespace firmament {
 namespace platform_unix {
 
@@ -99,8 +102,27 @@ class ProcFSMonitor {
   typedef ProcessStatistics ProcessStatistics_t;
   typedef SystemStatistics SystemStatistics_t;
   explicit ProcFSMonitor(uint64_t polling_frequency);
+  ~ProcFSMonitor();
+  /**
+   * Samples the statistics of one process, aggregated over its descendants.
+   * Unlike a full pass, this leaves the files of other processes open; only
+   * those of processes that have finished are closed.
+   * @param pid the root PID to sample
+   * @param stats the statistics to fill in, or NULL to allocate them
+   * @return the statistics
+   */
   const ProcessStatistics_t* ProcessInformation(pid_t pid,
       ProcessStatistics_t* stats);
+  /**
+   * Samples the statistics of several processes (each aggregated over its
+   * descendants) in one full pass. At the end of the pass, the ProcFS files
+   * of PIDs that were not reached are closed, so callers should always pass
+   * the complete set of PIDs that they monitor.
+   * @param pids the root PIDs to sample
+   * @param stats vector that receives one entry per PID, in the same order
+   */
+  void ProcessInformation(const vector<pid_t>& pids,
+                          vector<ProcessStatistics_t>* stats);
   void Run();
   void RunForPID(pid_t pid);
   void Stop();
@@ -114,30 +136,34 @@ class ProcFSMonitor {
   boost::mutex stop_mut_;
 
  private:
+  FRIEND_TEST(ProcFSMonitorTest, SinglePIDSampleKeepsOtherFiles);
+
+  // The ProcFS files of a process, kept open between samples.
+  struct PIDFiles {
+    ProcFSFile stat;
+    ProcFSFile schedstat;
+    ProcFSFile children;
+    // The sampling pass in which the process was last visited
+    uint64_t last_pass;
+  };
+
   // The polling frequency, specified in microseconds
   uint64_t polling_frequency_;
   uint64_t ticks_per_sec_;
   uint32_t page_size_;
-  void AddStatsForPID(pid_t pid, ProcessStatistics_t* stats);
-  void AddSchedStatsForPID(pid_t pid, ProcessStatistics_t* stats);
+  // Open ProcFS files for every process visited since the last full pass
+  unordered_map<pid_t, PIDFiles*> pid_files_;
+  uint64_t sample_pass_;
+  void AddSchedStatsForPID(PIDFiles* files, ProcessStatistics_t* stats);
   void AggregateStatsForPIDTree(pid_t pid, bool root,
                                 ProcessStatistics_t* stats);
+  void ClosePIDFiles(pid_t pid);
+  void ClosePIDFilesNotInPass();
   // Find a line matching the regular expression provided
   vector<string>* FindMatchingLine(const string& regexp, const string& data);
-  void GetStatsForPID(pid_t pid, ProcessStatistics_t* stats);
-  inline void readone(FILE* input, uint64_t *x) {
-    CHECK_EQ(fscanf(input, "%ju ", x), 1);
-  }
-  inline void readunsigned(FILE* input, uint64_t *x) {
-    CHECK_EQ(fscanf(input, "%ju ", x), 1);
-  }
-  inline void readstr(FILE* input, char *x) {
-    CHECK_EQ(fscanf(input, "%s ", x), 1);
-  }
-  inline void readchar(FILE* input, char *x) {
-    CHECK_EQ(fscanf(input, "%c ", x), 1);
-  }
-  inline void skip(FILE* input, int64_t num) {  fseek(input, num, SEEK_CUR); }
+  PIDFiles* GetPIDFiles(pid_t pid);
+  // Returns false if the process has finished
+  bool GetStatsForPID(PIDFiles* files, bool root, ProcessStatistics_t* stats);
 };
 
 }  // namespace platform_unix
@@ -24,10 +24,13 @@
 
 #include <boost/thread.hpp>
 
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "base/common.h"
+#include "misc/map-util.h"
 #include "platforms/unix/common.h"
 #include "platforms/unix/procfs_monitor.h"
 
@@ -112,6 +115,58 @@ TEST_F(ProcFSMonitorTest, SchedStatsTest) {
            pfsm_.ProcessInformation(pid, NULL)->sched_run_ticks);
 }
 
+// Tests that several processes are sampled in one pass, with the same
+// results as sampling them individually.
+TEST_F(ProcFSMonitorTest, BatchedProcessStatsTest) {
+  vector<pid_t> pids;
+  pids.push_back(getpid());
+  pids.push_back(getppid());
+  vector<ProcFSMonitor::ProcessStatistics_t> stats;
+  pfsm_.ProcessInformation(pids, &stats);
+  CHECK_EQ(stats.size(), pids.size());
+  for (uint64_t i = 0; i < pids.size(); ++i) {
+    CHECK_EQ(stats[i].pid, pids[i]);
+    ProcFSMonitor::ProcessStatistics_t single_stats;
+    pfsm_.ProcessInformation(pids[i], &single_stats);
+    CHECK_EQ(string(stats[i].comm), string(single_stats.comm));
+    CHECK_EQ(stats[i].ppid, single_stats.ppid);
+    CHECK_EQ(stats[i].starttime, single_stats.starttime);
+  }
+}
+
+// Tests that sampling a single process leaves the files of the processes
+// sampled in the last full pass open, and closes those of a process that
+// has finished.
+TEST_F(ProcFSMonitorTest, SinglePIDSampleKeepsOtherFiles) {
+  pid_t child_pid = fork();
+  CHECK_GE(child_pid, 0);
+  if (child_pid == 0) {
+    pause();
+    _exit(0);
+  }
+  vector<pid_t> pids;
+  pids.push_back(getppid());
+  vector<ProcFSMonitor::ProcessStatistics_t> stats;
+  pfsm_.ProcessInformation(pids, &stats);
+  CHECK(ContainsKey(pfsm_.pid_files_, getppid()));
+  ProcFSMonitor::ProcessStatistics_t child_stats;
+  pfsm_.ProcessInformation(child_pid, &child_stats);
+  CHECK_EQ(child_stats.pid, child_pid);
+  CHECK(ContainsKey(pfsm_.pid_files_, child_pid));
+  CHECK(ContainsKey(pfsm_.pid_files_, getppid()));
+  // Once the child has been reaped, its files go away on the next sample
+  CHECK_EQ(kill(child_pid, SIGKILL), 0);
+  CHECK_EQ(waitpid(child_pid, NULL, 0), child_pid);
+  pfsm_.ProcessInformation(child_pid, &child_stats);
+  CHECK(!ContainsKey(pfsm_.pid_files_, child_pid));
+  CHECK(ContainsKey(pfsm_.pid_files_, getppid()));
+  // A full pass closes the files of the processes that it did not reach
+  pids[0] = getpid();
+  pfsm_.ProcessInformation(pids, &stats);
+  CHECK(ContainsKey(pfsm_.pid_files_, getpid()));
+  CHECK(!ContainsKey(pfsm_.pid_files_, getppid()));
+}
+
 
 }  // namespace platform_unix
 }  // namespace firmament
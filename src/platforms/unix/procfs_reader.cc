@@ -0,0 +1,90 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Persistent-descriptor reader and integer scanner for ProcFS and sysfs
+// files that are sampled repeatedly.
+
+#include "platforms/unix/procfs_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace firmament {
+namespace platform_unix {
+
+// Large enough for /proc/stat on machines with a few dozen cores; the buffer
+// grows for larger files.
+static const size_t kInitialProcFSBufferSize = 4096;
+
+ProcFSFile::ProcFSFile()
+  : fd_(-1), buffer_(kInitialProcFSBufferSize) {
+}
+
+ProcFSFile::ProcFSFile(const string& path)
+  : path_(path), fd_(-1), buffer_(kInitialProcFSBufferSize) {
+}
+
+ProcFSFile::~ProcFSFile() {
+  Close();
+}
+
+void ProcFSFile::Close() {
+  if (fd_ >= 0) {
+    CHECK_EQ(close(fd_), 0);
+    fd_ = -1;
+  }
+}
+
+void ProcFSFile::SetPath(const string& path) {
+  Close();
+  path_ = path;
+}
+
+const char* ProcFSFile::Read(size_t* len) {
+  if (fd_ < 0) {
+    fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    // The file may no longer be there if the process has finished
+    if (fd_ < 0)
+      return NULL;
+  }
+  while (true) {
+    ssize_t bytes_read = pread(fd_, &buffer_[0], buffer_.size() - 1, 0);
+    if (bytes_read < 0) {
+      if (errno == EINTR)
+        continue;
+      VLOG(2) << "Failed to read " << path_ << ": " << strerror(errno);
+      Close();
+      return NULL;
+    }
+    if (static_cast<size_t>(bytes_read) == buffer_.size() - 1) {
+      // The file may have been truncated; retry with a larger buffer
+      buffer_.resize(buffer_.size() * 2);
+      continue;
+    }
+    buffer_[bytes_read] = '\0';
+    if (len)
+      *len = bytes_read;
+    return &buffer_[0];
+  }
+}
+
+}  // namespace platform_unix
+}  // namespace firmament
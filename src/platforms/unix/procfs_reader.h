@@ -0,0 +1,166 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Persistent-descriptor reader and integer scanner for ProcFS and sysfs
+// files that are sampled repeatedly.
+
+#ifndef FIRMAMENT_PLATFORMS_UNIX_PROCFS_READER_H
+#define FIRMAMENT_PLATFORMS_UNIX_PROCFS_READER_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "base/common.h"
+
+namespace firmament {
+namespace platform_unix {
+
+// Keeps a ProcFS file open and re-reads it from offset zero on every sample,
+// which regenerates its contents without another open/close pair. The file
+// is (re-)opened lazily, and closed when a read fails, e.g. because the
+// process it describes has exited.
+class ProcFSFile : private boost::noncopyable {
+ public:
+  ProcFSFile();
+  explicit ProcFSFile(const string& path);
+  ~ProcFSFile();
+
+  /**
+   * Closes the current file (if any) and sets the path to read from.
+   * @param path the file to read on subsequent calls to Read
+   */
+  void SetPath(const string& path);
+
+  /**
+   * Reads the whole file into the internal buffer.
+   * @param len set to the number of bytes read, if not NULL
+   * @return pointer to the NUL-terminated contents, valid until the next
+   * call to Read, or NULL if the file could not be read
+   */
+  const char* Read(size_t* len);
+
+  void Close();
+
+  inline bool is_open() const {
+    return fd_ >= 0;
+  }
+  inline const string& path() const {
+    return path_;
+  }
+
+ private:
+  string path_;
+  int fd_;
+  // Reusable read buffer; grows if a file does not fit.
+  vector<char> buffer_;
+};
+
+// Cursor over NUL-terminated ProcFS contents that parses whitespace-separated
+// integers without going through the stdio machinery.
+class ProcFSScanner {
+ public:
+  explicit ProcFSScanner(const char* data) : pos_(data) {
+  }
+
+  /**
+   * Parses the next integer, skipping leading whitespace. As with fscanf's
+   * %ju conversion, a leading minus sign negates the value modulo 2^64.
+   * @param value set to the integer parsed
+   * @return true if an integer was found
+   */
+  inline bool NextUInt64(uint64_t* value) {
+    SkipWhitespace();
+    bool negative = false;
+    if (*pos_ == '-') {
+      negative = true;
+      ++pos_;
+    }
+    if (*pos_ < '0' || *pos_ > '9')
+      return false;
+    uint64_t result = 0;
+    while (*pos_ >= '0' && *pos_ <= '9') {
+      result = result * 10 + static_cast<uint64_t>(*pos_ - '0');
+      ++pos_;
+    }
+    *value = negative ? -result : result;
+    return true;
+  }
+
+  /**
+   * Returns the next whitespace-delimited token.
+   * @param len set to the length of the token
+   * @return pointer to the start of the token (not NUL-terminated), or NULL
+   * at the end of the input
+   */
+  inline const char* NextToken(size_t* len) {
+    SkipWhitespace();
+    if (*pos_ == '\0')
+      return NULL;
+    const char* start = pos_;
+    while (*pos_ != '\0' && !IsWhitespace(*pos_))
+      ++pos_;
+    *len = pos_ - start;
+    return start;
+  }
+
+  /**
+   * Moves the cursor past the last occurrence of a character in the
+   * remaining input.
+   * @param c the character to look for
+   * @return false if the character does not occur
+   */
+  inline bool SkipPastLast(char c) {
+    const char* found = strrchr(pos_, c);
+    if (!found)
+      return false;
+    pos_ = found + 1;
+    return true;
+  }
+
+  inline void SkipLine() {
+    while (*pos_ != '\0' && *pos_ != '\n')
+      ++pos_;
+    if (*pos_ == '\n')
+      ++pos_;
+  }
+
+  inline const char* position() const {
+    return pos_;
+  }
+
+ private:
+  inline bool IsWhitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t';
+  }
+  inline void SkipWhitespace() {
+    while (IsWhitespace(*pos_))
+      ++pos_;
+  }
+
+  const char* pos_;
+};
+
+}  // namespace platform_unix
+}  // namespace firmament
+
+#endif  // FIRMAMENT_PLATFORMS_UNIX_PROCFS_READER_H
@@ -0,0 +1,103 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// ProcFS reader and scanner unit tests.
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "base/common.h"
+#include "platforms/unix/procfs_reader.h"
+
+namespace firmament {
+namespace platform_unix {
+
+// Tests that integers and tokens are scanned like fscanf would.
+TEST(ProcFSScannerTest, ScanIntegersAndTokens) {
+  ProcFSScanner scanner("cpu  12 0 -1\nMemTotal:  42 kB\n");
+  size_t len;
+  const char* token = scanner.NextToken(&len);
+  CHECK_EQ(string(token, len), "cpu");
+  uint64_t value;
+  CHECK(scanner.NextUInt64(&value));
+  CHECK_EQ(value, 12);
+  CHECK(scanner.NextUInt64(&value));
+  CHECK_EQ(value, 0);
+  CHECK(scanner.NextUInt64(&value));
+  CHECK_EQ(value, UINT64_MAX);
+  token = scanner.NextToken(&len);
+  CHECK_EQ(string(token, len), "MemTotal:");
+  CHECK(scanner.NextUInt64(&value));
+  CHECK_EQ(value, 42);
+  CHECK(!scanner.NextUInt64(&value));
+  scanner.SkipLine();
+  CHECK(scanner.NextToken(&len) == NULL);
+}
+
+// Tests that fields following a command name containing parentheses and
+// spaces are found.
+TEST(ProcFSScannerTest, SkipPastCommandName) {
+  ProcFSScanner scanner("123 (a (b) c) S 1 2");
+  uint64_t value;
+  CHECK(scanner.NextUInt64(&value));
+  CHECK_EQ(value, 123);
+  CHECK(scanner.SkipPastLast(')'));
+  size_t len;
+  const char* state = scanner.NextToken(&len);
+  CHECK_EQ(string(state, len), "S");
+  CHECK(scanner.NextUInt64(&value));
+  CHECK_EQ(value, 1);
+  CHECK(!ProcFSScanner("no parens").SkipPastLast(')'));
+}
+
+// Tests that re-reading an open file returns its current contents.
+TEST(ProcFSFileTest, RereadsFromStart) {
+  char path[] = "/tmp/procfs_reader_testXXXXXX";
+  int fd = mkstemp(path);
+  CHECK_GE(fd, 0);
+  CHECK_EQ(write(fd, "1 2 3", 5), 5);
+  ProcFSFile file(path);
+  size_t len;
+  CHECK_EQ(string(file.Read(&len)), "1 2 3");
+  CHECK_EQ(len, 5);
+  CHECK(file.is_open());
+  // Contents larger than the initial buffer are read completely.
+  string large(10000, '7');
+  CHECK_EQ(pwrite(fd, large.data(), large.size(), 0), large.size());
+  CHECK_EQ(string(file.Read(&len)), large);
+  CHECK_EQ(close(fd), 0);
+  CHECK_EQ(unlink(path), 0);
+  // The file is still open, so it remains readable.
+  CHECK_NOTNULL(file.Read(&len));
+  file.Close();
+  CHECK(file.Read(&len) == NULL);
+}
+
+}  // namespace platform_unix
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -30,6 +30,13 @@
 
 using boost::asio::ip::tcp;
 
+DEFINE_int32(messaging_await_timeout_ms, 10,
+             "Maximum time in milliseconds for which the messaging adapter "
+             "blocks waiting for incoming messages.");
+DEFINE_uint64(max_async_send_queue_length, 1024,
+              "Maximum number of messages queued for asynchronous sending on "
+              "a stream sockets channel.");
+
 namespace firmament {
 namespace platform_unix {
 namespace streamsockets {
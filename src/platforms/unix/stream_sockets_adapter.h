@@ -42,8 +42,11 @@
 #include "platforms/common.h"
 #include "platforms/unix/tcp_connection.h"
 #include "platforms/unix/async_tcp_server.h"
+#include "platforms/unix/epoll_reactor.h"
 #include "platforms/unix/stream_sockets_channel.h"
 
+DECLARE_int32(messaging_await_timeout_ms);
+
 namespace firmament {
 namespace platform_unix {
 namespace streamsockets {
@@ -55,8 +58,7 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
   private boost::noncopyable {
  public:
   StreamSocketsAdapter() : message_recv_handler_(NULL),
-    error_path_handler_(NULL),
-    message_wait_ready_(false) {
+    error_path_handler_(NULL) {
   }
 
   virtual ~StreamSocketsAdapter() {
@@ -64,52 +66,23 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
     StopListen();
   }
 
+  /**
+   * Waits for up to --messaging_await_timeout_ms for messages to arrive and
+   * dispatches the received messages. Only the channels whose sockets are
+   * readable are visited, and only the messages that have fully arrived are
+   * dispatched.
+   */
   void AwaitNextMessage() {
-    boost::lock_guard<boost::mutex> lock(endpoint_channel_map_mutex_);
-    VLOG(3) << "Iterating over " << endpoint_channel_map_.size()
-            << " active channels in adapter " << this;
     if (VLOG_IS_ON(3))
       DumpActiveChannels();
-    // If we have no active channels, we cannot receive any messages, so we
-    // return immediately.
-    if (endpoint_channel_map_.size() == 0)
-      return;
-    // Otherwise, let's make sure we have an outstanding async receive request
-    // for each fo them.
-    {
-      boost::lock_guard<boost::mutex> envel_lock(channel_recv_envelopes_mutex_);
-      for (__typeof__(endpoint_channel_map_.begin()) chan_iter =
-             endpoint_channel_map_.begin();
-           chan_iter != endpoint_channel_map_.end();
-           ++chan_iter) {
-        StreamSocketsChannel<T>* chan = chan_iter->second;
-        if (!channel_recv_envelopes_.count(chan)) {
-          // No outstanding receive request for this channel, so create one
-          Envelope<T>* envelope = new Envelope<T>();
-          CHECK(InsertIfNotPresent(&channel_recv_envelopes_, chan, envelope));
-          VLOG(2) << "MA replenishing envelope for channel " << chan
-                  << " at " << envelope;
-          chan->RecvA(envelope,
-                      boost::bind(&StreamSocketsAdapter::HandleAsyncMessageRecv,
-                                  this,
-                                  boost::asio::placeholders::error,
-                                  boost::asio::placeholders::bytes_transferred,
-                                  chan));
-        }
-      }
-    }
-    /*if (any_outstanding) {
-    // Block until we receive a message somewhere
-    VLOG(3) << "About to lock mutex...";
-    boost::unique_lock<boost::mutex> lock(message_wait_mutex_);
-    VLOG(3) << "Locked!...";
-    while (!message_wait_ready_) {
-    VLOG(3) << "Waiting for condvar...";
-    message_wait_condvar_.wait(lock);
+    vector<void*> ready_channels;
+    reactor_.Wait(FLAGS_messaging_await_timeout_ms, &ready_channels);
+    VLOG(3) << ready_channels.size() << " of " << reactor_.num_registered()
+            << " channels ready in adapter " << this;
+    for (auto& ready_channel : ready_channels) {
+      HandleChannelReadable(
+          static_cast<StreamSocketsChannel<T>*>(ready_channel));
     }
-    VLOG(3) << "Message arrived, condvar signalled!";
-    message_wait_ready_ = false;
-    }*/
   }
 
   void AddChannelForConnection(TCPConnection::connection_ptr connection) {
@@ -120,16 +93,15 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
             << ", channel is " << *channel << ", remote endpoint: "
             << endpoint_name;
     boost::lock_guard<boost::mutex> lock(endpoint_channel_map_mutex_);
-    InsertIfNotPresent(&endpoint_channel_map_, endpoint_name, channel);
+    if (InsertIfNotPresent(&endpoint_channel_map_, endpoint_name, channel))
+      RegisterChannel(channel);
     if (VLOG_IS_ON(3))
       DumpActiveChannels();
-    // Unblock any waiters, since there's now an additional connection
-    message_wait_ready_ = true;
-    message_wait_condvar_.notify_all();
   }
 
   void CloseChannel(MessagingChannelInterface<T>* channel) {
     VLOG(1) << "Shutting down channel " << channel;
+    DeregisterChannel(static_cast<StreamSocketsChannel<T>*>(channel));
     channel->Close();
   }
 
@@ -161,10 +133,6 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
       return;*/
     CHECK(!ListenReady());
     CHECK_EQ(endpoint_channel_map_.size(), 0);
-    CHECK_EQ(channel_recv_envelopes_.size(), 0);
-    message_wait_mutex_.lock();
-    message_wait_ready_ = false;
-    message_wait_mutex_.unlock();
     VLOG(1) << "Creating an async TCP server on port " << port
             << " on endpoint " << hostname;
     tcp_server_.reset(new AsyncTCPServer(
@@ -223,6 +191,7 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
            chan_iter != endpoint_channel_map_.end();
            ++chan_iter) {
         VLOG(2) << "Closing associated channel at " << chan_iter->second;
+        DeregisterChannel(chan_iter->second);
         chan_iter->second->Close();
       }
       VLOG(2) << "Stopping async TCP server at " << tcp_server_ << "...";
@@ -231,12 +200,17 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
       tcp_server_thread_->join();
       VLOG(2) << "TCP server thread joined.";
     }
-    message_wait_condvar_.notify_all();
     // XXX(malte): We would prefer if channels cleared up after themselves, but
     // for the moment, this is a sledgehammer approach.
-    VLOG(1) << "Dropping channels and outstanding requests...";
+    VLOG(1) << "Dropping channels...";
+    {
+      boost::lock_guard<boost::mutex> lock(channel_fds_mutex_);
+      for (auto& channel_fd : channel_fds_) {
+        reactor_.Deregister(channel_fd.second);
+      }
+      channel_fds_.clear();
+    }
     endpoint_channel_map_.clear();
-    channel_recv_envelopes_.clear();
   }
 
   ostream& ToString(ostream* stream) const {
@@ -260,72 +234,76 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
   }
 
  private:
-  void HandleAsyncMessageRecv(
-      const boost::system::error_code& error,
-      uint64_t bytes_transferred,
-      StreamSocketsChannel<T>* chan) {
-    if (error) {
-      VLOG(1) << "Failed to receive message on MA " << *this;
-      // TODO(malte): think about clearing up state here. Should we consider the
-      // envelope as having been consumed? Currently we do so.
-      // XXX(malte): the below is possibly unsafe in some way, especially w.r.t.
-      // concurrency
-      string remote_endpoint = chan->RemoteEndpointString();
-      if (remote_endpoint != "") {
-        boost::lock_guard<boost::mutex> lock(endpoint_channel_map_mutex_);
-        boost::lock_guard<boost::mutex> envel_lock(
-            channel_recv_envelopes_mutex_);
-        CHECK(endpoint_channel_map_.erase(remote_endpoint));
-        CHECK(channel_recv_envelopes_.erase(chan));
+  void DeregisterChannel(StreamSocketsChannel<T>* chan) {
+    boost::lock_guard<boost::mutex> lock(channel_fds_mutex_);
+    int* fd = FindOrNull(channel_fds_, chan);
+    if (fd) {
+      reactor_.Deregister(*fd);
+      channel_fds_.erase(chan);
+    }
+  }
+
+  void HandleChannelReadable(StreamSocketsChannel<T>* chan) {
+    // Never blocks: a message that has only partly arrived stays buffered in
+    // the channel until the rest of it is readable.
+    boost::system::error_code error;
+    bool connected = chan->RecvAvailable(&error);
+    // Dispatch the complete messages, even if the connection has failed
+    // since they arrived.
+    while (true) {
+      Envelope<T> envelope;
+      bool parsed = false;
+      if (!chan->NextBufferedMessage(&envelope, &parsed))
+        break;
+      if (parsed) {
+        VLOG(2) << "Received in MA: " << envelope;
+        // Invoke message receipt callback, if any registered
+        CHECK(message_recv_handler_ != NULL);
+        message_recv_handler_(envelope.data(), chan->RemoteEndpointString());
       } else {
-        LOG(ERROR) << "Failed to receive on channel at " << chan
-                   << ", which no longer has an endpoint set. Cannot remove "
-                   << "from endpoint/channel map!";
+        LOG(ERROR) << "Failed to parse message received on channel " << chan
+                   << "; message discarded.";
       }
-      // After we have removed the channel from the map of active channels and
-      // deleted its next receive envelope, we can close it without danger.
-      chan->Close();
-      // Finally, we also need to ask the TCP server to remove the connection
-      // from its map of connections
-      if (tcp_server_)
-        tcp_server_->DropConnectionForEndpoint(remote_endpoint);
-      // At this point, we unlock and signal to the condition variable, so that
-      // we can pick another channel to receive on, or go back to the idle loop
-      // (if no other channels are available).
-      message_wait_ready_ = true;
-      message_wait_condvar_.notify_all();
-      // Invoke error callback, if any registered
-      if (error_path_handler_)
-        error_path_handler_(error, remote_endpoint);
-      else
-        LOG(ERROR) << "Unhandled error condition for failed receive from "
-                   << remote_endpoint;
-      return;
     }
-    CHECK_GT(channel_recv_envelopes_.count(chan), 0)
-      << "No envelopes around when we expected to have at least one.";
-    Envelope<T>* envelope = FindPtrOrNull(channel_recv_envelopes_, chan);
-    CHECK_NOTNULL(envelope);
-    VLOG(2) << "Received in MA: " << *envelope << " ("
-            << bytes_transferred << ")";
-    // Invoke message receipt callback, if any registered
-    CHECK(message_recv_handler_ != NULL);
-    message_recv_handler_(envelope->data(), chan->RemoteEndpointString());
-    // We've finished dealing with this message, so clean up now.
-    {
-      boost::lock_guard<boost::mutex> lock(channel_recv_envelopes_mutex_);
-      channel_recv_envelopes_.erase(chan);
-      delete envelope;
-    }
-    {
-      boost::lock_guard<boost::mutex> lock(message_wait_mutex_);
-      message_wait_ready_ = true;
+    if (!connected)
+      HandleRecvError(error, chan);
+  }
+
+  void HandleRecvError(const boost::system::error_code& error,
+                       StreamSocketsChannel<T>* chan) {
+    VLOG(1) << "Failed to receive message on MA " << *this;
+    // The socket keeps being reported as ready until it is removed from the
+    // reactor.
+    DeregisterChannel(chan);
+    string remote_endpoint = chan->RemoteEndpointString();
+    if (remote_endpoint != "") {
+      boost::lock_guard<boost::mutex> lock(endpoint_channel_map_mutex_);
+      endpoint_channel_map_.erase(remote_endpoint);
+    } else {
+      LOG(ERROR) << "Failed to receive on channel at " << chan
+                 << ", which no longer has an endpoint set. Cannot remove "
+                 << "from endpoint/channel map!";
     }
-    // TODO(malte): Not sure if we want notify_all here. So far, we assume that
-    // there is only one call to AwaitNextMessage() processing at any time; but
-    // this is not enforced. In fact, the below may work in that it gives us
-    // what is essentially broadcast semantics if multiple threads are waiting.
-    message_wait_condvar_.notify_all();
+    // After we have removed the channel from the map of active channels, we
+    // can close it without danger.
+    chan->Close();
+    // Finally, we also need to ask the TCP server to remove the connection
+    // from its map of connections
+    if (tcp_server_)
+      tcp_server_->DropConnectionForEndpoint(remote_endpoint);
+    // Invoke error callback, if any registered
+    if (error_path_handler_)
+      error_path_handler_(error, remote_endpoint);
+    else
+      LOG(ERROR) << "Unhandled error condition for failed receive from "
+                 << remote_endpoint;
+  }
+
+  void RegisterChannel(StreamSocketsChannel<T>* chan) {
+    boost::lock_guard<boost::mutex> lock(channel_fds_mutex_);
+    int fd = chan->NativeHandle();
+    if (reactor_.Register(fd, chan))
+      CHECK(InsertIfNotPresent(&channel_fds_, chan, fd));
   }
 
   bool _EstablishChannel(const string& endpoint_uri,
@@ -334,7 +312,9 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
             << ", chan: " << *chan << "!";
     bool result = chan->Establish(endpoint_uri);
     boost::lock_guard<boost::mutex> lock(endpoint_channel_map_mutex_);
-    InsertIfNotPresent(&endpoint_channel_map_, endpoint_uri, chan);
+    if (InsertIfNotPresent(&endpoint_channel_map_, endpoint_uri, chan) &&
+        result)
+      RegisterChannel(chan);
     return result;
   }
 
@@ -344,13 +324,14 @@ class StreamSocketsAdapter : public firmament::MessagingAdapterInterface<T>,
   scoped_ptr<boost::thread> tcp_server_thread_;
   //set<shared_ptr<StreamSocketsChannel<T> > > active_channels_;
   unordered_map<string, StreamSocketsChannel<T>*> endpoint_channel_map_;
-  unordered_map<StreamSocketsChannel<T>*, Envelope<T>*> channel_recv_envelopes_;
+  // The socket of each channel registered with the reactor. We keep the fd
+  // since server-side channels drop their socket when closed.
+  unordered_map<StreamSocketsChannel<T>*, int> channel_fds_;
+  // Watches the sockets of all active channels.
+  EpollReactor reactor_;
   // Synchronization variables, locks tec.
-  boost::mutex message_wait_mutex_;
-  boost::condition_variable message_wait_condvar_;
-  boost::mutex channel_recv_envelopes_mutex_;
+  boost::mutex channel_fds_mutex_;
   boost::mutex endpoint_channel_map_mutex_;
-  bool message_wait_ready_;
 };
 
 }  // namespace streamsockets
@@ -25,6 +25,10 @@
 
 #include <boost/asio.hpp>
 
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -40,6 +44,8 @@
 #include "platforms/unix/tcp_connection.h"
 #include "platforms/unix/async_tcp_server.h"
 
+DECLARE_uint64(max_async_send_queue_length);
+
 namespace firmament {
 namespace platform_unix {
 namespace streamsockets {
@@ -58,8 +64,8 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
   typedef shared_ptr<type> ptr_type;
 
   explicit StreamSocketsChannel(StreamSocketType type)
-    : async_recv_buffer_(NULL),
-      async_recv_buffer_vec_(NULL),
+    : recv_buffer_offset_(0),
+      async_recv_size_(0),
       client_io_service_(new io_service),
       client_socket_(NULL),
       channel_ready_(false),
@@ -77,8 +83,8 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
   }
 
   explicit StreamSocketsChannel(TCPConnection::connection_ptr connection)
-    : async_recv_buffer_(NULL),
-      async_recv_buffer_vec_(NULL),
+    : recv_buffer_offset_(0),
+      async_recv_size_(0),
       client_socket_(connection->socket()),
       client_connection_(connection),
       channel_ready_(false),
@@ -98,6 +104,12 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
         io_service_work_.reset(); // ~work();
       Close();
     }
+    for (auto& request : async_send_queue_) {
+      delete request.buffer;
+    }
+    for (auto& buffer : async_send_buffer_pool_) {
+      delete buffer;
+    }
     VLOG(2) << "Channel at " << this << " destroyed.";
   }
 
@@ -229,16 +241,10 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
     }
     // Obtain the lock on the async receive buffer.
     async_recv_lock_.lock();
-    CHECK_EQ(async_recv_buffer_vec_, static_cast<char*>(NULL));
-    CHECK_EQ(async_recv_buffer_,
-             static_cast<boost::asio::mutable_buffers_1*>(NULL));
-    async_recv_buffer_vec_ = reinterpret_cast<char*>(malloc(sizeof(uint64_t)));
-    async_recv_buffer_ =
-      new boost::asio::mutable_buffers_1(async_recv_buffer_vec_,
-                                         sizeof(uint64_t));
     // Asynchronously read the incoming protobuf message length and invoke the
     // second stage of the receive call once we have it.
-    async_read(*client_socket_, *async_recv_buffer_,
+    async_read(*client_socket_,
+               boost::asio::buffer(&async_recv_size_, sizeof(uint64_t)),
                boost::asio::transfer_exactly(sizeof(uint64_t)),
                boost::bind(&StreamSocketsChannel<T>::RecvASecondStage,
                            this,
@@ -253,62 +259,169 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
    * Synchronous receive -- blocks until the next message is received.
    */
   bool RecvS(misc::Envelope<T>* message) {
-    boost::lock_guard<boost::mutex> lock(sync_send_lock_);
+    boost::system::error_code error;
+    return RecvS(message, &error);
+  }
+
+  /**
+   * Synchronous receive that reports why it failed. If the channel's socket
+   * is readable, this only blocks until the rest of the message arrives.
+   * @param message the envelope to parse the message into
+   * @param error set to the I/O error if the receive failed
+   * @return true if a message was received
+   */
+  bool RecvS(misc::Envelope<T>* message, boost::system::error_code* error) {
+    boost::lock_guard<boost::mutex> lock(sync_recv_lock_);
     VLOG(2) << "In RecvS, polling for next message";
     if (!Ready()) {
       LOG(WARNING) << "Tried to read from channel " << this
                    << ", which is not ready; read failed.";
+      *error = boost::asio::error::not_connected;
       return false;
     }
     uint64_t len;
-    vector<char> size_buf(sizeof(uint64_t));
+    uint64_t msg_size_endian;
     boost::asio::mutable_buffers_1 size_m_buf(
-        reinterpret_cast<char*>(&size_buf[0]), sizeof(uint64_t));
-    boost::system::error_code error;
+        reinterpret_cast<char*>(&msg_size_endian), sizeof(uint64_t));
     // Read the incoming protobuf message length
     // N.B.: read() blocks until the buffer has been filled, i.e. an entire
     // uint64_t has been read.
     len = read(*client_socket_, size_m_buf,
-               boost::asio::transfer_exactly(sizeof(uint64_t)), error);
-    if (error || len != sizeof(uint64_t)) {
+               boost::asio::transfer_exactly(sizeof(uint64_t)), *error);
+    if (*error == boost::asio::error::eof) {
+      VLOG(1) << "Received EOF, connection terminating!";
+      return false;
+    } else if (*error || len != sizeof(uint64_t)) {
       LOG(ERROR) << "Error reading from connection on channel " << *this
                  << "(len: " << len << ", expected: " << sizeof(uint64_t) << ")"
-                 << ": " << error.message();
-      if (error)
-        HandleIOError(error);
+                 << ": " << error->message();
+      if (*error)
+        HandleIOError(*error);
+      else
+        *error = boost::asio::error::message_size;
       return false;
     }
     // ... we can get away with a simple CHECK here and assume that we have some
     // incoming data available.
     CHECK_EQ(sizeof(uint64_t), len);
-    uint64_t msg_size = be64toh(*reinterpret_cast<uint64_t*>(&size_buf[0]));
+    uint64_t msg_size = be64toh(msg_size_endian);
     CHECK_GT(msg_size, 0);
     VLOG(3) << "RecvS: size of incoming protobuf from" << RemoteEndpointString()
             << "is " << msg_size << " bytes.";
     // XXX(malte): This is a nasty hack to highlight bugs in the channel logic.
-    CHECK_LT(msg_size, 35000) << "Received implausibly large message size "
-                              << "from " << RemoteEndpointString();
-    vector<char> buf(msg_size);
+    // N.B.: Same bound as in RecvASecondStage.
+    CHECK_LT(msg_size, 1024*1024) << "Received implausibly large message "
+                                  << "from " << RemoteEndpointString();
+    // The buffer keeps its capacity across calls, so it is only reallocated
+    // when a larger message than any before arrives.
+    sync_recv_buffer_.resize(msg_size);
     len = read(*client_socket_,
-               boost::asio::mutable_buffers_1(&buf[0], msg_size),
-               boost::asio::transfer_exactly(msg_size), error);
+               boost::asio::mutable_buffers_1(&sync_recv_buffer_[0], msg_size),
+               boost::asio::transfer_exactly(msg_size), *error);
     VLOG(2) << "Read " << len << " bytes.";
 
-    if (error == boost::asio::error::eof) {
+    if (*error == boost::asio::error::eof) {
       VLOG(1) << "Received EOF, connection terminating!";
       return false;
-    } else if (error) {
+    } else if (*error) {
       LOG(ERROR) << "Error reading from connection: "
-                 << error.message();
-      HandleIOError(error);
+                 << error->message();
+      HandleIOError(*error);
       return false;
     } else {
       VLOG(2) << "Read " << len << " bytes of protobuf data...";
     }
     CHECK_GT(len, 0);
     CHECK_EQ(len, msg_size);
-    // XXX(malte): data copy here -- optimize away if possible.
-    return (message->Parse(&buf[0], len));
+    return (message->Parse(&sync_recv_buffer_[0], len));
+  }
+
+  /**
+   * Non-blocking receive. Reads the data that is available on the channel's
+   * socket into the channel's receive buffer, without waiting for more. Use
+   * NextBufferedMessage to take the complete messages from the buffer. Must
+   * not be mixed with RecvS and RecvA on the same channel.
+   * @param error set to the I/O error if the connection failed or was closed
+   * @return false if the connection failed or was closed
+   */
+  bool RecvAvailable(boost::system::error_code* error) {
+    boost::lock_guard<boost::mutex> lock(sync_recv_lock_);
+    if (!Ready()) {
+      LOG(WARNING) << "Tried to read from channel " << this
+                   << ", which is not ready; read failed.";
+      *error = boost::asio::error::not_connected;
+      return false;
+    }
+    // Drop the messages that have already been taken from the buffer.
+    if (recv_buffer_offset_ > 0) {
+      recv_buffer_.erase(recv_buffer_.begin(),
+                         recv_buffer_.begin() + recv_buffer_offset_);
+      recv_buffer_offset_ = 0;
+    }
+    int fd = client_socket_->native_handle();
+    while (true) {
+      size_t buffered = recv_buffer_.size();
+      recv_buffer_.resize(buffered + kRecvChunkSize);
+      ssize_t len = recv(fd, &recv_buffer_[buffered], kRecvChunkSize,
+                         MSG_DONTWAIT);
+      recv_buffer_.resize(buffered + (len > 0 ? len : 0));
+      if (len > 0) {
+        continue;
+      } else if (len == 0) {
+        VLOG(1) << "Received EOF, connection terminating!";
+        *error = boost::asio::error::eof;
+        return false;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        VLOG(2) << "Buffered " << recv_buffer_.size() << " bytes on channel "
+                << *this;
+        return true;
+      } else if (errno != EINTR) {
+        *error = boost::system::error_code(errno,
+                                           boost::system::system_category());
+        LOG(ERROR) << "Error reading from connection on channel " << *this
+                   << ": " << error->message();
+        HandleIOError(*error);
+        return false;
+      }
+    }
+  }
+
+  /**
+   * Takes the next complete message from the channel's receive buffer. A
+   * partially received message stays in the buffer until the rest of it has
+   * been read by RecvAvailable.
+   * @param message the envelope to parse the message into
+   * @param parsed set to true if the message could be parsed
+   * @return false if the buffer does not hold a complete message
+   */
+  bool NextBufferedMessage(misc::Envelope<T>* message, bool* parsed) {
+    boost::lock_guard<boost::mutex> lock(sync_recv_lock_);
+    size_t buffered = recv_buffer_.size() - recv_buffer_offset_;
+    if (buffered < sizeof(uint64_t))
+      return false;
+    uint64_t msg_size_endian;
+    memcpy(&msg_size_endian, &recv_buffer_[recv_buffer_offset_],
+           sizeof(uint64_t));
+    uint64_t msg_size = be64toh(msg_size_endian);
+    CHECK_GT(msg_size, 0) << "Received message of length 0 from "
+                          << RemoteEndpointString();
+    // N.B.: Same bound as in RecvS and RecvASecondStage.
+    CHECK_LT(msg_size, 1024*1024) << "Received implausibly large message "
+                                  << "from " << RemoteEndpointString();
+    if (buffered < sizeof(uint64_t) + msg_size)
+      return false;
+    *parsed = message->Parse(
+        &recv_buffer_[recv_buffer_offset_ + sizeof(uint64_t)], msg_size);
+    recv_buffer_offset_ += sizeof(uint64_t) + msg_size;
+    return true;
+  }
+
+  /**
+   * Get the file descriptor of the channel's socket.
+   */
+  int NativeHandle() {
+    CHECK_NOTNULL(client_socket_);
+    return client_socket_->native_handle();
   }
 
   /**
@@ -329,29 +442,13 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
     boost::lock_guard<boost::mutex> lock(sync_send_lock_);
     VLOG(2) << "Trying to send message of size " << message.size()
             << " on channel " << *this;
-    uint64_t msg_size = message.size();
-    vector<char> buf(msg_size);
-    CHECK(message.Serialize(&buf[0], message.size()));
-    // Send data size
+    CHECK(FrameMessage(message, &sync_send_buffer_));
+    // Send the size preamble and the data with a single write.
     boost::system::error_code error;
-    uint64_t msg_size_endian = htobe64(msg_size);
-
     uint64_t len = boost::asio::write(
-        *client_socket_, boost::asio::buffer(
-            reinterpret_cast<char*>(&msg_size_endian), sizeof(msg_size_endian)),
-        boost::asio::transfer_exactly(sizeof(uint64_t)), error);
-    if (error || len != sizeof(uint64_t)) {
-      LOG(ERROR) << "Error sending size preamble on connection: "
-                 << error.message();
-      if (error)
-        HandleIOError(error);
-      return false;
-    }
-    // Send the data
-    len = boost::asio::write(
-        *client_socket_, boost::asio::buffer(buf, msg_size),
-        boost::asio::transfer_exactly(msg_size), error);
-    if (error || len != msg_size) {
+        *client_socket_, boost::asio::buffer(sync_send_buffer_),
+        boost::asio::transfer_exactly(sync_send_buffer_.size()), error);
+    if (error || len != sync_send_buffer_.size()) {
       LOG(ERROR) << "Error sending message on connection: "
                  << error.message();
       if (error)
@@ -365,30 +462,43 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
   }
 
   /**
-   * Asynchronous send.
+   * Asynchronous send. The message is serialized before returning, and
+   * messages are sent in the order in which SendA was called.
    * N.B.: error handling is deferred to the callback handler, which takes a
-   * boost::system:error_code.
+   * boost::system:error_code and the number of bytes sent, including the
+   * size preamble. SendA and SendS must not be used concurrently on the same
+   * channel, as their writes may interleave.
+   * @return false if the channel is not ready or if
+   * --max_async_send_queue_length messages are already queued
    */
   bool SendA(const misc::Envelope<T>& message,
              typename AsyncSendHandler<T>::type callback) {
-    LOG(FATAL) << "Should not currently use broken SendA!";
     VLOG(2) << "Trying to asynchronously send message: " << message;
-    uint64_t msg_size = message.size();
-    // XXX(malte): not freed correctly!
-    vector<char>* buf = new vector<char>(msg_size);
-    CHECK(message.Serialize(&buf[0], msg_size));
-
-    uint64_t msg_size_endian = htobe64(msg_size);
-    // Synchronously send data size first
-    // XXX(malte): broken, sends async
-    boost::asio::async_write(
-        *client_socket_, boost::asio::buffer(
-             reinterpret_cast<char*>(&msg_size_endian),
-             sizeof(msg_size_endian)),
-        callback);
-    // Send the data
-    boost::asio::async_write(
-        *client_socket_, boost::asio::buffer(buf, msg_size), callback);
+    if (!Ready()) {
+      LOG(WARNING) << "Tried to send on channel " << this
+                   << ", which is not ready; send failed.";
+      return false;
+    }
+    boost::lock_guard<boost::mutex> lock(async_send_lock_);
+    if (async_send_queue_.size() >= FLAGS_max_async_send_queue_length) {
+      LOG(WARNING) << "Async send queue of channel " << *this << " is full; "
+                   << "send failed.";
+      return false;
+    }
+    AsyncSendRequest request;
+    if (async_send_buffer_pool_.empty()) {
+      request.buffer = new vector<char>();
+    } else {
+      request.buffer = async_send_buffer_pool_.back();
+      async_send_buffer_pool_.pop_back();
+    }
+    request.callback = callback;
+    CHECK(FrameMessage(message, request.buffer));
+    async_send_queue_.push_back(request);
+    if (async_send_queue_.size() == 1) {
+      // No send in progress.
+      StartAsyncSend();
+    }
     return true;
   }
 
@@ -397,6 +507,75 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
   }
 
  protected:
+  struct AsyncSendRequest {
+    vector<char>* buffer;
+    typename AsyncSendHandler<T>::type callback;
+  };
+
+  /**
+   * Serializes a message into a buffer, prefixed by its size in network byte
+   * order.
+   */
+  bool FrameMessage(const misc::Envelope<T>& message, vector<char>* buffer) {
+    uint64_t msg_size = message.size();
+    uint64_t msg_size_endian = htobe64(msg_size);
+    buffer->resize(sizeof(uint64_t) + msg_size);
+    memcpy(&(*buffer)[0], &msg_size_endian, sizeof(uint64_t));
+    return message.Serialize(&(*buffer)[sizeof(uint64_t)], msg_size);
+  }
+
+  /**
+   * Completion handler for the write of the message at the head of the async
+   * send queue. Starts sending the next message. On error, all the queued
+   * messages are failed.
+   */
+  void HandleAsyncSend(const boost::system::error_code& error,
+                       size_t bytes_transferred) {
+    vector<AsyncSendRequest> completed;
+    {
+      boost::lock_guard<boost::mutex> lock(async_send_lock_);
+      if (error) {
+        completed.insert(completed.end(), async_send_queue_.begin(),
+                         async_send_queue_.end());
+        async_send_queue_.clear();
+      } else {
+        completed.push_back(async_send_queue_.front());
+        async_send_queue_.pop_front();
+        if (!async_send_queue_.empty())
+          StartAsyncSend();
+      }
+      // Return the buffers to the pool. The pool cannot grow beyond the
+      // bound on the queue length.
+      for (auto& request : completed) {
+        async_send_buffer_pool_.push_back(request.buffer);
+      }
+    }
+    if (error) {
+      LOG(ERROR) << "Error sending message on connection: "
+                 << error.message();
+      HandleIOError(error);
+    }
+    // Invoke the callbacks without holding the lock, so that they can send
+    // further messages.
+    for (auto& request : completed) {
+      if (request.callback)
+        request.callback(error, bytes_transferred);
+    }
+  }
+
+  /**
+   * Starts writing the message at the head of the async send queue.
+   * Called with the async_send_lock_ mutex held.
+   */
+  void StartAsyncSend() {
+    vector<char>* buffer = async_send_queue_.front().buffer;
+    boost::asio::async_write(
+        *client_socket_, boost::asio::buffer(*buffer),
+        boost::bind(&StreamSocketsChannel<T>::HandleAsyncSend, this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred));
+  }
+
   void HandleIOError(boost::system::error_code error) {
     if (error == boost::asio::error::broken_pipe) {
       // Connection has gone away; attempt to reconnect
@@ -446,8 +625,7 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
     CHECK_EQ(sizeof(uint64_t), bytes_read);
     // Nasty cast to get message size indicator received (after endian
     // conversion)
-    uint64_t msg_size =
-      be64toh(*reinterpret_cast<uint64_t*>(async_recv_buffer_vec_));
+    uint64_t msg_size = be64toh(async_recv_size_);
     CHECK_GT(msg_size, 0) << "Received message of length 0 from "
                           << RemoteEndpointString();
     // XXX(malte): This is a nasty hack to highlight bugs in the channel logic.
@@ -455,15 +633,11 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
                                   << "from " << RemoteEndpointString();
     VLOG(2) << "RecvA: size of incoming protobuf from" << RemoteEndpointString()
             << "is " << msg_size << " bytes.";
-    // We still hold the async_recv_lock_ mutex here.
-    free(async_recv_buffer_vec_);
-    async_recv_buffer_vec_ = reinterpret_cast<char*>(malloc(msg_size));
-    VLOG(2) << "New async recv buffer is at "
-            << static_cast<void*>(async_recv_buffer_vec_);
-    delete async_recv_buffer_;
-    async_recv_buffer_ =
-      new boost::asio::mutable_buffers_1(async_recv_buffer_vec_, msg_size);
-    async_read(*client_socket_, *async_recv_buffer_,
+    // We still hold the async_recv_lock_ mutex here. The buffer keeps its
+    // capacity across receives.
+    async_recv_buffer_.resize(msg_size);
+    async_read(*client_socket_,
+               boost::asio::buffer(&async_recv_buffer_[0], msg_size),
                boost::asio::transfer_exactly(msg_size),
                boost::bind(&StreamSocketsChannel<T>::RecvAThirdStage,
                            this,
@@ -503,14 +677,10 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
     CHECK_GT(bytes_read, 0);
     CHECK_EQ(bytes_read, message_size);
     VLOG(2) << "About to parse message";
-    if (!final_envelope->Parse(async_recv_buffer_vec_, bytes_read)) {
+    if (!final_envelope->Parse(&async_recv_buffer_[0], bytes_read)) {
       LOG(ERROR) << "Failed to parse protobuf message of " << bytes_read
                  << " bytes!";
     }
-    free(async_recv_buffer_vec_);
-    delete async_recv_buffer_;
-    async_recv_buffer_vec_ = NULL;
-    async_recv_buffer_ = NULL;
     // Invoke the original callback
     // XXX(malte): potential race condition -- someone else may finish and
     // invoke the callback before we do (although this is very unlikely).
@@ -524,12 +694,25 @@ class StreamSocketsChannel : public MessagingChannelInterface<T>,
  private:
   boost::mutex sync_recv_lock_;
   boost::mutex sync_send_lock_;
+  // Reusable buffers for synchronous sends and receives; protected by the
+  // respective locks.
+  vector<char> sync_recv_buffer_;
+  vector<char> sync_send_buffer_;
+  // Data read by RecvAvailable; the messages before recv_buffer_offset_ have
+  // already been taken by NextBufferedMessage. Protected by sync_recv_lock_.
+  static const size_t kRecvChunkSize = 64 * 1024;
+  vector<char> recv_buffer_;
+  size_t recv_buffer_offset_;
   // Async receive buffer data structures and lock
   boost::mutex async_recv_lock_;
-  //scoped_ptr<boost::asio::mutable_buffers_1> async_recv_buffer_;
-  boost::asio::mutable_buffers_1* async_recv_buffer_;
-  //scoped_ptr<vector<char> > async_recv_buffer_vec_;
-  char* async_recv_buffer_vec_;
+  uint64_t async_recv_size_;
+  vector<char> async_recv_buffer_;
+  // Messages waiting to be sent asynchronously. The head of the queue is
+  // being written.
+  boost::mutex async_send_lock_;
+  deque<AsyncSendRequest> async_send_queue_;
+  // Buffers of completed async sends, reused for later sends.
+  vector<vector<char>*> async_send_buffer_pool_;
   // TCP and io_service data structures
   shared_ptr<boost::asio::io_service> client_io_service_;
   scoped_ptr<boost::asio::io_service::work> io_service_work_;
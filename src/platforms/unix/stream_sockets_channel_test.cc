@@ -0,0 +1,175 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Stream sockets channel loopback tests.
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "messages/base_message.pb.h"
+#include "misc/protobuf_envelope.h"
+#include "platforms/unix/stream_sockets_channel.h"
+#include "platforms/unix/tcp_connection.h"
+
+namespace firmament {
+namespace platform_unix {
+namespace streamsockets {
+
+class StreamSocketsChannelTest : public ::testing::Test {
+ public:
+  void HandleSend(const boost::system::error_code& error,
+                  size_t bytes_transferred) {
+    CHECK(!error);
+    boost::lock_guard<boost::mutex> lock(num_sent_lock_);
+    num_sent_++;
+  }
+
+ protected:
+  StreamSocketsChannelTest()
+    : server_io_service_(new io_service),
+      client_channel_(StreamSocketsChannel<BaseMessage>::SS_TCP),
+      num_sent_(0) {
+  }
+
+  virtual void SetUp() {
+    // Connect a client channel to a server-side channel over loopback.
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 0);
+    tcp::acceptor acceptor(*server_io_service_, endpoint);
+    string uri = "tcp:127.0.0.1:" +
+      to_string(acceptor.local_endpoint().port());
+    CHECK(client_channel_.Establish(uri));
+    connection_.reset(new TCPConnection(server_io_service_));
+    acceptor.accept(*connection_->socket());
+    connection_->Start(shared_ptr<tcp::endpoint>(
+        new tcp::endpoint(connection_->socket()->remote_endpoint())));
+    server_channel_.reset(new StreamSocketsChannel<BaseMessage>(connection_));
+  }
+
+  shared_ptr<io_service> server_io_service_;
+  StreamSocketsChannel<BaseMessage> client_channel_;
+  TCPConnection::connection_ptr connection_;
+  scoped_ptr<StreamSocketsChannel<BaseMessage> > server_channel_;
+  boost::mutex num_sent_lock_;
+  uint64_t num_sent_;
+};
+
+// Tests that synchronously sent messages are received intact.
+TEST_F(StreamSocketsChannelTest, SendSRecvS) {
+  for (int64_t index = 1; index <= 10; ++index) {
+    BaseMessage message;
+    message.mutable_test()->set_test(index);
+    Envelope<BaseMessage> envelope(&message);
+    CHECK(client_channel_.SendS(envelope));
+  }
+  for (int64_t index = 1; index <= 10; ++index) {
+    BaseMessage message;
+    Envelope<BaseMessage> envelope(&message);
+    CHECK(server_channel_->RecvS(&envelope));
+    CHECK_EQ(message.test().test(), index);
+  }
+}
+
+// Tests that asynchronously sent messages are received in order and that
+// every callback is invoked.
+TEST_F(StreamSocketsChannelTest, SendARecvS) {
+  const int64_t kNumMessages = 100;
+  for (int64_t index = 1; index <= kNumMessages; ++index) {
+    BaseMessage message;
+    message.mutable_test()->set_test(index);
+    Envelope<BaseMessage> envelope(&message);
+    // The message is serialized by SendA, so it may go out of scope.
+    CHECK(client_channel_.SendA(
+        envelope, boost::bind(&StreamSocketsChannelTest::HandleSend, this,
+                              boost::asio::placeholders::error,
+                              boost::asio::placeholders::bytes_transferred)));
+  }
+  for (int64_t index = 1; index <= kNumMessages; ++index) {
+    BaseMessage message;
+    Envelope<BaseMessage> envelope(&message);
+    CHECK(server_channel_->RecvS(&envelope));
+    CHECK_EQ(message.test().test(), index);
+  }
+  for (uint32_t attempt = 0; attempt < 1000; ++attempt) {
+    {
+      boost::lock_guard<boost::mutex> lock(num_sent_lock_);
+      if (num_sent_ == kNumMessages)
+        break;
+    }
+    usleep(1000);
+  }
+  boost::lock_guard<boost::mutex> lock(num_sent_lock_);
+  CHECK_EQ(num_sent_, kNumMessages);
+}
+
+// Tests that a message that has only partly arrived stays buffered without
+// blocking, and is taken from the buffer once the rest of it has arrived.
+TEST_F(StreamSocketsChannelTest, RecvAvailablePartialMessage) {
+  BaseMessage message;
+  message.mutable_test()->set_test(42);
+  Envelope<BaseMessage> envelope(&message);
+  vector<char> frame(sizeof(uint64_t) + envelope.size());
+  uint64_t msg_size_endian = htobe64(envelope.size());
+  memcpy(&frame[0], &msg_size_endian, sizeof(uint64_t));
+  CHECK(envelope.Serialize(&frame[sizeof(uint64_t)], envelope.size()));
+  // Send the size and the first byte of the message only.
+  int fd = client_channel_.NativeHandle();
+  size_t first_part = sizeof(uint64_t) + 1;
+  CHECK_EQ(write(fd, &frame[0], first_part), first_part);
+  usleep(10000);
+  boost::system::error_code error;
+  BaseMessage received;
+  Envelope<BaseMessage> received_envelope(&received);
+  bool parsed = false;
+  CHECK(server_channel_->RecvAvailable(&error));
+  CHECK(!server_channel_->NextBufferedMessage(&received_envelope, &parsed));
+  // Send the rest of the message, followed by another complete message.
+  CHECK_EQ(write(fd, &frame[first_part], frame.size() - first_part),
+           frame.size() - first_part);
+  CHECK(client_channel_.SendS(envelope));
+  usleep(10000);
+  CHECK(server_channel_->RecvAvailable(&error));
+  for (uint32_t index = 0; index < 2; ++index) {
+    received.Clear();
+    CHECK(server_channel_->NextBufferedMessage(&received_envelope, &parsed));
+    CHECK(parsed);
+    CHECK_EQ(received.test().test(), 42);
+  }
+  CHECK(!server_channel_->NextBufferedMessage(&received_envelope, &parsed));
+  // The peer closing the connection is reported as an error.
+  client_channel_.Close();
+  usleep(10000);
+  CHECK(!server_channel_->RecvAvailable(&error));
+  CHECK(error == boost::asio::error::eof);
+}
+
+}  // namespace streamsockets
+}  // namespace platform_unix
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
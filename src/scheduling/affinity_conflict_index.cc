@@ -0,0 +1,302 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Index of the labels and selectors of pending pod affinity/anti-affinity
+// tasks, used to group them into conflict-free batches.
+
+#include "scheduling/affinity_conflict_index.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "misc/map-util.h"
+
+// Minimum number of tasks each thread looks up conflicts for.
+#define MIN_TASKS_PER_THREAD 512
+
+namespace firmament {
+namespace scheduler {
+
+void AffinityConflictIndex::AddTask(const TaskDescriptor& td) {
+  RemoveTask(td.uid());
+  TaskProfile profile;
+  profile.conflicts_with_all = false;
+  unordered_set<string> keys;
+  for (auto& label : td.labels()) {
+    if (keys.insert(label.key()).second) {
+      profile.labels.push_back(
+          pair<string, string>(label.key(), label.value()));
+    }
+  }
+  auto add_expression = [&profile](const string& key, const string& op,
+                                   const RepeatedPtrField<string>& values) {
+    if (op == "In") {
+      for (auto& value : values) {
+        profile.in_selectors.push_back(pair<string, string>(key, value));
+      }
+    } else if (op == "Exists") {
+      profile.exists_selectors.push_back(key);
+    } else {
+      // "NotIn" and "DoesNotExist" match the tasks that lack a value or the
+      // key, so they cannot be looked up by label.
+      profile.conflicts_with_all = true;
+    }
+  };
+  if (td.affinity().has_pod_affinity()) {
+    for (auto& term : td.affinity().pod_affinity()
+                        .requiredduringschedulingignoredduringexecution()) {
+      for (auto& expression : term.labelselector().matchexpressions()) {
+        add_expression(expression.key(), expression.operator_(),
+                       expression.values());
+      }
+    }
+  }
+  if (td.affinity().has_pod_anti_affinity()) {
+    for (auto& term : td.affinity().pod_anti_affinity()
+                        .requiredduringschedulingignoredduringexecution()) {
+      // A term that applies to the task's own namespace conflicts with
+      // every other task.
+      if (!term.namespaces_size()) {
+        profile.conflicts_with_all = true;
+      }
+      for (auto& name : term.namespaces()) {
+        if (name == td.task_namespace()) {
+          profile.conflicts_with_all = true;
+        }
+      }
+      for (auto& expression : term.labelselector().matchexpressions()) {
+        add_expression(expression.key(), expression.operator_(),
+                       expression.values());
+      }
+    }
+  }
+  TaskID_t task_id = td.uid();
+  for (auto& label : profile.labels) {
+    label_index_[label.first][label.second].insert(task_id);
+  }
+  for (auto& selector : profile.in_selectors) {
+    in_selector_index_[selector.first][selector.second].insert(task_id);
+  }
+  for (auto& key : profile.exists_selectors) {
+    exists_selector_index_[key].insert(task_id);
+  }
+  if (profile.conflicts_with_all) {
+    conflicts_with_all_.insert(task_id);
+  }
+  CHECK(InsertIfNotPresent(&profiles_, task_id, profile));
+}
+
+void AffinityConflictIndex::ConflictCandidates(
+    TaskID_t task_id, unordered_set<TaskID_t>* candidates) const {
+  const TaskProfile* profile = FindOrNull(profiles_, task_id);
+  CHECK_NOTNULL(profile);
+  if (profile->conflicts_with_all) {
+    for (auto& task_profile : profiles_) {
+      candidates->insert(task_profile.first);
+    }
+    candidates->erase(task_id);
+    return;
+  }
+  // Tasks whose labels this task's expressions select
+  for (auto& selector : profile->in_selectors) {
+    const unordered_map<string, unordered_set<TaskID_t>>* values =
+      FindOrNull(label_index_, selector.first);
+    if (values) {
+      const unordered_set<TaskID_t>* tasks =
+        FindOrNull(*values, selector.second);
+      if (tasks) {
+        candidates->insert(tasks->begin(), tasks->end());
+      }
+    }
+  }
+  for (auto& key : profile->exists_selectors) {
+    const unordered_map<string, unordered_set<TaskID_t>>* values =
+      FindOrNull(label_index_, key);
+    if (values) {
+      for (auto& value_tasks : *values) {
+        candidates->insert(value_tasks.second.begin(),
+                           value_tasks.second.end());
+      }
+    }
+  }
+  // Tasks whose expressions select this task's labels
+  for (auto& label : profile->labels) {
+    const unordered_map<string, unordered_set<TaskID_t>>* values =
+      FindOrNull(in_selector_index_, label.first);
+    if (values) {
+      const unordered_set<TaskID_t>* tasks = FindOrNull(*values, label.second);
+      if (tasks) {
+        candidates->insert(tasks->begin(), tasks->end());
+      }
+    }
+    const unordered_set<TaskID_t>* tasks =
+      FindOrNull(exists_selector_index_, label.first);
+    if (tasks) {
+      candidates->insert(tasks->begin(), tasks->end());
+    }
+  }
+  candidates->insert(conflicts_with_all_.begin(), conflicts_with_all_.end());
+  candidates->erase(task_id);
+}
+
+void AffinityConflictIndex::FindEarlierConflicts(
+    const vector<TaskDescriptor*>& tasks,
+    const unordered_map<TaskID_t, uint64_t>& positions,
+    const vector<uint64_t>& unindexed, ConflictCheck_t conflicts,
+    uint64_t begin, uint64_t end,
+    vector<vector<uint64_t>>* earlier_conflicts) const {
+  for (uint64_t index = begin; index < end; ++index) {
+    TaskDescriptor* td_ptr = tasks[index];
+    vector<uint64_t>* task_conflicts = &(*earlier_conflicts)[index];
+    if (!Contains(td_ptr->uid())) {
+      // Not indexed; compare with every earlier task.
+      for (uint64_t other = 0; other < index; ++other) {
+        if (conflicts(td_ptr, tasks[other])) {
+          task_conflicts->push_back(other);
+        }
+      }
+      continue;
+    }
+    unordered_set<TaskID_t> candidates;
+    ConflictCandidates(td_ptr->uid(), &candidates);
+    for (auto& candidate : candidates) {
+      const uint64_t* position = FindOrNull(positions, candidate);
+      if (position && *position < index &&
+          conflicts(td_ptr, tasks[*position])) {
+        task_conflicts->push_back(*position);
+      }
+    }
+    // Tasks that are not indexed only know about their own conflicts, so
+    // check the later ones against this task here.
+    for (auto& other : unindexed) {
+      if (other >= index) {
+        break;
+      }
+      if (conflicts(td_ptr, tasks[other])) {
+        task_conflicts->push_back(other);
+      }
+    }
+  }
+}
+
+void AffinityConflictIndex::GroupTasks(
+    const vector<TaskDescriptor*>& tasks, ConflictCheck_t conflicts,
+    uint32_t num_threads, unordered_map<TaskID_t, vector<TaskID_t>>* groups,
+    unordered_map<TaskID_t, TaskID_t>* first_group) const {
+  unordered_map<TaskID_t, uint64_t> positions;
+  vector<uint64_t> unindexed;
+  for (uint64_t index = 0; index < tasks.size(); ++index) {
+    InsertIfNotPresent(&positions, tasks[index]->uid(), index);
+    if (!Contains(tasks[index]->uid())) {
+      unindexed.push_back(index);
+    }
+  }
+  // Find, for each task, the earlier tasks it conflicts with. The tasks are
+  // independent of each other, so large backlogs are split across threads.
+  vector<vector<uint64_t>> earlier_conflicts(tasks.size());
+  uint64_t tasks_per_thread = tasks.size() / max(num_threads, 1U) + 1;
+  if (tasks_per_thread < MIN_TASKS_PER_THREAD) {
+    tasks_per_thread = MIN_TASKS_PER_THREAD;
+  }
+  if (tasks_per_thread >= tasks.size()) {
+    FindEarlierConflicts(tasks, positions, unindexed, conflicts, 0,
+                         tasks.size(), &earlier_conflicts);
+  } else {
+    boost::thread_group threads;
+    for (uint64_t begin = 0; begin < tasks.size();
+         begin += tasks_per_thread) {
+      uint64_t end = min(begin + tasks_per_thread,
+                         static_cast<uint64_t>(tasks.size()));
+      threads.create_thread(
+          boost::bind(&AffinityConflictIndex::FindEarlierConflicts, this,
+                      boost::cref(tasks), boost::cref(positions),
+                      boost::cref(unindexed), conflicts, begin, end,
+                      &earlier_conflicts));
+    }
+    threads.join_all();
+  }
+  // A task may join a group unless one of its members conflicts with it.
+  vector<TaskID_t> leaders;
+  vector<vector<uint64_t>> groups_of_task(tasks.size());
+  vector<bool> blocked;
+  for (uint64_t index = 0; index < tasks.size(); ++index) {
+    TaskID_t task_id = tasks[index]->uid();
+    blocked.assign(leaders.size(), false);
+    for (auto& other : earlier_conflicts[index]) {
+      for (auto& group : groups_of_task[other]) {
+        blocked[group] = true;
+      }
+    }
+    uint64_t num_groups = leaders.size();
+    for (uint64_t group = 0; group < num_groups; ++group) {
+      if (blocked[group]) {
+        continue;
+      }
+      (*groups)[leaders[group]].push_back(task_id);
+      groups_of_task[index].push_back(group);
+      InsertIfNotPresent(first_group, task_id, leaders[group]);
+    }
+    if (groups_of_task[index].empty()) {
+      groups_of_task[index].push_back(leaders.size());
+      leaders.push_back(task_id);
+      InsertIfNotPresent(groups, task_id, vector<TaskID_t>());
+    }
+  }
+}
+
+void AffinityConflictIndex::RemoveTask(TaskID_t task_id) {
+  TaskProfile* profile = FindOrNull(profiles_, task_id);
+  if (!profile) {
+    return;
+  }
+  for (auto& label : profile->labels) {
+    unordered_map<string, unordered_set<TaskID_t>>& values =
+      label_index_[label.first];
+    values[label.second].erase(task_id);
+    if (values[label.second].empty()) {
+      values.erase(label.second);
+    }
+    if (values.empty()) {
+      label_index_.erase(label.first);
+    }
+  }
+  for (auto& selector : profile->in_selectors) {
+    unordered_map<string, unordered_set<TaskID_t>>& values =
+      in_selector_index_[selector.first];
+    values[selector.second].erase(task_id);
+    if (values[selector.second].empty()) {
+      values.erase(selector.second);
+    }
+    if (values.empty()) {
+      in_selector_index_.erase(selector.first);
+    }
+  }
+  for (auto& key : profile->exists_selectors) {
+    exists_selector_index_[key].erase(task_id);
+    if (exists_selector_index_[key].empty()) {
+      exists_selector_index_.erase(key);
+    }
+  }
+  conflicts_with_all_.erase(task_id);
+  profiles_.erase(task_id);
+}
+
+}  // namespace scheduler
+}  // namespace firmament
@@ -0,0 +1,120 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Index of the labels and selectors of pending pod affinity/anti-affinity
+// tasks, used to group them into conflict-free batches.
+
+#ifndef FIRMAMENT_SCHEDULING_AFFINITY_CONFLICT_INDEX_H
+#define FIRMAMENT_SCHEDULING_AFFINITY_CONFLICT_INDEX_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include "base/common.h"
+#include "base/task_desc.pb.h"
+#include "base/types.h"
+
+namespace firmament {
+namespace scheduler {
+
+/**
+ * Two tasks conflict if a required pod affinity/anti-affinity expression of
+ * one of them matches (or, for NotIn and DoesNotExist, fails to match) the
+ * labels of the other. The index maps label keys and values to the tasks
+ * that carry them and to the tasks whose expressions select them, so that
+ * only pairs that can conflict have to be compared.
+ */
+class AffinityConflictIndex {
+ public:
+  // Returns true if the two tasks must not be scheduled in the same batch.
+  typedef boost::function<bool(TaskDescriptor*, TaskDescriptor*)>
+    ConflictCheck_t;
+
+  void AddTask(const TaskDescriptor& td);
+  void RemoveTask(TaskID_t task_id);
+  /**
+   * Collects the indexed tasks that may conflict with a task. The result is
+   * a superset of the conflicting tasks and never contains the task itself.
+   * @param task_id the task to look up; it must be indexed
+   * @param candidates set to which the candidates are added
+   */
+  void ConflictCandidates(TaskID_t task_id,
+                          unordered_set<TaskID_t>* candidates) const;
+  /**
+   * Groups tasks into conflict-free batches. Tasks are taken in order; each
+   * one joins every existing group with none of whose tasks it conflicts, and
+   * leads a new group if there is no such group. This gives the same groups
+   * as comparing every task with every member of every group.
+   * @param tasks the tasks to group, in order
+   * @param conflicts exact check for a candidate pair
+   * @param num_threads threads used to find the conflicting pairs
+   * @param groups map from group leader to the other tasks in the group
+   * @param first_group map from a grouped task to the first group it joined
+   */
+  void GroupTasks(const vector<TaskDescriptor*>& tasks,
+                  ConflictCheck_t conflicts, uint32_t num_threads,
+                  unordered_map<TaskID_t, vector<TaskID_t>>* groups,
+                  unordered_map<TaskID_t, TaskID_t>* first_group) const;
+
+  inline bool Contains(TaskID_t task_id) const {
+    return profiles_.find(task_id) != profiles_.end();
+  }
+  inline uint64_t size() const {
+    return profiles_.size();
+  }
+
+ private:
+  struct TaskProfile {
+    // The task's labels; the first value wins for repeated keys
+    vector<pair<string, string>> labels;
+    // Key and value pairs selected by "In" expressions
+    vector<pair<string, string>> in_selectors;
+    // Keys selected by "Exists" expressions
+    vector<string> exists_selectors;
+    // True if the task may conflict with tasks regardless of their labels
+    bool conflicts_with_all;
+  };
+
+  void FindEarlierConflicts(const vector<TaskDescriptor*>& tasks,
+                            const unordered_map<TaskID_t, uint64_t>& positions,
+                            const vector<uint64_t>& unindexed,
+                            ConflictCheck_t conflicts, uint64_t begin,
+                            uint64_t end,
+                            vector<vector<uint64_t>>* earlier_conflicts) const;
+
+  unordered_map<TaskID_t, TaskProfile> profiles_;
+  // Label key -> label value -> tasks carrying the label
+  unordered_map<string, unordered_map<string, unordered_set<TaskID_t>>>
+    label_index_;
+  // Label key -> label value -> tasks with an "In" expression selecting it
+  unordered_map<string, unordered_map<string, unordered_set<TaskID_t>>>
+    in_selector_index_;
+  // Label key -> tasks with an "Exists" expression on it
+  unordered_map<string, unordered_set<TaskID_t>> exists_selector_index_;
+  unordered_set<TaskID_t> conflicts_with_all_;
+};
+
+}  // namespace scheduler
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_AFFINITY_CONFLICT_INDEX_H
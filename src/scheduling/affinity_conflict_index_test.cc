@@ -0,0 +1,287 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Affinity conflict index unit tests.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "misc/map-util.h"
+#include "misc/trace_generator.h"
+#include "misc/utils.h"
+#include "misc/wall_time.h"
+#include "scheduling/affinity_conflict_index.h"
+#include "scheduling/knowledge_base.h"
+#include "scheduling/simple/simple_scheduler.h"
+#include "storage/simple_object_store.h"
+
+namespace firmament {
+namespace scheduler {
+
+// Exposes the pairwise checks with which the flow scheduler decides whether
+// two pod affinity/anti-affinity tasks conflict.
+class ConflictCheckingScheduler : public SimpleScheduler {
+ public:
+  ConflictCheckingScheduler(ResourceTopologyNodeDescriptor* rtn_root,
+                            ResourceID_t root_res_id, WallTime* wall_time,
+                            TraceGenerator* trace_generator)
+    : SimpleScheduler(shared_ptr<JobMap_t>(new JobMap_t),
+                      shared_ptr<ResourceMap_t>(new ResourceMap_t), rtn_root,
+                      shared_ptr<store::ObjectStoreInterface>(
+                          new store::SimpleObjectStore(root_res_id)),
+                      shared_ptr<TaskMap_t>(new TaskMap_t),
+                      shared_ptr<KnowledgeBase>(new KnowledgeBase),
+                      shared_ptr<TopologyManager>(new TopologyManager),
+                      NULL, NULL, root_res_id, "http://localhost", wall_time,
+                      trace_generator) {
+  }
+
+  bool Conflicts(TaskDescriptor* td_ptr, TaskDescriptor* other_td_ptr) {
+    return !CheckPodAffinityNoConflictWithin(td_ptr, other_td_ptr)
+        || !CheckPodAntiAffinityNoConflictWithin(td_ptr, other_td_ptr)
+        || !CheckPodAffinityNoConflictWithin(other_td_ptr, td_ptr)
+        || !CheckPodAntiAffinityNoConflictWithin(other_td_ptr, td_ptr);
+  }
+};
+
+class AffinityConflictIndexTest : public ::testing::Test {
+ protected:
+  AffinityConflictIndexTest()
+    : trace_generator_(&wall_time_) {
+    ResourceID_t root_res_id =
+      GenerateRootResourceID("affinity_conflict_index_test");
+    rtn_root_.mutable_resource_desc()->set_uuid(to_string(root_res_id));
+    scheduler_.reset(new ConflictCheckingScheduler(
+        &rtn_root_, root_res_id, &wall_time_, &trace_generator_));
+    conflicts_ = [this](TaskDescriptor* td_ptr, TaskDescriptor* other_td_ptr) {
+      return scheduler_->Conflicts(td_ptr, other_td_ptr);
+    };
+  }
+
+  virtual void TearDown() {
+    for (auto& td_ptr : tasks_) {
+      delete td_ptr;
+    }
+    tasks_.clear();
+  }
+
+  TaskDescriptor* AddTask(TaskID_t task_id, const string& app,
+                          const string& tier) {
+    TaskDescriptor* td_ptr = new TaskDescriptor;
+    td_ptr->set_uid(task_id);
+    td_ptr->set_task_namespace("default");
+    Label* label = td_ptr->add_labels();
+    label->set_key("app");
+    label->set_value(app);
+    if (!tier.empty()) {
+      label = td_ptr->add_labels();
+      label->set_key("tier");
+      label->set_value(tier);
+    }
+    tasks_.push_back(td_ptr);
+    return td_ptr;
+  }
+
+  void AddAffinity(TaskDescriptor* td_ptr, const string& key,
+                   const string& op, const string& value) {
+    LabelSelectorRequirement* expression =
+      td_ptr->mutable_affinity()->mutable_pod_affinity()
+        ->add_requiredduringschedulingignoredduringexecution()
+        ->mutable_labelselector()->add_matchexpressions();
+    expression->set_key(key);
+    expression->set_operator_(op);
+    expression->add_values(value);
+  }
+
+  void AddAntiAffinity(TaskDescriptor* td_ptr, const string& key,
+                       const string& op, const string& value) {
+    PodAffinityTermAntiAff* term =
+      td_ptr->mutable_affinity()->mutable_pod_anti_affinity()
+        ->add_requiredduringschedulingignoredduringexecution();
+    term->add_namespaces("other");
+    LabelSelectorRequirementAntiAff* expression =
+      term->mutable_labelselector()->add_matchexpressions();
+    expression->set_key(key);
+    expression->set_operator_(op);
+    expression->add_values(value);
+  }
+
+  // Groups the tasks by comparing each one with every member of every
+  // group, as the flow scheduler used to.
+  void ReferenceGroupTasks(
+      const vector<TaskDescriptor*>& tasks,
+      vector<pair<TaskID_t, vector<TaskID_t>>>* groups) {
+    for (auto& td_ptr : tasks) {
+      bool matched = false;
+      for (auto& group : *groups) {
+        bool no_conflict = true;
+        for (auto& other_td_ptr : tasks) {
+          if (other_td_ptr->uid() != group.first &&
+              find(group.second.begin(), group.second.end(),
+                   other_td_ptr->uid()) == group.second.end()) {
+            continue;
+          }
+          if (scheduler_->Conflicts(td_ptr, other_td_ptr)) {
+            no_conflict = false;
+            break;
+          }
+        }
+        if (no_conflict) {
+          group.second.push_back(td_ptr->uid());
+          matched = true;
+        }
+      }
+      if (!matched) {
+        groups->push_back(pair<TaskID_t, vector<TaskID_t>>(
+            td_ptr->uid(), vector<TaskID_t>()));
+      }
+    }
+  }
+
+  // Adds tasks with random labels and selectors. The "NotIn" and
+  // "DoesNotExist" operators are only used if unindexed_operators is set.
+  void AddRandomTasks(uint32_t num_tasks, uint32_t num_apps,
+                      bool unindexed_operators) {
+    for (TaskID_t task_id = 1; task_id <= num_tasks; ++task_id) {
+      string app = "app" + to_string(rand_r(&seed_) % num_apps);
+      string tier = rand_r(&seed_) % 2 ? "frontend" : "";
+      TaskDescriptor* td_ptr = AddTask(task_id, app, tier);
+      uint32_t kind = rand_r(&seed_) % 24;
+      string other_app = "app" + to_string(rand_r(&seed_) % num_apps);
+      if (kind < 8) {
+        AddAntiAffinity(td_ptr, "app", "In", other_app);
+      } else if (kind < 12) {
+        AddAffinity(td_ptr, "app", "In", other_app);
+      } else if (kind == 12) {
+        AddAntiAffinity(td_ptr, "tier", "Exists", "");
+      } else if (kind == 13) {
+        AddAffinity(td_ptr, "tier", "Exists", "");
+      } else if (unindexed_operators) {
+        if (kind == 14) {
+          AddAffinity(td_ptr, "app", "NotIn", other_app);
+        } else if (kind == 15) {
+          AddAntiAffinity(td_ptr, "app", "NotIn", other_app);
+        } else if (kind == 16) {
+          AddAffinity(td_ptr, "tier", "DoesNotExist", "");
+        } else if (kind == 17) {
+          AddAntiAffinity(td_ptr, "tier", "DoesNotExist", "");
+        }
+      }
+      index_.AddTask(*td_ptr);
+    }
+  }
+
+  void CheckMatchesReference(uint32_t num_threads) {
+    unordered_map<TaskID_t, vector<TaskID_t>> groups;
+    unordered_map<TaskID_t, TaskID_t> first_group;
+    index_.GroupTasks(tasks_, conflicts_, num_threads, &groups,
+                      &first_group);
+    vector<pair<TaskID_t, vector<TaskID_t>>> reference_groups;
+    ReferenceGroupTasks(tasks_, &reference_groups);
+    CHECK_EQ(groups.size(), reference_groups.size());
+    for (auto& group : reference_groups) {
+      vector<TaskID_t>* members = FindOrNull(groups, group.first);
+      CHECK_NOTNULL(members);
+      CHECK(*members == group.second);
+      for (auto& task_id : group.second) {
+        CHECK(ContainsKey(first_group, task_id));
+      }
+    }
+  }
+
+  WallTime wall_time_;
+  TraceGenerator trace_generator_;
+  ResourceTopologyNodeDescriptor rtn_root_;
+  scoped_ptr<ConflictCheckingScheduler> scheduler_;
+  AffinityConflictIndex::ConflictCheck_t conflicts_;
+  AffinityConflictIndex index_;
+  vector<TaskDescriptor*> tasks_;
+  uint32_t seed_ = 42;
+};
+
+TEST_F(AffinityConflictIndexTest, CandidatesFollowLabelsAndSelectors) {
+  TaskDescriptor* web_td_ptr = AddTask(1, "web", "");
+  AddAntiAffinity(web_td_ptr, "app", "In", "db");
+  TaskDescriptor* db_td_ptr = AddTask(2, "db", "");
+  TaskDescriptor* cache_td_ptr = AddTask(3, "cache", "frontend");
+  for (auto& td_ptr : tasks_) {
+    index_.AddTask(*td_ptr);
+  }
+  unordered_set<TaskID_t> candidates;
+  index_.ConflictCandidates(db_td_ptr->uid(), &candidates);
+  CHECK_EQ(candidates.size(), 1);
+  CHECK(ContainsKey(candidates, web_td_ptr->uid()));
+  candidates.clear();
+  index_.ConflictCandidates(cache_td_ptr->uid(), &candidates);
+  CHECK(candidates.empty());
+  // A task with a NotIn expression may conflict with anything
+  TaskDescriptor* other_td_ptr = AddTask(4, "batch", "");
+  AddAffinity(other_td_ptr, "app", "NotIn", "web");
+  index_.AddTask(*other_td_ptr);
+  candidates.clear();
+  index_.ConflictCandidates(cache_td_ptr->uid(), &candidates);
+  CHECK_EQ(candidates.size(), 1);
+  index_.RemoveTask(other_td_ptr->uid());
+  // So may a task with a DoesNotExist expression
+  other_td_ptr = AddTask(5, "batch", "");
+  AddAntiAffinity(other_td_ptr, "tier", "DoesNotExist", "");
+  index_.AddTask(*other_td_ptr);
+  candidates.clear();
+  index_.ConflictCandidates(cache_td_ptr->uid(), &candidates);
+  CHECK_EQ(candidates.size(), 1);
+  CHECK(ContainsKey(candidates, other_td_ptr->uid()));
+  index_.RemoveTask(other_td_ptr->uid());
+  index_.RemoveTask(web_td_ptr->uid());
+  candidates.clear();
+  index_.ConflictCandidates(db_td_ptr->uid(), &candidates);
+  CHECK(candidates.empty());
+  CHECK_EQ(index_.size(), 2);
+}
+
+TEST_F(AffinityConflictIndexTest, GroupsMatchPairwiseComparison) {
+  AddRandomTasks(600, 40, true);
+  CheckMatchesReference(1);
+}
+
+TEST_F(AffinityConflictIndexTest, ParallelGroupsMatchPairwiseComparison) {
+  AddRandomTasks(1500, 100, true);
+  // Tasks that are not indexed are compared with every other task
+  for (uint32_t index = 0; index < tasks_.size(); index += 7) {
+    index_.RemoveTask(tasks_[index]->uid());
+  }
+  CheckMatchesReference(4);
+}
+
+// Groups 10k pending affinity/anti-affinity tasks, which share groups as
+// few of them conflict. NotIn and DoesNotExist expressions are left out as
+// they have to be compared with every task.
+TEST_F(AffinityConflictIndexTest, GroupsManyTasks) {
+  AddRandomTasks(10000, 2000, false);
+  unordered_map<TaskID_t, vector<TaskID_t>> groups;
+  unordered_map<TaskID_t, TaskID_t> first_group;
+  index_.GroupTasks(tasks_, conflicts_, 4, &groups, &first_group);
+  CHECK_LT(groups.size(), tasks_.size());
+  // Every task leads a group or has joined one
+  CHECK_EQ(first_group.size() + groups.size(), tasks_.size());
+}
+
+}  // namespace scheduler
+}  // namespace firmament
@@ -0,0 +1,369 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Indexed placement engine for tasks with pod affinity/anti-affinity.
+
+#include "scheduling/affinity_placement_engine.h"
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+#include "scheduling/label_utils.h"
+
+// Cost of a fully utilized machine; an idle machine costs 0.
+#define MAX_MACHINE_COST 1000
+
+namespace firmament {
+namespace scheduler {
+
+AffinityPlacementEngine::AffinityPlacementEngine() {
+}
+
+void AffinityPlacementEngine::AddMachine(const ResourceDescriptor& rd) {
+  CHECK(rd.type() == ResourceDescriptor::RESOURCE_MACHINE);
+  ResourceID_t res_id = ResourceIDFromString(rd.uuid());
+  if (ContainsKey(machines_, res_id)) {
+    return;
+  }
+  MachineRecord record;
+  record.rd_ptr = &rd;
+  record.free_resources = rd.available_resources();
+  record.num_tasks = 0;
+  record.cost = ComputeCost(record);
+  CHECK(InsertIfNotPresent(&machines_, res_id, record));
+  machines_by_cost_.insert(pair<int64_t, ResourceID_t>(record.cost, res_id));
+}
+
+ResourceID_t AffinityPlacementEngine::BestMachineForTask(
+    const TaskDescriptor& td) const {
+  ResourceID_t best_res_id = boost::uuids::nil_uuid();
+  vector<ResourceID_t> candidates;
+  if (IndexedCandidates(td, &candidates)) {
+    // The task must run next to some pods; only the machines running them
+    // can be feasible.
+    int64_t best_cost = 0;
+    for (auto& res_id : candidates) {
+      const MachineRecord* record = FindOrNull(machines_, res_id);
+      if (!record || !IsFeasible(*record, td)) {
+        continue;
+      }
+      if (best_res_id.is_nil() || record->cost < best_cost ||
+          (record->cost == best_cost && res_id < best_res_id)) {
+        best_res_id = res_id;
+        best_cost = record->cost;
+      }
+    }
+    return best_res_id;
+  }
+  for (auto& cost_res_id : machines_by_cost_) {
+    const MachineRecord* record = FindOrNull(machines_, cost_res_id.second);
+    CHECK_NOTNULL(record);
+    if (IsFeasible(*record, td)) {
+      return cost_res_id.second;
+    }
+  }
+  return best_res_id;
+}
+
+int64_t AffinityPlacementEngine::ComputeCost(
+    const MachineRecord& record) const {
+  // Prefer the least requested machines, like the CPU cost model does.
+  const ResourceVector& capacity = record.rd_ptr->resource_capacity();
+  int64_t cost = 0;
+  if (capacity.cpu_cores() > 0) {
+    cost += static_cast<int64_t>(
+        (capacity.cpu_cores() - record.free_resources.cpu_cores()) /
+        capacity.cpu_cores() * MAX_MACHINE_COST);
+  }
+  if (capacity.ram_cap() > 0) {
+    cost += static_cast<int64_t>(
+        (capacity.ram_cap() - record.free_resources.ram_cap()) /
+        static_cast<double>(capacity.ram_cap()) * MAX_MACHINE_COST);
+  }
+  return cost / 2;
+}
+
+bool AffinityPlacementEngine::ExpressionMatches(
+    const MachineRecord& record, const string& key, const string& op,
+    const RepeatedPtrField<string>& values) const {
+  const unordered_map<string, uint32_t>* label_values =
+    FindOrNull(record.pod_labels, key);
+  if (op == "In" || op == "NotIn") {
+    bool found = false;
+    if (label_values) {
+      for (auto& value : values) {
+        if (ContainsKey(*label_values, value)) {
+          found = true;
+          break;
+        }
+      }
+    }
+    return op == "In" ? found : !found;
+  } else if (op == "Exists") {
+    return label_values != NULL;
+  } else if (op == "DoesNotExist") {
+    return label_values == NULL;
+  }
+  LOG(FATAL) << "Unsupported selector type: " << op;
+  return false;
+}
+
+bool AffinityPlacementEngine::IndexedCandidates(
+    const TaskDescriptor& td, vector<ResourceID_t>* candidates) const {
+  if (!td.has_affinity() || !td.affinity().has_pod_affinity()) {
+    return false;
+  }
+  // Every "In" or "Exists" expression of a required term restricts the task
+  // to the machines running pods with the label. Use the narrowest one.
+  bool restricted = false;
+  for (auto& term : td.affinity().pod_affinity()
+                      .requiredduringschedulingignoredduringexecution()) {
+    for (auto& expression : term.labelselector().matchexpressions()) {
+      const unordered_map<string, MachineSet_t>* label_values =
+        FindOrNull(pod_label_index_, expression.key());
+      MachineSet_t machines;
+      if (expression.operator_() == "In") {
+        if (label_values) {
+          for (auto& value : expression.values()) {
+            const MachineSet_t* value_machines =
+              FindOrNull(*label_values, value);
+            if (value_machines) {
+              machines.insert(value_machines->begin(), value_machines->end());
+            }
+          }
+        }
+      } else if (expression.operator_() == "Exists") {
+        if (label_values) {
+          for (auto& value_machines : *label_values) {
+            machines.insert(value_machines.second.begin(),
+                            value_machines.second.end());
+          }
+        }
+      } else {
+        continue;
+      }
+      if (!restricted || machines.size() < candidates->size()) {
+        candidates->assign(machines.begin(), machines.end());
+        restricted = true;
+      }
+    }
+  }
+  return restricted;
+}
+
+bool AffinityPlacementEngine::IsFeasible(const MachineRecord& record,
+                                         const TaskDescriptor& td) const {
+  const ResourceDescriptor& rd = *record.rd_ptr;
+  const ResourceVector& request = td.resource_request();
+  if (record.num_tasks >= rd.max_pods() ||
+      request.cpu_cores() >= record.free_resources.cpu_cores() ||
+      request.ram_cap() >= record.free_resources.ram_cap() ||
+      request.ephemeral_storage() >=
+        record.free_resources.ephemeral_storage()) {
+    return false;
+  }
+  return SatisfiesNodeSelectorAndNodeAffinity(rd, td) &&
+    SatisfiesPodAntiAffinity(record, td) &&
+    SatisfiesPodAffinity(record, td) &&
+    HasMatchingTolerationforNodeTaints(rd, td);
+}
+
+void AffinityPlacementEngine::RefreshMachines() {
+  machines_by_cost_.clear();
+  for (auto& res_id_record : machines_) {
+    MachineRecord* record = &res_id_record.second;
+    record->free_resources = record->rd_ptr->available_resources();
+    record->cost = ComputeCost(*record);
+    machines_by_cost_.insert(
+        pair<int64_t, ResourceID_t>(record->cost, res_id_record.first));
+  }
+}
+
+void AffinityPlacementEngine::RemoveMachine(ResourceID_t machine_res_id) {
+  MachineRecord* record = FindOrNull(machines_, machine_res_id);
+  if (!record) {
+    return;
+  }
+  machines_by_cost_.erase(
+      pair<int64_t, ResourceID_t>(record->cost, machine_res_id));
+  for (auto& key_values : record->pod_labels) {
+    unordered_map<string, MachineSet_t>& label_values =
+      pod_label_index_[key_values.first];
+    for (auto& value_count : key_values.second) {
+      label_values[value_count.first].erase(machine_res_id);
+      if (label_values[value_count.first].empty()) {
+        label_values.erase(value_count.first);
+      }
+    }
+    if (label_values.empty()) {
+      pod_label_index_.erase(key_values.first);
+    }
+  }
+  machines_.erase(machine_res_id);
+  // Tasks that ran on the machine are dropped in TaskRemoved.
+}
+
+bool AffinityPlacementEngine::SatisfiesPodAffinity(
+    const MachineRecord& record, const TaskDescriptor& td) const {
+  if (!td.has_affinity() || !td.affinity().has_pod_affinity()) {
+    return true;
+  }
+  for (auto& term : td.affinity().pod_affinity()
+                      .requiredduringschedulingignoredduringexecution()) {
+    bool namespace_found = false;
+    if (!term.namespaces_size()) {
+      namespace_found = ContainsKey(record.namespaces, td.task_namespace());
+    } else {
+      for (auto& name : term.namespaces()) {
+        if (ContainsKey(record.namespaces, name)) {
+          namespace_found = true;
+          break;
+        }
+      }
+    }
+    if (!namespace_found) {
+      return false;
+    }
+    for (auto& expression : term.labelselector().matchexpressions()) {
+      if (!ExpressionMatches(record, expression.key(), expression.operator_(),
+                             expression.values())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool AffinityPlacementEngine::SatisfiesPodAntiAffinity(
+    const MachineRecord& record, const TaskDescriptor& td) const {
+  if (!td.has_affinity() || !td.affinity().has_pod_anti_affinity()) {
+    return true;
+  }
+  for (auto& term : td.affinity().pod_anti_affinity()
+                      .requiredduringschedulingignoredduringexecution()) {
+    if (!term.namespaces_size()) {
+      if (ContainsKey(record.namespaces, td.task_namespace())) {
+        return false;
+      }
+    } else {
+      for (auto& name : term.namespaces()) {
+        if (ContainsKey(record.namespaces, name)) {
+          return false;
+        }
+      }
+    }
+    for (auto& expression : term.labelselector().matchexpressions()) {
+      if (ExpressionMatches(record, expression.key(), expression.operator_(),
+                            expression.values())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void AffinityPlacementEngine::TaskPlaced(const TaskDescriptor& td,
+                                         ResourceID_t machine_res_id) {
+  TaskRemoved(td.uid());
+  MachineRecord* record = FindOrNull(machines_, machine_res_id);
+  if (!record) {
+    LOG(WARNING) << "Task " << td.uid() << " placed on unknown machine "
+                 << machine_res_id;
+    return;
+  }
+  PlacedTask placed_task;
+  placed_task.machine_res_id = machine_res_id;
+  placed_task.request = td.resource_request();
+  placed_task.task_namespace = td.task_namespace();
+  for (auto& label : td.labels()) {
+    placed_task.labels.push_back(
+        pair<string, string>(label.key(), label.value()));
+    if (++record->pod_labels[label.key()][label.value()] == 1) {
+      pod_label_index_[label.key()][label.value()].insert(machine_res_id);
+    }
+  }
+  record->namespaces[td.task_namespace()]++;
+  record->num_tasks++;
+  ResourceVector* free_resources = &record->free_resources;
+  free_resources->set_cpu_cores(free_resources->cpu_cores() -
+                                placed_task.request.cpu_cores());
+  free_resources->set_ram_cap(free_resources->ram_cap() -
+                              placed_task.request.ram_cap());
+  free_resources->set_ephemeral_storage(
+      free_resources->ephemeral_storage() -
+      placed_task.request.ephemeral_storage());
+  UpdateCost(machine_res_id, record);
+  CHECK(InsertIfNotPresent(&placed_tasks_, td.uid(), placed_task));
+}
+
+void AffinityPlacementEngine::TaskRemoved(TaskID_t task_id) {
+  PlacedTask* placed_task = FindOrNull(placed_tasks_, task_id);
+  if (!placed_task) {
+    return;
+  }
+  ResourceID_t machine_res_id = placed_task->machine_res_id;
+  MachineRecord* record = FindOrNull(machines_, machine_res_id);
+  if (record) {
+    for (auto& label : placed_task->labels) {
+      unordered_map<string, uint32_t>& label_values =
+        record->pod_labels[label.first];
+      if (--label_values[label.second] == 0) {
+        label_values.erase(label.second);
+        unordered_map<string, MachineSet_t>& index_values =
+          pod_label_index_[label.first];
+        index_values[label.second].erase(machine_res_id);
+        if (index_values[label.second].empty()) {
+          index_values.erase(label.second);
+        }
+        if (index_values.empty()) {
+          pod_label_index_.erase(label.first);
+        }
+      }
+      if (label_values.empty()) {
+        record->pod_labels.erase(label.first);
+      }
+    }
+    if (--record->namespaces[placed_task->task_namespace] == 0) {
+      record->namespaces.erase(placed_task->task_namespace);
+    }
+    record->num_tasks--;
+    ResourceVector* free_resources = &record->free_resources;
+    free_resources->set_cpu_cores(free_resources->cpu_cores() +
+                                  placed_task->request.cpu_cores());
+    free_resources->set_ram_cap(free_resources->ram_cap() +
+                                placed_task->request.ram_cap());
+    free_resources->set_ephemeral_storage(
+        free_resources->ephemeral_storage() +
+        placed_task->request.ephemeral_storage());
+    UpdateCost(machine_res_id, record);
+  }
+  placed_tasks_.erase(task_id);
+}
+
+void AffinityPlacementEngine::UpdateCost(ResourceID_t machine_res_id,
+                                         MachineRecord* record) {
+  machines_by_cost_.erase(
+      pair<int64_t, ResourceID_t>(record->cost, machine_res_id));
+  record->cost = ComputeCost(*record);
+  machines_by_cost_.insert(
+      pair<int64_t, ResourceID_t>(record->cost, machine_res_id));
+}
+
+}  // namespace scheduler
+}  // namespace firmament
@@ -0,0 +1,131 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Indexed placement engine for tasks with pod affinity/anti-affinity.
+
+#ifndef FIRMAMENT_SCHEDULING_AFFINITY_PLACEMENT_ENGINE_H
+#define FIRMAMENT_SCHEDULING_AFFINITY_PLACEMENT_ENGINE_H
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_desc.pb.h"
+#include "base/task_desc.pb.h"
+#include "base/types.h"
+
+namespace firmament {
+namespace scheduler {
+
+/**
+ * Answers "which machine is best for this task?" for tasks with pod
+ * affinity/anti-affinity without going through the flow network. The engine
+ * keeps a record per machine (free resources, pod count, labels and
+ * namespaces of the pods running on it), an index from pod labels to the
+ * machines running such pods, and the machines ordered by placement cost.
+ * Placements and removals update only the affected machine's record.
+ * The feasibility rules mirror those of the CPU cost model.
+ */
+class AffinityPlacementEngine {
+ public:
+  AffinityPlacementEngine();
+  /**
+   * Adds a machine to the engine. Does nothing if the machine is known.
+   * @param rd the machine's descriptor; must outlive the machine's record
+   */
+  void AddMachine(const ResourceDescriptor& rd);
+  void RemoveMachine(ResourceID_t machine_res_id);
+  /**
+   * Resets the free resources of every machine to the available resources in
+   * its descriptor, so that the engine agrees with the cost model after the
+   * latter has updated them from the machines' resource stats.
+   */
+  void RefreshMachines();
+  /**
+   * Returns the cheapest machine on which the task can run.
+   * @param td the task to place
+   * @return the machine's resource id, or nil if no machine is feasible
+   */
+  ResourceID_t BestMachineForTask(const TaskDescriptor& td) const;
+  /**
+   * Records that a task is running on a machine.
+   * @param td the task
+   * @param machine_res_id the machine the task runs on
+   */
+  void TaskPlaced(const TaskDescriptor& td, ResourceID_t machine_res_id);
+  /**
+   * Records that a task no longer runs. Does nothing if the engine does not
+   * know about the task.
+   * @param task_id the id of the task
+   */
+  void TaskRemoved(TaskID_t task_id);
+
+  inline uint64_t num_machines() const {
+    return machines_.size();
+  }
+
+ private:
+  struct MachineRecord {
+    const ResourceDescriptor* rd_ptr;
+    ResourceVector free_resources;
+    uint64_t num_tasks;
+    int64_t cost;
+    // Label key -> label value -> number of pods with the label
+    unordered_map<string, unordered_map<string, uint32_t>> pod_labels;
+    // Namespace -> number of pods in the namespace
+    unordered_map<string, uint32_t> namespaces;
+  };
+  struct PlacedTask {
+    ResourceID_t machine_res_id;
+    ResourceVector request;
+    vector<pair<string, string>> labels;
+    string task_namespace;
+  };
+  typedef unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>
+    MachineSet_t;
+
+  int64_t ComputeCost(const MachineRecord& record) const;
+  bool ExpressionMatches(const MachineRecord& record, const string& key,
+                         const string& op,
+                         const RepeatedPtrField<string>& values) const;
+  bool IndexedCandidates(const TaskDescriptor& td,
+                         vector<ResourceID_t>* candidates) const;
+  bool IsFeasible(const MachineRecord& record, const TaskDescriptor& td) const;
+  bool SatisfiesPodAffinity(const MachineRecord& record,
+                            const TaskDescriptor& td) const;
+  bool SatisfiesPodAntiAffinity(const MachineRecord& record,
+                                const TaskDescriptor& td) const;
+  void UpdateCost(ResourceID_t machine_res_id, MachineRecord* record);
+
+  unordered_map<ResourceID_t, MachineRecord,
+                boost::hash<boost::uuids::uuid>> machines_;
+  unordered_map<TaskID_t, PlacedTask> placed_tasks_;
+  // Pod label key -> label value -> machines running a pod with the label
+  unordered_map<string, unordered_map<string, MachineSet_t>> pod_label_index_;
+  // Machines ordered by placement cost, cheapest first
+  set<pair<int64_t, ResourceID_t>> machines_by_cost_;
+};
+
+}  // namespace scheduler
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_AFFINITY_PLACEMENT_ENGINE_H
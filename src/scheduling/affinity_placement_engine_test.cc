@@ -0,0 +1,198 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Affinity placement engine unit tests.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "misc/utils.h"
+#include "scheduling/affinity_placement_engine.h"
+
+namespace firmament {
+namespace scheduler {
+
+class AffinityPlacementEngineTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    for (auto& rd_ptr : machines_) {
+      delete rd_ptr;
+    }
+    machines_.clear();
+  }
+
+  ResourceDescriptor* AddMachine(const string& name, float cpu_cores,
+                                 uint64_t max_pods) {
+    ResourceDescriptor* rd_ptr = new ResourceDescriptor;
+    rd_ptr->set_uuid(to_string(GenerateResourceID(name)));
+    rd_ptr->set_friendly_name(name);
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    rd_ptr->set_max_pods(max_pods);
+    ResourceVector* capacity = rd_ptr->mutable_resource_capacity();
+    capacity->set_cpu_cores(cpu_cores);
+    capacity->set_ram_cap(65536);
+    capacity->set_ephemeral_storage(100000);
+    rd_ptr->mutable_available_resources()->CopyFrom(*capacity);
+    machines_.push_back(rd_ptr);
+    engine_.AddMachine(*rd_ptr);
+    return rd_ptr;
+  }
+
+  TaskDescriptor MakeTask(TaskID_t task_id, const string& app) {
+    TaskDescriptor td;
+    td.set_uid(task_id);
+    td.set_task_namespace("default");
+    Label* label = td.add_labels();
+    label->set_key("app");
+    label->set_value(app);
+    ResourceVector* request = td.mutable_resource_request();
+    request->set_cpu_cores(1);
+    request->set_ram_cap(1024);
+    request->set_ephemeral_storage(1);
+    return td;
+  }
+
+  void AddAntiAffinity(TaskDescriptor* td, const string& app) {
+    PodAffinityTermAntiAff* term =
+      td->mutable_affinity()->mutable_pod_anti_affinity()
+        ->add_requiredduringschedulingignoredduringexecution();
+    LabelSelectorRequirementAntiAff* expression =
+      term->mutable_labelselector()->add_matchexpressions();
+    expression->set_key("app");
+    expression->set_operator_("In");
+    expression->add_values(app);
+  }
+
+  void AddAffinity(TaskDescriptor* td, const string& app) {
+    PodAffinityTerm* term =
+      td->mutable_affinity()->mutable_pod_affinity()
+        ->add_requiredduringschedulingignoredduringexecution();
+    LabelSelectorRequirement* expression =
+      term->mutable_labelselector()->add_matchexpressions();
+    expression->set_key("app");
+    expression->set_operator_("In");
+    expression->add_values(app);
+  }
+
+  ResourceID_t ResID(const ResourceDescriptor* rd_ptr) {
+    return ResourceIDFromString(rd_ptr->uuid());
+  }
+
+  AffinityPlacementEngine engine_;
+  vector<ResourceDescriptor*> machines_;
+};
+
+TEST_F(AffinityPlacementEngineTest, AntiAffinitySpreadsTasks) {
+  for (uint32_t index = 0; index < 3; ++index) {
+    AddMachine("machine" + to_string(index), 16, 110);
+  }
+  unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>> used;
+  for (TaskID_t task_id = 1; task_id <= 3; ++task_id) {
+    TaskDescriptor td = MakeTask(task_id, "web");
+    AddAntiAffinity(&td, "web");
+    ResourceID_t res_id = engine_.BestMachineForTask(td);
+    CHECK(!res_id.is_nil());
+    CHECK(used.insert(res_id).second);
+    engine_.TaskPlaced(td, res_id);
+  }
+  TaskDescriptor td = MakeTask(4, "web");
+  AddAntiAffinity(&td, "web");
+  CHECK(engine_.BestMachineForTask(td).is_nil());
+  // Once a task completes, its machine becomes available again
+  engine_.TaskRemoved(2);
+  CHECK(!engine_.BestMachineForTask(td).is_nil());
+}
+
+TEST_F(AffinityPlacementEngineTest, AffinityFollowsRunningPods) {
+  for (uint32_t index = 0; index < 100; ++index) {
+    AddMachine("machine" + to_string(index), 16, 110);
+  }
+  TaskDescriptor td = MakeTask(2, "cache");
+  AddAffinity(&td, "db");
+  CHECK(engine_.BestMachineForTask(td).is_nil());
+  TaskDescriptor db_td = MakeTask(1, "db");
+  engine_.TaskPlaced(db_td, ResID(machines_[42]));
+  CHECK_EQ(engine_.BestMachineForTask(td), ResID(machines_[42]));
+  engine_.TaskRemoved(1);
+  CHECK(engine_.BestMachineForTask(td).is_nil());
+}
+
+TEST_F(AffinityPlacementEngineTest, PrefersLeastRequestedFeasibleMachine) {
+  ResourceDescriptor* small_rd = AddMachine("small", 4, 110);
+  ResourceDescriptor* big_rd = AddMachine("big", 8, 2);
+  TaskDescriptor td = MakeTask(1, "web");
+  // Both machines are idle, so both cost the same
+  engine_.TaskPlaced(td, ResID(small_rd));
+  for (TaskID_t task_id = 2; task_id <= 3; ++task_id) {
+    td = MakeTask(task_id, "web");
+    CHECK_EQ(engine_.BestMachineForTask(td), ResID(big_rd));
+    engine_.TaskPlaced(td, ResID(big_rd));
+  }
+  // The big machine has no pod slots left
+  td = MakeTask(4, "web");
+  CHECK_EQ(engine_.BestMachineForTask(td), ResID(small_rd));
+  engine_.RemoveMachine(ResID(small_rd));
+  CHECK(engine_.BestMachineForTask(td).is_nil());
+  engine_.TaskRemoved(1);
+  CHECK_EQ(engine_.num_machines(), 1);
+}
+
+TEST_F(AffinityPlacementEngineTest, RefreshMachinesFromResourceStats) {
+  ResourceDescriptor* first_rd = AddMachine("first", 16, 110);
+  ResourceDescriptor* second_rd = AddMachine("second", 16, 110);
+  engine_.TaskPlaced(MakeTask(1, "web"), ResID(second_rd));
+  TaskDescriptor td = MakeTask(2, "web");
+  CHECK_EQ(engine_.BestMachineForTask(td), ResID(first_rd));
+  // The resource stats show that the first machine is almost fully used by
+  // tasks the engine does not know about.
+  first_rd->mutable_available_resources()->set_cpu_cores(0.5);
+  CHECK_EQ(engine_.BestMachineForTask(td), ResID(first_rd));
+  engine_.RefreshMachines();
+  CHECK_EQ(engine_.BestMachineForTask(td), ResID(second_rd));
+  // Once the load moves to the second machine, the first one is the
+  // cheapest again.
+  first_rd->mutable_available_resources()->set_cpu_cores(16);
+  second_rd->mutable_available_resources()->set_cpu_cores(8);
+  engine_.RefreshMachines();
+  CHECK_EQ(engine_.BestMachineForTask(td), ResID(first_rd));
+}
+
+// Places one anti-affinity pod per machine on a 5k machine cluster.
+TEST_F(AffinityPlacementEngineTest, AntiAffinityFillsLargeCluster) {
+  uint32_t num_machines = 5000;
+  for (uint32_t index = 0; index < num_machines; ++index) {
+    AddMachine("machine" + to_string(index), 16, 110);
+  }
+  uint32_t num_placed = 0;
+  for (TaskID_t task_id = 1; task_id <= num_machines; ++task_id) {
+    TaskDescriptor td = MakeTask(task_id, "web");
+    AddAntiAffinity(&td, "web");
+    ResourceID_t res_id = engine_.BestMachineForTask(td);
+    if (!res_id.is_nil()) {
+      engine_.TaskPlaced(td, res_id);
+      num_placed++;
+    }
+  }
+  CHECK_EQ(num_placed, num_machines);
+}
+
+}  // namespace scheduler
+}  // namespace firmament
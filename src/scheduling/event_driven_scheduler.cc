@@ -100,7 +100,7 @@ EventDrivenScheduler::~EventDrivenScheduler() {
 }
 
 void EventDrivenScheduler::AddJob(JobDescriptor* jd_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   InsertOrUpdate(&jobs_to_schedule_, JobIDFromString(jd_ptr->uuid()), jd_ptr);
   AddPodAffinityAntiAffinityJobData(jd_ptr);
 }
@@ -121,6 +121,7 @@ void EventDrivenScheduler::AddPodAffinityAntiAffinityJobData(
     }
     if (no_conflict_within) {
       no_conflict_root_tasks_.insert(rtd.uid());
+      affinity_conflict_index_.AddTask(rtd);
       unordered_set<TaskID_t> children_set;
       InsertIfNotPresent(&root_to_children_tasks_, rtd.uid(), children_set);
     } else {
@@ -314,7 +315,7 @@ vector<TaskID_t> EventDrivenScheduler::BoundTasksForResource(
 }
 
 void EventDrivenScheduler::CheckRunningTasksHealth() {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   for (auto& executor : executors_) {
     vector<TaskID_t> failed_tasks;
     if (!executor.second->CheckRunningTasksHealth(&failed_tasks)) {
@@ -337,6 +338,55 @@ void EventDrivenScheduler::CheckRunningTasksHealth() {
   }
 }
 
+void EventDrivenScheduler::CollectTaskStats(
+    vector<TaskHeartbeatMessage>* reports) {
+  vector<TaskStats> task_stats;
+  vector<TaskHeartbeatMessage> heartbeats;
+  {
+    // Sampling reads the tasks' cgroup or procfs files, so we do it without
+    // holding the scheduling lock.
+    boost::lock_guard<boost::mutex> lock(executors_lock_);
+    for (auto& executor : executors_) {
+      executor.second->CollectTaskStats(&task_stats);
+      executor.second->CollectTaskHeartbeats(&heartbeats);
+    }
+  }
+  if (task_stats.empty() && heartbeats.empty())
+    return;
+  {
+    boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
+    // Heartbeats received by the executors count as signs of life, just like
+    // those sent to the coordinator.
+    uint64_t cur_time = time_manager_->GetCurrentTimestamp();
+    for (auto& heartbeat : heartbeats) {
+      TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, heartbeat.task_id());
+      if (td_ptr)
+        td_ptr->set_last_heartbeat_time(cur_time);
+    }
+  }
+  vector<const TaskStats*> samples;
+  samples.reserve(task_stats.size() + heartbeats.size());
+  for (auto& stats : task_stats) {
+    samples.push_back(&stats);
+  }
+  for (auto& heartbeat : heartbeats) {
+    if (heartbeat.has_stats())
+      samples.push_back(&heartbeat.stats());
+  }
+  knowledge_base_->AddTaskStatsSamples(samples);
+  if (reports) {
+    // The executors' samples carry no sequence number; they are forwarded as
+    // stats-only heartbeats.
+    for (auto& stats : task_stats) {
+      TaskHeartbeatMessage report;
+      report.set_task_id(stats.task_id());
+      report.mutable_stats()->CopyFrom(stats);
+      reports->push_back(report);
+    }
+    reports->insert(reports->end(), heartbeats.begin(), heartbeats.end());
+  }
+}
+
 void EventDrivenScheduler::CleanStateForDeregisteredResource(
     ResourceTopologyNodeDescriptor* rtnd_ptr) {
   const ResourceDescriptor& rd = rtnd_ptr->resource_desc();
@@ -349,7 +399,10 @@ void EventDrivenScheduler::CleanStateForDeregisteredResource(
     // TODO(ionel): Terminate the tasks running on res_id or any of
     // its sub-resources. Make sure the tasks get re-scheduled.
     // exec->TerminateAllTasks();
-    CHECK(executors_.erase(res_id));
+    {
+      boost::lock_guard<boost::mutex> executors_lock(executors_lock_);
+      CHECK(executors_.erase(res_id));
+    }
     delete exec;
   } else if (rd.type() == ResourceDescriptor::RESOURCE_MACHINE) {
     trace_generator_->RemoveMachine(rd);
@@ -361,6 +414,21 @@ void EventDrivenScheduler::CleanStateForDeregisteredResource(
   delete rs_ptr;
 }
 
+void EventDrivenScheduler::ComputeRunnableTasksForPlacements(
+    const vector<pair<TaskDescriptor*, ResourceDescriptor*> >& placements,
+    vector<JobDescriptor*>* jd_ptr_vect) {
+  unordered_set<JobID_t, boost::hash<boost::uuids::uuid>> job_ids;
+  for (auto& placement : placements) {
+    JobID_t job_id = JobIDFromString(placement.first->job_id());
+    if (job_ids.insert(job_id).second) {
+      JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
+      CHECK_NOTNULL(jd_ptr);
+      ComputeRunnableTasksForJob(jd_ptr);
+      jd_ptr_vect->push_back(jd_ptr);
+    }
+  }
+}
+
 void EventDrivenScheduler::DebugPrintRunnableTasks() {
   for (auto& runnable_tasks_per_job : runnable_tasks_) {
     for (auto& task : runnable_tasks_per_job.second) {
@@ -403,7 +471,7 @@ void EventDrivenScheduler::ExecuteTask(TaskDescriptor* td_ptr,
 }
 
 void EventDrivenScheduler::HandleJobCompletion(JobID_t job_id) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   JobDescriptor* jd = FindOrNull(*job_map_, job_id);
   CHECK_NOTNULL(jd);
   jobs_to_schedule_.erase(job_id);
@@ -415,7 +483,7 @@ void EventDrivenScheduler::HandleJobCompletion(JobID_t job_id) {
 }
 
 void EventDrivenScheduler::HandleJobRemoval(JobID_t job_id) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   JobDescriptor* jd = FindOrNull(*job_map_, job_id);
   CHECK_NOTNULL(jd);
   jobs_to_schedule_.erase(job_id);
@@ -435,7 +503,7 @@ void EventDrivenScheduler::HandleReferenceStateChange(
     // no change, return
     return;
   } else if (!old_ref.Consumable() && new_ref.Consumable()) {
-    boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+    boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
     // something became available, unblock the waiting tasks
     unordered_set<TaskDescriptor*>* tasks = FindOrNull(reference_subscriptions_,
                                                        old_ref.id());
@@ -473,7 +541,7 @@ void EventDrivenScheduler::HandleReferenceStateChange(
 
 void EventDrivenScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
                                                 TaskFinalReport* report) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   // Find resource for task
   ResourceID_t* res_id_ptr = BoundResourceForTask(td_ptr->uid());
   ResourceStatus* rs_ptr = NULL;
@@ -511,7 +579,7 @@ void EventDrivenScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
 
 void EventDrivenScheduler::HandleTaskDelegationFailure(
     TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   // Find the resource where the task was supposed to be delegated
   ResourceID_t* res_id_ptr = BoundResourceForTask(td_ptr->uid());
   CHECK_NOTNULL(res_id_ptr);
@@ -530,7 +598,7 @@ void EventDrivenScheduler::HandleTaskDelegationFailure(
 
 void EventDrivenScheduler::HandleTaskDelegationSuccess(
     TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   // Remove the task from the runnable set
   JobID_t job_id = JobIDFromString(td_ptr->job_id());
   TaskID_t task_id = td_ptr->uid();
@@ -542,7 +610,7 @@ void EventDrivenScheduler::HandleTaskDelegationSuccess(
 
 void EventDrivenScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
                                               ResourceDescriptor* rd_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   ResourceID_t res_id = ResourceIDFromString(rd_ptr->uuid());
   VLOG(1) << "Handling eviction of task " << td_ptr->uid()
           << ", freeing resource " << res_id;
@@ -563,7 +631,7 @@ void EventDrivenScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
 }
 
 void EventDrivenScheduler::HandleTaskFailure(TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   // Find resource for task
   ResourceID_t* res_id_ptr = FindOrNull(task_bindings_, td_ptr->uid());
   CHECK_NOTNULL(res_id_ptr);
@@ -879,7 +947,7 @@ bool EventDrivenScheduler::PlaceDelegatedTask(TaskDescriptor* td,
     return false;
   }
   // Otherwise, bind the task
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   InsertIfNotPresent(task_map_.get(), td->uid(), td);
   HandleTaskPlacement(td, rd);
   td->set_state(TaskDescriptor::RUNNING);
@@ -944,6 +1012,7 @@ void EventDrivenScheduler::RegisterLocalResource(ResourceID_t res_id) {
   VLOG(1) << "Adding executor for local resource " << res_id;
   LocalExecutor* exec = new LocalExecutor(res_id, coordinator_uri_,
                                           time_manager_, topology_manager_);
+  boost::lock_guard<boost::mutex> lock(executors_lock_);
   CHECK(InsertIfNotPresent(&executors_, res_id, exec));
 }
 
@@ -952,7 +1021,7 @@ void EventDrivenScheduler::RegisterResource(
     ResourceTopologyNodeDescriptor* rtnd_ptr,
     bool local,
     bool simulated) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   BFSTraverseResourceProtobufTreeReturnRTND(
       rtnd_ptr, boost::bind(&EventDrivenScheduler::SetupPUs, this, _1,
                             local, simulated));
@@ -966,12 +1035,14 @@ void EventDrivenScheduler::RegisterRemoteResource(ResourceID_t res_id) {
                                             resource_map_.get(),
                                             m_adapter_ptr_,
                                             time_manager_);
+  boost::lock_guard<boost::mutex> lock(executors_lock_);
   CHECK(InsertIfNotPresent(&executors_, res_id, exec));
 }
 
 void EventDrivenScheduler::RegisterSimulatedResource(ResourceID_t res_id) {
   VLOG(1) << "Adding executor for simulated resource " << res_id;
   SimulatedExecutor* exec = new SimulatedExecutor(res_id, coordinator_uri_);
+  boost::lock_guard<boost::mutex> lock(executors_lock_);
   CHECK(InsertIfNotPresent(&executors_, res_id, exec));
 }
 
@@ -1024,6 +1095,19 @@ const unordered_set<TaskID_t>& EventDrivenScheduler::ComputeRunnableTasksForJob(
   }
 }
 
+void EventDrivenScheduler::RestoreTaskPlacements(
+    const vector<pair<TaskDescriptor*, ResourceDescriptor*> >& placements) {
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
+  vector<JobDescriptor*> jd_ptr_vect;
+  ComputeRunnableTasksForPlacements(placements, &jd_ptr_vect);
+  trace_generator_->set_restoring(true);
+  for (auto& placement : placements) {
+    trace_generator_->TaskSubmitted(placement.first);
+    HandleTaskPlacement(placement.first, placement.second);
+  }
+  trace_generator_->set_restoring(false);
+}
+
 void EventDrivenScheduler::SetupPUs(ResourceTopologyNodeDescriptor* rtnd_ptr,
                                     bool local,
                                     bool simulated) {
@@ -1056,8 +1140,15 @@ bool EventDrivenScheduler::UnbindTaskFromResource(TaskDescriptor* td_ptr,
   ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
   CHECK_NOTNULL(rs_ptr);
   ResourceDescriptor* rd_ptr = rs_ptr->mutable_descriptor();
-  // We don't have to remove the task from rd_ptr's running tasks because
-  // we've already cleared the list.
+  RepeatedField<uint64_t>* running_tasks =
+    rd_ptr->mutable_current_running_tasks();
+  for (int32_t index = 0; index < running_tasks->size(); ++index) {
+    if (running_tasks->Get(index) == task_id) {
+      running_tasks->SwapElements(index, running_tasks->size() - 1);
+      running_tasks->RemoveLast();
+      break;
+    }
+  }
   if (rd_ptr->current_running_tasks_size() == 0) {
     rd_ptr->set_state(ResourceDescriptor::RESOURCE_IDLE);
   }
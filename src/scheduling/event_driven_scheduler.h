@@ -29,6 +29,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
 #include "base/common.h"
 #include "base/types.h"
 #include "base/job_desc.pb.h"
@@ -38,6 +40,7 @@
 #include "misc/messaging_interface.h"
 #include "misc/time_interface.h"
 #include "misc/trace_generator.h"
+#include "scheduling/affinity_conflict_index.h"
 #include "scheduling/knowledge_base.h"
 #include "scheduling/scheduler_interface.h"
 #include "scheduling/scheduling_event_notifier_interface.h"
@@ -71,6 +74,7 @@ class EventDrivenScheduler : public SchedulerInterface {
   ResourceID_t* BoundResourceForTask(TaskID_t task_id);
   vector<TaskID_t> BoundTasksForResource(ResourceID_t res_id);
   void CheckRunningTasksHealth();
+  void CollectTaskStats(vector<TaskHeartbeatMessage>* reports);
   virtual void DeregisterResource(ResourceTopologyNodeDescriptor* rtnd_ptr);
   virtual void HandleJobCompletion(JobID_t job_id);
   virtual void HandleJobRemoval(JobID_t job_id);
@@ -93,6 +97,8 @@ class EventDrivenScheduler : public SchedulerInterface {
   virtual void RegisterResource(ResourceTopologyNodeDescriptor* rtnd_ptr,
                                 bool local,
                                 bool simulated);
+  virtual void RestoreTaskPlacements(
+      const vector<pair<TaskDescriptor*, ResourceDescriptor*> >& placements);
   // N.B. ScheduleJob must be implemented in scheduler-specific logic
   virtual uint64_t ScheduleAllJobs(SchedulerStats* scheduler_stats) = 0;
   virtual uint64_t ScheduleAllJobs(SchedulerStats* scheduler_stats,
@@ -113,6 +119,15 @@ class EventDrivenScheduler : public SchedulerInterface {
   void BindTaskToResource(TaskDescriptor* td_ptr, ResourceDescriptor* rd_ptr);
   void CleanStateForDeregisteredResource(
       ResourceTopologyNodeDescriptor* rtnd_ptr);
+  /**
+   * Computes the runnable tasks of the jobs to which restored task placements
+   * belong.
+   * @param placements the restored task placements
+   * @param jd_ptr_vect vector in which the descriptors of the jobs are returned
+   */
+  void ComputeRunnableTasksForPlacements(
+      const vector<pair<TaskDescriptor*, ResourceDescriptor*> >& placements,
+      vector<JobDescriptor*>* jd_ptr_vect);
   void DebugPrintRunnableTasks();
   void ExecuteTask(TaskDescriptor* td_ptr, ResourceDescriptor* rd_ptr);
   virtual void HandleTaskMigration(TaskDescriptor* td_ptr,
@@ -178,6 +193,10 @@ class EventDrivenScheduler : public SchedulerInterface {
   // includes both executors for local and for remote resources.
   unordered_map<ResourceID_t, ExecutorInterface*,
     boost::hash<ResourceID_t>> executors_;
+  // Protects executors_ against concurrent modification while the tasks'
+  // usage is sampled without holding the scheduling lock. Code that modifies
+  // executors_ must hold both locks, and takes the scheduling lock first.
+  boost::mutex executors_lock_;
   // A vector holding descriptors of the jobs to be scheduled in the next
   // scheduling round.
   unordered_map<JobID_t, JobDescriptor*,
@@ -209,6 +228,8 @@ class EventDrivenScheduler : public SchedulerInterface {
   unordered_map<JobDescriptor*, vector<SchedulingDelta>> affinity_job_to_deltas_;
   unordered_set<uint64_t> affinity_delta_tasks;
   unordered_set<TaskID_t> no_conflict_root_tasks_;
+  // Labels and selectors of the tasks in no_conflict_root_tasks_
+  AffinityConflictIndex affinity_conflict_index_;
   bool affinity_batch_schedule;
   unordered_map<TaskID_t, vector<TaskID_t>> no_conflict_tasks_map_;
   unordered_map<TaskID_t, TaskID_t> no_conflict_task_mapped_;
@@ -49,6 +49,8 @@ using firmament::scheduler::FlowScheduler;
 using firmament::scheduler::ObjectStoreInterface;
 using firmament::scheduler::SchedulerInterface;
 using firmament::scheduler::SchedulerStats;
+using firmament::scheduler::SchedulingLock;
+using firmament::scheduler::SchedulingRoundGuard;
 using firmament::scheduler::SimpleScheduler;
 using firmament::scheduler::TopologyManager;
 using firmament::platform::sim::SimulatedMessagingAdapter;
@@ -260,7 +262,12 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
 
   Status Schedule(ServerContext* context, const ScheduleRequest* request,
                   SchedulingDeltas* reply) override {
-    boost::lock_guard<boost::recursive_mutex> lock(
+    // The whole RPC is one scheduling round. Its solver runs release the
+    // scheduling lock, but not the round lock, so a second Schedule call
+    // waits here for this one to finish.
+    SchedulingRoundGuard round_guard(&scheduler_->scheduling_round_lock_,
+                                     &scheduler_->scheduling_lock_);
+    boost::lock_guard<SchedulingLock> lock(
         scheduler_->scheduling_lock_);
     // Clear unscheduled tasks related maps and sets of previous scheduling
     // round.
@@ -458,7 +465,7 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
 
   Status TaskRemoved(ServerContext* context, const TaskUID* tid_ptr,
                      TaskRemovedResponse* reply) override {
-    boost::lock_guard<boost::recursive_mutex> lock(
+    boost::lock_guard<SchedulingLock> lock(
         scheduler_->scheduling_lock_);
     TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, tid_ptr->task_uid());
     if (td_ptr == NULL) {
@@ -543,7 +550,7 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
   Status TaskSubmitted(ServerContext* context,
                        const TaskDescription* task_desc_ptr,
                        TaskSubmittedResponse* reply) override {
-    boost::lock_guard<boost::recursive_mutex> lock(
+    boost::lock_guard<SchedulingLock> lock(
         scheduler_->scheduling_lock_);
     TaskID_t task_id = task_desc_ptr->task_descriptor().uid();
     if (FindPtrOrNull(*task_map_, task_id)) {
@@ -637,7 +644,7 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
   Status NodeAdded(ServerContext* context,
                    const ResourceTopologyNodeDescriptor* submitted_rtnd_ptr,
                    NodeAddedResponse* reply) override {
-    boost::lock_guard<boost::recursive_mutex> lock(
+    boost::lock_guard<SchedulingLock> lock(
         scheduler_->scheduling_lock_);
     bool doesnt_exist = DFSTraverseResourceProtobufTreeWhileTrue(
         *submitted_rtnd_ptr,
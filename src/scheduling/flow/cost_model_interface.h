@@ -52,6 +52,14 @@ enum CostModelType {
   COST_MODEL_CPU = 10,
 };
 
+// What the cost of a task's arc to its unscheduled aggregator depends on.
+enum UnscheduledAggCostDependency {
+  // The cost does not change while the task waits.
+  UNSCHED_COST_CONSTANT = 0,
+  // The cost changes while the task waits.
+  UNSCHED_COST_DEPENDS_ON_TIME = 1,
+};
+
 struct ArcDescriptor {
   ArcDescriptor(Cost_t cost, uint64_t capacity, uint64_t min_flow) :
     cost_(cost), capacity_(capacity), min_flow_(min_flow), gain_(1.0) {
@@ -77,6 +85,16 @@ class CostModelInterface {
    * each iteration.
    */
   virtual ArcDescriptor TaskToUnscheduledAgg(TaskID_t task_id) = 0;
+  /**
+   * Tells the flow graph manager when the cost returned by
+   * TaskToUnscheduledAgg can change, so that it doesn't recompute costs
+   * that cannot have changed. The arc of a task whose node is updated is
+   * always recomputed.
+   * @return what the cost depends on
+   */
+  virtual UnscheduledAggCostDependency TaskToUnscheduledAggCostDependency() {
+    return UNSCHED_COST_DEPENDS_ON_TIME;
+  }
   // TODO(ionel): The returned capacity is ignored because the cost models
   // do not set it correctly.
   virtual ArcDescriptor UnscheduledAggToSink(JobID_t job_id) = 0;
@@ -115,6 +115,11 @@ ArcDescriptor CpuCostModel::TaskToUnscheduledAgg(TaskID_t task_id) {
   return ArcDescriptor(2560000, 1ULL, 0ULL);
 }
 
+UnscheduledAggCostDependency
+CpuCostModel::TaskToUnscheduledAggCostDependency() {
+  return UNSCHED_COST_CONSTANT;
+}
+
 ArcDescriptor CpuCostModel::UnscheduledAggToSink(JobID_t job_id) {
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
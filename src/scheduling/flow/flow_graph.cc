@@ -84,6 +84,10 @@ void FlowGraph::DeleteArc(FlowGraphArc* arc) {
   // Remove the arc from the incoming and outgoing collections.
   arc->src_node_->outgoing_arc_map_.erase(arc->dst_node_->id_);
   arc->dst_node_->incoming_arc_map_.erase(arc->src_node_->id_);
+  if (arc->dst_node_->type_ == FlowNodeType::EQUIVALENCE_CLASS &&
+      arc->dst_node_->incoming_arc_map_.empty()) {
+    MarkUnconnectedEquivClass(*arc->dst_node_);
+  }
   // First remove various meta-data relating to this arc
   arc_set_.erase(arc);
   // Then delete the arc itself
@@ -133,6 +137,22 @@ FlowGraphArc* FlowGraph::GetArc(FlowGraphNode* src, FlowGraphNode* dst) {
   return arc_it->second;
 }
 
+void FlowGraph::MarkUnconnectedEquivClass(const FlowGraphNode& ec_node) {
+  if (unconnected_ec_set_.insert(ec_node.ec_id_).second) {
+    unconnected_ecs_.push(ec_node.ec_id_);
+  }
+}
+
+bool FlowGraph::NextUnconnectedEquivClass(EquivClass_t* ec) {
+  if (unconnected_ecs_.empty()) {
+    return false;
+  }
+  *ec = unconnected_ecs_.front();
+  unconnected_ecs_.pop();
+  unconnected_ec_set_.erase(*ec);
+  return true;
+}
+
 uint64_t FlowGraph::NextId() {
   if (FLAGS_randomize_flow_graph_node_ids) {
     if (unused_ids_.empty()) {
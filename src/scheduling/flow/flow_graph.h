@@ -24,6 +24,7 @@
 #include <queue>
 #include <vector>
 
+#include "base/types.h"
 #include "misc/map-util.h"
 #include "scheduling/flow/flow_graph_arc.h"
 #include "scheduling/flow/flow_graph_node.h"
@@ -45,6 +46,20 @@ class FlowGraph {
   void DeleteArc(FlowGraphArc* arc);
   void DeleteNode(FlowGraphNode* node);
   FlowGraphArc* GetArc(FlowGraphNode* src, FlowGraphNode* dst);
+  /**
+   * Queues an equivalence class node that has no incoming arcs. DeleteArc
+   * calls this when an equivalence class node loses its last incoming arc.
+   * An equivalence class is queued at most once until it is popped.
+   * @param ec_node the equivalence class node
+   */
+  void MarkUnconnectedEquivClass(const FlowGraphNode& ec_node);
+  /**
+   * Pops the next queued equivalence class. The class may have been removed
+   * or connected again since it was queued.
+   * @param ec set to the equivalence class
+   * @return false if no equivalence class is queued
+   */
+  bool NextUnconnectedEquivClass(EquivClass_t* ec);
   inline const unordered_set<FlowGraphArc*>& Arcs() const { return arc_set_; }
   inline const unordered_map<uint64_t, FlowGraphNode*>& Nodes() const {
     return node_map_;
@@ -84,6 +99,10 @@ class FlowGraph {
   unordered_map<uint64_t, FlowGraphNode*> node_map_;
   // Queue storing the ids of the nodes we've previously removed.
   queue<uint64_t> unused_ids_;
+  // Equivalence classes whose nodes had no incoming arcs when queued, and
+  // the set of the queued classes.
+  queue<EquivClass_t> unconnected_ecs_;
+  unordered_set<EquivClass_t> unconnected_ec_set_;
 };
 
 }  // namespace firmament
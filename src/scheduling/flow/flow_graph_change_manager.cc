@@ -188,6 +188,7 @@ void FlowGraphChangeManager::DeleteNode(FlowGraphNode* node,
     AddGraphChange(chg);
   }
   dimacs_stats_->UpdateStats(change_type);
+  removed_node_ids_.insert(node->id_);
   flow_graph_->DeleteNode(node);
 }
 
@@ -470,6 +471,7 @@ void FlowGraphChangeManager::ResetChanges() {
     delete *it_tmp;
   }
   graph_changes_.clear();
+  removed_node_ids_.clear();
 }
 
 }  // namespace firmament
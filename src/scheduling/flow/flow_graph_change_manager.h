@@ -77,6 +77,10 @@ class FlowGraphChangeManager {
     OptimizeChanges();
     return graph_changes_;
   }
+  /**
+   * Clears the graph changes and the ids of the removed nodes. Called once
+   * the changes have been exported to the solver.
+   */
   void ResetChanges();
   inline bool CheckNodeType(uint64_t node_id, FlowNodeType type) {
     return flow_graph_->Node(node_id).type_ == type;
@@ -90,6 +94,13 @@ class FlowGraphChangeManager {
   inline const FlowGraphNode& Node(uint64_t node_id) {
     return flow_graph_->Node(node_id);
   }
+  /**
+   * Returns the ids of the nodes removed since the last ResetChanges call.
+   * Some of these ids may have been reused by nodes added since.
+   */
+  inline const unordered_set<uint64_t>& removed_node_ids() const {
+    return removed_node_ids_;
+  }
 
  private:
   FRIEND_TEST(FlowGraphChangeManagerTest, AddGraphChange);
@@ -143,6 +154,8 @@ class FlowGraphChangeManager {
   FlowGraph* flow_graph_;
   // Vector storing the graph changes occured since the last scheduling round.
   vector<DIMACSChange*> graph_changes_;
+  // Ids of the nodes removed since the graph changes were last reset.
+  unordered_set<uint64_t> removed_node_ids_;
   DIMACSChangeStats* dimacs_stats_;
 };
 
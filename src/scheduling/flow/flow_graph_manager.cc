@@ -48,9 +48,14 @@ DEFINE_bool(preemption, false, "Enable preemption and migration of tasks");
 DEFINE_bool(update_preferences_running_task, false,
             "True if the preferences of a running task should be updated before"
             " each scheduling round");
+DEFINE_uint64(purge_unconnected_ec_budget, 1000,
+              "Maximum number of unconnected EC nodes to remove in a purge. "
+              "The remaining ones are removed in later purges. 0 for no "
+              "limit.");
 
 DECLARE_string(flow_scheduling_solver);
 DECLARE_uint64(max_tasks_per_pu);
+DECLARE_int64(time_dependent_cost_update_frequency);
 
 namespace firmament {
 
@@ -64,6 +69,7 @@ FlowGraphManager::FlowGraphManager(
     : cost_model_(cost_model),
       graph_change_manager_(new FlowGraphChangeManager(dimacs_stats)),
       leaf_res_ids_(leaf_res_ids),
+      time_manager_(time_manager),
       trace_generator_(trace_generator),
       dimacs_stats_(dimacs_stats),
       cur_traversal_counter_(0) {
@@ -88,6 +94,9 @@ FlowGraphNode* FlowGraphManager::AddEquivClassNode(EquivClass_t ec) {
                                    "AddEquivClassNode");
   ec_node->ec_id_ = ec;
   CHECK(InsertIfNotPresent(&tec_to_node_map_, ec, ec_node));
+  // The node is purged if no arc to it gets added.
+  graph_change_manager_->mutable_flow_graph()->MarkUnconnectedEquivClass(
+      *ec_node);
   return ec_node;
 }
 
@@ -255,6 +264,22 @@ FlowGraphNode* FlowGraphManager::AddTaskNode(JobID_t job_id,
   return task_node;
 }
 
+void FlowGraphManager::AddTaskNodeForPlacement(JobID_t job_id,
+                                               TaskDescriptor* td_ptr) {
+  CHECK_NOTNULL(td_ptr);
+  if (NodeForTaskID(td_ptr->uid())) {
+    return;
+  }
+  FlowGraphNode* unsched_agg_node = UnschedAggNodeForJobID(job_id);
+  if (!unsched_agg_node) {
+    unsched_agg_node = AddUnscheduledAggNode(job_id);
+  }
+  FlowGraphNode* task_node = AddTaskNode(job_id, td_ptr);
+  // Increment capacity from unsched agg node to sink.
+  UpdateUnscheduledAggNode(unsched_agg_node, 1);
+  UpdateTaskToUnscheduledAggArc(task_node);
+}
+
 FlowGraphNode* FlowGraphManager::AddUnscheduledAggNode(JobID_t job_id) {
   string comment = "UNSCHED_AGG_for_" + to_string(job_id);
   FlowGraphNode* unsched_agg_node = graph_change_manager_->AddNode(
@@ -263,6 +288,77 @@ FlowGraphNode* FlowGraphManager::AddUnscheduledAggNode(JobID_t job_id) {
   return unsched_agg_node;
 }
 
+void FlowGraphManager::CollectGreedyCandidateArcs(
+    const FlowGraphNode& node, int64_t cost,
+    unordered_set<uint64_t>* visited_ecs,
+    vector<pair<int64_t, FlowGraphArc*>>* candidates) {
+  for (auto& dst_arc : node.outgoing_arc_map_) {
+    FlowGraphArc* arc = dst_arc.second;
+    FlowGraphNode* dst_node = arc->dst_node_;
+    if (arc->cap_upper_bound_ == 0) {
+      continue;
+    }
+    if (dst_node->IsResourceNode()) {
+      candidates->push_back(
+          pair<int64_t, FlowGraphArc*>(cost + arc->cost_, arc));
+    } else if (dst_node->IsEquivalenceClassNode() &&
+               visited_ecs->insert(dst_node->id_).second) {
+      CollectGreedyCandidateArcs(*dst_node, cost + arc->cost_, visited_ecs,
+                                 candidates);
+    }
+  }
+}
+
+multimap<uint64_t, uint64_t>* FlowGraphManager::ComputeGreedyTaskMappings() {
+  multimap<uint64_t, uint64_t>* task_mappings =
+    new multimap<uint64_t, uint64_t>();
+  // Flow placed on each arc so far.
+  unordered_map<FlowGraphArc*, uint64_t> used_capacity;
+  // Running tasks stay on their PUs. They would be preempted if they didn't
+  // have a mapping.
+  for (auto& task_running_arc : task_to_running_arc_) {
+    FlowGraphArc* running_arc = task_running_arc.second;
+    FlowGraphNode* pu_node = running_arc->dst_node_;
+    task_mappings->insert(
+        pair<uint64_t, uint64_t>(running_arc->src_, pu_node->id_));
+    FlowGraphArc* sink_arc =
+      FindPtrOrNull(pu_node->outgoing_arc_map_, sink_node_->id_);
+    if (sink_arc) {
+      used_capacity[sink_arc]++;
+    }
+  }
+  uint64_t num_placed = 0;
+  for (auto& task_id_node : task_to_node_map_) {
+    if (ContainsKey(task_to_running_arc_, task_id_node.first)) {
+      continue;
+    }
+    FlowGraphNode* task_node = task_id_node.second;
+    vector<pair<int64_t, FlowGraphArc*>> candidates;
+    unordered_set<uint64_t> visited_ecs;
+    CollectGreedyCandidateArcs(*task_node, 0, &visited_ecs, &candidates);
+    sort(candidates.begin(), candidates.end(),
+         [](const pair<int64_t, FlowGraphArc*>& candidate1,
+            const pair<int64_t, FlowGraphArc*>& candidate2) {
+           return candidate1.first < candidate2.first;
+         });
+    for (auto& candidate : candidates) {
+      vector<FlowGraphArc*> path;
+      if (FindGreedyPathToSink(candidate.second, used_capacity, &path)) {
+        for (auto& arc : path) {
+          used_capacity[arc]++;
+        }
+        // The last arc on the path connects the PU to the sink.
+        task_mappings->insert(
+            pair<uint64_t, uint64_t>(task_node->id_, path.back()->src_));
+        num_placed++;
+        break;
+      }
+    }
+  }
+  VLOG(1) << "Greedily placed " << num_placed << " tasks";
+  return task_mappings;
+}
+
 void FlowGraphManager::ComputeTopologyStatistics(
     FlowGraphNode* node,
     boost::function<void(FlowGraphNode*)> prepare,
@@ -301,6 +397,49 @@ void FlowGraphManager::ComputeTopologyStatistics(
   }
 }
 
+bool FlowGraphManager::FindGreedyPathToSink(
+    FlowGraphArc* arc,
+    const unordered_map<FlowGraphArc*, uint64_t>& used_capacity,
+    vector<FlowGraphArc*>* path) {
+  const uint64_t* used = FindOrNull(used_capacity, arc);
+  if (arc->cap_upper_bound_ <= (used ? *used : 0)) {
+    return false;
+  }
+  path->push_back(arc);
+  if (arc->dst_node_ == sink_node_) {
+    return true;
+  }
+  // Resource nodes only have arcs to their children and, for PUs, to the
+  // sink. Hence, the search can't loop.
+  for (auto& dst_arc : arc->dst_node_->outgoing_arc_map_) {
+    if (FindGreedyPathToSink(dst_arc.second, used_capacity, path)) {
+      return true;
+    }
+  }
+  path->pop_back();
+  return false;
+}
+
+void FlowGraphManager::HoldUnscheduledJobTasks(const JobDescriptor& jd) {
+  vector<EquivClass_t> no_pref_ec;
+  vector<ResourceID_t> no_pref_res;
+  queue<const TaskDescriptor*> to_visit;
+  to_visit.push(&jd.root_task());
+  while (!to_visit.empty()) {
+    const TaskDescriptor* td_ptr = to_visit.front();
+    to_visit.pop();
+    FlowGraphNode* task_node = NodeForTaskID(td_ptr->uid());
+    if (task_node && !task_node->IsTaskAssignedOrRunning()) {
+      RemoveInvalidECPrefArcs(*task_node, no_pref_ec,
+                              DEL_ARC_TASK_TO_EQUIV_CLASS);
+      RemoveInvalidPrefResArcs(*task_node, no_pref_res, DEL_ARC_TASK_TO_RES);
+    }
+    for (auto& child_td : td_ptr->spawned()) {
+      to_visit.push(&child_td);
+    }
+  }
+}
+
 void FlowGraphManager::JobCompleted(JobID_t job_id) {
   RemoveUnscheduledAggNode(job_id);
   // We don't have to do anything else here. The task nodes have already been
@@ -315,42 +454,37 @@ void FlowGraphManager::JobRemoved(JobID_t job_id) {
 
 void FlowGraphManager::SchedulingDeltasForPreemptedTasks(
     const multimap<uint64_t, uint64_t>& task_mappings,
+    const unordered_map<TaskID_t, ResourceID_t>& task_bindings,
     shared_ptr<ResourceMap_t> resource_map,
     vector<SchedulingDelta*>* deltas) {
-  for (auto& res_id_status : *resource_map) {
-    ResourceDescriptor* rd_ptr = res_id_status.second->mutable_descriptor();
-    RepeatedField<uint64_t> running_tasks = rd_ptr->current_running_tasks();
-    for (auto& task_id : running_tasks) {
-      FlowGraphNode* task_node = NodeForTaskID(task_id);
-      if (!task_node) {
-        // There's no node for the task => we don't need to generate
-        // a PREEMPT delta because the task has finished.
-        continue;
-      }
-      if (task_node->td_ptr_->state() != TaskDescriptor::RUNNING) {
-        // For pod affinity/antiaffinity tasks from previous 
-        // scheduling round not satisfying gang scheduling.
-        continue;
-      }
-      const uint64_t* res_node_id = FindOrNull(task_mappings, task_node->id_);
-      if (!res_node_id) {
-        // The task doesn't exist in the mappings => the task has been
-        // preempted.
-        VLOG(2) << "PREEMPTION: take " << task_id << " off "
-                << res_id_status.first;
-        SchedulingDelta* preempt_delta = new SchedulingDelta;
-        preempt_delta->set_type(SchedulingDelta::PREEMPT);
-        preempt_delta->set_task_id(task_id);
-        preempt_delta->set_resource_id(rd_ptr->uuid());
-        deltas->push_back(preempt_delta);
-      }
+  for (auto& task_res : task_bindings) {
+    FlowGraphNode* task_node = NodeForTaskID(task_res.first);
+    if (!task_node) {
+      // There's no node for the task => we don't need to generate
+      // a PREEMPT delta because the task has finished.
+      continue;
+    }
+    if (task_node->td_ptr_->state() != TaskDescriptor::RUNNING) {
+      // For pod affinity/antiaffinity tasks from previous
+      // scheduling round not satisfying gang scheduling.
+      continue;
     }
-    // We clear all the running tasks on the machine. The list is going to be
-    // populated again in NodeBindingToSchedulingDeltas and
-    // EventDrivenScheduler.
-    // It is easier and less expensive to clear it and populate it back again
-    // than making sure the preempted tasks are removed.
-    rd_ptr->clear_current_running_tasks();
+    if (task_mappings.find(task_node->id_) != task_mappings.end()) {
+      continue;
+    }
+    ResourceStatus* rs = FindPtrOrNull(*resource_map, task_res.second);
+    if (!rs) {
+      continue;
+    }
+    // The task doesn't exist in the mappings => the task has been
+    // preempted.
+    VLOG(2) << "PREEMPTION: take " << task_res.first << " off "
+            << task_res.second;
+    SchedulingDelta* preempt_delta = new SchedulingDelta;
+    preempt_delta->set_type(SchedulingDelta::PREEMPT);
+    preempt_delta->set_task_id(task_res.first);
+    preempt_delta->set_resource_id(rs->descriptor().uuid());
+    deltas->push_back(preempt_delta);
   }
 }
 
@@ -381,10 +515,6 @@ void FlowGraphManager::NodeBindingToSchedulingDeltas(
       delta->set_task_id(task.uid());
       delta->set_resource_id(res.uuid());
       deltas->push_back(delta);
-    } else {
-      // We were already scheduled here. Add back the task_id to the resource's
-      // running tasks list.
-      res_node.rd_ptr_->add_current_running_tasks(task.uid());
     }
   } else {
     // Place the task.
@@ -484,18 +614,22 @@ multimap<uint64_t, uint64_t>* FlowGraphManager::PopulateTaskMappingsForSimpleSol
 
 void FlowGraphManager::PurgeUnconnectedEquivClassNodes() {
   // NOTE: we could have a subgraph consisting of equiv class nodes.
-  // They would likely not end up being removed in a single
-  // PurgeUnconnectedEquivClassNodes call. However, this is fine
-  // because we will finish removing all of them in future calls.
-  for (unordered_map<EquivClass_t, FlowGraphNode*>::iterator
-         it = tec_to_node_map_.begin();
-       it != tec_to_node_map_.end(); ) {
-    FlowGraphNode* ec_node = it->second;
-    ++it;
-    if (ec_node->incoming_arc_map_.size() == 0) {
+  // Removing an EC node may disconnect the EC nodes it points to. These
+  // are queued and removed in this or a future call.
+  FlowGraph* flow_graph = graph_change_manager_->mutable_flow_graph();
+  uint64_t num_ecs_removed = 0;
+  EquivClass_t ec;
+  while ((FLAGS_purge_unconnected_ec_budget == 0 ||
+          num_ecs_removed < FLAGS_purge_unconnected_ec_budget) &&
+         flow_graph->NextUnconnectedEquivClass(&ec)) {
+    FlowGraphNode* ec_node = NodeForEquivClass(ec);
+    // The EC may have been removed or connected again since it was queued.
+    if (ec_node && ec_node->incoming_arc_map_.empty()) {
       RemoveEquivClassNode(ec_node);
+      num_ecs_removed++;
     }
   }
+  VLOG(1) << "Purged " << num_ecs_removed << " unconnected EC nodes";
 }
 
 void FlowGraphManager::RemoveEquivClassNode(FlowGraphNode* ec_node) {
@@ -602,6 +736,35 @@ void FlowGraphManager::RemoveResourceNode(FlowGraphNode* res_node) {
                                     "RemoveResourceNode");
 }
 
+void FlowGraphManager::RemoveStaleTaskMappings(
+    multimap<uint64_t, uint64_t>* task_mappings) {
+  CHECK_NOTNULL(task_mappings);
+  const unordered_set<uint64_t>& removed_node_ids =
+    graph_change_manager_->removed_node_ids();
+  if (removed_node_ids.empty()) {
+    return;
+  }
+  for (multimap<uint64_t, uint64_t>::iterator it = task_mappings->begin();
+       it != task_mappings->end();) {
+    if (removed_node_ids.find(it->first) != removed_node_ids.end()) {
+      // Ignore the task because it has completed or has been removed while
+      // the solver was running.
+      VLOG(1) << "Task with node id: " << it->first
+              << " was removed while the solver was running";
+      it = task_mappings->erase(it);
+    } else if (removed_node_ids.find(it->second) != removed_node_ids.end()) {
+      // We can't place a task on this PU because the PU has been removed
+      // while the solver was running. We will reconsider the task in the
+      // next solver run.
+      VLOG(1) << "PU with node id: " << it->second
+              << " was removed while the solver was running";
+      it = task_mappings->erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 void FlowGraphManager::RemoveTaskHelper(TaskID_t task_id) {
   FlowGraphNode* task_node = NodeForTaskID(task_id);
   // task_node may be NULL if the task already completed.
@@ -727,19 +890,28 @@ void FlowGraphManager::TraverseAndRemoveTopology(FlowGraphNode* res_node,
 }
 
 void FlowGraphManager::UpdateAllCostsToUnscheduledAggs() {
-  for (auto& job_node : job_unsched_to_node_) {
-    const FlowGraphNode* unsched_node = job_node.second;
-    CHECK_NOTNULL(unsched_node);
-    for (auto& dst_arc : unsched_node->incoming_arc_map_) {
-      FlowGraphNode* task_node = dst_arc.second->src_node_;
-      CHECK_NOTNULL(task_node->td_ptr_);
-      if (task_node->IsTaskAssignedOrRunning()) {
-        UpdateRunningTaskNode(task_node, false, NULL, NULL);
-      } else {
-        UpdateTaskToUnscheduledAggArc(task_node);
+  if (FLAGS_preemption) {
+    // Only running tasks keep their arcs to the unscheduled aggregators when
+    // preemption is enabled.
+    for (auto& job_node : job_unsched_to_node_) {
+      const FlowGraphNode* unsched_node = job_node.second;
+      CHECK_NOTNULL(unsched_node);
+      for (auto& dst_arc : unsched_node->incoming_arc_map_) {
+        FlowGraphNode* task_node = dst_arc.second->src_node_;
+        CHECK_NOTNULL(task_node->td_ptr_);
+        if (task_node->IsTaskAssignedOrRunning()) {
+          UpdateRunningTaskNode(task_node, false, NULL, NULL);
+        }
       }
     }
   }
+  // The waiting tasks' arcs were recomputed when their nodes were last
+  // updated, so only the costs that change with time can be stale. This is
+  // the only place where these are revisited, once per exported graph.
+  if (cost_model_->TaskToUnscheduledAggCostDependency() ==
+      UNSCHED_COST_DEPENDS_ON_TIME) {
+    UpdateTimeDependentCosts();
+  }
 }
 
 void FlowGraphManager::UpdateArcsForScheduledTask(FlowGraphNode* task_node,
@@ -1290,12 +1462,59 @@ FlowGraphNode* FlowGraphManager::UpdateTaskToUnscheduledAggArc(
         arc_descriptor.cost_, CHG_ARC_TO_UNSCHED,
         "UpdateTaskToUnscheduledAggArc");
   }
+  UpdateTimeDependentCostDeadline(*task_node->td_ptr_);
   return unsched_agg_node;
 }
 
-void FlowGraphManager::UpdateTimeDependentCosts(
-    const vector<JobDescriptor*>& jd_ptr_vec) {
-  AddOrUpdateJobNodes(jd_ptr_vec);
+void FlowGraphManager::UpdateTimeDependentCostDeadline(
+    const TaskDescriptor& td) {
+  if (FLAGS_time_dependent_cost_update_frequency <= 0 ||
+      cost_model_->TaskToUnscheduledAggCostDependency() !=
+      UNSCHED_COST_DEPENDS_ON_TIME) {
+    return;
+  }
+  uint64_t update_interval =
+    static_cast<uint64_t>(FLAGS_time_dependent_cost_update_frequency);
+  uint64_t cur_time = time_manager_->GetCurrentTimestamp();
+  uint64_t wait_time =
+    cur_time > td.submit_time() ? cur_time - td.submit_time() : 0;
+  uint64_t update_time =
+    td.submit_time() + (wait_time / update_interval + 1) * update_interval;
+  uint64_t* scheduled_update_time =
+    FindOrNull(task_cost_update_times_, td.uid());
+  if (scheduled_update_time && *scheduled_update_time == update_time) {
+    // The cost was already computed in the current interval.
+    return;
+  }
+  task_cost_update_times_[td.uid()] = update_time;
+  cost_update_heap_.push(pair<uint64_t, TaskID_t>(update_time, td.uid()));
+}
+
+void FlowGraphManager::UpdateTimeDependentCosts() {
+  uint64_t cur_time = time_manager_->GetCurrentTimestamp();
+  uint64_t num_tasks_updated = 0;
+  while (!cost_update_heap_.empty() &&
+         cost_update_heap_.top().first <= cur_time) {
+    pair<uint64_t, TaskID_t> cost_update = cost_update_heap_.top();
+    cost_update_heap_.pop();
+    uint64_t* update_time =
+      FindOrNull(task_cost_update_times_, cost_update.second);
+    if (!update_time || *update_time != cost_update.first) {
+      // The task's cost was updated since the entry was added.
+      continue;
+    }
+    task_cost_update_times_.erase(cost_update.second);
+    FlowGraphNode* task_node = NodeForTaskID(cost_update.second);
+    if (!task_node || task_node->IsTaskAssignedOrRunning()) {
+      // The task was removed or placed. Its deadline is set again if it
+      // ends up waiting.
+      continue;
+    }
+    UpdateTaskToUnscheduledAggArc(task_node);
+    num_tasks_updated++;
+  }
+  VLOG(1) << "Updated the time-dependent costs of " << num_tasks_updated
+          << " tasks";
 }
 
 void FlowGraphManager::UpdateUnscheduledAggNode(
@@ -21,9 +21,11 @@
 #ifndef FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_MANAGER_H
 #define FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_MANAGER_H
 
+#include <functional>
 #include <queue>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/common.h"
@@ -74,11 +76,35 @@ class FlowGraphManager {
    */
   void AddResourceTopology(ResourceTopologyNodeDescriptor* rtnd_ptr);
 
+  /**
+   * Adds a node for a task that is about to be placed without a solver run.
+   * Unlike AddOrUpdateJobNodes, this only connects the task to its job's
+   * unscheduled aggregator and does not compute any preference arcs.
+   * @param job_id the id of the task's job
+   * @param td_ptr the descriptor of the task
+   */
+  void AddTaskNodeForPlacement(JobID_t job_id, TaskDescriptor* td_ptr);
+  /**
+   * Places tasks without the solver, for when the solver misses its deadline.
+   * Running tasks keep their PUs. Every other task goes to the cheapest
+   * resource it reaches through its preference and EC-to-resource arcs that
+   * still has a PU with spare capacity below it. Tasks that fit nowhere are
+   * left unscheduled.
+   * @return the task node to PU node mappings
+   */
+  multimap<uint64_t, uint64_t>* ComputeGreedyTaskMappings();
   void ComputeTopologyStatistics(
       FlowGraphNode* node,
       boost::function<void(FlowGraphNode*)> prepare,
       boost::function<FlowGraphNode*(FlowGraphNode*, FlowGraphNode*)> gather,
       boost::function<FlowGraphNode*(FlowGraphNode*, FlowGraphNode*)> update);
+  /**
+   * Removes the preference arcs of all the job's tasks that are not running
+   * so that the solver can only leave them unscheduled. The arcs are added
+   * back when the job is next passed to AddOrUpdateJobNodes.
+   * @param jd the descriptor of the job whose tasks to hold back
+   */
+  void HoldUnscheduledJobTasks(const JobDescriptor& jd);
   void JobCompleted(JobID_t job_id);
   void JobRemoved(JobID_t job_id);
   void NodeBindingToSchedulingDeltas(
@@ -94,7 +120,9 @@ class FlowGraphManager {
    * resource removal we may end up with unconnected equivalence
    * class nodes. This method makes sure they are removed.
    * We cannot end up with unconnected unscheduled agg nodes,
-   * task or resource nodes.
+   * task or resource nodes. Only the EC nodes the flow graph queued when
+   * they lost their last incoming arc are visited, and at most
+   * FLAGS_purge_unconnected_ec_budget of them are removed per call.
    */
   void PurgeUnconnectedEquivClassNodes();
 
@@ -107,8 +135,28 @@ class FlowGraphManager {
    */
   void RemoveResourceTopology(const ResourceDescriptor& rd,
                               set<uint64_t>* pus_removed);
+  /**
+   * Removes the task mappings that nodes removed since the graph was last
+   * exported to the solver have invalidated. These are mappings of tasks that
+   * completed or were removed, and mappings to PUs that were removed, while
+   * the solver was running. Node ids reused since are treated as removed.
+   * @param task_mappings the solver's task node to resource node mappings
+   */
+  void RemoveStaleTaskMappings(multimap<uint64_t, uint64_t>* task_mappings);
+  /**
+   * Generates PREEMPT deltas for the running tasks that the solver no longer
+   * placed. Only the bound tasks are examined, not every resource. The
+   * solver's mappings include every running task that stays where it is,
+   * and the caller walks all of them afterwards, so this pass costs no more
+   * than that walk.
+   * @param task_mappings the solver's task node to resource node mappings
+   * @param task_bindings map from running task to the resource it is bound to
+   * @param resource_map the resources known to the scheduler
+   * @param deltas vector to which the deltas are appended
+   */
   void SchedulingDeltasForPreemptedTasks(
       const multimap<uint64_t, uint64_t>& task_mappings,
+      const unordered_map<TaskID_t, ResourceID_t>& task_bindings,
       shared_ptr<ResourceMap_t> resource_map,
       vector<SchedulingDelta*>* deltas);
   uint64_t TaskCompleted(TaskID_t task_id);
@@ -122,13 +170,15 @@ class FlowGraphManager {
   void TaskScheduled(TaskID_t task_id, ResourceID_t res_id);
 
   /**
-   * Update each task's arc to its unscheduled aggregator. Moreover, for
-   * running tasks we update their continuation costs.
+   * Update the tasks' arcs to their unscheduled aggregators whose costs can
+   * have changed since they were computed. If the cost model's costs depend
+   * on time, these are the waiting tasks that entered a new update
+   * interval. Moreover, for running tasks we update their continuation
+   * costs.
    */
   void UpdateAllCostsToUnscheduledAggs();
 
   void UpdateResourceTopology(ResourceTopologyNodeDescriptor* rtnd_ptr);
-  void UpdateTimeDependentCosts(const vector<JobDescriptor*>& jd_ptr_vec);
 
   // Simple accessor methods
   inline FlowGraphChangeManager* flow_graph_change_manager() {
@@ -155,16 +205,20 @@ class FlowGraphManager {
   FRIEND_TEST(FlowGraphManagerTest, AddResourceTopologyDFS);
   FRIEND_TEST(FlowGraphManagerTest, AddTaskNode);
   FRIEND_TEST(FlowGraphManagerTest, AddUnscheduledAggNode);
+  FRIEND_TEST(FlowGraphManagerTest, HoldUnscheduledJobTasks);
   FRIEND_TEST(FlowGraphManagerTest, PinTaskToNode);
+  FRIEND_TEST(FlowGraphManagerTest, PurgeReconnectedEquivClassNodes);
   FRIEND_TEST(FlowGraphManagerTest, PurgeUnconnectedEquivClassNodes);
   FRIEND_TEST(FlowGraphManagerTest, RemoveEquivClassNode);
   FRIEND_TEST(FlowGraphManagerTest, RemoveInvalidECPrefArcs);
   FRIEND_TEST(FlowGraphManagerTest, RemoveInvalidPrefResArcs);
   FRIEND_TEST(FlowGraphManagerTest, RemoveResourceNode);
+  FRIEND_TEST(FlowGraphManagerTest, RemoveStaleTaskMappings);
   FRIEND_TEST(FlowGraphManagerTest, RemoveTaskHelper);
   FRIEND_TEST(FlowGraphManagerTest, TaskScheduled);
   FRIEND_TEST(FlowGraphManagerTest, TraverseAndRemoveTopology);
   FRIEND_TEST(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggs);
+  FRIEND_TEST(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggsManyTasks);
   FRIEND_TEST(FlowGraphManagerTest, UpdateArcsForScheduledTask);
   FRIEND_TEST(FlowGraphManagerTest, UpdateChildrenTasks);
   FRIEND_TEST(FlowGraphManagerTest, UpdateEquivClassNode);
@@ -178,10 +232,12 @@ class FlowGraphManager {
   FRIEND_TEST(FlowGraphManagerTest, UpdateRunningTaskToUnscheduledAggArc);
   FRIEND_TEST(FlowGraphManagerTest, RemoveTaskNode);
   FRIEND_TEST(FlowGraphManagerTest, RemoveUnscheduledAggNode);
+  FRIEND_TEST(FlowGraphManagerTest, SchedulingDeltasForPreemptedTasks);
   FRIEND_TEST(FlowGraphManagerTest, UpdateTaskNode);
   FRIEND_TEST(FlowGraphManagerTest, UpdateTaskToEquivArcs);
   FRIEND_TEST(FlowGraphManagerTest, UpdateTaskToResArcs);
   FRIEND_TEST(FlowGraphManagerTest, UpdateTaskToUnscheduledAggArc);
+  FRIEND_TEST(FlowGraphManagerTest, UpdateTimeDependentCosts);
   FRIEND_TEST(FlowGraphManagerTest, UpdateUnscheduledAggNode);
 
   FlowGraphNode* AddEquivClassNode(EquivClass_t ec);
@@ -197,6 +253,29 @@ class FlowGraphManager {
 
   FlowGraphNode* AddTaskNode(JobID_t job_id, TaskDescriptor* td_ptr);
   FlowGraphNode* AddUnscheduledAggNode(JobID_t job_id);
+  /**
+   * Collects the arcs into resource nodes that are reachable from node
+   * through equivalence class nodes, together with the cost of the path.
+   * @param node the node from which to start
+   * @param cost the cost of the path to node
+   * @param visited_ecs the EC nodes already visited
+   * @param candidates vector to which to append the (cost, arc) pairs
+   */
+  void CollectGreedyCandidateArcs(
+      const FlowGraphNode& node, int64_t cost,
+      unordered_set<uint64_t>* visited_ecs,
+      vector<pair<int64_t, FlowGraphArc*>>* candidates);
+  /**
+   * Finds a path with spare capacity from arc down to the sink.
+   * @param arc the first arc of the path
+   * @param used_capacity the capacity already used on each arc
+   * @param path vector to which to append the arcs of the path
+   * @return true if such a path exists
+   */
+  bool FindGreedyPathToSink(
+      FlowGraphArc* arc,
+      const unordered_map<FlowGraphArc*, uint64_t>& used_capacity,
+      vector<FlowGraphArc*>* path);
   void PinTaskToNode(FlowGraphNode* task_node, FlowGraphNode* res_node);
   void RemoveEquivClassNode(FlowGraphNode* ec_node);
 
@@ -358,6 +437,19 @@ class FlowGraphManager {
    * @return the unscheduled aggregator node
    */
   FlowGraphNode* UpdateTaskToUnscheduledAggArc(FlowGraphNode* task_node);
+  /**
+   * Records when the cost of a waiting task's arc to its unscheduled
+   * aggregator must be recomputed next. The times are aligned to the task's
+   * submit time and are FLAGS_time_dependent_cost_update_frequency apart.
+   * @param td the descriptor of the task
+   */
+  void UpdateTimeDependentCostDeadline(const TaskDescriptor& td);
+  /**
+   * Updates the arcs to the unscheduled aggregators of the waiting tasks
+   * whose wait time entered a new update interval since their cost was last
+   * computed. The other tasks are not visited.
+   */
+  void UpdateTimeDependentCosts();
 
   /**
    * Adjusts the capacity of the arc connecting the unscheduled agg to the sink
@@ -403,10 +495,18 @@ class FlowGraphManager {
   // Map storing the running arc for every task that is running.
   unordered_map<TaskID_t, FlowGraphArc*> task_to_running_arc_;
   unordered_map<FlowGraphNode*, FlowGraphNode*> node_to_parent_node_map_;
+  // Min-heap of (time of the next cost update, task id) for the waiting
+  // tasks. An entry is stale if it doesn't match the task's time in
+  // task_cost_update_times_, and is dropped when it reaches the top.
+  priority_queue<pair<uint64_t, TaskID_t>, vector<pair<uint64_t, TaskID_t>>,
+                 greater<pair<uint64_t, TaskID_t>>> cost_update_heap_;
+  // Time of the next cost update for each task in cost_update_heap_.
+  unordered_map<TaskID_t, uint64_t> task_cost_update_times_;
   FlowGraphNode* sink_node_;
   CostModelInterface* cost_model_;
   FlowGraphChangeManager* graph_change_manager_;
   unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>* leaf_res_ids_;
+  TimeInterface* time_manager_;
   TraceGenerator* trace_generator_;
   DIMACSChangeStats* dimacs_stats_;
   // Counter updated whenever we compute topology statistics. The counter is
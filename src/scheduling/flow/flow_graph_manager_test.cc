@@ -18,8 +18,11 @@
  * permissions and limitations under the License.
  */
 
+#include <atomic>
+#include <deque>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <boost/thread.hpp>
 
 #include "base/common.h"
 #include "misc/map-util.h"
@@ -36,14 +39,63 @@
 #include "scheduling/flow/mock_cost_model.h"
 #include "scheduling/flow/trivial_cost_model.h"
 #include "scheduling/flow/void_cost_model.h"
+#include "scheduling/scheduling_lock.h"
 
+DECLARE_bool(incremental_flow);
 DECLARE_string(flow_scheduling_solver);
 DECLARE_uint64(num_pref_arcs_task_to_res);
+DECLARE_uint64(purge_unconnected_ec_budget);
+DECLARE_int64(time_dependent_cost_update_frequency);
 
 using ::testing::_;
+using firmament::scheduler::SchedulingLock;
 
 namespace firmament {
 
+// Time source that only moves when a test sets it.
+class ManualTime : public TimeInterface {
+ public:
+  ManualTime() : now_(0) {}
+  uint64_t GetCurrentTimestamp() {
+    return now_;
+  }
+  void UpdateCurrentTimestamp(uint64_t timestamp) {
+    now_ = timestamp;
+  }
+
+ private:
+  uint64_t now_;
+};
+
+// Cost model whose cost to the unscheduled aggregator goes up by one for
+// every update interval a task waits.
+class WaitTimeCostModel : public TrivialCostModel {
+ public:
+  WaitTimeCostModel(shared_ptr<ResourceMap_t> resource_map,
+                    shared_ptr<TaskMap_t> task_map,
+                    unordered_set<ResourceID_t,
+                      boost::hash<boost::uuids::uuid>>* leaf_res_ids,
+                    TimeInterface* time_manager)
+    : TrivialCostModel(resource_map, task_map, leaf_res_ids),
+      task_map_(task_map), time_manager_(time_manager) {
+  }
+  UnscheduledAggCostDependency TaskToUnscheduledAggCostDependency() {
+    return UNSCHED_COST_DEPENDS_ON_TIME;
+  }
+  ArcDescriptor TaskToUnscheduledAgg(TaskID_t task_id) {
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    CHECK_NOTNULL(td_ptr);
+    uint64_t wait_time =
+      time_manager_->GetCurrentTimestamp() - td_ptr->submit_time();
+    return ArcDescriptor(static_cast<int64_t>(
+        wait_time / FLAGS_time_dependent_cost_update_frequency), 1ULL, 0ULL);
+  }
+
+ private:
+  shared_ptr<TaskMap_t> task_map_;
+  TimeInterface* time_manager_;
+};
+
 class FlowGraphManagerTest : public ::testing::Test {
  protected:
   // You can remove any or all of the following functions if its body
@@ -293,6 +345,38 @@ TEST_F(FlowGraphManagerTest, AddResourceTopologyDFS) {
             1);
 }
 
+TEST_F(FlowGraphManagerTest, HoldUnscheduledJobTasks) {
+  MockCostModel mock_cost_model;
+  EXPECT_CALL(mock_cost_model, AddTask(_)).Times(1);
+  FlowGraphManager* graph_manager =
+    new FlowGraphManager(&mock_cost_model, leaf_res_ids_, &wall_time_, tg_,
+                         &dimacs_stats_);
+  const FlowGraph& flow_graph =
+    graph_manager->graph_change_manager_->flow_graph();
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 42);
+  JobID_t job_id = JobIDFromString(td_ptr->job_id());
+  FlowGraphNode* task_node = graph_manager->AddTaskNode(job_id, td_ptr);
+  ON_CALL(mock_cost_model, TaskToUnscheduledAgg(_))
+    .WillByDefault(testing::Return(ArcDescriptor(42LL, 1ULL, 0ULL)));
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(1);
+  graph_manager->UpdateTaskToUnscheduledAggArc(task_node);
+  FlowGraphNode* ec1_node = graph_manager->AddEquivClassNode(42);
+  FlowGraphNode* ec2_node = graph_manager->AddEquivClassNode(43);
+  graph_manager->graph_change_manager_->AddArc(
+      task_node, ec1_node, 0, 1, 0, OTHER, ADD_ARC_TASK_TO_EQUIV_CLASS, "");
+  graph_manager->graph_change_manager_->AddArc(
+      task_node, ec2_node, 0, 1, 0, OTHER, ADD_ARC_TASK_TO_EQUIV_CLASS, "");
+  EXPECT_EQ(flow_graph.NumArcs(), 3);
+  // Only the arc to the unscheduled aggregator is left.
+  graph_manager->HoldUnscheduledJobTasks(test_job);
+  EXPECT_EQ(flow_graph.NumArcs(), 1);
+  EXPECT_EQ(task_node->outgoing_arc_map_.size(), 1);
+  CHECK_NOTNULL(graph_manager->graph_change_manager_->mutable_flow_graph()
+                ->GetArc(task_node, graph_manager->UnschedAggNodeForJobID(
+                    job_id)));
+}
+
 TEST_F(FlowGraphManagerTest, PinTaskToNode) {
   MockCostModel mock_cost_model;
   FlowGraphManager* graph_manager =
@@ -401,6 +485,55 @@ TEST_F(FlowGraphManagerTest, PurgeUnconnectedEquivClassNodes) {
   EXPECT_EQ(1UL, flow_graph.unused_ids_.size());
 }
 
+TEST_F(FlowGraphManagerTest, PurgeReconnectedEquivClassNodes) {
+  uint64_t purge_budget = FLAGS_purge_unconnected_ec_budget;
+  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  FlowGraphChangeManager* change_manager =
+    graph_manager->graph_change_manager_;
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 42);
+  InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr);
+  JobID_t job_id = JobIDFromString(td_ptr->job_id());
+  FlowGraphNode* task_node = graph_manager->AddTaskNode(job_id, td_ptr);
+  // Connect the task to EC nodes 42, 43 and 44, and EC node 44 to EC node 45.
+  vector<FlowGraphArc*> task_to_ec_arcs;
+  for (EquivClass_t ec = 42; ec < 45; ++ec) {
+    FlowGraphNode* ec_node = graph_manager->AddEquivClassNode(ec);
+    task_to_ec_arcs.push_back(change_manager->AddArc(
+        task_node, ec_node, 0, 1, 1, FlowGraphArcType::OTHER,
+        ADD_ARC_TASK_TO_EQUIV_CLASS, "test"));
+  }
+  FlowGraphNode* ec_node45 = graph_manager->AddEquivClassNode(45);
+  change_manager->AddArc(graph_manager->NodeForEquivClass(44), ec_node45, 0,
+                         1, 1, FlowGraphArcType::OTHER,
+                         ADD_ARC_BETWEEN_EQUIV_CLASS, "test");
+  // All EC nodes are connected.
+  graph_manager->PurgeUnconnectedEquivClassNodes();
+  EXPECT_EQ(4U, graph_manager->tec_to_node_map_.size());
+  // Disconnect EC nodes 42 and 44. EC node 43 is disconnected and then
+  // reused before the purge.
+  change_manager->DeleteArc(task_to_ec_arcs[0], DEL_ARC_TASK_TO_EQUIV_CLASS,
+                            "test");
+  change_manager->DeleteArc(task_to_ec_arcs[1], DEL_ARC_TASK_TO_EQUIV_CLASS,
+                            "test");
+  change_manager->AddArc(task_node, graph_manager->NodeForEquivClass(43), 0,
+                         1, 1, FlowGraphArcType::OTHER,
+                         ADD_ARC_TASK_TO_EQUIV_CLASS, "test");
+  change_manager->DeleteArc(task_to_ec_arcs[2], DEL_ARC_TASK_TO_EQUIV_CLASS,
+                            "test");
+  // The purge stops after removing two nodes, before EC node 45, which was
+  // disconnected by the removal of EC node 44.
+  FLAGS_purge_unconnected_ec_budget = 2;
+  graph_manager->PurgeUnconnectedEquivClassNodes();
+  EXPECT_EQ(2U, graph_manager->tec_to_node_map_.size());
+  EXPECT_TRUE(graph_manager->NodeForEquivClass(43) != NULL);
+  EXPECT_TRUE(graph_manager->NodeForEquivClass(45) != NULL);
+  graph_manager->PurgeUnconnectedEquivClassNodes();
+  EXPECT_EQ(1U, graph_manager->tec_to_node_map_.size());
+  EXPECT_TRUE(graph_manager->NodeForEquivClass(43) != NULL);
+  FLAGS_purge_unconnected_ec_budget = purge_budget;
+}
+
 TEST_F(FlowGraphManagerTest, RemoveEquivClassNode) {
   FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
   EquivClass_t ec = 42;
@@ -536,6 +669,115 @@ TEST_F(FlowGraphManagerTest, RemoveResourceNode) {
   EXPECT_DEATH(graph_manager->RemoveResourceNode(NULL), "");
 }
 
+// Stress test: while the solver runs without the scheduling lock, another
+// thread removes and adds tasks and PUs, reusing node ids. The mappings left
+// after RemoveStaleTaskMappings must be for the tasks and PUs the solver saw,
+// and no task may be placed twice.
+TEST_F(FlowGraphManagerTest, RemoveStaleTaskMappings) {
+  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  FlowGraphChangeManager* change_manager =
+    graph_manager->graph_change_manager_;
+  SchedulingLock scheduling_lock;
+  const uint64_t kNumRounds = 100;
+  const uint64_t kNumPUs = 8;
+  const uint64_t kNumTasks = 32;
+  // Deques so that the descriptors the nodes point to never move.
+  deque<ResourceDescriptor> rds;
+  deque<JobDescriptor> jds;
+  uint64_t num_added = 0;
+  auto add_pu = [&]() {
+    rds.push_back(ResourceDescriptor());
+    ResourceDescriptor* rd_ptr = &rds.back();
+    rd_ptr->set_uuid(
+        to_string(GenerateResourceID("pu" + to_string(num_added++))));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_PU);
+    graph_manager->AddResourceNode(rd_ptr);
+  };
+  auto add_task = [&]() {
+    jds.push_back(JobDescriptor());
+    TaskDescriptor* td_ptr = CreateTask(&jds.back(), num_added++);
+    graph_manager->AddTaskNode(JobIDFromString(td_ptr->job_id()), td_ptr);
+  };
+  for (uint64_t index = 0; index < kNumPUs; ++index) {
+    add_pu();
+  }
+  for (uint64_t index = 0; index < kNumTasks; ++index) {
+    add_task();
+  }
+  std::atomic<uint64_t> num_events(0);
+  std::atomic<bool> done(false);
+  boost::thread event_thread([&]() {
+    uint32_t seed = 42;
+    while (!done) {
+      boost::lock_guard<SchedulingLock> lock(scheduling_lock);
+      uint32_t event = rand_r(&seed) % 4;
+      if (event == 0 && graph_manager->leaf_nodes_.size() > 1) {
+        ResourceID_t res_id = change_manager->Node(
+            *graph_manager->leaf_nodes_.begin()).resource_id_;
+        graph_manager->RemoveResourceNode(
+            graph_manager->NodeForResourceID(res_id));
+      } else if (event == 1 && graph_manager->task_to_node_map_.size() > 1) {
+        graph_manager->TaskRemoved(
+            graph_manager->task_to_node_map_.begin()->first);
+      } else if (event == 2) {
+        add_pu();
+      } else {
+        add_task();
+      }
+      num_events++;
+    }
+  });
+  uint64_t num_placed = 0;
+  for (uint64_t round = 0; round < kNumRounds; ++round) {
+    // A scheduling round nested in another locked call.
+    boost::lock_guard<SchedulingLock> outer_lock(scheduling_lock);
+    boost::lock_guard<SchedulingLock> round_lock(scheduling_lock);
+    // Export the graph: reset the changes and snapshot the nodes.
+    change_manager->ResetChanges();
+    unordered_map<uint64_t, TaskID_t> exported_tasks;
+    for (auto& task_id_node : graph_manager->task_to_node_map_) {
+      exported_tasks[task_id_node.second->id_] = task_id_node.first;
+    }
+    vector<uint64_t> exported_pus(graph_manager->leaf_nodes_.begin(),
+                                  graph_manager->leaf_nodes_.end());
+    unordered_map<uint64_t, ResourceID_t> exported_pu_res_ids;
+    for (auto& pu_node_id : exported_pus) {
+      exported_pu_res_ids[pu_node_id] =
+        change_manager->Node(pu_node_id).resource_id_;
+    }
+    uint32_t lock_depth = scheduling_lock.ReleaseAll();
+    EXPECT_EQ(lock_depth, 2);
+    // Solve without the lock: map every task to a PU, and wait for some
+    // events to be handled in the meantime.
+    uint64_t num_events_before = num_events;
+    multimap<uint64_t, uint64_t> task_mappings;
+    uint64_t pu_index = 0;
+    for (auto& node_task : exported_tasks) {
+      task_mappings.insert(pair<uint64_t, uint64_t>(
+          node_task.first, exported_pus[pu_index++ % exported_pus.size()]));
+    }
+    while (num_events < num_events_before + 4) {
+      boost::this_thread::yield();
+    }
+    scheduling_lock.ReacquireAll(lock_depth);
+    graph_manager->RemoveStaleTaskMappings(&task_mappings);
+    unordered_set<TaskID_t> placed_tasks;
+    for (auto& mapping : task_mappings) {
+      const FlowGraphNode& task_node = change_manager->Node(mapping.first);
+      EXPECT_TRUE(task_node.IsTaskNode());
+      EXPECT_EQ(task_node.td_ptr_->uid(), exported_tasks[mapping.first]);
+      EXPECT_TRUE(placed_tasks.insert(task_node.td_ptr_->uid()).second);
+      const FlowGraphNode& pu_node = change_manager->Node(mapping.second);
+      EXPECT_EQ(pu_node.type_, FlowNodeType::PU);
+      EXPECT_EQ(pu_node.resource_id_, exported_pu_res_ids[mapping.second]);
+    }
+    num_placed += placed_tasks.size();
+  }
+  done = true;
+  event_thread.join();
+  EXPECT_GT(num_placed, 0);
+}
+
 TEST_F(FlowGraphManagerTest, RemoveTaskHelper) {
   MockCostModel mock_cost_model;
   FlowGraphManager* graph_manager = new FlowGraphManager(
@@ -623,6 +865,76 @@ TEST_F(FlowGraphManagerTest, RemoveUnscheduledAggNode) {
   EXPECT_DEATH(graph_manager->RemoveUnscheduledAggNode(job_id), "");
 }
 
+TEST_F(FlowGraphManagerTest, SchedulingDeltasForPreemptedTasks) {
+  FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
+  const uint64_t kNumPUs = 4;
+  const uint64_t kNumTasks = 16;
+  ResourceTopologyNodeDescriptor pu_rtnds[kNumPUs];
+  vector<FlowGraphNode*> pu_nodes;
+  for (uint64_t pu_index = 0; pu_index < kNumPUs; ++pu_index) {
+    ResourceDescriptor* pu_rd_ptr =
+      CreateMachine(&pu_rtnds[pu_index], "pu" + to_string(pu_index));
+    pu_rd_ptr->set_type(ResourceDescriptor::RESOURCE_PU);
+    InsertIfNotPresent(resource_map_.get(),
+                       ResourceIDFromString(pu_rd_ptr->uuid()),
+                       new ResourceStatus(pu_rd_ptr, &pu_rtnds[pu_index],
+                                          "", 0));
+    pu_nodes.push_back(graph_manager->AddResourceNode(pu_rd_ptr));
+  }
+  // Bind every task to a PU, keeping the PUs' running task lists in sync the
+  // same way EventDrivenScheduler::BindTaskToResource does. Only every third
+  // task is placed by the solver. The second task is bound but not running.
+  JobDescriptor test_jobs[kNumTasks];
+  unordered_map<TaskID_t, ResourceID_t> task_bindings;
+  multimap<uint64_t, uint64_t> task_mappings;
+  for (uint64_t task_index = 0; task_index < kNumTasks; ++task_index) {
+    TaskDescriptor* td_ptr = CreateTask(&test_jobs[task_index],
+                                        42 + task_index);
+    td_ptr->set_state(task_index == 1 ? TaskDescriptor::RUNNABLE
+                                      : TaskDescriptor::RUNNING);
+    FlowGraphNode* task_node =
+      graph_manager->AddTaskNode(JobIDFromString(td_ptr->job_id()), td_ptr);
+    CHECK_NOTNULL(task_node);
+    FlowGraphNode* pu_node = pu_nodes[task_index % kNumPUs];
+    pu_node->rd_ptr_->add_current_running_tasks(td_ptr->uid());
+    InsertIfNotPresent(&task_bindings, td_ptr->uid(), pu_node->resource_id_);
+    if (task_index % 3 == 0) {
+      task_mappings.insert(pair<uint64_t, uint64_t>(task_node->id_,
+                                                    pu_node->id_));
+    }
+  }
+  vector<SchedulingDelta*> deltas;
+  graph_manager->SchedulingDeltasForPreemptedTasks(task_mappings,
+                                                   task_bindings,
+                                                   resource_map_, &deltas);
+  // The deltas must match those of a full scan over all resources.
+  set<pair<TaskID_t, string>> expected_preemptions;
+  for (auto& res_id_status : *resource_map_) {
+    const ResourceDescriptor& rd = res_id_status.second->descriptor();
+    for (auto& task_id : rd.current_running_tasks()) {
+      FlowGraphNode* task_node = graph_manager->NodeForTaskID(task_id);
+      if (task_node->td_ptr_->state() == TaskDescriptor::RUNNING &&
+          task_mappings.find(task_node->id_) == task_mappings.end()) {
+        expected_preemptions.insert(pair<TaskID_t, string>(task_id,
+                                                           rd.uuid()));
+      }
+    }
+  }
+  set<pair<TaskID_t, string>> preemptions;
+  for (auto& delta : deltas) {
+    EXPECT_EQ(delta->type(), SchedulingDelta::PREEMPT);
+    preemptions.insert(pair<TaskID_t, string>(delta->task_id(),
+                                              delta->resource_id()));
+    delete delta;
+  }
+  EXPECT_EQ(preemptions.size(), deltas.size());
+  EXPECT_EQ(preemptions.size(), 9);
+  EXPECT_TRUE(preemptions == expected_preemptions);
+  for (auto& res_id_status : *resource_map_) {
+    delete res_id_status.second;
+  }
+}
+
 TEST_F(FlowGraphManagerTest, TaskScheduled) {
   FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
   uint64_t num_arcs =
@@ -711,9 +1023,14 @@ TEST_F(FlowGraphManagerTest, TraverseAndRemoveTopology) {
 }
 
 TEST_F(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggs) {
+  int64_t update_frequency = FLAGS_time_dependent_cost_update_frequency;
+  FLAGS_time_dependent_cost_update_frequency = 10;
+  ManualTime manual_time;
   MockCostModel mock_cost_model;
   FlowGraphManager* graph_manager = new FlowGraphManager(
-      &mock_cost_model, leaf_res_ids_, &wall_time_, tg_, &dimacs_stats_);
+      &mock_cost_model, leaf_res_ids_, &manual_time, tg_, &dimacs_stats_);
+  ON_CALL(mock_cost_model, TaskToUnscheduledAgg(_))
+      .WillByDefault(testing::Return(ArcDescriptor(1LL, 1ULL, 0ULL)));
   // Add a job.
   JobDescriptor test_job1;
   TaskDescriptor* td_ptr1 = CreateTask(&test_job1, 42);
@@ -721,14 +1038,14 @@ TEST_F(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggs) {
   JobID_t job_id1 = JobIDFromString(td_ptr1->job_id());
   EXPECT_CALL(mock_cost_model, AddTask(_)).Times(1);
   FlowGraphNode* task_node1 = graph_manager->AddTaskNode(job_id1, td_ptr1);
-  FlowGraphNode* unsched_agg_node1 =
-      graph_manager->AddUnscheduledAggNode(job_id1);
-  CHECK_NOTNULL(unsched_agg_node1);
   // Add arc between task and unsched_agg1.
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(1);
+  FlowGraphNode* unsched_agg_node1 =
+      graph_manager->UpdateTaskToUnscheduledAggArc(task_node1);
   FlowGraphArc* arc_task_to_unsched1 =
-      graph_manager->graph_change_manager_->AddArc(
-          task_node1, unsched_agg_node1, 0, 1, 1, FlowGraphArcType::OTHER,
-          ADD_ARC_TO_UNSCHED, "test1");
+      graph_manager->graph_change_manager_->mutable_flow_graph()->GetArc(
+          task_node1, unsched_agg_node1);
+  CHECK_NOTNULL(arc_task_to_unsched1);
 
   // Adding another job.
   JobDescriptor test_job2;
@@ -737,21 +1054,80 @@ TEST_F(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggs) {
   JobID_t job_id2 = JobIDFromString(td_ptr2->job_id());
   EXPECT_CALL(mock_cost_model, AddTask(_)).Times(1);
   FlowGraphNode* task_node2 = graph_manager->AddTaskNode(job_id2, td_ptr2);
-  FlowGraphNode* unsched_agg_node2 =
-      graph_manager->AddUnscheduledAggNode(job_id2);
-  CHECK_NOTNULL(unsched_agg_node2);
   // Add arc between task and unsched_agg2.
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(1);
+  FlowGraphNode* unsched_agg_node2 =
+      graph_manager->UpdateTaskToUnscheduledAggArc(task_node2);
   FlowGraphArc* arc_task_to_unsched2 =
-      graph_manager->graph_change_manager_->AddArc(
-          task_node2, unsched_agg_node2, 0, 1, 1, FlowGraphArcType::OTHER,
-          ADD_ARC_TO_UNSCHED, "test2");
+      graph_manager->graph_change_manager_->mutable_flow_graph()->GetArc(
+          task_node2, unsched_agg_node2);
+  CHECK_NOTNULL(arc_task_to_unsched2);
+  // The costs are not recomputed before the tasks waited for an interval.
+  EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(0);
+  graph_manager->UpdateAllCostsToUnscheduledAggs();
   // Update all costs to unsched aggs and verify updated costs.
+  manual_time.UpdateCurrentTimestamp(10);
   ON_CALL(mock_cost_model, TaskToUnscheduledAgg(_))
       .WillByDefault(testing::Return(ArcDescriptor(45LL, 1ULL, 0ULL)));
   EXPECT_CALL(mock_cost_model, TaskToUnscheduledAgg(_)).Times(2);
   graph_manager->UpdateAllCostsToUnscheduledAggs();
   CHECK_EQ(arc_task_to_unsched1->cost_, 45);
   CHECK_EQ(arc_task_to_unsched2->cost_, 45);
+  FLAGS_time_dependent_cost_update_frequency = update_frequency;
+}
+
+TEST_F(FlowGraphManagerTest, UpdateAllCostsToUnscheduledAggsManyTasks) {
+  // Refreshes the costs of 100k waiting tasks after they waited for one
+  // update interval. Only the time-dependent cost model changes arcs.
+  const uint64_t kNumTasks = 100000;
+  int64_t update_frequency = FLAGS_time_dependent_cost_update_frequency;
+  FLAGS_time_dependent_cost_update_frequency = 10;
+  // Record the arc changes.
+  FLAGS_incremental_flow = true;
+  ManualTime manual_time;
+  TrivialCostModel constant_cost_model(resource_map_, task_map_,
+                                       leaf_res_ids_);
+  WaitTimeCostModel wait_time_cost_model(resource_map_, task_map_,
+                                         leaf_res_ids_, &manual_time);
+  JobDescriptor test_job;
+  TaskDescriptor* root_td_ptr = CreateTask(&test_job, 42);
+  JobID_t job_id = JobIDFromString(root_td_ptr->job_id());
+  vector<TaskDescriptor*> td_ptrs;
+  td_ptrs.push_back(root_td_ptr);
+  for (uint64_t index = 1; index < kNumTasks; ++index) {
+    TaskDescriptor* td_ptr = root_td_ptr->add_spawned();
+    td_ptr->set_uid(GenerateTaskID(*root_td_ptr, index));
+    td_ptr->set_job_id(test_job.uuid());
+    td_ptrs.push_back(td_ptr);
+  }
+  for (auto& td_ptr : td_ptrs) {
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+  }
+  vector<CostModelInterface*> cost_models;
+  cost_models.push_back(&constant_cost_model);
+  cost_models.push_back(&wait_time_cost_model);
+  for (auto& cost_model : cost_models) {
+    manual_time.UpdateCurrentTimestamp(0);
+    FlowGraphManager graph_manager(cost_model, leaf_res_ids_, &manual_time,
+                                   tg_, &dimacs_stats_);
+    for (auto& td_ptr : td_ptrs) {
+      graph_manager.AddTaskNodeForPlacement(job_id, td_ptr);
+    }
+    FlowGraphChangeManager* change_manager =
+      graph_manager.graph_change_manager_;
+    change_manager->ResetChanges();
+    manual_time.UpdateCurrentTimestamp(10);
+    graph_manager.UpdateAllCostsToUnscheduledAggs();
+    uint64_t num_changes = change_manager->GetGraphChanges().size();
+    if (cost_model == &constant_cost_model) {
+      EXPECT_EQ(0U, num_changes);
+    } else {
+      EXPECT_EQ(kNumTasks, num_changes);
+    }
+  }
+  FLAGS_time_dependent_cost_update_frequency = update_frequency;
+  FLAGS_incremental_flow = false;
 }
 
 TEST_F(FlowGraphManagerTest, UpdateArcsForScheduledTask) {
@@ -1318,6 +1694,70 @@ TEST_F(FlowGraphManagerTest, UpdateTaskToUnscheduledAggArc) {
   EXPECT_EQ(task_to_unsched_arc->cap_upper_bound_, 1);
 }
 
+TEST_F(FlowGraphManagerTest, UpdateTimeDependentCosts) {
+  int64_t update_frequency = FLAGS_time_dependent_cost_update_frequency;
+  FLAGS_time_dependent_cost_update_frequency = 10;
+  // Record the arc changes.
+  FLAGS_incremental_flow = true;
+  ManualTime manual_time;
+  WaitTimeCostModel cost_model(resource_map_, task_map_, leaf_res_ids_,
+                               &manual_time);
+  FlowGraphManager graph_manager(&cost_model, leaf_res_ids_, &manual_time,
+                                 tg_, &dimacs_stats_);
+  // Add four jobs whose tasks were submitted at times 0, 3, 6 and 9.
+  JobDescriptor test_jobs[4];
+  vector<JobDescriptor*> jd_ptr_vect;
+  vector<TaskID_t> task_ids;
+  for (uint64_t index = 0; index < 4; ++index) {
+    TaskDescriptor* td_ptr = CreateTask(&test_jobs[index], 42 + index);
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    td_ptr->set_submit_time(3 * index);
+    CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+    jd_ptr_vect.push_back(&test_jobs[index]);
+    task_ids.push_back(td_ptr->uid());
+  }
+  manual_time.UpdateCurrentTimestamp(9);
+  graph_manager.AddOrUpdateJobNodes(jd_ptr_vect);
+  FlowGraphChangeManager* change_manager =
+    graph_manager.graph_change_manager_;
+  // Returns the cost on each task's arc to its unscheduled aggregator.
+  auto unsched_costs = [&]() {
+    vector<int64_t> costs;
+    for (auto& task_id : task_ids) {
+      FlowGraphNode* task_node = graph_manager.NodeForTaskID(task_id);
+      FlowGraphNode* unsched_agg_node =
+        graph_manager.UnschedAggNodeForJobID(task_node->job_id_);
+      FlowGraphArc* arc =
+        change_manager->mutable_flow_graph()->GetArc(task_node,
+                                                     unsched_agg_node);
+      CHECK_NOTNULL(arc);
+      costs.push_back(arc->cost_);
+    }
+    return costs;
+  };
+  // No task has waited for a whole interval yet.
+  change_manager->ResetChanges();
+  graph_manager.UpdateTimeDependentCosts();
+  EXPECT_EQ(0U, change_manager->GetGraphChanges().size());
+  // At time 25 all tasks entered a new interval.
+  manual_time.UpdateCurrentTimestamp(25);
+  graph_manager.UpdateTimeDependentCosts();
+  EXPECT_EQ(4U, change_manager->GetGraphChanges().size());
+  EXPECT_EQ(vector<int64_t>({2, 2, 1, 1}), unsched_costs());
+  // At time 32 only the task submitted at time 3 stays in its interval.
+  change_manager->ResetChanges();
+  manual_time.UpdateCurrentTimestamp(32);
+  graph_manager.UpdateTimeDependentCosts();
+  EXPECT_EQ(3U, change_manager->GetGraphChanges().size());
+  vector<int64_t> costs = unsched_costs();
+  EXPECT_EQ(vector<int64_t>({3, 2, 2, 2}), costs);
+  // A full sweep computes the same costs.
+  graph_manager.UpdateAllCostsToUnscheduledAggs();
+  EXPECT_EQ(costs, unsched_costs());
+  FLAGS_time_dependent_cost_update_frequency = update_frequency;
+  FLAGS_incremental_flow = false;
+}
+
 TEST_F(FlowGraphManagerTest, UpdateUnscheduledAggNode) {
   FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
   const FlowGraph& flow_graph =
@@ -24,7 +24,9 @@
 
 #include <boost/timer/timer.hpp>
 #include <cstdio>
+#include <limits>
 #include <map>
+#include <queue>
 #include <set>
 #include <string>
 #include <vector>
@@ -41,6 +43,7 @@
 #include "scheduling/scheduling_event_notifier_interface.h"
 #include "scheduling/flow/cost_models.h"
 #include "scheduling/flow/cost_model_interface.h"
+#include "scheduling/flow/cost_model_utils.h"
 
 #define SIMULATION_START_TIME 600000000
 
@@ -50,14 +53,18 @@ DEFINE_int32(flow_scheduling_cost_model, 0,
              "4 = WHARE, 5 = COCO, 6 = OCTOPUS, 7 = VOID, 8 = NET, "
              "9 = QUINCY_INTERFERENCE");
 DEFINE_uint64(max_solver_runtime, 100000000,
-              "Maximum runtime of the solver in u-sec");
+              "Maximum runtime of the solver in u-sec. The solver is killed "
+              "when it runs longer, and tasks are placed greedily instead.");
 DEFINE_int64(time_dependent_cost_update_frequency, 10000000ULL,
-             "Update frequency for time-dependent costs, in microseconds.");
+             "Update frequency for time-dependent costs, in microseconds. "
+             "A waiting task's cost is updated whenever its wait time "
+             "enters a new interval of this length.");
 DEFINE_bool(gather_unscheduled_tasks, true, "Gather unscheduled tasks");
 DEFINE_bool(debug_cost_model, false,
             "Store cost model debug info in CSV files.");
-DEFINE_uint64(purge_unconnected_ec_frequency, 10, "Frequency in solver runs "
-              "at which to purge unconnected EC nodes");
+DEFINE_uint64(purge_unconnected_ec_frequency, 1, "Frequency in solver runs "
+              "at which to purge unconnected EC nodes. Each purge removes at "
+              "most --purge_unconnected_ec_budget nodes.");
 DEFINE_bool(update_resource_topology_capacities, false,
             "True if the arc capacities of the resource topology should be "
             "updated after every scheduling round");
@@ -71,9 +78,29 @@ DEFINE_bool(reschedule_tasks_upon_node_failure, true, "True if tasks that were "
 
 DECLARE_string(flow_scheduling_solver);
 DECLARE_bool(flowlessly_flip_algorithms);
+DECLARE_bool(incremental_flow);
 DEFINE_bool(resource_stats_update_based_on_resource_reservation, true,
             "Set this false when you have external machine stats server");
 DEFINE_bool(pod_affinity_antiaffinity_symmetry, false, "Enable pod affinity/anti-affinity symmetry");
+DEFINE_bool(affinity_placement_index, false,
+            "Place queued tasks with pod affinity/anti-affinity from an "
+            "indexed placement engine instead of single-task solver runs. "
+            "Not used with --pod_affinity_antiaffinity_symmetry.");
+DEFINE_bool(gang_admission_control, true,
+            "Hold back gang jobs that cannot get their minimum number of "
+            "tasks placed, both before and after the solver runs.");
+DEFINE_uint32(affinity_conflict_grouping_threads, 4,
+              "Number of threads used to find conflicting task pairs when "
+              "grouping pod affinity/anti-affinity tasks into batches.");
+DEFINE_bool(pipeline_solver_runs, false,
+            "Release the scheduling lock while the flow solver runs, so that "
+            "events are handled during the solve. Their graph changes go "
+            "into the next scheduling round.");
+DEFINE_string(flow_partition_label_key, "",
+              "Machine label whose values split the cluster into node pools "
+              "that are solved as separate flow graphs. Tasks that select "
+              "exactly one value of the label are only scheduled in that "
+              "pool. Empty to solve a single flow graph.");
 
 namespace firmament {
 namespace scheduler {
@@ -103,11 +130,11 @@ FlowScheduler::FlowScheduler(
                            coordinator_uri, time_manager, trace_generator,
                            labels_map, affinity_antiaffinity_tasks),
       topology_manager_(topo_mgr),
-      last_updated_time_dependent_costs_(0ULL),
       leaf_res_ids_(new unordered_set<ResourceID_t,
                       boost::hash<boost::uuids::uuid>>),
       dimacs_stats_(new DIMACSChangeStats),
-      solver_run_cnt_(0) {
+      solver_run_cnt_(0),
+      placement_engine_(NULL) {
   // Select the cost model to use
   VLOG(1) << "Set cost model to use in flow graph to \""
           << FLAGS_flow_scheduling_cost_model << "\"";
@@ -181,13 +208,79 @@ FlowScheduler::FlowScheduler(
   flow_graph_manager_->AddResourceTopology(resource_topology);
   // Set up the dispatcher, which starts the flow solver
   solver_dispatcher_ = new SolverDispatcher(flow_graph_manager_, false);
+  if (FLAGS_flow_partition_label_key.empty()) {
+    partitioned_solver_dispatcher_ = NULL;
+  } else {
+    // The partitions are rebuilt on every run, so there is nothing to
+    // update incrementally.
+    CHECK(!FLAGS_incremental_flow)
+      << "--flow_partition_label_key requires a non-incremental solver";
+    partitioned_solver_dispatcher_ =
+      new PartitionedSolverDispatcher(flow_graph_manager_,
+                                      FLAGS_flow_partition_label_key);
+  }
+  if (FLAGS_affinity_placement_index &&
+      !FLAGS_pod_affinity_antiaffinity_symmetry) {
+    placement_engine_ = new AffinityPlacementEngine();
+    AddMachinesToPlacementEngine(resource_topology);
+  }
 }
 
 FlowScheduler::~FlowScheduler() {
   delete dimacs_stats_;
   delete cost_model_;
   delete solver_dispatcher_;
+  delete partitioned_solver_dispatcher_;
   delete leaf_res_ids_;
+  delete placement_engine_;
+}
+
+void FlowScheduler::AddMachinesToPlacementEngine(
+    ResourceTopologyNodeDescriptor* rtnd_ptr) {
+  DFSTraverseResourceProtobufTreeReturnRTND(
+      rtnd_ptr,
+      [this](ResourceTopologyNodeDescriptor* node) {
+        if (node->resource_desc().type() ==
+            ResourceDescriptor::RESOURCE_MACHINE) {
+          placement_engine_->AddMachine(node->resource_desc());
+        }
+      });
+}
+
+void FlowScheduler::AdmitGangJobs(vector<JobDescriptor*>* jds,
+                                  GangAdmission* gang_admission) {
+  vector<JobDescriptor*> admitted_jds;
+  for (auto& jd_ptr : *jds) {
+    if (!jd_ptr->is_gang_scheduling_job()) {
+      admitted_jds.push_back(jd_ptr);
+      continue;
+    }
+    uint64_t num_running_tasks = 0;
+    queue<const TaskDescriptor*> to_visit;
+    to_visit.push(&jd_ptr->root_task());
+    while (!to_visit.empty()) {
+      const TaskDescriptor* td_ptr = to_visit.front();
+      to_visit.pop();
+      if (td_ptr->state() == TaskDescriptor::RUNNING ||
+          td_ptr->state() == TaskDescriptor::ASSIGNED) {
+        num_running_tasks++;
+      }
+      for (auto& child_td : td_ptr->spawned()) {
+        to_visit.push(&child_td);
+      }
+    }
+    uint64_t num_runnable_tasks = ComputeRunnableTasksForJob(jd_ptr).size();
+    if (gang_admission->Admit(*jd_ptr, num_running_tasks,
+                              num_runnable_tasks)) {
+      admitted_jds.push_back(jd_ptr);
+    } else {
+      // The gang's tasks may still have preference arcs from an earlier
+      // round; remove them so that the solver leaves the gang unscheduled.
+      flow_graph_manager_->HoldUnscheduledJobTasks(*jd_ptr);
+      delta_jobs.insert(jd_ptr);
+    }
+  }
+  jds->swap(admitted_jds);
 }
 
 uint64_t FlowScheduler::ApplySchedulingDeltas(
@@ -325,14 +418,18 @@ uint64_t FlowScheduler::ApplySchedulingDeltas(
 
 void FlowScheduler::DeregisterResource(
     ResourceTopologyNodeDescriptor* rtnd_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   // Traverse the resource topology tree in order to evict tasks.
   DFSTraversePostOrderResourceProtobufTreeReturnRTND(
       rtnd_ptr,
       boost::bind(&FlowScheduler::HandleTasksFromDeregisteredResource,
                   this, _1));
-  flow_graph_manager_->RemoveResourceTopology(
-      rtnd_ptr->resource_desc(), &pus_removed_during_solver_run_);
+  if (placement_engine_) {
+    RemoveMachinesFromPlacementEngine(rtnd_ptr);
+  }
+  set<uint64_t> pus_removed;
+  flow_graph_manager_->RemoveResourceTopology(rtnd_ptr->resource_desc(),
+                                              &pus_removed);
   if (rtnd_ptr->parent_id().empty()) {
     resource_roots_.erase(rtnd_ptr);
   }
@@ -358,25 +455,44 @@ void FlowScheduler::RemoveAffinityAntiAffinityJobData(JobID_t job_id) {
   JobDescriptor* jdp = FindOrNull(*job_map_, job_id);
   if (jdp) {
     no_conflict_root_tasks_.erase(jdp->root_task().uid());
+    affinity_conflict_index_.RemoveTask(jdp->root_task().uid());
     root_to_children_tasks_.erase(jdp->root_task().uid());
   }
 }
 
+void FlowScheduler::RemoveMachinesFromPlacementEngine(
+    ResourceTopologyNodeDescriptor* rtnd_ptr) {
+  DFSTraverseResourceProtobufTreeReturnRTND(
+      rtnd_ptr,
+      [this](ResourceTopologyNodeDescriptor* node) {
+        if (node->resource_desc().type() ==
+            ResourceDescriptor::RESOURCE_MACHINE) {
+          placement_engine_->RemoveMachine(
+              ResourceIDFromString(node->resource_desc().uuid()));
+        }
+      });
+}
+
 void FlowScheduler::HandleJobCompletion(JobID_t job_id) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   // Job completed, so remove its nodes
   flow_graph_manager_->JobCompleted(job_id);
+  JobDescriptor* jdp = FindOrNull(*job_map_, job_id);
+  if (jdp) {
+    delta_jobs.erase(jdp);
+  }
   RemoveAffinityAntiAffinityJobData(job_id);
   // Call into superclass handler
   EventDrivenScheduler::HandleJobCompletion(job_id);
 }
 
 void FlowScheduler::HandleJobRemoval(JobID_t job_id) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   flow_graph_manager_->JobRemoved(job_id);
   JobDescriptor* jdp = FindOrNull(*job_map_, job_id);
   if (jdp) {
     affinity_job_to_deltas_.erase(jdp);
+    delta_jobs.erase(jdp);
     RemoveAffinityAntiAffinityJobData(job_id);
   }
   // Call into superclass handler
@@ -385,7 +501,7 @@ void FlowScheduler::HandleJobRemoval(JobID_t job_id) {
 
 void FlowScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
                                          TaskFinalReport* report) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   bool task_in_graph = true;
   if (td_ptr->state() == TaskDescriptor::FAILED ||
       td_ptr->state() == TaskDescriptor::ABORTED) {
@@ -405,18 +521,20 @@ void FlowScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
   // We first call into the superclass handler because it populates
   // the task report. The report might be used by the cost models.
   EventDrivenScheduler::HandleTaskCompletion(td_ptr, report);
+  if (placement_engine_) {
+    placement_engine_->TaskRemoved(td_ptr->uid());
+  }
   // We don't need to do any flow graph stuff for delegated tasks as
   // they are not currently represented in the flow graph.
   // Otherwise, we need to remove nodes, etc.
   if (td_ptr->delegated_from().empty() && task_in_graph) {
-    uint64_t task_node_id = flow_graph_manager_->TaskCompleted(td_ptr->uid());
-    tasks_completed_during_solver_run_.insert(task_node_id);
+    flow_graph_manager_->TaskCompleted(td_ptr->uid());
   }
 }
 
 void FlowScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
                                        ResourceDescriptor* rd_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   ResourceID_t res_id = ResourceIDFromString(rd_ptr->uuid());
   flow_graph_manager_->TaskEvicted(td_ptr->uid(), res_id);
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
@@ -424,11 +542,14 @@ void FlowScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
   }
   cost_model_->UpdateResourceToNamespacesMap(res_id,
                                            td_ptr->task_namespace(), false);
+  if (placement_engine_) {
+    placement_engine_->TaskRemoved(td_ptr->uid());
+  }
   EventDrivenScheduler::HandleTaskEviction(td_ptr, rd_ptr);
 }
 
 void FlowScheduler::HandleTaskFailure(TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   flow_graph_manager_->TaskFailed(td_ptr->uid());
   // pod affinity/anti-affinity symmetry
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
@@ -439,12 +560,15 @@ void FlowScheduler::HandleTaskFailure(TaskDescriptor* td_ptr) {
     cost_model_->UpdateResourceToNamespacesMap(res_id,
                                            td_ptr->task_namespace(), false);
   }
+  if (placement_engine_) {
+    placement_engine_->TaskRemoved(td_ptr->uid());
+  }
   EventDrivenScheduler::HandleTaskFailure(td_ptr);
 }
 
 void FlowScheduler::HandleTaskFinalReport(const TaskFinalReport& report,
                                           TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   TaskID_t task_id = td_ptr->uid();
   vector<EquivClass_t>* equiv_classes =
     cost_model_->GetTaskEquivClasses(task_id);
@@ -460,7 +584,7 @@ void FlowScheduler::HandleTaskFinalReport(const TaskFinalReport& report,
 
 void FlowScheduler::HandleTaskMigration(TaskDescriptor* td_ptr,
                                         ResourceDescriptor* rd_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   TaskID_t task_id = td_ptr->uid();
   // Get the old resource id before we call EventDrivenScheduler.
   // Otherwise, we would end up getting the new resource id.
@@ -475,12 +599,17 @@ void FlowScheduler::HandleTaskMigration(TaskDescriptor* td_ptr,
   td_ptr->set_scheduled_to_resource(rd_ptr->uuid());
   flow_graph_manager_->TaskMigrated(task_id, old_res_id,
                                     ResourceIDFromString(rd_ptr->uuid()));
+  if (placement_engine_) {
+    placement_engine_->TaskPlaced(
+        *td_ptr, MachineResIDForResource(resource_map_,
+                                         ResourceIDFromString(rd_ptr->uuid())));
+  }
   EventDrivenScheduler::HandleTaskMigration(td_ptr, rd_ptr);
 }
 
 void FlowScheduler::HandleTaskPlacement(TaskDescriptor* td_ptr,
                                         ResourceDescriptor* rd_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   td_ptr->set_scheduled_to_resource(rd_ptr->uuid());
   ResourceID_t res_id = ResourceIDFromString(rd_ptr->uuid());
   flow_graph_manager_->TaskScheduled(td_ptr->uid(), res_id);
@@ -509,11 +638,16 @@ void FlowScheduler::HandleTaskPlacement(TaskDescriptor* td_ptr,
   }
   cost_model_->UpdateResourceToNamespacesMap(res_id,
                                              td_ptr->task_namespace(), true);
+  if (placement_engine_) {
+    placement_engine_->TaskPlaced(*td_ptr,
+                                  MachineResIDForResource(resource_map_,
+                                                          res_id));
+  }
   EventDrivenScheduler::HandleTaskPlacement(td_ptr, rd_ptr);
 }
 
 void FlowScheduler::HandleTaskRemoval(TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   flow_graph_manager_->TaskRemoved(td_ptr->uid());
   // pod affinity/anti-affinity symmetry
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
@@ -524,12 +658,15 @@ void FlowScheduler::HandleTaskRemoval(TaskDescriptor* td_ptr) {
     cost_model_->UpdateResourceToNamespacesMap(res_id,
                                            td_ptr->task_namespace(), false);
   }
+  if (placement_engine_) {
+    placement_engine_->TaskRemoved(td_ptr->uid());
+  }
   EventDrivenScheduler::HandleTaskRemoval(td_ptr);
 }
 
 void FlowScheduler::KillRunningTask(TaskID_t task_id,
                                     TaskKillMessage::TaskKillReason reason) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   flow_graph_manager_->TaskKilled(task_id);
   EventDrivenScheduler::KillRunningTask(task_id, reason);
 }
@@ -571,7 +708,8 @@ uint64_t FlowScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats) {
 vector<TaskID_t>* FlowScheduler::ScheduleAllAffinityBatchJobs(
                                            SchedulerStats* scheduler_stats,
                                            vector<SchedulingDelta>* deltas) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  SchedulingRoundGuard round_guard(&scheduling_round_lock_, &scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   uint64_t num_scheduled_tasks = 0;
   vector<TaskID_t>* unscheduled_tasks = new vector<TaskID_t>();
   affinity_batch_schedule = true;
@@ -614,10 +752,24 @@ vector<TaskID_t>* FlowScheduler::ScheduleAllAffinityBatchJobs(
 
 uint64_t FlowScheduler::ScheduleAllQueueJobs(SchedulerStats* scheduler_stats,
                                              vector<SchedulingDelta>* deltas) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  queue_based_schedule = true;
+  SchedulingRoundGuard round_guard(&scheduling_round_lock_, &scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   auto task_itr = affinity_antiaffinity_tasks_->begin();
   TaskDescriptor* tdp = FindPtrOrNull(*task_map_, *task_itr);
+  if (placement_engine_ && tdp) {
+    JobDescriptor* jd_ptr = FindOrNull(*job_map_,
+                                       JobIDFromString(tdp->job_id()));
+    CHECK_NOTNULL(jd_ptr);
+    // Gang jobs still go through the solver, which tracks their deltas.
+    if (!jd_ptr->is_gang_scheduling_job()) {
+      uint64_t num_scheduled_tasks = 0;
+      if (ScheduleQueueTaskFromIndex(tdp, jd_ptr, deltas,
+                                     &num_scheduled_tasks)) {
+        return num_scheduled_tasks;
+      }
+    }
+  }
+  queue_based_schedule = true;
   if (tdp) {
     if (tdp->state() == TaskDescriptor::RUNNABLE) {
       TaskID_t task_id = *task_itr;
@@ -634,6 +786,89 @@ uint64_t FlowScheduler::ScheduleAllQueueJobs(SchedulerStats* scheduler_stats,
   return num_scheduled_tasks;
 }
 
+bool FlowScheduler::ScheduleQueueTaskFromIndex(
+    TaskDescriptor* td_ptr,
+    JobDescriptor* jd_ptr,
+    vector<SchedulingDelta>* deltas,
+    uint64_t* num_scheduled) {
+  TaskID_t task_id = td_ptr->uid();
+  task_to_be_scheduled_ = task_id;
+  *num_scheduled = 0;
+  // Move the task to the back of the queue, so that a task that cannot be
+  // placed does not hold up the ones behind it.
+  auto move_task_to_back = [this, task_id]() {
+    affinity_antiaffinity_tasks_->erase(
+        affinity_antiaffinity_tasks_->begin());
+    affinity_antiaffinity_tasks_->push_back(task_id);
+  };
+  if (ComputeRunnableTasksForJob(jd_ptr).count(task_id) == 0) {
+    move_task_to_back();
+    return true;
+  }
+  ResourceID_t machine_res_id = placement_engine_->BestMachineForTask(*td_ptr);
+  if (machine_res_id.is_nil()) {
+    VLOG(1) << "No machine can currently run task " << task_id;
+    move_task_to_back();
+    return true;
+  }
+  const ResourceDescriptor* pu_rd_ptr = LeastLoadedPUWithFreeSlot(
+      machine_res_id);
+  if (!pu_rd_ptr) {
+    // The engine only tracks machine resources; leave the choice to the
+    // solver, which knows the PU slots.
+    VLOG(1) << "No PU of machine " << to_string(machine_res_id)
+            << " has a free slot for task " << task_id;
+    return false;
+  }
+  move_task_to_back();
+  // The task needs a node in the flow graph so that later solver runs see
+  // it running, but it does not need any preference arcs.
+  flow_graph_manager_->AddTaskNodeForPlacement(
+      JobIDFromString(jd_ptr->uuid()), td_ptr);
+  SchedulingDelta delta;
+  delta.set_type(SchedulingDelta::PLACE);
+  delta.set_task_id(task_id);
+  delta.set_resource_id(pu_rd_ptr->uuid());
+  vector<SchedulingDelta*> delta_ptrs(1, &delta);
+  *num_scheduled = ApplySchedulingDeltas(delta_ptrs);
+  if (deltas) {
+    deltas->push_back(delta);
+  }
+  return true;
+}
+
+const ResourceDescriptor* FlowScheduler::LeastLoadedPUWithFreeSlot(
+    ResourceID_t machine_res_id) {
+  ResourceStatus* machine_rs = FindPtrOrNull(*resource_map_, machine_res_id);
+  CHECK_NOTNULL(machine_rs);
+  const ResourceDescriptor* best_pu_rd_ptr = NULL;
+  uint64_t best_num_running = 0;
+  vector<const ResourceTopologyNodeDescriptor*> to_visit(
+      1, &machine_rs->topology_node());
+  while (!to_visit.empty()) {
+    const ResourceTopologyNodeDescriptor* rtnd_ptr = to_visit.back();
+    to_visit.pop_back();
+    for (auto& child : rtnd_ptr->children()) {
+      to_visit.push_back(&child);
+    }
+    if (rtnd_ptr->resource_desc().type() != ResourceDescriptor::RESOURCE_PU) {
+      continue;
+    }
+    ResourceStatus* pu_rs =
+      FindPtrOrNull(*resource_map_,
+                    ResourceIDFromString(rtnd_ptr->resource_desc().uuid()));
+    CHECK_NOTNULL(pu_rs);
+    const ResourceDescriptor& pu_rd = pu_rs->descriptor();
+    uint64_t num_running = pu_rd.current_running_tasks_size();
+    if (num_running < FLAGS_max_tasks_per_pu &&
+        (!best_pu_rd_ptr || num_running < best_num_running)) {
+      best_pu_rd_ptr = &pu_rd;
+      best_num_running = num_running;
+    }
+  }
+  return best_pu_rd_ptr;
+}
+
 bool FlowScheduler::CheckAllTasksInJobRunning(TaskDescriptor* rtd) {
   if (rtd && (rtd->state() == TaskDescriptor::RUNNING)) {
     unordered_set<TaskID_t>* spawned_tasks_set =
@@ -646,48 +881,29 @@ bool FlowScheduler::CheckAllTasksInJobRunning(TaskDescriptor* rtd) {
 }
 
 void FlowScheduler::UpdateBatchAffinityTasksMap() {
+  vector<TaskDescriptor*> pending_tasks;
   for (auto task : no_conflict_root_tasks_) {
-    bool matched = false;
     TaskDescriptor* rtd = FindPtrOrNull(*task_map_, task);
-    if (CheckAllTasksInJobRunning(rtd)) continue;
-    for (auto it = no_conflict_tasks_map_.begin();
-              it != no_conflict_tasks_map_.end(); it++) {
-      TaskDescriptor* other_rtd = FindPtrOrNull(*task_map_, it->first);
-      if (!CheckPodAffinityNoConflictWithin(rtd, other_rtd)
-          || !CheckPodAntiAffinityNoConflictWithin(rtd, other_rtd)
-          || !CheckPodAffinityNoConflictWithin(other_rtd, rtd)
-          || !CheckPodAntiAffinityNoConflictWithin(other_rtd, rtd)) {
-        continue;
-      }
-      bool other_task_match = true;
-      for (auto other_task : it->second) {
-        other_rtd = FindPtrOrNull(*task_map_, other_task);
-        if (!CheckPodAffinityNoConflictWithin(rtd, other_rtd)
+    if (!rtd || CheckAllTasksInJobRunning(rtd)) continue;
+    pending_tasks.push_back(rtd);
+  }
+  // Only pairs that share a selected label are compared; see
+  // AffinityConflictIndex.
+  affinity_conflict_index_.GroupTasks(pending_tasks,
+      [this](TaskDescriptor* rtd, TaskDescriptor* other_rtd) {
+        return !CheckPodAffinityNoConflictWithin(rtd, other_rtd)
             || !CheckPodAntiAffinityNoConflictWithin(rtd, other_rtd)
             || !CheckPodAffinityNoConflictWithin(other_rtd, rtd)
-            || !CheckPodAntiAffinityNoConflictWithin(other_rtd, rtd)) {
-          other_task_match = false;
-          break;
-        }
-      }
-      if (!other_task_match) {
-        continue;
-      } else {
-        matched = true;
-        it->second.push_back(task);
-        InsertIfNotPresent(&no_conflict_task_mapped_, task, it->first);
-      }
-    }
-    if (!matched) {
-      vector<TaskID_t> tasks_vec;
-      InsertIfNotPresent(&no_conflict_tasks_map_, task, tasks_vec);
-    }
-  }
+            || !CheckPodAntiAffinityNoConflictWithin(other_rtd, rtd);
+      },
+      FLAGS_affinity_conflict_grouping_threads, &no_conflict_tasks_map_,
+      &no_conflict_task_mapped_);
 }
 
 uint64_t FlowScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats,
                                         vector<SchedulingDelta>* deltas) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  SchedulingRoundGuard round_guard(&scheduling_round_lock_, &scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   vector<JobDescriptor*> jobs;
   //Pod affinity/anti-affinity
   one_task_runnable = false;
@@ -726,7 +942,8 @@ uint64_t FlowScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats,
 
 uint64_t FlowScheduler::ScheduleJob(JobDescriptor* jd_ptr,
                                     SchedulerStats* scheduler_stats) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  SchedulingRoundGuard round_guard(&scheduling_round_lock_, &scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   LOG(INFO) << "START SCHEDULING (via " << jd_ptr->uuid() << ")";
   LOG(WARNING) << "This way of scheduling a job is slow in the flow scheduler! "
                << "Consider using ScheduleAllJobs() instead.";
@@ -737,7 +954,8 @@ uint64_t FlowScheduler::ScheduleJob(JobDescriptor* jd_ptr,
 uint64_t FlowScheduler::ScheduleJobs(const vector<JobDescriptor*>& jd_ptr_vect,
                                      SchedulerStats* scheduler_stats,
                                      vector<SchedulingDelta>* deltas) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  SchedulingRoundGuard round_guard(&scheduling_round_lock_, &scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   CHECK_NOTNULL(scheduler_stats);
   uint64_t num_scheduled_tasks = 0;
   boost::timer::cpu_timer total_scheduler_timer;
@@ -762,12 +980,30 @@ uint64_t FlowScheduler::ScheduleJobs(const vector<JobDescriptor*>& jd_ptr_vect,
     // known before AddOrUpdateJobNodes is invoked below, as it may add arcs
     // depending on these metrics.
     UpdateCostModelResourceStats();
+    // Gangs are admitted against the slots that are free across all the
+    // resource topologies.
+    uint64_t free_slots = 0;
+    for (auto& rtnd_ptr : resource_roots_) {
+      free_slots += CapacityFromResNodeToParent(rtnd_ptr->resource_desc());
+    }
+    GangAdmission gang_admission(free_slots);
+    GangAdmission* gang_admission_ptr = NULL;
+    if (FLAGS_gang_admission_control && !queue_based_schedule) {
+      gang_admission_ptr = &gang_admission;
+      AdmitGangJobs(&jds_with_runnables, gang_admission_ptr);
+      if (jds_with_runnables.empty() && !FLAGS_flowlessly_flip_algorithms) {
+        // Only gangs that cannot fit had runnable tasks.
+        return num_scheduled_tasks;
+      }
+    }
     if (FLAGS_gather_unscheduled_tasks)  {
       // Clear unscheduled tasks related maps and sets.
       cost_model_->ClearUnscheduledTasksData();
     }
     flow_graph_manager_->AddOrUpdateJobNodes(jds_with_runnables);
-    num_scheduled_tasks += RunSchedulingIteration(scheduler_stats, deltas, &jds_with_runnables);
+    num_scheduled_tasks += RunSchedulingIteration(scheduler_stats, deltas,
+                                                  &jds_with_runnables,
+                                                  gang_admission_ptr);
     VLOG(1) << "STOP SCHEDULING, placed " << num_scheduled_tasks << " tasks";
     // If we have cost model debug logging turned on, write some debugging
     // information now.
@@ -789,76 +1025,50 @@ uint64_t FlowScheduler::ScheduleJobs(const vector<JobDescriptor*>& jd_ptr_vect,
 void FlowScheduler::RegisterResource(ResourceTopologyNodeDescriptor* rtnd_ptr,
                                      bool local,
                                      bool simulated) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   EventDrivenScheduler::RegisterResource(rtnd_ptr, local, simulated);
   flow_graph_manager_->AddResourceTopology(rtnd_ptr);
+  if (placement_engine_) {
+    AddMachinesToPlacementEngine(rtnd_ptr);
+  }
   if (rtnd_ptr->parent_id().empty()) {
     resource_roots_.insert(rtnd_ptr);
   }
 }
 
+void FlowScheduler::RestoreTaskPlacements(
+    const vector<pair<TaskDescriptor*, ResourceDescriptor*> >& placements) {
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
+  vector<JobDescriptor*> jd_ptr_vect;
+  ComputeRunnableTasksForPlacements(placements, &jd_ptr_vect);
+  // The tasks must have nodes in the flow graph before they can be pinned
+  // to the resources on which they run. As in EventDrivenScheduler, the
+  // trace generator sees the tasks submitted (when their task nodes are
+  // added) and placed, but writes no records for them.
+  trace_generator_->set_restoring(true);
+  UpdateCostModelResourceStats();
+  flow_graph_manager_->AddOrUpdateJobNodes(jd_ptr_vect);
+  for (auto& placement : placements) {
+    HandleTaskPlacement(placement.first, placement.second);
+  }
+  trace_generator_->set_restoring(false);
+}
+
 uint64_t FlowScheduler::RunSchedulingIteration(
     SchedulerStats* scheduler_stats,
-    vector<SchedulingDelta>* deltas_output, vector<JobDescriptor*>* job_vector) {
-  // If it's time to revisit time-dependent costs, do so now, just before
-  // we run the solver.
-  uint64_t cur_time = time_manager_->GetCurrentTimestamp();
-  if (last_updated_time_dependent_costs_ <= (cur_time -
-      static_cast<uint64_t>(FLAGS_time_dependent_cost_update_frequency))) {
-    // First collect all non-finished jobs
-    // TODO(malte): this can be removed when we've factored archived tasks
-    // and jobs out of the job_map_ into separate data structures.
-    // (cf. issue #24).
-    /*
-    vector<JobDescriptor*> job_vec;
-    for (auto it = job_map_->begin();
-         it != job_map_->end();
-         ++it) {
-      // We only need to reconsider this job if it is still active
-      if (it->second.state() != JobDescriptor::COMPLETED &&
-          it->second.state() != JobDescriptor::FAILED &&
-          it->second.state() != JobDescriptor::ABORTED) {
-        job_vec.push_back(&it->second);
-      }
-    }
-    */
-    // This will re-visit all jobs and update their time-dependent costs
-    // Changed above code to revisit only jobs from job_vector not from
-    // job_map_ i.e, jobs with pod affinty and pod anti-affinity are handled
-    // in sepearte scheduling round even for time dependent costs update.
-    // Jobs with pod affinty/anti-affinty are scheduled one task at a time
-    // in a single scheduling round, whereas for other jobs tasks are
-    // scheduled in a batch.
-    VLOG(1) << "Flow scheduler updating time-dependent costs.";
-    vector<JobDescriptor*> job_vec;
-    for (auto it = (*job_vector).begin();
-         it != (*job_vector).end();
-         ++it) {
-      // We only need to reconsider this job if it is still active
-      if ((*it)->state() != JobDescriptor::COMPLETED &&
-          (*it)->state() != JobDescriptor::FAILED &&
-          (*it)->state() != JobDescriptor::ABORTED) {
-        job_vec.push_back(*it);
-      }
-    }
-    if (FLAGS_gather_unscheduled_tasks)  {
-      // Clear unscheduled tasks related maps and sets.
-      cost_model_->ClearUnscheduledTasksData();
-    }
-    flow_graph_manager_->UpdateTimeDependentCosts(job_vec);
-    last_updated_time_dependent_costs_ = cur_time;
-  }
+    vector<SchedulingDelta>* deltas_output, vector<JobDescriptor*>* job_vector,
+    GangAdmission* gang_admission) {
   if (solver_run_cnt_ % FLAGS_purge_unconnected_ec_frequency == 0) {
     // Periodically remove EC nodes without incoming arcs.
     flow_graph_manager_->PurgeUnconnectedEquivClassNodes();
   }
-  pus_removed_during_solver_run_.clear();
-  tasks_completed_during_solver_run_.clear();
   uint64_t scheduler_start_timestamp = time_manager_->GetCurrentTimestamp();
   // Run the flow solver! This is where all the juicy goodness happens :)
   multimap<uint64_t, uint64_t>* task_mappings;
-  if (!queue_based_schedule) {
-    task_mappings = solver_dispatcher_->Run(scheduler_stats);
+  if (gang_admission) {
+    task_mappings = RunSolverForGangs(scheduler_stats, gang_admission);
+  } else if (!queue_based_schedule) {
+    task_mappings = RunSolver(scheduler_stats);
   } else {
       string id = ((*job_vector)[0])->uuid();
       TaskID_t single_task_id = *(runnable_tasks_[JobIDFromString(id)].begin());
@@ -872,9 +1082,6 @@ uint64_t FlowScheduler::RunSchedulingIteration(
                                                                  single_delta);
   }
   solver_run_cnt_++;
-  CHECK_LE(scheduler_stats->scheduler_runtime_, FLAGS_max_solver_runtime)
-    << "Solver took longer than limit of "
-    << scheduler_stats->scheduler_runtime_;
   // Play all the simulation events that happened while the solver was running.
   if (event_notifier_) {
     if (solver_run_cnt_ == 1) {
@@ -906,34 +1113,19 @@ uint64_t FlowScheduler::RunSchedulingIteration(
       }
     }
   }
-  // Solver's done, let's post-process the results.
+  // Solver's done, let's post-process the results. Drop the mappings of
+  // tasks and PUs that went away during the solve, including those the
+  // notifier has just completed or removed.
+  flow_graph_manager_->RemoveStaleTaskMappings(task_mappings);
   multimap<uint64_t, uint64_t>::iterator it;
   vector<SchedulingDelta*> deltas;
-  // We first generate the deltas for the preempted tasks in a separate step.
-  // Otherwise, we would have to maintain for every ResourceDescriptor the
-  // current_running_tasks field which would be expensive because
-  // RepeatedFields don't have any efficient remove element method.
+  // We first generate the deltas for the preempted tasks in a separate step,
+  // diffing the task bindings against the solver's mappings.
   flow_graph_manager_->SchedulingDeltasForPreemptedTasks(*task_mappings,
+                                                         task_bindings_,
                                                          resource_map_,
                                                          &deltas);
   for (it = task_mappings->begin(); it != task_mappings->end(); it++) {
-    if (tasks_completed_during_solver_run_.find(it->first) !=
-        tasks_completed_during_solver_run_.end()) {
-      // Ignore the task because it has already completed while the solver
-      // was running.
-      VLOG(1) << "Task with node id: " << it->first
-              << " completed while the solver was running";
-      continue;
-    }
-    if (pus_removed_during_solver_run_.find(it->second) !=
-        pus_removed_during_solver_run_.end()) {
-      // We can't place a task on this PU because the PU has been removed
-      // while the solver was running. We will reconsider the task in the
-      // next solver run.
-      VLOG(1) << "PU with node id: " << it->second
-              << " was removed while the solver was running";
-      continue;
-    }
     VLOG(2) << "Bind " << it->first << " to " << it->second << endl;
     flow_graph_manager_->NodeBindingToSchedulingDeltas(it->first, it->second,
                                                        &task_bindings_,
@@ -1003,6 +1195,97 @@ uint64_t FlowScheduler::RunSchedulingIteration(
   return num_scheduled;
 }
 
+multimap<uint64_t, uint64_t>* FlowScheduler::RunSolverForGangs(
+    SchedulerStats* scheduler_stats, GangAdmission* gang_admission) {
+  uint64_t scheduler_runtime = 0;
+  uint64_t algorithm_runtime = 0;
+  while (true) {
+    multimap<uint64_t, uint64_t>* task_mappings = RunSolver(scheduler_stats);
+    scheduler_runtime += scheduler_stats->scheduler_runtime_;
+    if (algorithm_runtime != numeric_limits<uint64_t>::max()) {
+      algorithm_runtime =
+        scheduler_stats->algorithm_runtime_ == numeric_limits<uint64_t>::max()
+        ? numeric_limits<uint64_t>::max()
+        : algorithm_runtime + scheduler_stats->algorithm_runtime_;
+    }
+    scheduler_stats->scheduler_runtime_ = scheduler_runtime;
+    scheduler_stats->algorithm_runtime_ = algorithm_runtime;
+    if (!gang_admission->num_admitted_gangs()) {
+      return task_mappings;
+    }
+    flow_graph_manager_->RemoveStaleTaskMappings(task_mappings);
+    unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>> num_placed_tasks;
+    for (auto& mapping : *task_mappings) {
+      const FlowGraphNode& task_node =
+        flow_graph_manager_->node_for_node_id(mapping.first);
+      num_placed_tasks[task_node.job_id_]++;
+    }
+    vector<JobID_t> short_gangs;
+    gang_admission->CollectShortGangs(num_placed_tasks, &short_gangs);
+    // The scheduling lock is released while the solver runs, so a gang may
+    // have completed or been removed in the meantime. CollectShortGangs no
+    // longer considers it admitted, and there is nothing left to hold back.
+    vector<JobDescriptor*> short_gang_jds;
+    for (auto& job_id : short_gangs) {
+      JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
+      if (!jd_ptr) {
+        VLOG(1) << "Gang job " << to_string(job_id) << " went away during "
+                << "the solver run";
+        continue;
+      }
+      short_gang_jds.push_back(jd_ptr);
+    }
+    if (short_gang_jds.empty()) {
+      return task_mappings;
+    }
+    // Each rerun holds back at least one more gang, so this terminates.
+    delete task_mappings;
+    for (auto& jd_ptr : short_gang_jds) {
+      VLOG(1) << "Gang job " << jd_ptr->uuid() << " did not fit, rerunning "
+              << "the solver without it";
+      flow_graph_manager_->HoldUnscheduledJobTasks(*jd_ptr);
+      delta_jobs.insert(jd_ptr);
+    }
+  }
+}
+
+multimap<uint64_t, uint64_t>* FlowScheduler::RunSolver(
+    SchedulerStats* scheduler_stats) {
+  if (partitioned_solver_dispatcher_) {
+    partitioned_solver_dispatcher_->ExportSnapshot();
+  } else {
+    solver_dispatcher_->ExportSnapshot();
+  }
+  multimap<uint64_t, uint64_t>* task_mappings;
+  // Let events through while the solver runs. They update the flow graph
+  // and their changes are exported in the next round. The round lock stays
+  // held, so no other round starts in the meantime; the round's flags are
+  // restored regardless, as the rest of the round depends on them.
+  bool round_affinity_batch_schedule = affinity_batch_schedule;
+  bool round_queue_based_schedule = queue_based_schedule;
+  uint32_t lock_depth =
+    FLAGS_pipeline_solver_runs ? scheduling_lock_.ReleaseAll() : 0;
+  if (partitioned_solver_dispatcher_) {
+    task_mappings = partitioned_solver_dispatcher_->Solve(scheduler_stats);
+  } else {
+    task_mappings = solver_dispatcher_->Solve(scheduler_stats);
+  }
+  if (FLAGS_pipeline_solver_runs) {
+    scheduling_lock_.ReacquireAll(lock_depth);
+    affinity_batch_schedule = round_affinity_batch_schedule;
+    queue_based_schedule = round_queue_based_schedule;
+  }
+  if (task_mappings == NULL) {
+    // The solver missed its deadline. Place tasks greedily on the current
+    // graph so that the round still makes progress.
+    LOG(WARNING) << "Using greedy placements because the solver missed its "
+                 << "deadline";
+    scheduler_stats->placement_source_ = GREEDY_FALLBACK_PLACEMENTS;
+    return flow_graph_manager_->ComputeGreedyTaskMappings();
+  }
+  return task_mappings;
+}
+
 void FlowScheduler::UpdateCostModelResourceStats() {
   VLOG(2) << "Updating resource statistics in flow graph";
   flow_graph_manager_->ComputeTopologyStatistics(
@@ -1010,6 +1293,10 @@ void FlowScheduler::UpdateCostModelResourceStats() {
       boost::bind(&CostModelInterface::PrepareStats, cost_model_, _1),
       boost::bind(&CostModelInterface::GatherStats, cost_model_, _1, _2),
       boost::bind(&CostModelInterface::UpdateStats, cost_model_, _1, _2));
+  if (placement_engine_) {
+    // The cost model may have changed the machines' available resources.
+    placement_engine_->RefreshMachines();
+  }
 }
 
 void FlowScheduler::AddKnowledgeBaseResourceStats(TaskDescriptor* td_ptr,
@@ -1052,27 +1339,26 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
                     unordered_set<uint64_t>* unscheduled_affinity_tasks_set,
                     vector<uint64_t>* unscheduled_affinity_tasks) {
   // update batch schedule deltas
+  unordered_set<uint64_t> unscheduled_batch_tasks_set(
+      unscheduled_batch_tasks->begin(), unscheduled_batch_tasks->end());
   for (auto job_ptr : delta_jobs) {
     TaskDescriptor rtd = job_ptr->root_task();
     for (auto td : rtd.spawned()) {
-      vector<uint64_t>::iterator it = find(unscheduled_batch_tasks->begin(),
-                                      unscheduled_batch_tasks->end(),
-                                      td.uid());
-      if (it == unscheduled_batch_tasks->end()) {
+      if (unscheduled_batch_tasks_set.insert(td.uid()).second) {
         unscheduled_batch_tasks->push_back(td.uid());
       }
     }
-    delta_jobs.clear();
-
-    vector<uint64_t>::iterator rit = find(unscheduled_batch_tasks->begin(),
-                                     unscheduled_batch_tasks->end(),
-                                     rtd.uid());
-    if (rit == unscheduled_batch_tasks->end()) {
+    if (unscheduled_batch_tasks_set.insert(rtd.uid()).second) {
       unscheduled_batch_tasks->push_back(rtd.uid());
     }
   }
+  delta_jobs.clear();
 
   // update queue schedule deltas
+  unordered_set<TaskID_t> queued_affinity_tasks(
+      affinity_antiaffinity_tasks_->begin(),
+      affinity_antiaffinity_tasks_->end());
+  unordered_set<TaskID_t> undone_delta_tasks;
   for (auto it = affinity_job_to_deltas_.begin();
             it != affinity_job_to_deltas_.end(); ++it) {
     JobDescriptor* jd_ptr = it->first;
@@ -1105,10 +1391,7 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
         td_ptr->clear_scheduled_to_resource();
         if (no_conflict_root_tasks_.find(root_td.uid())
                                     == no_conflict_root_tasks_.end()) {
-          vector<TaskID_t>::iterator it =
-                          find(affinity_antiaffinity_tasks_->begin(),
-                          affinity_antiaffinity_tasks_->end(), td_ptr->uid());
-          if (it == affinity_antiaffinity_tasks_->end()) {
+          if (queued_affinity_tasks.insert(td_ptr->uid()).second) {
             affinity_antiaffinity_tasks_->push_back(td_ptr->uid());
           }
         }
@@ -1118,12 +1401,7 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
         if (runnables_for_job) {
           runnables_for_job->erase(delta.task_id());
         }
-        vector<SchedulingDelta>::iterator it =
-              find_if(deltas_output->begin(), deltas_output->end(),
-              [&](SchedulingDelta& d){return (d.task_id() == delta.task_id());});
-        if (it != deltas_output->end()) {
-          deltas_output->erase(it);
-        }
+        undone_delta_tasks.insert(delta.task_id());
       }
       for (auto td : root_td.spawned()) {
         unscheduled_affinity_tasks_set->insert(td.uid());
@@ -1146,6 +1424,15 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
     jd_ptr->set_scheduled_tasks_count(0);
     it->second.clear();
   }
+  if (!undone_delta_tasks.empty()) {
+    // Drop the first delta of each undone task from the output.
+    deltas_output->erase(
+        remove_if(deltas_output->begin(), deltas_output->end(),
+                  [&](const SchedulingDelta& delta) {
+                    return undone_delta_tasks.erase(delta.task_id()) > 0;
+                  }),
+        deltas_output->end());
+  }
   affinity_delta_tasks.clear();
 }
 
@@ -34,6 +34,7 @@
 #include "base/task_desc.pb.h"
 #include "engine/executors/executor_interface.h"
 #include "misc/time_interface.h"
+#include "scheduling/affinity_placement_engine.h"
 #include "scheduling/event_driven_scheduler.h"
 #include "scheduling/knowledge_base.h"
 #include "scheduling/scheduling_delta.pb.h"
@@ -41,6 +42,8 @@
 #include "scheduling/flow/dimacs_change_stats.h"
 #include "scheduling/flow/dimacs_exporter.h"
 #include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/gang_admission.h"
+#include "scheduling/flow/partitioned_solver_dispatcher.h"
 #include "scheduling/flow/solver_dispatcher.h"
 #include "storage/reference_interface.h"
 
@@ -90,6 +93,8 @@ class FlowScheduler : public EventDrivenScheduler {
   virtual void RegisterResource(ResourceTopologyNodeDescriptor* rtnd_ptr,
                                 bool local,
                                 bool simulated);
+  virtual void RestoreTaskPlacements(
+      const vector<pair<TaskDescriptor*, ResourceDescriptor*> >& placements);
   virtual uint64_t ScheduleAllJobs(SchedulerStats* scheduler_stats);
   virtual vector<TaskID_t>* ScheduleAllAffinityBatchJobs(
                                       SchedulerStats* scheduler_stats,
@@ -124,6 +129,9 @@ class FlowScheduler : public EventDrivenScheduler {
   const SolverDispatcher& dispatcher() const {
     return *solver_dispatcher_;
   }
+  FlowGraphManager* flow_graph_manager() {
+    return flow_graph_manager_.get();
+  }
 
   TaskID_t GetSingleTaskTobeScheduled() {
     TaskID_t task_id = task_to_be_scheduled_;
@@ -137,6 +145,14 @@ class FlowScheduler : public EventDrivenScheduler {
                                    ResourceDescriptor* rd_ptr);
 
  private:
+  /**
+   * Holds back the gang jobs that cannot get their minimum number of tasks
+   * placed with the free slots left in the cluster.
+   * @param jds the jobs with runnable tasks; held back gangs are removed
+   * @param gang_admission the admission state of this scheduling round
+   */
+  void AdmitGangJobs(vector<JobDescriptor*>* jds,
+                     GangAdmission* gang_admission);
   uint64_t ApplySchedulingDeltas(const vector<SchedulingDelta*>& deltas);
   void HandleTasksFromDeregisteredResource(
       ResourceTopologyNodeDescriptor* rtnd_ptr);
@@ -145,10 +161,57 @@ class FlowScheduler : public EventDrivenScheduler {
   void RegisterLocalResource(ResourceID_t res_id);
   void RegisterRemoteResource(ResourceID_t res_id);
   uint64_t RunSchedulingIteration(SchedulerStats* scheduler_stats,
-    vector<SchedulingDelta>* deltas_output, vector<JobDescriptor*>* job_vector);
+    vector<SchedulingDelta>* deltas_output, vector<JobDescriptor*>* job_vector,
+    GangAdmission* gang_admission = NULL);
+  /**
+   * Runs the solver until every admitted gang gets at least its minimum
+   * number of tasks. Gangs that fall short are held back and the solver is
+   * rerun, so the capacity they would have used goes to the other jobs.
+   * @param scheduler_stats the stats in which to accumulate the runtimes
+   * @param gang_admission the admission state of this scheduling round
+   * @return the task node to resource node mappings of the last run
+   */
+  multimap<uint64_t, uint64_t>* RunSolverForGangs(
+      SchedulerStats* scheduler_stats, GangAdmission* gang_admission);
+  /**
+   * Runs the solver on the current flow graph. With --pipeline_solver_runs
+   * the scheduling lock is released while the solver runs. The mappings may
+   * then refer to tasks and PUs that went away, and callers must drop them
+   * with FlowGraphManager::RemoveStaleTaskMappings before using them. If the
+   * solver misses its deadline, the tasks are placed greedily instead.
+   * @param scheduler_stats the stats to which to write the solver runtimes
+   * and the source of the placements
+   * @return the task node to resource node mappings
+   */
+  multimap<uint64_t, uint64_t>* RunSolver(SchedulerStats* scheduler_stats);
   void UpdateCostModelResourceStats();
   void AddKnowledgeBaseResourceStats(TaskDescriptor* td_ptr,
                                                  ResourceStatus* rs);
+  void AddMachinesToPlacementEngine(ResourceTopologyNodeDescriptor* rtnd_ptr);
+  void RemoveMachinesFromPlacementEngine(
+      ResourceTopologyNodeDescriptor* rtnd_ptr);
+  /**
+   * Places the task at the front of the affinity queue on the machine the
+   * placement engine picks, without running the solver.
+   * @param td_ptr the task to place
+   * @param jd_ptr the task's job
+   * @param deltas vector to which the placement delta is appended
+   * @param num_scheduled set to the number of tasks placed
+   * @return false if no PU of the chosen machine has a free slot, in which
+   * case the task has to be scheduled by the solver
+   */
+  bool ScheduleQueueTaskFromIndex(TaskDescriptor* td_ptr,
+                                  JobDescriptor* jd_ptr,
+                                  vector<SchedulingDelta>* deltas,
+                                  uint64_t* num_scheduled);
+  /**
+   * Finds the PU below a machine that runs the fewest tasks, among those
+   * running fewer than --max_tasks_per_pu.
+   * @param machine_res_id the resource id of the machine
+   * @return the PU's descriptor, or NULL if every PU is full
+   */
+  const ResourceDescriptor* LeastLoadedPUWithFreeSlot(
+      ResourceID_t machine_res_id);
   void UpdateBatchAffinityTasksMap();
   void RemoveAffinityAntiAffinityJobData(JobID_t job_id);
   bool CheckAllTasksInJobRunning(TaskDescriptor* rtd);
@@ -159,27 +222,23 @@ class FlowScheduler : public EventDrivenScheduler {
   shared_ptr<FlowGraphManager> flow_graph_manager_;
   // The dispatcher runs different flow solvers.
   SolverDispatcher* solver_dispatcher_;
+  // Solves the node pools separately. NULL unless
+  // --flow_partition_label_key is set.
+  PartitionedSolverDispatcher* partitioned_solver_dispatcher_;
   // The scheduler's active cost model, used to construct the flow network and
   // assign costs to edges
   CostModelInterface* cost_model_;
-  // Timestamp when the time-dependent costs in the graph were last updated
-  uint64_t last_updated_time_dependent_costs_;
   // Set containing the resource ids of the PUs.
   unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>* leaf_res_ids_;
-  // Set storing the graph node id of the PUs that have been removed
-  // while the solver was running. This set is used to make sure we don't
-  // place tasks on PUs that have been removed.
-  set<uint64_t> pus_removed_during_solver_run_;
-  // Set of task node ids that have completed while the solver was running.
-  // We use this set to make sure we don't try to place again the completed
-  // tasks.
-  set<uint64_t> tasks_completed_during_solver_run_;
   DIMACSChangeStats* dimacs_stats_;
   uint64_t solver_run_cnt_;
   unordered_set<ResourceTopologyNodeDescriptor*> resource_roots_;
   // Single task that needs to scheduled in queue based scheduling round.
   TaskID_t task_to_be_scheduled_;
   unordered_set<TaskID_t> affinity_batch_job_schedule_;
+  // Places queued pod affinity/anti-affinity tasks without solver runs.
+  // NULL unless --affinity_placement_index is set.
+  AffinityPlacementEngine* placement_engine_;
 };
 
 }  // namespace scheduler
@@ -0,0 +1,584 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the flow scheduler. The flow solver is replaced by a shell script
+// that reads the graph and returns no flow, so every placement seen here
+// comes from the scheduler itself.
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "base/resource_status.h"
+#include "misc/map-util.h"
+#include "misc/trace_generator.h"
+#include "misc/utils.h"
+#include "misc/wall_time.h"
+#include "scheduling/flow/cost_model_interface.h"
+#include "scheduling/flow/flow_scheduler.h"
+#include "scheduling/knowledge_base.h"
+#include "scheduling/scheduling_event_notifier_interface.h"
+#include "storage/simple_object_store.h"
+
+DECLARE_bool(affinity_placement_index);
+DECLARE_string(custom_flow_scheduling_args);
+DECLARE_string(flow_scheduling_binary);
+DECLARE_string(flow_scheduling_solver);
+DECLARE_bool(pipeline_solver_runs);
+
+namespace firmament {
+namespace scheduler {
+
+// Event notifier that runs a callback once the scheduler has taken its
+// decisions, like the simulator does to replay the events that happened
+// while the solver ran.
+class CallbackEventNotifier : public SchedulingEventNotifierInterface {
+ public:
+  void OnJobCompletion(JobID_t job_id) {}
+  void OnJobRemoval(JobID_t job_id) {}
+  void OnSchedulingDecisionsCompletion(uint64_t scheduler_start_time,
+                                       uint64_t scheduler_runtime) {
+    if (!on_decisions_completion_.empty()) {
+      boost::function<void()> callback = on_decisions_completion_;
+      on_decisions_completion_.clear();
+      callback();
+    }
+  }
+  void OnTaskCompletion(TaskDescriptor* td_ptr, ResourceDescriptor* rd_ptr) {}
+  void OnTaskEviction(TaskDescriptor* td_ptr, ResourceDescriptor* rd_ptr) {}
+  void OnTaskFailure(TaskDescriptor* td_ptr, ResourceDescriptor* rd_ptr) {}
+  void OnTaskMigration(TaskDescriptor* td_ptr, ResourceDescriptor* old_rd_ptr,
+                       ResourceDescriptor* rd_ptr) {}
+  void OnTaskPlacement(TaskDescriptor* td_ptr, ResourceDescriptor* rd_ptr) {}
+
+  // Runs once, on the next completion of the scheduling decisions.
+  boost::function<void()> on_decisions_completion_;
+};
+
+class FlowSchedulerTest : public ::testing::Test {
+ protected:
+  FlowSchedulerTest()
+    : job_map_(new JobMap_t),
+      resource_map_(new ResourceMap_t),
+      task_map_(new TaskMap_t),
+      knowledge_base_(new KnowledgeBase),
+      trace_generator_(&wall_time_) {
+  }
+
+  virtual void SetUp() {
+    char solver_dir[] = "/tmp/flow_scheduler_test_XXXXXX";
+    CHECK_NOTNULL(mkdtemp(solver_dir));
+    solver_dir_ = solver_dir;
+    // Reads the graph and returns no flow.
+    WriteSolver("cat > /dev/null\n"
+                "echo 'c EOI'\n");
+    FLAGS_flow_scheduling_cost_model = COST_MODEL_TRIVIAL;
+    FLAGS_flow_scheduling_solver = "custom";
+    FLAGS_flow_scheduling_binary = solver_dir_ + "/solver.sh";
+  }
+
+  virtual void TearDown() {
+    scheduler_.reset();
+    for (auto& res_id_status : *resource_map_) {
+      delete res_id_status.second;
+    }
+    boost::filesystem::remove_all(solver_dir_);
+    FLAGS_flow_scheduling_solver = "cs2";
+    FLAGS_flow_scheduling_binary = "";
+    FLAGS_affinity_placement_index = false;
+    FLAGS_pipeline_solver_runs = false;
+  }
+
+  void WriteSolver(const string& script) {
+    string solver_path = solver_dir_ + "/solver.sh";
+    ofstream solver_file(solver_path.c_str());
+    solver_file << "#!/bin/sh\n" << script;
+    solver_file.close();
+    CHECK_EQ(chmod(solver_path.c_str(), 0755), 0);
+  }
+
+  void CreateScheduler(
+      SchedulingEventNotifierInterface* event_notifier = NULL) {
+    ResourceID_t root_res_id = GenerateRootResourceID("flow_scheduler_test");
+    ResourceDescriptor* root_rd = rtn_root_.mutable_resource_desc();
+    root_rd->set_uuid(to_string(root_res_id));
+    root_rd->set_type(ResourceDescriptor::RESOURCE_COORDINATOR);
+    AddResourceStatus(&rtn_root_);
+    scheduler_.reset(new FlowScheduler(
+        job_map_, resource_map_, &rtn_root_,
+        shared_ptr<store::ObjectStoreInterface>(
+            new store::SimpleObjectStore(root_res_id)),
+        task_map_, knowledge_base_,
+        shared_ptr<TopologyManager>(new TopologyManager),
+        NULL, event_notifier, root_res_id, "http://localhost", &wall_time_,
+        &trace_generator_, &labels_map_, &affinity_tasks_));
+    scheduler_->RegisterResource(&rtn_root_, false, true);
+  }
+
+  void AddResourceStatus(ResourceTopologyNodeDescriptor* rtnd_ptr) {
+    ResourceDescriptor* rd_ptr = rtnd_ptr->mutable_resource_desc();
+    CHECK(InsertIfNotPresent(resource_map_.get(),
+                             ResourceIDFromString(rd_ptr->uuid()),
+                             new ResourceStatus(rd_ptr, rtnd_ptr, "", 0)));
+  }
+
+  // Adds a machine with the given number of PUs and CPU cores (one per PU
+  // by default) and returns the resource id of its first PU.
+  ResourceID_t AddMachine(const string& name, uint32_t num_pus,
+                          uint32_t num_cores = 0) {
+    ResourceTopologyNodeDescriptor* machine_rtnd = rtn_root_.add_children();
+    machine_rtnd->set_parent_id(rtn_root_.resource_desc().uuid());
+    ResourceDescriptor* machine_rd = machine_rtnd->mutable_resource_desc();
+    machine_rd->set_uuid(to_string(GenerateResourceID(name)));
+    machine_rd->set_friendly_name(name);
+    machine_rd->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    machine_rd->set_max_pods(110);
+    ResourceVector* capacity = machine_rd->mutable_resource_capacity();
+    capacity->set_cpu_cores(num_cores ? num_cores : num_pus);
+    capacity->set_ram_cap(65536);
+    capacity->set_ephemeral_storage(100000);
+    machine_rd->mutable_available_resources()->CopyFrom(*capacity);
+    AddResourceStatus(machine_rtnd);
+    for (uint32_t index = 0; index < num_pus; ++index) {
+      ResourceTopologyNodeDescriptor* pu_rtnd = machine_rtnd->add_children();
+      pu_rtnd->set_parent_id(machine_rd->uuid());
+      ResourceDescriptor* pu_rd = pu_rtnd->mutable_resource_desc();
+      pu_rd->set_uuid(to_string(GenerateResourceID()));
+      pu_rd->set_friendly_name(name + " PU #" + to_string(index));
+      pu_rd->set_type(ResourceDescriptor::RESOURCE_PU);
+      AddResourceStatus(pu_rtnd);
+    }
+    scheduler_->RegisterResource(machine_rtnd, false, true);
+    return ResourceIDFromString(
+        machine_rtnd->children(0).resource_desc().uuid());
+  }
+
+  // Sets up a task of the given job that requests one core and is labelled
+  // with the job's app, and adds it to the task map.
+  void InitTask(const JobDescriptor& jd, const string& app,
+                TaskDescriptor* td_ptr) {
+    td_ptr->set_job_id(jd.uuid());
+    td_ptr->set_state(TaskDescriptor::CREATED);
+    td_ptr->set_task_namespace("default");
+    Label* label = td_ptr->add_labels();
+    label->set_key("app");
+    label->set_value(app);
+    ResourceVector* request = td_ptr->mutable_resource_request();
+    request->set_cpu_cores(1);
+    request->set_ram_cap(1024);
+    request->set_ephemeral_storage(1);
+    CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+  }
+
+  // Adds a job with a single task, which has an anti-affinity to its own
+  // label if anti_affinity is set.
+  JobDescriptor* AddJob(const string& app, bool anti_affinity) {
+    JobID_t job_id = GenerateJobID();
+    JobDescriptor jd;
+    jd.set_uuid(to_string(job_id));
+    jd.set_name(app);
+    CHECK(InsertIfNotPresent(job_map_.get(), job_id, jd));
+    JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
+    TaskDescriptor* td_ptr = jd_ptr->mutable_root_task();
+    td_ptr->set_uid(GenerateRootTaskID(*jd_ptr));
+    if (anti_affinity) {
+      PodAffinityTermAntiAff* term =
+        td_ptr->mutable_affinity()->mutable_pod_anti_affinity()
+          ->add_requiredduringschedulingignoredduringexecution();
+      LabelSelectorRequirementAntiAff* expression =
+        term->mutable_labelselector()->add_matchexpressions();
+      expression->set_key("app");
+      expression->set_operator_("In");
+      expression->add_values(app);
+      affinity_tasks_.push_back(td_ptr->uid());
+    }
+    InitTask(*jd_ptr, app, td_ptr);
+    scheduler_->AddJob(jd_ptr);
+    return jd_ptr;
+  }
+
+  // Adds a gang-scheduled job whose tasks must all be placed together.
+  JobDescriptor* AddGangJob(const string& app, uint32_t num_tasks) {
+    JobID_t job_id = GenerateJobID();
+    JobDescriptor jd;
+    jd.set_uuid(to_string(job_id));
+    jd.set_name(app);
+    jd.set_is_gang_scheduling_job(true);
+    jd.set_min_number_of_tasks(num_tasks);
+    CHECK(InsertIfNotPresent(job_map_.get(), job_id, jd));
+    JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
+    TaskDescriptor* root_td_ptr = jd_ptr->mutable_root_task();
+    root_td_ptr->set_uid(GenerateRootTaskID(*jd_ptr));
+    InitTask(*jd_ptr, app, root_td_ptr);
+    for (uint32_t index = 1; index < num_tasks; ++index) {
+      TaskID_t task_id = GenerateTaskID(*root_td_ptr, index);
+      TaskDescriptor* td_ptr = root_td_ptr->add_spawned();
+      td_ptr->set_uid(task_id);
+      InitTask(*jd_ptr, app, td_ptr);
+    }
+    scheduler_->AddJob(jd_ptr);
+    return jd_ptr;
+  }
+
+  // Replaces the solver with one that places each task on its own PU, in
+  // the order in which the graph lists them, until it runs out of PUs.
+  void WriteMappingSolver() {
+    WriteSolver("awk '$1 == \"n\" && $4 == 1 { tasks[num_tasks++] = $2 }\n"
+                "     $1 == \"n\" && $4 == 2 { pus[num_pus++] = $2 }\n"
+                "     $1 == \"n\" && $4 == 3 { sink = $2 }\n"
+                "     END {\n"
+                "       for (i = 0; i < num_tasks && i < num_pus; ++i) {\n"
+                "         print \"f\", tasks[i], pus[i], 1\n"
+                "         print \"f\", pus[i], sink, 1\n"
+                "       }\n"
+                "       print \"c EOI\"\n"
+                "     }'\n");
+  }
+
+  // Replaces the solver with one that follows a script: its n-th run places
+  // at most as many new tasks as line n of the "limits" file says. Only the
+  // tasks that still have arcs to equivalence classes are placed, each on a
+  // PU that no running task uses. Running tasks stay on their PU. Every run
+  // appends a line to the "runs" file.
+  void WriteScriptedSolver(const string& limits) {
+    ofstream limits_file((solver_dir_ + "/limits").c_str());
+    limits_file << limits;
+    limits_file.close();
+    WriteSolver("awk -v dir=" + solver_dir_ + " '\n"
+                "  $1 == \"c\" && $2 == \"nd\" { comment = $3; next }\n"
+                "  $1 == \"n\" && $4 == 1 { tasks[num_tasks++] = $2 }\n"
+                "  $1 == \"n\" && $4 == 2 { pus[num_pus++] = $2 }\n"
+                "  $1 == \"n\" && $4 == 2 { is_pu[$2] = 1 }\n"
+                "  $1 == \"n\" && $4 == 3 { sink = $2 }\n"
+                "  $1 == \"n\" && comment ~ /^EC_/ { ecs[$2] = 1 }\n"
+                "  $1 == \"n\" { comment = \"\" }\n"
+                "  $1 == \"a\" && ($3 in ecs) { waiting[$2] = 1 }\n"
+                "  $1 == \"a\" && ($3 in is_pu) { task_pu[$2] = $3 }\n"
+                "  END {\n"
+                "    while ((getline line < (dir \"/runs\")) > 0) ++num_runs\n"
+                "    print \"run\" >> (dir \"/runs\")\n"
+                "    for (i = 0; (getline line < (dir \"/limits\")) > 0; ++i)\n"
+                "      if (i == num_runs) limit = line\n"
+                "    for (i = 0; i < num_tasks; ++i) {\n"
+                "      task = tasks[i]\n"
+                "      if ((task in task_pu) && !(task in waiting)) {\n"
+                "        print \"f\", task, task_pu[task], 1\n"
+                "        print \"f\", task_pu[task], sink, 1\n"
+                "        used[task_pu[task]] = 1\n"
+                "      }\n"
+                "    }\n"
+                "    pu = 0\n"
+                "    for (i = 0; i < num_tasks && limit > 0; ++i) {\n"
+                "      if (!(tasks[i] in waiting)) continue\n"
+                "      while (pu < num_pus && (pus[pu] in used)) ++pu\n"
+                "      if (pu == num_pus) break\n"
+                "      print \"f\", tasks[i], pus[pu], 1\n"
+                "      print \"f\", pus[pu], sink, 1\n"
+                "      used[pus[pu]] = 1\n"
+                "      --limit\n"
+                "    }\n"
+                "    print \"c EOI\"\n"
+                "  }'\n");
+  }
+
+  // Waits up to 10 seconds for a file in the solver directory to exist.
+  bool WaitForSolverFile(const string& name) {
+    for (uint32_t i = 0; i < 1000; ++i) {
+      if (boost::filesystem::exists(solver_dir_ + "/" + name)) {
+        return true;
+      }
+      usleep(10000);
+    }
+    return false;
+  }
+
+  // Returns the number of lines in a file in the solver directory.
+  uint32_t SolverFileLines(const string& name) {
+    ifstream file((solver_dir_ + "/" + name).c_str());
+    uint32_t num_lines = 0;
+    string line;
+    while (getline(file, line)) {
+      ++num_lines;
+    }
+    return num_lines;
+  }
+
+  // Returns the task's node in the flow graph, or NULL if it has none.
+  const FlowGraphNode* TaskNode(TaskID_t task_id) {
+    for (auto& id_node :
+         scheduler_->flow_graph_manager()->flow_graph_change_manager()
+           ->flow_graph().Nodes()) {
+      const FlowGraphNode* node = id_node.second;
+      if (node->IsTaskNode() && node->td_ptr_->uid() == task_id) {
+        return node;
+      }
+    }
+    return NULL;
+  }
+
+  WallTime wall_time_;
+  shared_ptr<JobMap_t> job_map_;
+  shared_ptr<ResourceMap_t> resource_map_;
+  shared_ptr<TaskMap_t> task_map_;
+  shared_ptr<KnowledgeBase> knowledge_base_;
+  TraceGenerator trace_generator_;
+  ResourceTopologyNodeDescriptor rtn_root_;
+  unordered_map<string, unordered_map<string, vector<TaskID_t>>> labels_map_;
+  vector<TaskID_t> affinity_tasks_;
+  scoped_ptr<FlowScheduler> scheduler_;
+  string solver_dir_;
+};
+
+// Tests that a queued anti-affinity task placed from the placement engine
+// is pinned to its PU, and that the next solver run still sees it running.
+TEST_F(FlowSchedulerTest, QueueTaskPlacedFromIndexStaysRunning) {
+  FLAGS_affinity_placement_index = true;
+  CreateScheduler();
+  ResourceID_t pu_res_id = AddMachine("machine", 2);
+  JobDescriptor* first_jd_ptr = AddJob("web", true);
+  JobDescriptor* second_jd_ptr = AddJob("cache", true);
+  TaskDescriptor* first_td_ptr = first_jd_ptr->mutable_root_task();
+  TaskID_t first_task_id = first_td_ptr->uid();
+  TaskID_t second_task_id = second_jd_ptr->root_task().uid();
+  SchedulerStats scheduler_stats;
+  vector<SchedulingDelta> deltas;
+  CHECK_EQ(scheduler_->ScheduleAllQueueJobs(&scheduler_stats, &deltas), 1);
+  // The placed task moves to the back of the queue.
+  CHECK_EQ(affinity_tasks_.size(), 2);
+  CHECK_EQ(affinity_tasks_[0], second_task_id);
+  CHECK_EQ(affinity_tasks_[1], first_task_id);
+  CHECK_EQ(deltas.size(), 1);
+  CHECK_EQ(deltas[0].type(), SchedulingDelta::PLACE);
+  CHECK_EQ(deltas[0].task_id(), first_task_id);
+  CHECK_EQ(deltas[0].resource_id(), to_string(pu_res_id));
+  CHECK_EQ(first_td_ptr->state(), TaskDescriptor::RUNNING);
+  // The task got a node with only its running arc to the PU.
+  const FlowGraphNode* task_node = TaskNode(first_task_id);
+  CHECK_NOTNULL(task_node);
+  CHECK_EQ(task_node->type_, FlowNodeType::SCHEDULED_TASK);
+  // A solver run for another job leaves the task where it is.
+  AddJob("batch", false);
+  deltas.clear();
+  CHECK_EQ(scheduler_->ScheduleAllJobs(&scheduler_stats, &deltas), 0);
+  CHECK_EQ(first_td_ptr->state(), TaskDescriptor::RUNNING);
+  ResourceID_t* bound_res_id = scheduler_->BoundResourceForTask(first_task_id);
+  CHECK_NOTNULL(bound_res_id);
+  CHECK_EQ(*bound_res_id, pu_res_id);
+  task_node = TaskNode(first_task_id);
+  CHECK_NOTNULL(task_node);
+  CHECK_EQ(task_node->type_, FlowNodeType::SCHEDULED_TASK);
+  bool has_running_arc = false;
+  for (auto& dst_arc : task_node->outgoing_arc_map_) {
+    if (dst_arc.second->type_ == FlowGraphArcType::RUNNING) {
+      CHECK_EQ(dst_arc.second->dst_node_->resource_id_, pu_res_id);
+      has_running_arc = true;
+    }
+  }
+  CHECK(has_running_arc);
+}
+
+// Tests that tasks placed from the placement engine are spread over the
+// PUs with free slots, and go to the solver once every PU is full.
+TEST_F(FlowSchedulerTest, QueueTasksPlacedFromIndexRespectPUSlots) {
+  FLAGS_affinity_placement_index = true;
+  CreateScheduler();
+  // Enough cores for three tasks, but only two PUs with one slot each.
+  ResourceID_t first_pu_res_id = AddMachine("machine", 2, 8);
+  vector<TaskDescriptor*> td_ptrs;
+  td_ptrs.push_back(AddJob("web", true)->mutable_root_task());
+  td_ptrs.push_back(AddJob("cache", true)->mutable_root_task());
+  td_ptrs.push_back(AddJob("db", true)->mutable_root_task());
+  SchedulerStats scheduler_stats;
+  vector<SchedulingDelta> deltas;
+  CHECK_EQ(scheduler_->ScheduleAllQueueJobs(&scheduler_stats, &deltas), 1);
+  CHECK_EQ(scheduler_->ScheduleAllQueueJobs(&scheduler_stats, &deltas), 1);
+  CHECK_EQ(deltas.size(), 2);
+  CHECK_NE(deltas[0].resource_id(), deltas[1].resource_id());
+  CHECK(deltas[0].resource_id() == to_string(first_pu_res_id) ||
+        deltas[1].resource_id() == to_string(first_pu_res_id));
+  for (auto& delta : deltas) {
+    ResourceStatus* pu_rs =
+      FindPtrOrNull(*resource_map_, ResourceIDFromString(delta.resource_id()));
+    CHECK_NOTNULL(pu_rs);
+    CHECK_EQ(pu_rs->descriptor().current_running_tasks_size(), 1);
+  }
+  // Both PUs are full, so the third task goes to the single-task solver
+  // path, which finds no placement with the trivial cost model.
+  CHECK_EQ(scheduler_->ScheduleAllQueueJobs(&scheduler_stats, &deltas), 0);
+  CHECK_EQ(deltas.size(), 2);
+  CHECK_EQ(td_ptrs[0]->state(), TaskDescriptor::RUNNING);
+  CHECK_EQ(td_ptrs[1]->state(), TaskDescriptor::RUNNING);
+  CHECK_NE(td_ptrs[2]->state(), TaskDescriptor::RUNNING);
+  CHECK(scheduler_->BoundResourceForTask(td_ptrs[2]->uid()) == NULL);
+}
+
+// Tests that events are handled while a round's solver runs, but that a
+// second round waits until the first one has finished.
+TEST_F(FlowSchedulerTest, ConcurrentScheduleAndTaskRemovalDuringSolve) {
+  FLAGS_pipeline_solver_runs = true;
+  // The first solver run blocks until the test releases it.
+  WriteSolver("cat > /dev/null\n"
+              "echo run >> " + solver_dir_ + "/runs\n"
+              "if [ ! -e " + solver_dir_ + "/release ]; then\n"
+              "  touch " + solver_dir_ + "/started\n"
+              "  while [ ! -e " + solver_dir_ + "/release ]; do\n"
+              "    sleep 0.01\n"
+              "  done\n"
+              "fi\n"
+              "echo 'c EOI'\n");
+  CreateScheduler();
+  AddMachine("machine", 2);
+  JobDescriptor* first_jd_ptr = AddJob("web", false);
+  JobDescriptor* second_jd_ptr = AddJob("cache", false);
+  TaskDescriptor* first_td_ptr = first_jd_ptr->mutable_root_task();
+  TaskDescriptor* second_td_ptr = second_jd_ptr->mutable_root_task();
+  SchedulerStats first_stats;
+  vector<SchedulingDelta> first_deltas;
+  boost::thread first_round([&]() {
+    scheduler_->ScheduleAllJobs(&first_stats, &first_deltas);
+  });
+  CHECK(WaitForSolverFile("started"));
+  // The scheduling lock is released while the solver runs.
+  scheduler_->HandleTaskRemoval(second_td_ptr);
+  CHECK_EQ(second_td_ptr->state(), TaskDescriptor::ABORTED);
+  std::atomic<bool> second_round_done(false);
+  SchedulerStats second_stats;
+  vector<SchedulingDelta> second_deltas;
+  boost::thread second_round([&]() {
+    scheduler_->ScheduleAllJobs(&second_stats, &second_deltas);
+    second_round_done = true;
+  });
+  // The second round cannot start its solver run before the first one is
+  // done.
+  usleep(200000);
+  CHECK(!second_round_done);
+  CHECK_EQ(SolverFileLines("runs"), 1);
+  ofstream release_file((solver_dir_ + "/release").c_str());
+  release_file.close();
+  first_round.join();
+  second_round.join();
+  CHECK_EQ(SolverFileLines("runs"), 2);
+  CHECK(first_deltas.empty());
+  CHECK(second_deltas.empty());
+  CHECK(TaskNode(second_td_ptr->uid()) == NULL);
+  CHECK_EQ(first_td_ptr->state(), TaskDescriptor::RUNNABLE);
+  CHECK_NOTNULL(TaskNode(first_td_ptr->uid()));
+}
+
+// Tests that the mappings of a task and a PU that the event notifier removes
+// once the solver has finished are dropped rather than applied.
+TEST_F(FlowSchedulerTest, NotifierRemovesMappedTaskAndPU) {
+  WriteMappingSolver();
+  CallbackEventNotifier event_notifier;
+  CreateScheduler(&event_notifier);
+  ResourceID_t kept_pu_res_id = AddMachine("kept", 1);
+  ResourceID_t removed_pu_res_id = AddMachine("removed", 1);
+  ResourceTopologyNodeDescriptor* removed_machine_rtnd =
+    rtn_root_.mutable_children(1);
+  CHECK_EQ(removed_machine_rtnd->resource_desc().friendly_name(), "removed");
+  TaskDescriptor* kept_td_ptr = AddJob("web", false)->mutable_root_task();
+  TaskDescriptor* removed_td_ptr = AddJob("cache", false)->mutable_root_task();
+  TaskID_t removed_task_id = removed_td_ptr->uid();
+  event_notifier.on_decisions_completion_ = [&]() {
+    // Both tasks are mapped by now, and both nodes go away.
+    scheduler_->HandleTaskRemoval(removed_td_ptr);
+    scheduler_->DeregisterResource(removed_machine_rtnd);
+  };
+  SchedulerStats scheduler_stats;
+  vector<SchedulingDelta> deltas;
+  uint64_t num_scheduled = scheduler_->ScheduleAllJobs(&scheduler_stats,
+                                                       &deltas);
+  CHECK(event_notifier.on_decisions_completion_.empty());
+  CHECK_LE(num_scheduled, 1);
+  CHECK_EQ(deltas.size(), num_scheduled);
+  for (auto& delta : deltas) {
+    CHECK_EQ(delta.type(), SchedulingDelta::PLACE);
+    CHECK_EQ(delta.task_id(), kept_td_ptr->uid());
+    CHECK_EQ(delta.resource_id(), to_string(kept_pu_res_id));
+  }
+  CHECK(TaskNode(removed_task_id) == NULL);
+  CHECK(FindPtrOrNull(*resource_map_, removed_pu_res_id) == NULL);
+  // The kept task either went to the kept PU, or was mapped to the removed
+  // one and waits for the next round, which places it.
+  if (num_scheduled == 0) {
+    CHECK_EQ(kept_td_ptr->state(), TaskDescriptor::RUNNABLE);
+    CHECK_EQ(scheduler_->ScheduleAllJobs(&scheduler_stats, &deltas), 1);
+  }
+  CHECK_EQ(kept_td_ptr->state(), TaskDescriptor::RUNNING);
+  ResourceID_t* bound_res_id =
+    scheduler_->BoundResourceForTask(kept_td_ptr->uid());
+  CHECK_NOTNULL(bound_res_id);
+  CHECK_EQ(*bound_res_id, kept_pu_res_id);
+}
+
+// Tests that a gang that is admitted, but that the solver places only in
+// part, is held back and the solver rerun without it, so that none of its
+// tasks is placed. Once the solver can place the whole gang, it does.
+TEST_F(FlowSchedulerTest, ShortGangIsHeldBackAndRerun) {
+  // The first run places one task only, so the gang falls short.
+  WriteScriptedSolver("1\n3\n3\n");
+  CreateScheduler();
+  AddMachine("first", 1);
+  AddMachine("second", 1);
+  AddMachine("third", 1);
+  TaskDescriptor* web_td_ptr = AddJob("web", false)->mutable_root_task();
+  JobDescriptor* gang_jd_ptr = AddGangJob("mpi", 2);
+  vector<TaskDescriptor*> gang_td_ptrs;
+  gang_td_ptrs.push_back(gang_jd_ptr->mutable_root_task());
+  gang_td_ptrs.push_back(gang_jd_ptr->mutable_root_task()->mutable_spawned(0));
+  SchedulerStats scheduler_stats;
+  vector<SchedulingDelta> deltas;
+  // The rerun places the other job's task, but none of the gang's.
+  CHECK_EQ(scheduler_->ScheduleAllJobs(&scheduler_stats, &deltas), 1);
+  CHECK_EQ(SolverFileLines("runs"), 2);
+  CHECK_EQ(web_td_ptr->state(), TaskDescriptor::RUNNING);
+  for (auto& td_ptr : gang_td_ptrs) {
+    CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNABLE);
+    CHECK(scheduler_->BoundResourceForTask(td_ptr->uid()) == NULL);
+  }
+  // The two free PUs fit the gang, which the solver now places whole.
+  deltas.clear();
+  CHECK_EQ(scheduler_->ScheduleAllJobs(&scheduler_stats, &deltas), 2);
+  CHECK_EQ(SolverFileLines("runs"), 3);
+  CHECK_EQ(web_td_ptr->state(), TaskDescriptor::RUNNING);
+  for (auto& td_ptr : gang_td_ptrs) {
+    CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNING);
+    CHECK_NOTNULL(scheduler_->BoundResourceForTask(td_ptr->uid()));
+  }
+}
+
+}  // namespace scheduler
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,72 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Up-front admission of gang-scheduled jobs into a flow scheduling round.
+
+#include "scheduling/flow/gang_admission.h"
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+
+namespace firmament {
+namespace scheduler {
+
+GangAdmission::GangAdmission(uint64_t free_slots)
+  : free_slots_(free_slots) {
+}
+
+bool GangAdmission::Admit(const JobDescriptor& jd,
+                          uint64_t num_running_tasks,
+                          uint64_t num_runnable_tasks) {
+  if (!jd.is_gang_scheduling_job() ||
+      num_running_tasks >= jd.min_number_of_tasks()) {
+    return true;
+  }
+  uint64_t num_missing_tasks = jd.min_number_of_tasks() - num_running_tasks;
+  if (num_runnable_tasks < num_missing_tasks ||
+      free_slots_ < num_missing_tasks) {
+    VLOG(1) << "Holding back gang job " << jd.uuid() << ": it needs "
+            << num_missing_tasks << " more tasks, has " << num_runnable_tasks
+            << " runnable and " << free_slots_ << " free slots are left";
+    return false;
+  }
+  free_slots_ -= num_missing_tasks;
+  InsertOrUpdate(&admitted_gangs_, JobIDFromString(jd.uuid()),
+                 jd.min_number_of_tasks());
+  return true;
+}
+
+void GangAdmission::CollectShortGangs(
+    const unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>>&
+      num_placed_tasks,
+    vector<JobID_t>* short_gangs) {
+  for (auto it = admitted_gangs_.begin(); it != admitted_gangs_.end();) {
+    const uint64_t* num_placed = FindOrNull(num_placed_tasks, it->first);
+    if (!num_placed || *num_placed < it->second) {
+      short_gangs->push_back(it->first);
+      it = admitted_gangs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace scheduler
+}  // namespace firmament
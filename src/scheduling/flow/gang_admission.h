@@ -0,0 +1,87 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Up-front admission of gang-scheduled jobs into a flow scheduling round.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_GANG_ADMISSION_H
+#define FIRMAMENT_SCHEDULING_FLOW_GANG_ADMISSION_H
+
+#include <vector>
+
+#include "base/common.h"
+#include "base/job_desc.pb.h"
+#include "base/types.h"
+
+namespace firmament {
+namespace scheduler {
+
+/**
+ * Decides before a solver run which gang jobs can possibly get their
+ * minimum number of tasks placed. A gang is admitted only if the free task
+ * slots left after the gangs admitted before it cover its missing tasks.
+ * After the solver has run, admitted gangs that still fell short (e.g.,
+ * because the slots were fragmented) are reported so that they can be held
+ * back and the solver rerun.
+ */
+class GangAdmission {
+ public:
+  explicit GangAdmission(uint64_t free_slots);
+
+  /**
+   * Checks whether a job may take part in the scheduling round. Jobs that
+   * are not gang-scheduled and gangs that already run their minimum number
+   * of tasks are always admitted.
+   * @param jd the descriptor of the job
+   * @param num_running_tasks the number of the job's tasks that are running
+   * @param num_runnable_tasks the number of the job's tasks to be placed
+   * @return true if the job is admitted; the gang's missing tasks are then
+   * reserved against the free slots
+   */
+  bool Admit(const JobDescriptor& jd, uint64_t num_running_tasks,
+             uint64_t num_runnable_tasks);
+  /**
+   * Collects the admitted gangs for which the solver placed fewer tasks than
+   * they need. These gangs are no longer considered admitted.
+   * @param num_placed_tasks map from job to the number of its tasks the
+   * solver placed or kept running
+   * @param short_gangs vector to which the jobs that fell short are appended
+   */
+  void CollectShortGangs(
+      const unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>>&
+        num_placed_tasks,
+      vector<JobID_t>* short_gangs);
+
+  inline uint64_t free_slots() const {
+    return free_slots_;
+  }
+  inline uint64_t num_admitted_gangs() const {
+    return admitted_gangs_.size();
+  }
+
+ private:
+  uint64_t free_slots_;
+  // Map from admitted gang to its minimum number of tasks
+  unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>> admitted_gangs_;
+};
+
+}  // namespace scheduler
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_GANG_ADMISSION_H
@@ -0,0 +1,111 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Gang admission unit tests.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "misc/utils.h"
+#include "scheduling/flow/gang_admission.h"
+
+namespace firmament {
+namespace scheduler {
+
+class GangAdmissionTest : public ::testing::Test {
+ protected:
+  JobDescriptor CreateGang(uint64_t job_id_seed, uint64_t min_tasks) {
+    JobDescriptor jd;
+    jd.set_uuid(to_string(GenerateJobID(job_id_seed)));
+    jd.set_is_gang_scheduling_job(true);
+    jd.set_min_number_of_tasks(min_tasks);
+    return jd;
+  }
+};
+
+TEST_F(GangAdmissionTest, GangFitsExactly) {
+  GangAdmission gang_admission(8);
+  JobDescriptor jd = CreateGang(1, 8);
+  CHECK(gang_admission.Admit(jd, 0, 8));
+  CHECK_EQ(gang_admission.free_slots(), 0);
+  CHECK_EQ(gang_admission.num_admitted_gangs(), 1);
+  // The solver placed all the tasks
+  unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>> num_placed_tasks;
+  num_placed_tasks[JobIDFromString(jd.uuid())] = 8;
+  vector<JobID_t> short_gangs;
+  gang_admission.CollectShortGangs(num_placed_tasks, &short_gangs);
+  CHECK(short_gangs.empty());
+  // Running tasks count towards the gang's minimum
+  GangAdmission running_admission(3);
+  CHECK(running_admission.Admit(jd, 5, 3));
+  CHECK_EQ(running_admission.free_slots(), 0);
+}
+
+TEST_F(GangAdmissionTest, GangShortByOne) {
+  GangAdmission gang_admission(7);
+  JobDescriptor jd = CreateGang(1, 8);
+  CHECK(!gang_admission.Admit(jd, 0, 8));
+  CHECK_EQ(gang_admission.free_slots(), 7);
+  // Not enough runnable tasks to make up the gang
+  GangAdmission large_admission(100);
+  CHECK(!large_admission.Admit(jd, 0, 7));
+  CHECK(large_admission.Admit(jd, 1, 7));
+  // Admitted, but the solver placed one task too few
+  unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>> num_placed_tasks;
+  num_placed_tasks[JobIDFromString(jd.uuid())] = 7;
+  vector<JobID_t> short_gangs;
+  large_admission.CollectShortGangs(num_placed_tasks, &short_gangs);
+  CHECK_EQ(short_gangs.size(), 1);
+  CHECK_EQ(short_gangs[0], JobIDFromString(jd.uuid()));
+  CHECK_EQ(large_admission.num_admitted_gangs(), 0);
+}
+
+TEST_F(GangAdmissionTest, ManyCompetingGangs) {
+  GangAdmission gang_admission(100);
+  uint32_t num_admitted = 0;
+  unordered_map<JobID_t, uint64_t, boost::hash<JobID_t>> num_placed_tasks;
+  for (uint64_t seed = 1; seed <= 30; ++seed) {
+    JobDescriptor jd = CreateGang(seed, 8);
+    if (gang_admission.Admit(jd, 0, 8)) {
+      num_admitted++;
+      // The solver places all but the first admitted gang
+      num_placed_tasks[JobIDFromString(jd.uuid())] = num_admitted > 1 ? 8 : 3;
+    }
+  }
+  // 12 gangs of 8 tasks fit into 100 slots
+  CHECK_EQ(num_admitted, 12);
+  CHECK_EQ(gang_admission.free_slots(), 4);
+  // Jobs that are not gangs are always admitted
+  JobDescriptor jd;
+  jd.set_uuid(to_string(GenerateJobID(31)));
+  CHECK(gang_admission.Admit(jd, 0, 50));
+  CHECK_EQ(gang_admission.free_slots(), 4);
+  vector<JobID_t> short_gangs;
+  gang_admission.CollectShortGangs(num_placed_tasks, &short_gangs);
+  CHECK_EQ(short_gangs.size(), 1);
+  CHECK_EQ(gang_admission.num_admitted_gangs(), 11);
+  short_gangs.clear();
+  gang_admission.CollectShortGangs(num_placed_tasks, &short_gangs);
+  CHECK(short_gangs.empty());
+}
+
+}  // namespace scheduler
+}  // namespace firmament
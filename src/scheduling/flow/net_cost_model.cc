@@ -48,6 +48,11 @@ ArcDescriptor NetCostModel::TaskToUnscheduledAgg(TaskID_t task_id) {
   return ArcDescriptor(2560000, 1ULL, 0ULL);
 }
 
+UnscheduledAggCostDependency
+NetCostModel::TaskToUnscheduledAggCostDependency() {
+  return UNSCHED_COST_CONSTANT;
+}
+
 ArcDescriptor NetCostModel::UnscheduledAggToSink(JobID_t job_id) {
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
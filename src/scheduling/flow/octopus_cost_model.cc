@@ -48,6 +48,11 @@ ArcDescriptor OctopusCostModel::TaskToUnscheduledAgg(TaskID_t task_id) {
   return ArcDescriptor(1000000LL, 1ULL, 0ULL);
 }
 
+UnscheduledAggCostDependency
+OctopusCostModel::TaskToUnscheduledAggCostDependency() {
+  return UNSCHED_COST_CONSTANT;
+}
+
 ArcDescriptor OctopusCostModel::UnscheduledAggToSink(JobID_t job_id) {
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
@@ -0,0 +1,357 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Solves the flow graph as independent partitions, one per node pool.
+
+#include "scheduling/flow/partitioned_solver_dispatcher.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "misc/map-util.h"
+
+DECLARE_uint64(max_solver_runtime);
+
+namespace firmament {
+namespace scheduler {
+
+PartitionedSolverDispatcher::PartitionedSolverDispatcher(
+    shared_ptr<FlowGraphManager> flow_graph_manager,
+    const string& partition_label_key)
+  : flow_graph_manager_(flow_graph_manager),
+    partition_label_key_(partition_label_key),
+    residual_partition_(NULL), residual_solver_dispatcher_(NULL),
+    solver_ran_once_(false) {
+}
+
+PartitionedSolverDispatcher::~PartitionedSolverDispatcher() {
+  for (auto& pool_partition : partitions_) {
+    delete pool_partition.second;
+  }
+  delete residual_partition_;
+  for (auto& pool_dispatcher : solver_dispatchers_) {
+    delete pool_dispatcher.second;
+  }
+  delete residual_solver_dispatcher_;
+}
+
+FlowGraphNode* PartitionedSolverDispatcher::AddPartitionNode(
+    const FlowGraphNode& node, FlowGraphPartition* partition) {
+  // The copy doesn't point to any descriptor, so that the partition can be
+  // exported and solved while the flow graph changes.
+  FlowGraphNode* partition_node = partition->graph_.AddNode();
+  partition_node->type_ = node.type_;
+  partition_node->excess_ = node.excess_;
+  partition_node->job_id_ = node.job_id_;
+  partition_node->ec_id_ = node.ec_id_;
+  partition_node->comment_ = node.comment_;
+  CHECK(InsertIfNotPresent(&partition->flow_graph_node_ids_,
+                           partition_node->id_, node.id_));
+  if (node.type_ == FlowNodeType::PU) {
+    partition->leaf_ids_.insert(partition_node->id_);
+  }
+  return partition_node;
+}
+
+void PartitionedSolverDispatcher::BuildPartition(
+    const vector<FlowGraphNode*>& task_nodes,
+    const unordered_map<uint64_t, string>& resource_pools,
+    const string* pool, FlowGraphPartition* partition) {
+  const FlowGraphNode* sink_node = flow_graph_manager_->sink_node();
+  unordered_map<uint64_t, FlowGraphNode*> partition_nodes;
+  // Add the sink first because the solvers expect it to have a low id.
+  FlowGraphNode* partition_sink_node = AddPartitionNode(*sink_node, partition);
+  partition_nodes[sink_node->id_] = partition_sink_node;
+  partition->sink_id_ = partition_sink_node->id_;
+  queue<const FlowGraphNode*> to_visit;
+  int64_t supply = 0;
+  for (auto& task_node : task_nodes) {
+    partition_nodes[task_node->id_] = AddPartitionNode(*task_node, partition);
+    supply += task_node->excess_;
+    to_visit.push(task_node);
+  }
+  // Copy everything the tasks can send flow to. A pool partition only gets
+  // the resources in its pool.
+  while (!to_visit.empty()) {
+    const FlowGraphNode* node = to_visit.front();
+    to_visit.pop();
+    FlowGraphNode* partition_src_node = partition_nodes[node->id_];
+    for (auto& dst_arc : node->outgoing_arc_map_) {
+      FlowGraphArc* arc = dst_arc.second;
+      FlowGraphNode* dst_node = arc->dst_node_;
+      if (pool && dst_node->IsResourceNode()) {
+        const string* dst_pool = FindOrNull(resource_pools, dst_node->id_);
+        if (!dst_pool || *dst_pool != *pool) {
+          continue;
+        }
+      }
+      FlowGraphNode* partition_dst_node =
+        FindPtrOrNull(partition_nodes, dst_node->id_);
+      if (!partition_dst_node) {
+        partition_dst_node = AddPartitionNode(*dst_node, partition);
+        partition_nodes[dst_node->id_] = partition_dst_node;
+        to_visit.push(dst_node);
+      }
+      FlowGraphArc* partition_arc =
+        partition->graph_.AddArc(partition_src_node, partition_dst_node);
+      partition->graph_.ChangeArc(partition_arc, arc->cap_lower_bound_,
+                                  arc->cap_upper_bound_, arc->cost_);
+      partition_arc->type_ = arc->type_;
+      if (dst_node == sink_node && node->type_ == FlowNodeType::PU) {
+        partition->pu_to_sink_arcs_[node->id_] = partition_arc;
+      }
+    }
+  }
+  partition_sink_node->excess_ = -supply;
+  partition->num_tasks_ = task_nodes.size();
+}
+
+void PartitionedSolverDispatcher::ExportSnapshot() {
+  // Adjusts the costs on the arcs from tasks to unsched aggs.
+  if (solver_ran_once_) {
+    flow_graph_manager_->UpdateAllCostsToUnscheduledAggs();
+  }
+  FlowGraphChangeManager* change_manager =
+    flow_graph_manager_->flow_graph_change_manager();
+  const FlowGraph& graph = change_manager->flow_graph();
+  // Every resource below a labelled machine belongs to the machine's pool.
+  unordered_map<uint64_t, string> resource_pools;
+  for (auto& id_node : graph.Nodes()) {
+    FlowGraphNode* node = id_node.second;
+    if (node->type_ != FlowNodeType::MACHINE || !node->rd_ptr_) {
+      continue;
+    }
+    for (auto& label : node->rd_ptr_->labels()) {
+      if (label.key() == partition_label_key_) {
+        MarkResourcePool(*node, label.value(), &resource_pools);
+        break;
+      }
+    }
+  }
+  map<string, vector<FlowGraphNode*>> pool_task_nodes;
+  vector<FlowGraphNode*> residual_task_nodes;
+  for (auto& id_node : graph.Nodes()) {
+    FlowGraphNode* node = id_node.second;
+    if (!node->IsTaskNode()) {
+      continue;
+    }
+    string pool;
+    bool pinned_to_pool = TaskPool(*node->td_ptr_, &pool);
+    // A task running outside of its pool must keep its running arc, which
+    // only the residual partition has.
+    for (auto& dst_arc : node->outgoing_arc_map_) {
+      if (dst_arc.second->type_ == RUNNING) {
+        const string* running_pool = FindOrNull(resource_pools, dst_arc.first);
+        if (!running_pool || *running_pool != pool) {
+          pinned_to_pool = false;
+        }
+      }
+    }
+    if (pinned_to_pool) {
+      pool_task_nodes[pool].push_back(node);
+    } else {
+      residual_task_nodes.push_back(node);
+    }
+  }
+  for (auto& pool_partition : partitions_) {
+    delete pool_partition.second;
+  }
+  partitions_.clear();
+  delete residual_partition_;
+  residual_partition_ = NULL;
+  for (auto& pool_tasks : pool_task_nodes) {
+    FlowGraphPartition* partition = new FlowGraphPartition();
+    BuildPartition(pool_tasks.second, resource_pools, &pool_tasks.first,
+                   partition);
+    partitions_[pool_tasks.first] = partition;
+  }
+  if (!residual_task_nodes.empty()) {
+    residual_partition_ = new FlowGraphPartition();
+    BuildPartition(residual_task_nodes, resource_pools, NULL,
+                   residual_partition_);
+  }
+  VLOG(1) << "Split the flow graph into " << partitions_.size()
+          << " pool partitions and " << residual_task_nodes.size()
+          << " residual tasks";
+  change_manager->ResetChanges();
+}
+
+void PartitionedSolverDispatcher::MarkResourcePool(
+    const FlowGraphNode& node, const string& pool,
+    unordered_map<uint64_t, string>* resource_pools) {
+  (*resource_pools)[node.id_] = pool;
+  for (auto& dst_arc : node.outgoing_arc_map_) {
+    FlowGraphNode* dst_node = dst_arc.second->dst_node_;
+    if (dst_node->IsResourceNode()) {
+      MarkResourcePool(*dst_node, pool, resource_pools);
+    }
+  }
+}
+
+multimap<uint64_t, uint64_t>* PartitionedSolverDispatcher::Solve(
+    SchedulerStats* scheduler_stats) {
+  // All partitions share one deadline. Otherwise, the residual partition,
+  // which is solved after the pools, could take up to twice as long.
+  boost::system_time deadline = boost::get_system_time() +
+    boost::posix_time::microseconds(FLAGS_max_solver_runtime);
+  vector<FlowGraphPartition*> partitions;
+  vector<SolverDispatcher*> solver_dispatchers;
+  for (auto& pool_partition : partitions_) {
+    SolverDispatcher* solver_dispatcher =
+      FindPtrOrNull(solver_dispatchers_, pool_partition.first);
+    if (!solver_dispatcher) {
+      solver_dispatcher = new SolverDispatcher(flow_graph_manager_, false);
+      solver_dispatchers_[pool_partition.first] = solver_dispatcher;
+    }
+    partitions.push_back(pool_partition.second);
+    solver_dispatchers.push_back(solver_dispatcher);
+  }
+  vector<SchedulerStats> partition_stats(partitions.size());
+  vector<multimap<uint64_t, uint64_t>*> partition_mappings(partitions.size(),
+                                                           NULL);
+  boost::thread_group solver_threads;
+  for (uint64_t index = 0; index < partitions.size(); ++index) {
+    solver_threads.create_thread(
+        boost::bind(&PartitionedSolverDispatcher::SolvePartition, this,
+                    partitions[index], solver_dispatchers[index], deadline,
+                    &partition_stats[index], &partition_mappings[index]));
+  }
+  solver_threads.join_all();
+  // The pools are solved concurrently, so the slowest one accounts for the
+  // runtime.
+  uint64_t scheduler_runtime = 0;
+  uint64_t algorithm_runtime = 0;
+  for (auto& stats : partition_stats) {
+    scheduler_runtime = max(scheduler_runtime, stats.scheduler_runtime_);
+    algorithm_runtime = max(algorithm_runtime, stats.algorithm_runtime_);
+  }
+  multimap<uint64_t, uint64_t>* task_mappings =
+    new multimap<uint64_t, uint64_t>();
+  // Number of tasks the pool partitions placed on each PU.
+  unordered_map<uint64_t, uint64_t> pu_num_tasks;
+  bool missed_deadline = false;
+  for (uint64_t index = 0; index < partitions.size(); ++index) {
+    if (!partition_mappings[index]) {
+      missed_deadline = true;
+      continue;
+    }
+    MergeTaskMappings(*partitions[index], *partition_mappings[index],
+                      task_mappings, &pu_num_tasks);
+    delete partition_mappings[index];
+  }
+  if (!missed_deadline && residual_partition_ &&
+      boost::get_system_time() >= deadline) {
+    VLOG(1) << "No time left to solve the residual partition";
+    missed_deadline = true;
+  }
+  if (!missed_deadline && residual_partition_) {
+    // The residual tasks can only use the PU capacity the pools left.
+    for (auto& pu_tasks : pu_num_tasks) {
+      FlowGraphArc* arc =
+        FindPtrOrNull(residual_partition_->pu_to_sink_arcs_, pu_tasks.first);
+      if (arc) {
+        uint64_t cap_upper_bound =
+          arc->cap_upper_bound_ - min(arc->cap_upper_bound_, pu_tasks.second);
+        residual_partition_->graph_.ChangeArc(
+            arc, min(arc->cap_lower_bound_, cap_upper_bound), cap_upper_bound,
+            arc->cost_);
+      }
+    }
+    if (!residual_solver_dispatcher_) {
+      residual_solver_dispatcher_ =
+        new SolverDispatcher(flow_graph_manager_, false);
+    }
+    SchedulerStats residual_stats;
+    multimap<uint64_t, uint64_t>* residual_mappings = NULL;
+    SolvePartition(residual_partition_, residual_solver_dispatcher_, deadline,
+                   &residual_stats, &residual_mappings);
+    scheduler_runtime += residual_stats.scheduler_runtime_;
+    // The maximum runtime means the solver did not report it.
+    if (algorithm_runtime != numeric_limits<uint64_t>::max()) {
+      algorithm_runtime =
+        residual_stats.algorithm_runtime_ == numeric_limits<uint64_t>::max() ?
+        residual_stats.algorithm_runtime_ :
+        algorithm_runtime + residual_stats.algorithm_runtime_;
+    }
+    if (residual_mappings) {
+      MergeTaskMappings(*residual_partition_, *residual_mappings,
+                        task_mappings, &pu_num_tasks);
+      delete residual_mappings;
+    } else {
+      missed_deadline = true;
+    }
+  }
+  if (scheduler_stats != NULL) {
+    scheduler_stats->scheduler_runtime_ = scheduler_runtime;
+    scheduler_stats->algorithm_runtime_ = algorithm_runtime;
+  }
+  solver_ran_once_ = true;
+  if (missed_deadline) {
+    delete task_mappings;
+    return NULL;
+  }
+  return task_mappings;
+}
+
+void PartitionedSolverDispatcher::MergeTaskMappings(
+    const FlowGraphPartition& partition,
+    const multimap<uint64_t, uint64_t>& partition_mappings,
+    multimap<uint64_t, uint64_t>* task_mappings,
+    unordered_map<uint64_t, uint64_t>* pu_num_tasks) {
+  for (auto& mapping : partition_mappings) {
+    const uint64_t* task_node_id =
+      FindOrNull(partition.flow_graph_node_ids_, mapping.first);
+    const uint64_t* pu_node_id =
+      FindOrNull(partition.flow_graph_node_ids_, mapping.second);
+    CHECK_NOTNULL(task_node_id);
+    CHECK_NOTNULL(pu_node_id);
+    task_mappings->insert(
+        pair<uint64_t, uint64_t>(*task_node_id, *pu_node_id));
+    (*pu_num_tasks)[*pu_node_id]++;
+  }
+}
+
+void PartitionedSolverDispatcher::SolvePartition(
+    FlowGraphPartition* partition, SolverDispatcher* solver_dispatcher,
+    const boost::system_time& deadline, SchedulerStats* scheduler_stats,
+    multimap<uint64_t, uint64_t>** task_mappings) {
+  solver_dispatcher->ExportSubgraphSnapshot(
+      partition->graph_, partition->leaf_ids_, partition->sink_id_);
+  *task_mappings = solver_dispatcher->Solve(scheduler_stats, deadline);
+}
+
+bool PartitionedSolverDispatcher::TaskPool(const TaskDescriptor& td,
+                                           string* pool) {
+  for (auto& selector : td.label_selectors()) {
+    if (selector.key() == partition_label_key_ &&
+        selector.type() == LabelSelector::IN_SET &&
+        selector.values_size() == 1) {
+      *pool = selector.values(0);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace scheduler
+}  // namespace firmament
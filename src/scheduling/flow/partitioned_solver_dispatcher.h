@@ -0,0 +1,130 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Solves the flow graph as independent partitions, one per node pool.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_PARTITIONED_SOLVER_DISPATCHER_H
+#define FIRMAMENT_SCHEDULING_FLOW_PARTITIONED_SOLVER_DISPATCHER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/common.h"
+#include "scheduling/scheduler_interface.h"
+#include "scheduling/flow/flow_graph.h"
+#include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/solver_dispatcher.h"
+
+namespace firmament {
+namespace scheduler {
+
+// A sub-graph of the flow graph that is solved on its own.
+struct FlowGraphPartition {
+  FlowGraphPartition() : sink_id_(0), num_tasks_(0) {
+  }
+  FlowGraph graph_;
+  // Maps the partition's node ids to the flow graph's node ids.
+  unordered_map<uint64_t, uint64_t> flow_graph_node_ids_;
+  // Maps the flow graph's PU node ids to the partition's PU to sink arcs.
+  unordered_map<uint64_t, FlowGraphArc*> pu_to_sink_arcs_;
+  unordered_set<uint64_t> leaf_ids_;
+  uint64_t sink_id_;
+  uint64_t num_tasks_;
+};
+
+/**
+ * Splits the flow graph into one partition per value of a machine label and
+ * runs a solver for each partition concurrently. A task goes to the
+ * partition its label selectors pin it to. Tasks that could run in several
+ * partitions go to a residual partition that spans all resources. It is
+ * solved after the others, with the PU capacity they used taken away. All
+ * partitions share one FLAGS_max_solver_runtime deadline, so the residual
+ * partition only gets the time the pools left.
+ */
+class PartitionedSolverDispatcher {
+ public:
+  PartitionedSolverDispatcher(shared_ptr<FlowGraphManager> flow_graph_manager,
+                              const string& partition_label_key);
+  ~PartitionedSolverDispatcher();
+
+  /**
+   * Builds the partitions from the current flow graph and resets the graph
+   * changes. Must be called while holding the scheduling lock.
+   */
+  void ExportSnapshot();
+  /**
+   * Solves the partitions of the last snapshot and merges their mappings.
+   * It does not access the flow graph.
+   * @param scheduler_stats stats to which to write the solver runtimes
+   * @return the task node to PU node mappings in flow graph node ids, or
+   * NULL if a solver missed the round's deadline
+   */
+  multimap<uint64_t, uint64_t>* Solve(SchedulerStats* scheduler_stats);
+
+ private:
+  FRIEND_TEST(PartitionedSolverDispatcherTest, PartitionsByPool);
+  FRIEND_TEST(PartitionedSolverDispatcherTest, PartitionsShareDeadline);
+  FlowGraphNode* AddPartitionNode(const FlowGraphNode& node,
+                                  FlowGraphPartition* partition);
+  void BuildPartition(const vector<FlowGraphNode*>& task_nodes,
+                      const unordered_map<uint64_t, string>& resource_pools,
+                      const string* pool, FlowGraphPartition* partition);
+  void MarkResourcePool(const FlowGraphNode& node, const string& pool,
+                        unordered_map<uint64_t, string>* resource_pools);
+  /**
+   * Adds a partition's mappings to the flow graph's mappings.
+   * @param partition the partition that was solved
+   * @param partition_mappings the mappings in partition node ids
+   * @param task_mappings the mappings in flow graph node ids to add to
+   * @param pu_num_tasks incremented for every task mapped to a PU
+   */
+  void MergeTaskMappings(const FlowGraphPartition& partition,
+                         const multimap<uint64_t, uint64_t>& partition_mappings,
+                         multimap<uint64_t, uint64_t>* task_mappings,
+                         unordered_map<uint64_t, uint64_t>* pu_num_tasks);
+  /**
+   * Returns the pool a task's label selectors pin it to.
+   * @param td the descriptor of the task
+   * @param pool set to the value of the partition label the task requires
+   * @return true if the task requires exactly one value of the label
+   */
+  bool TaskPool(const TaskDescriptor& td, string* pool);
+  void SolvePartition(FlowGraphPartition* partition,
+                      SolverDispatcher* solver_dispatcher,
+                      const boost::system_time& deadline,
+                      SchedulerStats* scheduler_stats,
+                      multimap<uint64_t, uint64_t>** task_mappings);
+
+  shared_ptr<FlowGraphManager> flow_graph_manager_;
+  const string partition_label_key_;
+  // The partitions of the last snapshot, keyed by pool.
+  map<string, FlowGraphPartition*> partitions_;
+  FlowGraphPartition* residual_partition_;
+  // One dispatcher per pool, kept across runs.
+  map<string, SolverDispatcher*> solver_dispatchers_;
+  SolverDispatcher* residual_solver_dispatcher_;
+  bool solver_ran_once_;
+};
+
+}  // namespace scheduler
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_PARTITIONED_SOLVER_DISPATCHER_H
@@ -0,0 +1,267 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the partitioned solver dispatcher.
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <boost/timer/timer.hpp>
+
+#include "base/common.h"
+#include "base/resource_status.h"
+#include "base/units.h"
+#include "misc/map-util.h"
+#include "misc/trace_generator.h"
+#include "misc/wall_time.h"
+#include "misc/utils.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/partitioned_solver_dispatcher.h"
+#include "scheduling/flow/solver_dispatcher.h"
+#include "scheduling/flow/trivial_cost_model.h"
+
+DECLARE_string(cs2_binary);
+DECLARE_string(custom_flow_scheduling_args);
+DECLARE_string(flow_scheduling_binary);
+DECLARE_string(flow_scheduling_solver);
+DECLARE_uint64(max_solver_runtime);
+
+namespace firmament {
+namespace scheduler {
+
+// The fixture for testing the PartitionedSolverDispatcher class.
+class PartitionedSolverDispatcherTest : public ::testing::Test {
+ protected:
+  PartitionedSolverDispatcherTest()
+    : resource_map_(new ResourceMap_t),
+      task_map_(new TaskMap_t),
+      leaf_res_ids_(
+          new unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>),
+      trace_generator_(&wall_time_) {
+    FLAGS_v = 1;
+    cost_model_ = new TrivialCostModel(resource_map_, task_map_, leaf_res_ids_);
+    flow_graph_manager_.reset(new FlowGraphManager(
+        cost_model_, leaf_res_ids_, &wall_time_, &trace_generator_,
+        &dimacs_stats_));
+  }
+
+  virtual ~PartitionedSolverDispatcherTest() {
+    flow_graph_manager_.reset();
+    delete cost_model_;
+    for (auto& rs : machine_statuses_) {
+      delete rs;
+    }
+    for (auto& rtnd : machine_rtnds_) {
+      delete rtnd;
+    }
+    delete leaf_res_ids_;
+  }
+
+  // Adds a machine with num_pus PUs that is labelled with its pool.
+  void AddMachine(const string& pool, uint64_t num_pus) {
+    ResourceTopologyNodeDescriptor* rtnd_ptr =
+      new ResourceTopologyNodeDescriptor;
+    machine_rtnds_.push_back(rtnd_ptr);
+    ResourceDescriptor* machine_rd_ptr = rtnd_ptr->mutable_resource_desc();
+    string machine_id = to_string(GenerateResourceID());
+    machine_rd_ptr->set_uuid(machine_id);
+    machine_rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    Label* label = machine_rd_ptr->add_labels();
+    label->set_key("pool");
+    label->set_value(pool);
+    for (uint64_t index = 0; index < num_pus; ++index) {
+      ResourceTopologyNodeDescriptor* rtn_pu = rtnd_ptr->add_children();
+      string pu_id = to_string(GenerateResourceID());
+      rtn_pu->mutable_resource_desc()->set_uuid(pu_id);
+      rtn_pu->set_parent_id(machine_id);
+      rtn_pu->mutable_resource_desc()->set_type(
+          ResourceDescriptor::RESOURCE_PU);
+      pu_pools_[ResourceIDFromString(pu_id)] = pool;
+    }
+    ResourceStatus* rs =
+      new ResourceStatus(machine_rd_ptr, rtnd_ptr, "", 0);
+    machine_statuses_.push_back(rs);
+    CHECK(InsertIfNotPresent(resource_map_.get(),
+                             ResourceIDFromString(machine_id), rs));
+    cost_model_->AddMachine(rtnd_ptr);
+    flow_graph_manager_->AddResourceTopology(rtnd_ptr);
+  }
+
+  // Adds a runnable task to the job. The task selects the pool if pool is
+  // not empty.
+  void AddTask(const string& pool) {
+    TaskDescriptor* rt = jd_.mutable_root_task();
+    TaskDescriptor* td_ptr;
+    if (rt->uid() == 0) {
+      jd_.set_uuid(to_string(GenerateJobID()));
+      td_ptr = rt;
+      td_ptr->set_uid(GenerateRootTaskID(jd_));
+    } else {
+      td_ptr = rt->add_spawned();
+      td_ptr->set_uid(GenerateTaskID(*rt));
+    }
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    td_ptr->set_job_id(jd_.uuid());
+    if (!pool.empty()) {
+      LabelSelector* selector = td_ptr->add_label_selectors();
+      selector->set_type(LabelSelector::IN_SET);
+      selector->set_key("pool");
+      selector->add_values(pool);
+    }
+    CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+  }
+
+  // Adds num_pools pools of machines, and a job with tasks_per_pool tasks
+  // that select each pool plus num_free_tasks tasks that select none.
+  void AddPoolsAndJob(uint64_t num_pools, uint64_t machines_per_pool,
+                      uint64_t pus_per_machine, uint64_t tasks_per_pool,
+                      uint64_t num_free_tasks) {
+    for (uint64_t pool = 0; pool < num_pools; ++pool) {
+      for (uint64_t machine = 0; machine < machines_per_pool; ++machine) {
+        AddMachine("pool" + to_string(pool), pus_per_machine);
+      }
+      for (uint64_t task = 0; task < tasks_per_pool; ++task) {
+        AddTask("pool" + to_string(pool));
+      }
+    }
+    for (uint64_t task = 0; task < num_free_tasks; ++task) {
+      AddTask("");
+    }
+    vector<JobDescriptor*> jd_ptr_vect;
+    jd_ptr_vect.push_back(&jd_);
+    flow_graph_manager_->AddOrUpdateJobNodes(jd_ptr_vect);
+  }
+
+  // Returns the pool of the PU a partition node stands for.
+  string PartitionPUPool(const FlowGraphPartition& partition,
+                         uint64_t partition_node_id) {
+    uint64_t node_id =
+      FindOrDie(partition.flow_graph_node_ids_, partition_node_id);
+    const FlowGraphNode& node =
+      flow_graph_manager_->flow_graph_change_manager()->flow_graph().Node(
+          node_id);
+    return FindOrDie(pu_pools_, node.resource_id_);
+  }
+
+  shared_ptr<ResourceMap_t> resource_map_;
+  shared_ptr<TaskMap_t> task_map_;
+  unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>* leaf_res_ids_;
+  DIMACSChangeStats dimacs_stats_;
+  WallTime wall_time_;
+  TraceGenerator trace_generator_;
+  TrivialCostModel* cost_model_;
+  shared_ptr<FlowGraphManager> flow_graph_manager_;
+  vector<ResourceTopologyNodeDescriptor*> machine_rtnds_;
+  vector<ResourceStatus*> machine_statuses_;
+  unordered_map<ResourceID_t, string,
+                boost::hash<boost::uuids::uuid>> pu_pools_;
+  JobDescriptor jd_;
+};
+
+// Every pool gets a partition with only its own PUs, and the tasks that do
+// not select a pool go to the residual partition, which has all PUs.
+TEST_F(PartitionedSolverDispatcherTest, PartitionsByPool) {
+  AddPoolsAndJob(4, 2, 2, 3, 2);
+  PartitionedSolverDispatcher partitioned_dispatcher(flow_graph_manager_,
+                                                     "pool");
+  partitioned_dispatcher.ExportSnapshot();
+  EXPECT_EQ(4U, partitioned_dispatcher.partitions_.size());
+  for (auto& pool_partition : partitioned_dispatcher.partitions_) {
+    const FlowGraphPartition& partition = *pool_partition.second;
+    EXPECT_EQ(3U, partition.num_tasks_);
+    EXPECT_EQ(4U, partition.leaf_ids_.size());
+    EXPECT_EQ(4U, partition.pu_to_sink_arcs_.size());
+    for (auto& leaf_id : partition.leaf_ids_) {
+      EXPECT_EQ(pool_partition.first, PartitionPUPool(partition, leaf_id));
+    }
+  }
+  FlowGraphPartition* residual_partition =
+    partitioned_dispatcher.residual_partition_;
+  ASSERT_TRUE(residual_partition != NULL);
+  EXPECT_EQ(2U, residual_partition->num_tasks_);
+  EXPECT_EQ(16U, residual_partition->leaf_ids_.size());
+  EXPECT_EQ(-2, residual_partition->graph_.Node(
+      residual_partition->sink_id_).excess_);
+
+  // The partitions place as many tasks as the whole graph. This needs the
+  // cs2 solver.
+  if (access(FLAGS_cs2_binary.c_str(), X_OK) != 0) {
+    LOG(WARNING) << "Skipping the whole graph comparison because "
+                 << FLAGS_cs2_binary << " is missing";
+    return;
+  }
+  FLAGS_flow_scheduling_solver = "cs2";
+  SchedulerStats partitioned_stats;
+  multimap<uint64_t, uint64_t>* partitioned_mappings =
+    partitioned_dispatcher.Solve(&partitioned_stats);
+  ASSERT_TRUE(partitioned_mappings != NULL);
+  EXPECT_EQ(14U, partitioned_mappings->size());
+  delete partitioned_mappings;
+
+  SolverDispatcher solver_dispatcher(flow_graph_manager_, false);
+  solver_dispatcher.ExportSnapshot();
+  SchedulerStats stats;
+  multimap<uint64_t, uint64_t>* task_mappings = solver_dispatcher.Solve(&stats);
+  ASSERT_TRUE(task_mappings != NULL);
+  EXPECT_EQ(14U, task_mappings->size());
+  delete task_mappings;
+}
+
+// The pools and the residual partition are solved within one deadline. Each
+// solver run here fits within the deadline, but the pools followed by the
+// residual partition do not.
+TEST_F(PartitionedSolverDispatcherTest, PartitionsShareDeadline) {
+  AddPoolsAndJob(2, 1, 2, 1, 1);
+  FLAGS_flow_scheduling_solver = "custom";
+  FLAGS_flow_scheduling_binary = "/bin/sh";
+  // Reads the graph, takes 0.3 seconds and exits without placing any task.
+  // The arguments are split at spaces, hence the IFS.
+  FLAGS_custom_flow_scheduling_args = "-c cat>/dev/null;sleep${IFS}0.3";
+  FLAGS_max_solver_runtime = 500000;
+  PartitionedSolverDispatcher partitioned_dispatcher(flow_graph_manager_,
+                                                     "pool");
+  partitioned_dispatcher.ExportSnapshot();
+  ASSERT_TRUE(partitioned_dispatcher.residual_partition_ != NULL);
+  SchedulerStats stats;
+  boost::timer::cpu_timer timer;
+  multimap<uint64_t, uint64_t>* task_mappings =
+    partitioned_dispatcher.Solve(&stats);
+  uint64_t runtime = timer.elapsed().wall / NANOSECONDS_IN_MICROSECOND;
+  EXPECT_TRUE(task_mappings == NULL);
+  EXPECT_LT(runtime, 2 * FLAGS_max_solver_runtime);
+  delete task_mappings;
+  // With enough time for both, the round succeeds.
+  FLAGS_max_solver_runtime = 10000000;
+  partitioned_dispatcher.ExportSnapshot();
+  task_mappings = partitioned_dispatcher.Solve(&stats);
+  ASSERT_TRUE(task_mappings != NULL);
+  EXPECT_TRUE(task_mappings->empty());
+  delete task_mappings;
+  FLAGS_flow_scheduling_solver = "cs2";
+  FLAGS_flow_scheduling_binary = "";
+  FLAGS_custom_flow_scheduling_args = "";
+  FLAGS_max_solver_runtime = 100000000;
+}
+
+}  // namespace scheduler
+}  // namespace firmament
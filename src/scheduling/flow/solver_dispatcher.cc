@@ -20,11 +20,14 @@
 
 #include "scheduling/flow/solver_dispatcher.h"
 
+#include <signal.h>
 #include <sys/stat.h>
 #include <pthread.h>
 #include <utility>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 #include <boost/timer/timer.hpp>
 
 #include "base/common.h"
@@ -70,6 +73,8 @@ DEFINE_bool(flowlessly_run_cost_scaling_and_relax, false, "True if Flowlessly "
 DEFINE_int64(flowlessly_alpha_factor, 9, "Alpha factor to be used by "
              "Flowlessly's cost scaling");
 
+DECLARE_uint64(max_solver_runtime);
+
 namespace firmament {
 namespace scheduler {
 
@@ -82,7 +87,10 @@ SolverDispatcher::SolverDispatcher(
     bool solver_ran_once)
   : flow_graph_manager_(flow_graph_manager),
     solver_ran_once_(solver_ran_once),
-    debug_seq_num_(0), to_solver_(NULL), from_solver_(NULL),
+    debug_seq_num_(0), exported_num_nodes_(0), exported_sink_id_(0),
+    solver_pid_(0), logger_thread_(static_cast<pthread_t>(-1)),
+    solver_returned_(false), solver_timed_out_(false),
+    to_solver_(NULL), from_solver_(NULL),
     from_solver_stderr_(NULL) {
   // Set up debug directory if it doesn't exist
   struct stat st;
@@ -121,15 +129,26 @@ void SolverDispatcher::ExportJSON(string* output) const {
 
 void *ExportToSolver(void *x) {
   SolverDispatcher* solver_dispatcher = reinterpret_cast<SolverDispatcher*>(x);
-  solver_dispatcher->ExportGraph(solver_dispatcher->to_solver_);
-  solver_dispatcher->flow_graph_manager_->
-    flow_graph_change_manager()->ResetChanges();
-  if (fflush(solver_dispatcher->to_solver_)) {
-    PLOG(FATAL) << "Error while flushing";
+  // The solver may be killed at its deadline while we're writing to it. We
+  // block SIGPIPE so that writing to it fails instead of killing us.
+  sigset_t sigpipe_mask;
+  sigemptyset(&sigpipe_mask);
+  sigaddset(&sigpipe_mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe_mask, NULL);
+  const string& exported_graph = solver_dispatcher->exported_graph_;
+  if (fwrite(exported_graph.data(), 1, exported_graph.size(),
+             solver_dispatcher->to_solver_) != exported_graph.size() ||
+      fflush(solver_dispatcher->to_solver_)) {
+    if (!solver_dispatcher->SolverTimedOut()) {
+      PLOG(FATAL) << "Error while writing to the solver";
+    }
   }
   if (!FLAGS_incremental_flow) {
     // We need to close the stream because that's what cs expects.
-    CHECK_EQ(fclose(solver_dispatcher->to_solver_), 0);
+    if (fclose(solver_dispatcher->to_solver_) != 0) {
+      CHECK(solver_dispatcher->SolverTimedOut())
+        << "Error while closing the stream to the solver";
+    }
     solver_dispatcher->to_solver_ = NULL;
   }
   return NULL;
@@ -163,19 +182,18 @@ void SolverDispatcher::ExportGraph(FILE* stream) {
   }
 }
 
-multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
-    SchedulerStats* scheduler_stats) {
+void SolverDispatcher::ExportSnapshot() {
   // Adjusts the costs on the arcs from tasks to unsched aggs.
   if (solver_ran_once_) {
     flow_graph_manager_->UpdateAllCostsToUnscheduledAggs();
   }
+  FlowGraphChangeManager* change_manager =
+    flow_graph_manager_->flow_graph_change_manager();
 
   // Write debugging copy, of whatever we send to flow solver
   if (FLAGS_debug_flow_graph) {
     // TODO(malte): somewhat ugly hack to compose a unique file name for each
     // scheduler iteration
-    FlowGraphChangeManager* change_manager =
-      flow_graph_manager_->flow_graph_change_manager();
     string out_file_name;
     spf(&out_file_name, "%s/debug_%ju.dm", FLAGS_debug_output_dir.c_str(),
         debug_seq_num_);
@@ -198,10 +216,50 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     }
   }
 
+  // Export the graph into memory, so that the solver can be fed while the
+  // graph changes again.
+  char* buffer = NULL;
+  size_t buffer_size = 0;
+  FILE* stream = open_memstream(&buffer, &buffer_size);
+  CHECK_NOTNULL(stream);
+  ExportGraph(stream);
+  CHECK_EQ(fclose(stream), 0);
+  exported_graph_.assign(buffer, buffer_size);
+  free(buffer);
+  change_manager->ResetChanges();
+  exported_num_nodes_ = change_manager->flow_graph().NumNodes();
+  exported_leaf_ids_ = flow_graph_manager_->leaf_node_ids();
+  exported_sink_id_ = flow_graph_manager_->sink_node()->id_;
+}
+
+void SolverDispatcher::ExportSubgraphSnapshot(
+    const FlowGraph& graph, const unordered_set<uint64_t>& leaf_ids,
+    uint64_t sink_id) {
+  CHECK(!FLAGS_incremental_flow)
+    << "Subgraphs can only be solved from scratch";
+  char* buffer = NULL;
+  size_t buffer_size = 0;
+  FILE* stream = open_memstream(&buffer, &buffer_size);
+  CHECK_NOTNULL(stream);
+  dimacs_exporter_.Export(graph, stream);
+  CHECK_EQ(fclose(stream), 0);
+  exported_graph_.assign(buffer, buffer_size);
+  free(buffer);
+  exported_num_nodes_ = graph.NumNodes();
+  exported_leaf_ids_ = leaf_ids;
+  exported_sink_id_ = sink_id;
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::Solve(
+    SchedulerStats* scheduler_stats) {
+  return Solve(scheduler_stats, boost::get_system_time() +
+               boost::posix_time::microseconds(FLAGS_max_solver_runtime));
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::Solve(
+    SchedulerStats* scheduler_stats, const boost::system_time& deadline) {
   // Now run the solver
   vector<string> args;
-  pid_t solver_pid = 0;
-  pthread_t logger_thread = static_cast<pthread_t>(-1);
   // If the solver hasn't executed or if we're not running in incremental mode.
   if (!solver_ran_once_ || !FLAGS_incremental_flow) {
     // Pipe setup
@@ -213,8 +271,8 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     // infd[1] == PARENT_WRITE
     string binary;
     SolverConfiguration(FLAGS_flow_scheduling_solver, &binary, &args);
-    solver_pid = ExecCommandSync(binary, args, infd_, outfd_, errfd_);
-    VLOG(2) << "Solver running " << "(PID: " << solver_pid << ")"
+    solver_pid_ = ExecCommandSync(binary, args, infd_, outfd_, errfd_);
+    VLOG(2) << "Solver running " << "(PID: " << solver_pid_ << ")"
             << ", CHILD_READ: " << infd_[0]
             << ", CHILD_WRITE_STD: " << outfd_[1]
             << ", CHILD_WRITE_ERR: " << errfd_[1]
@@ -235,13 +293,17 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
                  << infd_[1];
     }
 
-    if (pthread_create(&logger_thread, NULL,
+    if (pthread_create(&logger_thread_, NULL,
                        ProcessStderrJustlog, from_solver_stderr_)) {
       PLOG(FATAL) << "Error creating thread";
     }
   }
 
   boost::timer::cpu_timer flowsolver_timer;
+  solver_returned_ = false;
+  solver_timed_out_ = false;
+  boost::thread deadline_thread(
+      boost::bind(&SolverDispatcher::WatchSolverDeadline, this, deadline));
 
   // We must export graph and read from STDOUT/STDERR in parallel
   // Otherwise, the solver might block if STDOUT/STDERR buffer gets full.
@@ -262,8 +324,14 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
   if (pthread_join(exporter_thread, NULL)) {
     PLOG(FATAL) << "Error joining thread";
   }
+  {
+    boost::lock_guard<boost::mutex> lock(solver_deadline_lock_);
+    solver_returned_ = true;
+  }
+  solver_returned_cond_.notify_all();
+  deadline_thread.join();
 
-  solver_ran_once_ = true;
+  exported_graph_.clear();
 
   if (scheduler_stats != NULL) {
     scheduler_stats->scheduler_runtime_ =
@@ -272,9 +340,18 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     scheduler_stats->algorithm_runtime_ = algorithm_runtime;
   }
 
+  if (solver_timed_out_) {
+    LOG(WARNING) << "Solver did not finish by its deadline and was killed";
+    delete task_mappings;
+    StopTimedOutSolver();
+    debug_seq_num_++;
+    return NULL;
+  }
+  solver_ran_once_ = true;
+
   if (!FLAGS_incremental_flow) {
     // We're done with the solver and can let it terminate here.
-    int status = WaitForFinish(solver_pid);
+    int status = WaitForFinish(solver_pid_);
 
     CHECK_EQ(fclose(from_solver_), 0);
     from_solver_ = NULL;
@@ -285,7 +362,7 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     // it here)
 
     // wait for logger thread
-    if (pthread_join(logger_thread, NULL)) {
+    if (pthread_join(logger_thread_, NULL)) {
       PLOG(FATAL) << "Error joining thread";
     }
 
@@ -297,6 +374,50 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
   return task_mappings;
 }
 
+multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
+    SchedulerStats* scheduler_stats) {
+  ExportSnapshot();
+  return Solve(scheduler_stats);
+}
+
+bool SolverDispatcher::SolverTimedOut() {
+  boost::lock_guard<boost::mutex> lock(solver_deadline_lock_);
+  return solver_timed_out_;
+}
+
+void SolverDispatcher::StopTimedOutSolver() {
+  WaitForFinish(solver_pid_);
+  // The streams may hold output the solver could not take anymore, so
+  // closing them can fail.
+  if (to_solver_ != NULL) {
+    fclose(to_solver_);
+    to_solver_ = NULL;
+  }
+  CHECK_EQ(fclose(from_solver_), 0);
+  from_solver_ = NULL;
+  CHECK_EQ(fclose(from_solver_stderr_), 0);
+  from_solver_stderr_ = NULL;
+  if (pthread_join(logger_thread_, NULL)) {
+    PLOG(FATAL) << "Error joining thread";
+  }
+  // The new solver doesn't know the graph.
+  solver_ran_once_ = false;
+}
+
+void SolverDispatcher::WatchSolverDeadline(boost::system_time deadline) {
+  boost::unique_lock<boost::mutex> lock(solver_deadline_lock_);
+  while (!solver_returned_) {
+    if (!solver_returned_cond_.timed_wait(lock, deadline) &&
+        !solver_returned_) {
+      // Set the flag before killing the solver, so that the threads talking
+      // to it know why the pipes broke.
+      solver_timed_out_ = true;
+      PCHECK(kill(solver_pid_, SIGKILL) == 0);
+      return;
+    }
+  }
+}
+
 pair<TaskID_t, ResourceID_t> SolverDispatcher::RunSimpleSolverForSingleTask(
     SchedulerStats* scheduler_stats, TaskID_t single_task_id) {
   pair<TaskID_t, ResourceID_t> delta =
@@ -377,14 +498,12 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
 // only the arcs with positive flow (i.e. what ReadFlowGraph returns).
 multimap<uint64_t, uint64_t>* SolverDispatcher::GetMappings(
     vector<unordered_map<uint64_t, uint64_t>>* extracted_flow,
-    unordered_set<uint64_t> leaves, uint64_t sink) {
+    const unordered_set<uint64_t>& leaves, uint64_t sink) {
   CHECK_NOTNULL(extracted_flow);
   multimap<uint64_t, uint64_t>* task_to_pu =
     new multimap<uint64_t, uint64_t>();
-  const FlowGraph& flow_graph =
-    flow_graph_manager_->flow_graph_change_manager()->flow_graph();
-  vector<vector<uint64_t>> pu_ids(flow_graph.NumNodes() + 1);
-  vector<bool> visited(flow_graph.NumNodes() + 1, false);
+  vector<vector<uint64_t>> pu_ids(extracted_flow->size());
+  vector<bool> visited(extracted_flow->size(), false);
   queue<uint64_t> to_visit;
   for (auto& leaf_node : leaves) {
     visited[leaf_node]= true;
@@ -401,13 +520,11 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::GetMappings(
     uint64_t node_id = to_visit.front();
     to_visit.pop();
     visited[node_id] = true;
-    if (flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::ROOT_TASK) ||
-        flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::UNSCHEDULED_TASK) ||
-        flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::SCHEDULED_TASK)) {
-      // It's a task node.
+    if ((*extracted_flow)[node_id].empty()) {
+      // It's a task node. Tasks are the only nodes with supply, and hence
+      // the only nodes that send flow without receiving any. We don't look
+      // at the node types because the graph may have changed since it was
+      // exported.
       for (auto& pu_node_id : pu_ids[node_id]) {
         task_to_pu->insert(pair<uint64_t, uint64_t>(node_id, pu_node_id));
       }
@@ -457,13 +574,15 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::ReadOutput(
     task_mappings = ReadTaskMappingChanges(from_solver_, algorithm_runtime);
   } else {
     // Parse and process the result
-    uint64_t num_nodes =
-      flow_graph_manager_->flow_graph_change_manager()->flow_graph().NumNodes();
     vector<unordered_map<uint64_t, uint64_t> >* extracted_flow =
-      ReadFlowGraph(from_solver_, algorithm_runtime, num_nodes);
-    task_mappings = GetMappings(extracted_flow,
-                                flow_graph_manager_->leaf_node_ids(),
-                                flow_graph_manager_->sink_node()->id_);
+      ReadFlowGraph(from_solver_, algorithm_runtime, exported_num_nodes_);
+    if (SolverTimedOut()) {
+      // The flow is incomplete and the mappings are discarded anyway.
+      task_mappings = new multimap<uint64_t, uint64_t>();
+    } else {
+      task_mappings = GetMappings(extracted_flow, exported_leaf_ids_,
+                                  exported_sink_id_);
+    }
     delete extracted_flow;
   }
   return task_mappings;
@@ -494,7 +613,11 @@ vector<unordered_map<uint64_t, uint64_t>>* SolverDispatcher::ReadFlowGraph(
       uint64_t src;
       uint64_t dst;
       uint64_t flow;
-      CHECK_EQ(sscanf(line, "%*c %ju %ju %ju", &src, &dst, &flow), 3);
+      if (sscanf(line, "%*c %ju %ju %ju", &src, &dst, &flow) != 3) {
+        // The solver was killed while it was writing the line.
+        CHECK(SolverTimedOut()) << "Unexpected line in flow graph: " << line;
+        break;
+      }
       // Only add it to the adjacency list if flow > 0
       if (flow > 0) {
         (*adj_list)[dst].insert(make_pair(src, flow));
@@ -527,7 +650,11 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::ReadTaskMappingChanges(
       if (line[0] == 'm') {
         uint64_t task_id;
         uint64_t core_id;
-        CHECK_EQ(sscanf(line, "%*c %ju %ju", &task_id, &core_id), 2);
+        if (sscanf(line, "%*c %ju %ju", &task_id, &core_id) != 2) {
+          // The solver was killed while it was writing the line.
+          CHECK(SolverTimedOut()) << "Unexpected line in flow graph: " << line;
+          break;
+        }
         VLOG(2) << "Assigning task node " << task_id << " to PU node "
                 << core_id;
         task_node->insert(pair<uint64_t, uint64_t>(task_id, core_id));
@@ -540,6 +667,10 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::ReadTaskMappingChanges(
       } else {
         LOG(ERROR) << "Unknown type of row in flow graph.";
       }
+    } else {
+      // The solver exited or was killed before the end of the iteration.
+      CHECK(SolverTimedOut()) << "Solver closed its output mid-iteration";
+      break;
     }
   }
   return task_node;
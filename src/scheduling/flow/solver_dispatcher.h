@@ -21,9 +21,13 @@
 #ifndef FIRMAMENT_SCHEDULING_FLOW_SOLVER_DISPATCHER_H
 #define FIRMAMENT_SCHEDULING_FLOW_SOLVER_DISPATCHER_H
 
+#include <pthread.h>
 #include <map>
 #include <string>
 #include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
 
 #include "base/common.h"
 #include "scheduling/scheduler_interface.h"
@@ -41,6 +45,43 @@ class SolverDispatcher {
   ~SolverDispatcher();
 
   void ExportJSON(string* output) const;
+  /**
+   * Exports the flow graph changes made since the previous solver run and
+   * records the graph state needed to read the solver's output. The graph
+   * changes are reset, so changes made afterwards go into the next export.
+   * Must be called while holding the scheduling lock.
+   */
+  void ExportSnapshot();
+  /**
+   * Exports a graph other than the flow graph manager's, e.g. a partition of
+   * it, as the snapshot for the next Solve. The whole graph is exported, so
+   * this only works with non-incremental solver runs.
+   * @param graph the graph to export
+   * @param leaf_ids the ids of the graph's PU nodes
+   * @param sink_id the id of the graph's sink node
+   */
+  void ExportSubgraphSnapshot(const FlowGraph& graph,
+                              const unordered_set<uint64_t>& leaf_ids,
+                              uint64_t sink_id);
+  /**
+   * Runs the solver on the last exported snapshot. It does not access the
+   * flow graph, so it can run while other threads update the graph. The
+   * solver is killed if it runs for longer than FLAGS_max_solver_runtime.
+   * @param scheduler_stats stats to which to write the solver runtimes
+   * @return the task node to PU node mappings, or NULL if the solver missed
+   * its deadline
+   */
+  multimap<uint64_t, uint64_t>* Solve(SchedulerStats* scheduler_stats);
+  /**
+   * Runs the solver on the last exported snapshot and kills it at the given
+   * deadline rather than after FLAGS_max_solver_runtime.
+   * @param scheduler_stats stats to which to write the solver runtimes
+   * @param deadline the time by which the solver must have returned
+   * @return the task node to PU node mappings, or NULL if the solver missed
+   * its deadline
+   */
+  multimap<uint64_t, uint64_t>* Solve(SchedulerStats* scheduler_stats,
+                                      const boost::system_time& deadline);
   multimap<uint64_t, uint64_t>* Run(SchedulerStats* scheduler_stats);
 
   pair<TaskID_t, ResourceID_t> RunSimpleSolverForSingleTask(
@@ -54,7 +95,7 @@ class SolverDispatcher {
   void ExportGraph(FILE* stream);
   multimap<uint64_t, uint64_t>* GetMappings(
       vector<unordered_map<uint64_t, uint64_t>>* extracted_flow,
-      unordered_set<uint64_t> leaves, uint64_t sink);
+      const unordered_set<uint64_t>& leaves, uint64_t sink);
   multimap<uint64_t, uint64_t>* ReadOutput(uint64_t* algorithm_runtime);
   vector<unordered_map<uint64_t, uint64_t>>* ReadFlowGraph(
       FILE* fptr,
@@ -65,6 +106,18 @@ class SolverDispatcher {
       uint64_t* algorithm_runtime);
   void SolverConfiguration(const string& solver, string* binary,
                            vector<string> *args);
+  /**
+   * Tears down a solver that was killed at its deadline. The next run starts
+   * a new solver and exports the full graph to it.
+   */
+  void StopTimedOutSolver();
+  bool SolverTimedOut();
+  /**
+   * Kills the solver unless it returns before the deadline. Runs in its own
+   * thread for the duration of a solver run.
+   * @param deadline the time by which the solver must have returned
+   */
+  void WatchSolverDeadline(boost::system_time deadline);
   friend void *ExportToSolver(void *x);
 
   shared_ptr<FlowGraphManager> flow_graph_manager_;
@@ -77,6 +130,21 @@ class SolverDispatcher {
   bool solver_ran_once_;
   // Debug sequence number (for solver input/output files written to /tmp)
   uint64_t debug_seq_num_;
+  // Graph state exported by ExportSnapshot: the DIMACS input for the solver,
+  // the number of nodes, the PU node ids and the sink node id.
+  string exported_graph_;
+  uint64_t exported_num_nodes_;
+  unordered_set<uint64_t> exported_leaf_ids_;
+  uint64_t exported_sink_id_;
+
+  // The solver process and the thread that logs its stderr.
+  pid_t solver_pid_;
+  pthread_t logger_thread_;
+  // Deadline state shared with the thread that watches the solver run.
+  boost::mutex solver_deadline_lock_;
+  boost::condition_variable solver_returned_cond_;
+  bool solver_returned_;
+  bool solver_timed_out_;
 
   // FDs used to communicate with the solver.
   int errfd_[2];
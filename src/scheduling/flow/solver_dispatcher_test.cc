@@ -0,0 +1,187 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the solver dispatcher.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <boost/timer/timer.hpp>
+
+#include "base/common.h"
+#include "base/resource_status.h"
+#include "base/units.h"
+#include "misc/trace_generator.h"
+#include "misc/wall_time.h"
+#include "misc/utils.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/solver_dispatcher.h"
+#include "scheduling/flow/trivial_cost_model.h"
+
+DECLARE_string(custom_flow_scheduling_args);
+DECLARE_string(flow_scheduling_binary);
+DECLARE_string(flow_scheduling_solver);
+DECLARE_uint64(max_solver_runtime);
+
+namespace firmament {
+namespace scheduler {
+
+// The fixture for testing the SolverDispatcher class.
+class SolverDispatcherTest : public ::testing::Test {
+ protected:
+  SolverDispatcherTest()
+    : resource_map_(new ResourceMap_t),
+      task_map_(new TaskMap_t),
+      leaf_res_ids_(
+          new unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>),
+      trace_generator_(&wall_time_), machine_rs_(NULL) {
+    FLAGS_v = 1;
+    cost_model_ = new TrivialCostModel(resource_map_, task_map_, leaf_res_ids_);
+    flow_graph_manager_.reset(new FlowGraphManager(
+        cost_model_, leaf_res_ids_, &wall_time_, &trace_generator_,
+        &dimacs_stats_));
+  }
+
+  virtual ~SolverDispatcherTest() {
+    flow_graph_manager_.reset();
+    delete cost_model_;
+    delete machine_rs_;
+    delete leaf_res_ids_;
+  }
+
+  virtual void SetUp() {
+    FLAGS_flow_scheduling_solver = "custom";
+  }
+
+  virtual void TearDown() {
+    FLAGS_flow_scheduling_solver = "cs2";
+    FLAGS_flow_scheduling_binary = "";
+    FLAGS_custom_flow_scheduling_args = "";
+    FLAGS_max_solver_runtime = 100000000;
+  }
+
+  // Adds a machine with num_pus PUs and a job with num_tasks runnable tasks
+  // to the flow graph.
+  void AddResourcesAndJob(uint64_t num_pus, uint64_t num_tasks) {
+    ResourceDescriptor* machine_rd_ptr = rtn_machine_.mutable_resource_desc();
+    string machine_id = to_string(GenerateResourceID("machine"));
+    machine_rd_ptr->set_uuid(machine_id);
+    machine_rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    for (uint64_t index = 0; index < num_pus; ++index) {
+      ResourceTopologyNodeDescriptor* rtn_pu = rtn_machine_.add_children();
+      rtn_pu->mutable_resource_desc()->set_uuid(
+          to_string(GenerateResourceID("pu" + to_string(index))));
+      rtn_pu->set_parent_id(machine_id);
+      rtn_pu->mutable_resource_desc()->set_type(
+          ResourceDescriptor::RESOURCE_PU);
+    }
+    machine_rs_ = new ResourceStatus(machine_rd_ptr, &rtn_machine_, "", 0);
+    CHECK(InsertIfNotPresent(resource_map_.get(),
+                             ResourceIDFromString(machine_id), machine_rs_));
+    cost_model_->AddMachine(&rtn_machine_);
+    flow_graph_manager_->AddResourceTopology(&rtn_machine_);
+    jd_.set_uuid(to_string(GenerateJobID()));
+    TaskDescriptor* rt = jd_.mutable_root_task();
+    rt->set_uid(GenerateRootTaskID(jd_));
+    rt->set_state(TaskDescriptor::RUNNABLE);
+    rt->set_job_id(jd_.uuid());
+    CHECK(InsertIfNotPresent(task_map_.get(), rt->uid(), rt));
+    for (uint64_t index = 1; index < num_tasks; ++index) {
+      TaskDescriptor* td_ptr = rt->add_spawned();
+      td_ptr->set_uid(GenerateTaskID(*rt));
+      td_ptr->set_state(TaskDescriptor::RUNNABLE);
+      td_ptr->set_job_id(jd_.uuid());
+      CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+    }
+    vector<JobDescriptor*> jd_ptr_vect;
+    jd_ptr_vect.push_back(&jd_);
+    flow_graph_manager_->AddOrUpdateJobNodes(jd_ptr_vect);
+  }
+
+  shared_ptr<ResourceMap_t> resource_map_;
+  shared_ptr<TaskMap_t> task_map_;
+  unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>* leaf_res_ids_;
+  DIMACSChangeStats dimacs_stats_;
+  WallTime wall_time_;
+  TraceGenerator trace_generator_;
+  TrivialCostModel* cost_model_;
+  shared_ptr<FlowGraphManager> flow_graph_manager_;
+  ResourceTopologyNodeDescriptor rtn_machine_;
+  ResourceStatus* machine_rs_;
+  JobDescriptor jd_;
+};
+
+// A solver that never answers is killed at the deadline, and the tasks are
+// placed greedily instead.
+TEST_F(SolverDispatcherTest, SlowSolverMissesDeadline) {
+  AddResourcesAndJob(2, 3);
+  FLAGS_flow_scheduling_binary = "/bin/sleep";
+  FLAGS_custom_flow_scheduling_args = "30";
+  FLAGS_max_solver_runtime = 200000;
+  SolverDispatcher solver_dispatcher(flow_graph_manager_, false);
+  for (uint32_t run = 0; run < 2; ++run) {
+    SchedulerStats scheduler_stats;
+    boost::timer::cpu_timer round_timer;
+    multimap<uint64_t, uint64_t>* task_mappings =
+      solver_dispatcher.Run(&scheduler_stats);
+    uint64_t round_runtime =
+      static_cast<uint64_t>(round_timer.elapsed().wall) /
+      NANOSECONDS_IN_MICROSECOND;
+    EXPECT_TRUE(task_mappings == NULL);
+    EXPECT_GE(scheduler_stats.scheduler_runtime_, FLAGS_max_solver_runtime);
+    // The solver sleeps for 30 seconds.
+    EXPECT_LT(round_runtime, 10 * FLAGS_max_solver_runtime);
+  }
+  multimap<uint64_t, uint64_t>* task_mappings =
+    flow_graph_manager_->ComputeGreedyTaskMappings();
+  // Each PU takes one task, so one of the tasks stays unscheduled.
+  EXPECT_EQ(task_mappings->size(), 2);
+  unordered_set<uint64_t> pu_node_ids;
+  for (auto& mapping : *task_mappings) {
+    EXPECT_TRUE(flow_graph_manager_->node_for_node_id(mapping.first)
+                .IsTaskNode());
+    EXPECT_EQ(flow_graph_manager_->node_for_node_id(mapping.second).type_,
+              FlowNodeType::PU);
+    EXPECT_TRUE(pu_node_ids.insert(mapping.second).second);
+  }
+  delete task_mappings;
+}
+
+// A solver that finishes in time is not affected by the deadline.
+TEST_F(SolverDispatcherTest, SolverWithinDeadline) {
+  AddResourcesAndJob(2, 3);
+  // Reads the graph and exits without placing any task.
+  FLAGS_flow_scheduling_binary = "/bin/sh";
+  FLAGS_custom_flow_scheduling_args = "-c cat>/dev/null";
+  FLAGS_max_solver_runtime = 10000000;
+  SolverDispatcher solver_dispatcher(flow_graph_manager_, false);
+  SchedulerStats scheduler_stats;
+  multimap<uint64_t, uint64_t>* task_mappings =
+    solver_dispatcher.Run(&scheduler_stats);
+  ASSERT_TRUE(task_mappings != NULL);
+  EXPECT_TRUE(task_mappings->empty());
+  EXPECT_LT(scheduler_stats.scheduler_runtime_, FLAGS_max_solver_runtime);
+  delete task_mappings;
+}
+
+}  // namespace scheduler
+}  // namespace firmament
@@ -51,6 +51,11 @@ ArcDescriptor TrivialCostModel::TaskToUnscheduledAgg(TaskID_t task_id) {
   return ArcDescriptor(5LL, 1ULL, 0ULL);
 }
 
+UnscheduledAggCostDependency
+TrivialCostModel::TaskToUnscheduledAggCostDependency() {
+  return UNSCHED_COST_CONSTANT;
+}
+
 ArcDescriptor TrivialCostModel::UnscheduledAggToSink(JobID_t job_id) {
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
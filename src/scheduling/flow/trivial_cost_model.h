@@ -43,6 +43,7 @@ class TrivialCostModel : public CostModelInterface {
 
   // Costs pertaining to leaving tasks unscheduled
   ArcDescriptor TaskToUnscheduledAgg(TaskID_t task_id);
+  UnscheduledAggCostDependency TaskToUnscheduledAggCostDependency();
   ArcDescriptor UnscheduledAggToSink(JobID_t job_id);
   // Per-task costs (into the resource topology)
   ArcDescriptor TaskToResourceNode(TaskID_t task_id, ResourceID_t resource_id);
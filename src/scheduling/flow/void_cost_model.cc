@@ -43,6 +43,11 @@ ArcDescriptor VoidCostModel::TaskToUnscheduledAgg(TaskID_t task_id) {
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
 
+UnscheduledAggCostDependency
+VoidCostModel::TaskToUnscheduledAggCostDependency() {
+  return UNSCHED_COST_CONSTANT;
+}
+
 ArcDescriptor VoidCostModel::UnscheduledAggToSink(JobID_t job_id) {
   return ArcDescriptor(0LL, 1ULL, 0ULL);
 }
@@ -111,8 +111,21 @@ void KnowledgeBase::AddMachineSample(const ResourceStats& sample) {
 }
 
 void KnowledgeBase::AddTaskStatsSample(const TaskStats& sample) {
-  TaskID_t tid = sample.task_id();
   boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
+  AddTaskStatsSampleLocked(sample);
+}
+
+void KnowledgeBase::AddTaskStatsSamples(
+    const vector<const TaskStats*>& samples) {
+  // Take the lock once for the whole batch, rather than once per sample
+  boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
+  for (auto& sample : samples) {
+    AddTaskStatsSampleLocked(*sample);
+  }
+}
+
+void KnowledgeBase::AddTaskStatsSampleLocked(const TaskStats& sample) {
+  TaskID_t tid = sample.task_id();
   // Check if we already have a record for this task
   deque<TaskStats>* q = FindOrNull(task_map_, tid);
   if (!q) {
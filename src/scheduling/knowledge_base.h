@@ -51,6 +51,7 @@ class KnowledgeBase {
   virtual ~KnowledgeBase();
   void AddMachineSample(const ResourceStats& sample);
   void AddTaskStatsSample(const TaskStats& stats_sample);
+  void AddTaskStatsSamples(const vector<const TaskStats*>& stats_samples);
   void DumpMachineStats(const ResourceID_t& res_id) const;
   bool GetLatestStatsForMachine(ResourceID_t id, ResourceStats* sample);
   const deque<ResourceStats> GetStatsForMachine(ResourceID_t id);
@@ -88,6 +89,8 @@ class KnowledgeBase {
       boost::hash<boost::uuids::uuid>> resource_tasks_count_;
 
  private:
+  void AddTaskStatsSampleLocked(const TaskStats& stats_sample);
+
   fstream serial_machine_samples_;
   fstream serial_task_samples_;
   ::google::protobuf::io::ZeroCopyOutputStream* raw_machine_output_;
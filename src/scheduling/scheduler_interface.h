@@ -39,6 +39,7 @@
 #include "engine/executors/topology_manager.h"
 #include "scheduling/knowledge_base.h"
 #include "scheduling/scheduling_delta.pb.h"
+#include "scheduling/scheduling_lock.h"
 #include "storage/object_store_interface.h"
 
 namespace firmament {
@@ -49,9 +50,17 @@ using machine::topology::TopologyManager;
 using store::DataObjectMap_t;
 using store::ObjectStoreInterface;
 
+// The path that produced a scheduling round's placements.
+enum PlacementSource {
+  SOLVER_PLACEMENTS = 0,
+  // The solver missed its deadline and tasks were placed greedily.
+  GREEDY_FALLBACK_PLACEMENTS = 1,
+};
+
 struct SchedulerStats {
   SchedulerStats() : algorithm_runtime_(numeric_limits<uint64_t>::max()),
-    scheduler_runtime_(0ULL), total_runtime_(0ULL) {
+    scheduler_runtime_(0ULL), total_runtime_(0ULL),
+    placement_source_(SOLVER_PLACEMENTS) {
   }
   // Accounts only the algorithmic part of the scheduler (in u-sec).
   uint64_t algorithm_runtime_;
@@ -62,11 +71,16 @@ struct SchedulerStats {
   // writing it, running the solver, reading the output and updating again
   // the graph.
   uint64_t total_runtime_;
+  // Which path produced the placements. A round with several solver runs
+  // reports the greedy fallback if any of the runs fell back to it.
+  PlacementSource placement_source_;
 };
 
 class SchedulerInterface : public PrintableInterface {
  public:
-  boost::recursive_mutex scheduling_lock_;
+  SchedulingLock scheduling_lock_;
+  // Held for the whole of a scheduling round; see SchedulingRoundGuard.
+  boost::recursive_mutex scheduling_round_lock_;
   SchedulerInterface(shared_ptr<JobMap_t> job_map,
                      shared_ptr<KnowledgeBase> knowledge_base,
                      shared_ptr<ResourceMap_t> resource_map,
@@ -110,6 +124,16 @@ class SchedulerInterface : public PrintableInterface {
    */
   virtual void CheckRunningTasksHealth() = 0;
 
+  /**
+   * Samples the resource usage of the running tasks from the executors and
+   * records it in the knowledge base. Also processes heartbeats that tasks
+   * reported to their executors directly.
+   * @param reports if not NULL, a heartbeat is appended for every usage
+   * sample and for every heartbeat collected, so that the caller can forward
+   * them to a parent coordinator
+   */
+  virtual void CollectTaskStats(vector<TaskHeartbeatMessage>* reports) = 0;
+
   /**
    * Unregisters a resource ID from the scheduler. No-op if the resource ID is
    * not actually registered with it.
@@ -240,6 +264,19 @@ class SchedulerInterface : public PrintableInterface {
                                 bool local,
                                 bool simulated = false) = 0;
 
+  /**
+   * Restores the placements of tasks that were running when a simulation
+   * checkpoint was taken. The tasks' jobs must have been added with AddJob.
+   * The tasks are bound to their resources without running the scheduler,
+   * and no trace records are generated for them: the trace of the run that
+   * took the checkpoint already contains their submission and placement.
+   * @param placements pairs of task descriptor and the descriptor of the
+   * resource on which the task runs
+   */
+  virtual void RestoreTaskPlacements(
+      const vector<pair<TaskDescriptor*, ResourceDescriptor*> >&
+      placements) = 0;
+
   /**
    * Runs a scheduling iteration for all active jobs.
    * @return the number of tasks scheduled
@@ -0,0 +1,148 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Locks that serialise scheduling rounds and scheduler events.
+
+#ifndef FIRMAMENT_SCHEDULING_SCHEDULING_LOCK_H
+#define FIRMAMENT_SCHEDULING_SCHEDULING_LOCK_H
+
+#include <boost/thread/recursive_mutex.hpp>
+
+#include "base/common.h"
+
+namespace firmament {
+namespace scheduler {
+
+/**
+ * Recursive mutex that counts how many times its owner holds it. The count
+ * allows a scheduling round to release the lock completely while the flow
+ * solver runs, no matter how many locked calls the round is nested in.
+ */
+class SchedulingLock {
+ public:
+  SchedulingLock() : depth_(0) {
+  }
+
+  void lock() {
+    mutex_.lock();
+    ++depth_;
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    ++depth_;
+    return true;
+  }
+
+  void unlock() {
+    --depth_;
+    mutex_.unlock();
+  }
+
+  /**
+   * Releases the lock completely. Must be called by the owner of the lock.
+   * @return the number of times the owner held the lock
+   */
+  uint32_t ReleaseAll() {
+    uint32_t depth = depth_;
+    depth_ = 0;
+    for (uint32_t i = 0; i < depth; ++i) {
+      mutex_.unlock();
+    }
+    return depth;
+  }
+
+  /**
+   * Releases the lock completely if the calling thread holds it.
+   * @return the number of times the calling thread held the lock, or 0 if
+   * it did not hold it
+   */
+  uint32_t ReleaseIfHeld() {
+    if (!mutex_.try_lock()) {
+      // Another thread holds the lock.
+      return 0;
+    }
+    uint32_t depth = depth_;
+    depth_ = 0;
+    for (uint32_t i = 0; i <= depth; ++i) {
+      mutex_.unlock();
+    }
+    return depth;
+  }
+
+  /**
+   * Reacquires a lock that was released with ReleaseAll or ReleaseIfHeld.
+   * @param depth the number of times to acquire the lock, as returned by
+   * ReleaseAll or ReleaseIfHeld
+   */
+  void ReacquireAll(uint32_t depth) {
+    if (depth == 0) {
+      return;
+    }
+    for (uint32_t i = 0; i < depth; ++i) {
+      mutex_.lock();
+    }
+    depth_ = depth;
+  }
+
+ private:
+  boost::recursive_mutex mutex_;
+  // Number of times the current owner holds mutex_. Only accessed while
+  // mutex_ is held.
+  uint32_t depth_;
+};
+
+/**
+ * Holds the scheduling round lock for a scope. The round lock stays held for
+ * the whole round, including the solver runs during which the round releases
+ * the scheduling lock, so a second round cannot start and change the state
+ * the first one still uses. Events only take the scheduling lock and are
+ * handled while the solver runs. The round lock must be taken before the
+ * scheduling lock; a caller that already holds the scheduling lock gives it
+ * up while it waits for another round to finish, since that round needs it
+ * back after its solver run.
+ */
+class SchedulingRoundGuard {
+ public:
+  SchedulingRoundGuard(boost::recursive_mutex* round_lock,
+                       SchedulingLock* scheduling_lock)
+    : round_lock_(round_lock) {
+    if (round_lock_->try_lock()) {
+      return;
+    }
+    uint32_t depth = scheduling_lock->ReleaseIfHeld();
+    round_lock_->lock();
+    scheduling_lock->ReacquireAll(depth);
+  }
+
+  ~SchedulingRoundGuard() {
+    round_lock_->unlock();
+  }
+
+ private:
+  boost::recursive_mutex* round_lock_;
+};
+
+}  // namespace scheduler
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_SCHEDULING_LOCK_H
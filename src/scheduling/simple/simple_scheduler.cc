@@ -158,7 +158,7 @@ void SimpleScheduler::KillRunningTask(
 
 void SimpleScheduler::HandleTaskFinalReport(const TaskFinalReport& report,
                                             TaskDescriptor* td_ptr) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   EventDrivenScheduler::HandleTaskFinalReport(report, td_ptr);
   TaskID_t task_id = td_ptr->uid();
   vector<EquivClass_t> equiv_classes;
@@ -193,7 +193,7 @@ uint64_t SimpleScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats) {
 
 uint64_t SimpleScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats,
                                           vector<SchedulingDelta>* deltas) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   vector<JobDescriptor*> jobs;
   for (auto& job_id_jd : jobs_to_schedule_) {
     jobs.push_back(job_id_jd.second);
@@ -206,7 +206,7 @@ uint64_t SimpleScheduler::ScheduleJob(JobDescriptor* jd_ptr,
                                       SchedulerStats* scheduler_stats) {
   uint64_t num_scheduled_tasks = 0;
   VLOG(2) << "Preparing to schedule job " << jd_ptr->uuid();
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   LOG(INFO) << "START SCHEDULING " << jd_ptr->uuid();
   boost::timer::cpu_timer scheduler_timer;
   // Get the set of runnable tasks for this job
@@ -257,7 +257,7 @@ uint64_t SimpleScheduler::ScheduleJob(JobDescriptor* jd_ptr,
 uint64_t SimpleScheduler::ScheduleJobs(const vector<JobDescriptor*>& jds_ptr,
                                        SchedulerStats* scheduler_stats,
                                        vector<SchedulingDelta>* deltas) {
-  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  boost::lock_guard<SchedulingLock> lock(scheduling_lock_);
   uint64_t num_scheduled_tasks = 0;
   boost::timer::cpu_timer scheduler_timer;
   // TODO(ionel): Populate scheduling deltas!
@@ -80,6 +80,18 @@ class EventManager {
   void RemoveTaskEndRuntimeEvent(const TraceTaskIdentifier& task_identifier,
                                  uint64_t task_end_time);
 
+  inline const multimap<uint64_t, EventDescriptor>& events() const {
+    return events_;
+  }
+
+  inline uint64_t num_events_processed() const {
+    return num_events_processed_;
+  }
+
+  inline void set_num_events_processed(uint64_t num_events_processed) {
+    num_events_processed_ = num_events_processed;
+  }
+
  private:
   SimulatedWallTime* simulated_time_;
   // The map storing the simulator events. Maps from timestamp to simulator
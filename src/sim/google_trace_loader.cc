@@ -203,12 +203,7 @@ bool GoogleTraceLoader::LoadTaskEvents(
     if (!task_events_file_) {
       if (current_task_events_file_id_ < FLAGS_num_files_to_process) {
         // We still have files to open.
-        string fname;
-        spf(&fname, "%s/task_events/part-%05d-of-00500.csv",
-            FLAGS_trace_path.c_str(), current_task_events_file_id_);
-        if ((task_events_file_ = fopen(fname.c_str(), "r")) == NULL) {
-          LOG(FATAL) << "Failed to open trace for reading of task events.";
-        }
+        OpenTaskEventsFile();
       } else {
         // There are no task events left to load.
         return loaded_event;
@@ -285,6 +280,15 @@ bool GoogleTraceLoader::LoadTaskEvents(
   return true;
 }
 
+void GoogleTraceLoader::OpenTaskEventsFile() {
+  string fname;
+  spf(&fname, "%s/task_events/part-%05d-of-00500.csv",
+      FLAGS_trace_path.c_str(), current_task_events_file_id_);
+  if ((task_events_file_ = fopen(fname.c_str(), "r")) == NULL) {
+    LOG(FATAL) << "Failed to open trace for reading of task events.";
+  }
+}
+
 void GoogleTraceLoader::LoadTaskUtilizationStats(
     unordered_map<TaskID_t, TraceTaskStats>* task_id_to_stats,
     const unordered_map<TaskID_t, uint64_t>& task_runtimes) {
@@ -475,5 +479,46 @@ uint64_t GoogleTraceLoader::MaxMachineEventHashToRetain() {
   }
 }
 
+void GoogleTraceLoader::RestoreState(const TraceLoaderCheckpoint& state) {
+  if (task_events_file_) {
+    fclose(task_events_file_);
+    task_events_file_ = NULL;
+  }
+  current_task_events_file_id_ = state.task_events_file_id();
+  loaded_synthetic_task_ = state.loaded_synthetic_task();
+  filtered_tasks_.clear();
+  for (auto& filtered_task : state.filtered_tasks()) {
+    TraceTaskIdentifier task_id;
+    task_id.job_id = filtered_task.job_id();
+    task_id.task_index = filtered_task.task_index();
+    filtered_tasks_.insert(task_id);
+  }
+  if (state.task_events_file_offset() >= 0) {
+    // The loader was in the middle of a task events file.
+    OpenTaskEventsFile();
+    if (fseek(task_events_file_, state.task_events_file_offset(),
+              SEEK_SET) != 0) {
+      LOG(FATAL) << "Failed to seek to offset "
+                 << state.task_events_file_offset() << " in task events file "
+                 << current_task_events_file_id_;
+    }
+  }
+}
+
+void GoogleTraceLoader::SaveState(TraceLoaderCheckpoint* state) {
+  state->set_task_events_file_id(current_task_events_file_id_);
+  if (task_events_file_) {
+    state->set_task_events_file_offset(ftell(task_events_file_));
+  } else {
+    state->set_task_events_file_offset(-1);
+  }
+  state->set_loaded_synthetic_task(loaded_synthetic_task_);
+  for (auto& filtered_task : filtered_tasks_) {
+    TraceTaskIdentifierDescriptor* task_id = state->add_filtered_tasks();
+    task_id->set_job_id(filtered_task.job_id);
+    task_id->set_task_index(filtered_task.task_index);
+  }
+}
+
 } // namespace sim
 } // namespace firmament
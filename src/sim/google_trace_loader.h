@@ -75,9 +75,16 @@ class GoogleTraceLoader : public TraceLoader {
   void LoadTasksRunningTime(
       unordered_map<TaskID_t, uint64_t>* task_runtime);
 
+  void RestoreState(const TraceLoaderCheckpoint& state);
+  void SaveState(TraceLoaderCheckpoint* state);
+
  private:
   uint64_t MaxEventHashToRetain();
   uint64_t MaxMachineEventHashToRetain();
+  /**
+   * Opens the task events file identified by current_task_events_file_id_.
+   */
+  void OpenTaskEventsFile();
 
   // The number of the task events file the simulator is reading from.
   int32_t current_task_events_file_id_;
@@ -20,6 +20,9 @@
 
 #include "sim/interference/quincy_task_interference.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "misc/map-util.h"
 #include "misc/utils.h"
 #include "sim/simulator_utils.h"
@@ -35,20 +38,16 @@ namespace firmament {
 namespace sim {
 
 QuincyTaskInterference::QuincyTaskInterference(
-    scheduler::SchedulerInterface* scheduler,
-    multimap<ResourceID_t, ResourceDescriptor*>* machine_res_id_pus,
     shared_ptr<ResourceMap_t> resource_map,
     shared_ptr<TaskMap_t> task_map,
     unordered_map<TaskID_t, uint64_t>* task_runtime)
-  : scheduler_(scheduler),
-    machine_res_id_pus_(machine_res_id_pus),
-    resource_map_(resource_map),
+  : resource_map_(resource_map),
     task_map_(task_map),
     task_runtime_(task_runtime) {
 }
 
 QuincyTaskInterference::~QuincyTaskInterference() {
-  // The object doesn't own scheduler_, machine_res_id_pus_ and task_runtime_.
+  // The object doesn't own task_runtime_.
 }
 
 void QuincyTaskInterference::OnTaskCompletion(
@@ -56,16 +55,14 @@ void QuincyTaskInterference::OnTaskCompletion(
     TaskDescriptor* td_ptr,
     ResourceID_t res_id,
     vector<TaskEndRuntimes>* tasks_end_time) {
+  MachineTasks* machine_tasks = MachineTasksForResource(res_id);
+  UpdateTaskRunTime(*machine_tasks, td_ptr);
   td_ptr->set_total_run_time(ComputeTaskTotalRunTime(current_time_us, *td_ptr));
-  vector<TaskID_t> colocated_on_pu;
-  vector<TaskID_t> colocated_on_machine;
-  // co-located_on_pu does not include the completed task.
-  GetColocatedTasks(res_id, &colocated_on_pu, &colocated_on_machine);
-  uint64_t num_tasks_colocated =
-    colocated_on_pu.size() + colocated_on_machine.size();
-  UpdateOtherTasksOnMachine(current_time_us, num_tasks_colocated + 1,
-                            num_tasks_colocated, colocated_on_pu,
-                            colocated_on_machine, tasks_end_time);
+  td_ptr->set_finish_time(current_time_us);
+  AdvanceMachineTasks(machine_tasks, current_time_us);
+  // The simulator has already removed the end event of the completed task.
+  RemoveTaskFromMachine(machine_tasks, td_ptr->uid(), false, tasks_end_time);
+  RescheduleMachineEndEvent(machine_tasks, current_time_us, tasks_end_time);
 }
 
 void QuincyTaskInterference::OnTaskEviction(
@@ -73,36 +70,27 @@ void QuincyTaskInterference::OnTaskEviction(
     TaskDescriptor* td_ptr,
     ResourceID_t res_id,
     vector<TaskEndRuntimes>* tasks_end_time) {
+  TaskID_t task_id = td_ptr->uid();
+  MachineTasks* machine_tasks = MachineTasksForResource(res_id);
+  UpdateTaskRunTime(*machine_tasks, td_ptr);
+  AdvanceMachineTasks(machine_tasks, current_time_us);
+  double work_left =
+    RemoveTaskFromMachine(machine_tasks, task_id, true, tasks_end_time);
   // Update runtime of the other co-located tasks.
-  vector<TaskID_t> colocated_on_pu;
-  vector<TaskID_t> colocated_on_machine;
-  // co-located_on_pu does not include the evicted task.
-  GetColocatedTasks(res_id, &colocated_on_pu, &colocated_on_machine);
-  uint64_t num_tasks_colocated =
-    colocated_on_pu.size() + colocated_on_machine.size();
-  UpdateOtherTasksOnMachine(current_time_us, num_tasks_colocated + 1,
-                            num_tasks_colocated, colocated_on_pu,
-                            colocated_on_machine, tasks_end_time);
+  RescheduleMachineEndEvent(machine_tasks, current_time_us, tasks_end_time);
   // Update the evicted task.
-  TaskID_t task_id = td_ptr->uid();
-  TaskEndRuntimes task_end_runtimes(task_id);
-  task_end_runtimes.set_previous_end_time(td_ptr->finish_time());
   td_ptr->set_total_run_time(ComputeTaskTotalRunTime(current_time_us, *td_ptr));
-  uint64_t* runtime_ptr = FindOrNull(*task_runtime_, task_id);
-  if (runtime_ptr != NULL) {
+  if (FindOrNull(*task_runtime_, task_id) != NULL) {
     // NOTE: We assume that the work conducted by a task until eviction is
     // saved. Hence, we update the time the task has left to run.
-    uint64_t task_executed_for = current_time_us - td_ptr->start_time();
-    uint64_t real_executed_for =
-      TimeWithInterferenceToTraceTime(task_executed_for,
-                                      num_tasks_colocated + 1);
-    InsertOrUpdate(task_runtime_, task_id, *runtime_ptr - real_executed_for);
+    InsertOrUpdate(task_runtime_, task_id,
+                   static_cast<uint64_t>(round(work_left)));
   } else {
-    // The task didn't finish in the trace.
+    // The task didn't finish in the trace. Its end event is removed by
+    // RemoveTaskFromMachine.
   }
   td_ptr->clear_start_time();
   td_ptr->set_submit_time(current_time_us);
-  tasks_end_time->push_back(task_end_runtimes);
 }
 
 void QuincyTaskInterference::OnTaskMigration(
@@ -111,70 +99,41 @@ void QuincyTaskInterference::OnTaskMigration(
     ResourceID_t old_res_id,
     ResourceID_t res_id,
     vector<TaskEndRuntimes>* tasks_end_time) {
-  ResourceID_t old_machine_res_id =
-    MachineResIDForResource(resource_map_, old_res_id);
-  ResourceID_t new_machine_res_id =
-    MachineResIDForResource(resource_map_, res_id);
-  // Update runtime of the tasks running on the machine from which the task
-  // has been migrated.
-  vector<TaskID_t> colocated_on_pu;
-  vector<TaskID_t> colocated_on_machine;
-  // co-located_on_pu does not include the migrated task.
-  GetColocatedTasks(old_res_id, &colocated_on_pu, &colocated_on_machine);
-  uint64_t num_tasks_colocated_on_old_machine =
-    colocated_on_pu.size() + colocated_on_machine.size() + 1;
-  if (old_machine_res_id != new_machine_res_id) {
-    // co-located_on_machine does not include the migrated task.
-    UpdateOtherTasksOnMachine(current_time_us,
-                              num_tasks_colocated_on_old_machine,
-                              num_tasks_colocated_on_old_machine - 1,
-                              colocated_on_pu, colocated_on_machine,
-                              tasks_end_time);
-  }
-  // Update runtime of the tasks running on the machine on which the task
-  // has been migrated.
   TaskID_t task_id = td_ptr->uid();
-  colocated_on_pu.clear();
-  colocated_on_machine.clear();
-  // co-located_on_pu does include the migrated task.
-  GetColocatedTasks(res_id, &colocated_on_pu, &colocated_on_machine);
-  // Remove the migrated task.
-  auto task_it = find(colocated_on_pu.begin(), colocated_on_pu.end(), task_id);
-  CHECK(task_it != colocated_on_pu.end());
-  colocated_on_pu.erase(task_it);
-  uint64_t num_tasks_colocated_on_new_machine =
-    colocated_on_pu.size() + colocated_on_machine.size();
-  if (old_machine_res_id != new_machine_res_id) {
-    UpdateOtherTasksOnMachine(current_time_us,
-                              num_tasks_colocated_on_new_machine,
-                              num_tasks_colocated_on_new_machine + 1,
-                              colocated_on_pu, colocated_on_machine,
-                              tasks_end_time);
-  }
+  MachineTasks* old_machine_tasks = MachineTasksForResource(old_res_id);
+  MachineTasks* new_machine_tasks = MachineTasksForResource(res_id);
+  UpdateTaskRunTime(*old_machine_tasks, td_ptr);
   td_ptr->set_total_run_time(ComputeTaskTotalRunTime(current_time_us, *td_ptr));
-  uint64_t* runtime_ptr = FindOrNull(*task_runtime_, task_id);
-  if (runtime_ptr != NULL) {
-    TaskEndRuntimes task_end_runtimes(task_id);
-    task_end_runtimes.set_previous_end_time(td_ptr->finish_time());
+  td_ptr->set_start_time(current_time_us);
+  if (old_machine_tasks != new_machine_tasks) {
+    // Update runtime of the tasks running on the machine from which the task
+    // has been migrated. The end event of tasks that didn't finish in the
+    // trace doesn't change.
+    bool finishes_in_trace = FindOrNull(*task_runtime_, task_id) != NULL;
+    AdvanceMachineTasks(old_machine_tasks, current_time_us);
     // NOTE: We assume that the work conducted by a task until migration is
-    // saved. Hence, we update the time the task has left to run.
-    uint64_t task_executed_for = current_time_us - td_ptr->start_time();
-    uint64_t real_executed_for =
-      TimeWithInterferenceToTraceTime(task_executed_for,
-                                      num_tasks_colocated_on_old_machine);
-    uint64_t real_time_left = *runtime_ptr - real_executed_for;
-    InsertOrUpdate(task_runtime_, task_id, real_time_left);
-    uint64_t task_end_time = current_time_us +
-      TraceTimeToTimeWithInterference(real_time_left,
-                                      num_tasks_colocated_on_new_machine + 1);
-    task_end_runtimes.set_current_end_time(task_end_time);
-    td_ptr->set_finish_time(task_end_time);
-    tasks_end_time->push_back(task_end_runtimes);
+    // saved.
+    double work_left = RemoveTaskFromMachine(old_machine_tasks, task_id,
+                                             finishes_in_trace,
+                                             tasks_end_time);
+    RescheduleMachineEndEvent(old_machine_tasks, current_time_us,
+                              tasks_end_time);
+    if (finishes_in_trace) {
+      InsertOrUpdate(task_runtime_, task_id,
+                     static_cast<uint64_t>(round(work_left)));
+    }
+    // Update runtime of the tasks running on the machine on which the task
+    // has been migrated.
+    AdvanceMachineTasks(new_machine_tasks, current_time_us);
+    new_machine_tasks->task_ids.push_back(task_id);
+    new_machine_tasks->remaining_work.push_back(work_left);
+    RescheduleMachineEndEvent(new_machine_tasks, current_time_us,
+                              tasks_end_time);
   } else {
-    // The task didn't finish in the trace.
+    // The task has been migrated within the machine. The number of tasks
+    // running on the machine, and thus the end events, do not change.
   }
   td_ptr->set_submit_time(current_time_us);
-  td_ptr->set_start_time(current_time_us);
 }
 
 void QuincyTaskInterference::OnTaskPlacement(
@@ -183,160 +142,162 @@ void QuincyTaskInterference::OnTaskPlacement(
     ResourceID_t res_id,
     vector<TaskEndRuntimes>* tasks_end_time) {
   TaskID_t task_id = td_ptr->uid();
-  vector<TaskID_t> colocated_on_pu;
-  vector<TaskID_t> colocated_on_machine;
-  // co-located_on_pu includes the newly placed task.
-  GetColocatedTasks(res_id, &colocated_on_pu, &colocated_on_machine);
-  // Remove the placed task.
-  auto task_it = find(colocated_on_pu.begin(), colocated_on_pu.end(), task_id);
-  CHECK(task_it != colocated_on_pu.end());
-  colocated_on_pu.erase(task_it);
-  uint64_t num_tasks_colocated =
-    colocated_on_pu.size() + colocated_on_machine.size();
-  UpdateOtherTasksOnMachine(current_time_us, num_tasks_colocated,
-                            num_tasks_colocated + 1, colocated_on_pu,
-                            colocated_on_machine, tasks_end_time);
-  // And end time for newly placed task.
-  tasks_end_time->push_back(
-      UpdateEndTimeForPlacedTask(td_ptr, current_time_us,
-                                 num_tasks_colocated + 1));
-}
-
-void QuincyTaskInterference::GetColocatedTasks(
-    ResourceID_t pu_res_id,
-    vector<TaskID_t>* colocated_on_pu,
-    vector<TaskID_t>* colocated_on_machine) {
-  // Get the ResourceID_t of the machine on which the task has been placed.
-  ResourceID_t machine_res_id =
-    MachineResIDForResource(resource_map_, pu_res_id);
-  // Get machine's PUs
-  pair<multimap<ResourceID_t, ResourceDescriptor*>::iterator,
-       multimap<ResourceID_t, ResourceDescriptor*>::iterator> range_it =
-    machine_res_id_pus_->equal_range(machine_res_id);
-  for (; range_it.first != range_it.second; range_it.first++) {
-    // Get the tasks running on the PU
-    ResourceID_t cur_pu_res_id =
-      ResourceIDFromString(range_it.first->second->uuid());
-    vector<TaskID_t> colocated_task_ids =
-      scheduler_->BoundTasksForResource(cur_pu_res_id);
-    if (cur_pu_res_id == pu_res_id) {
-      colocated_on_pu->insert(colocated_on_pu->end(),
-                              colocated_task_ids.begin(),
-                              colocated_task_ids.end());
-    } else {
-      colocated_on_machine->insert(colocated_on_machine->end(),
-                                   colocated_task_ids.begin(),
-                                   colocated_task_ids.end());
-    }
-  }
-}
-
-uint64_t QuincyTaskInterference::TimeWithInterferenceToTraceTime(
-    uint64_t time,
-    uint64_t num_tasks_colocated) {
-  return static_cast<uint64_t>(round(
-      time /
-      (1 + FLAGS_quincy_interference_runtime_increase * num_tasks_colocated)));
-}
-
-uint64_t QuincyTaskInterference::TraceTimeToTimeWithInterference(
-    uint64_t time,
-    uint64_t num_tasks_colocated) {
-  return static_cast<uint64_t>(round(
-      time *
-      (1 + FLAGS_quincy_interference_runtime_increase * num_tasks_colocated)));
-}
-
-TaskEndRuntimes QuincyTaskInterference::UpdateEndTimeForPlacedTask(
-    TaskDescriptor* td_ptr,
-    uint64_t current_time_us,
-    uint64_t num_tasks_colocated) {
-  TaskID_t task_id = td_ptr->uid();
-  TaskEndRuntimes task_end_runtimes(task_id);
   td_ptr->set_start_time(current_time_us);
   td_ptr->set_total_unscheduled_time(UpdateTaskTotalUnscheduledTime(*td_ptr));
+  MachineTasks* machine_tasks = MachineTasksForResource(res_id);
+  AdvanceMachineTasks(machine_tasks, current_time_us);
+  machine_tasks->task_ids.push_back(task_id);
   uint64_t* runtime_ptr = FindOrNull(*task_runtime_, task_id);
   if (runtime_ptr != NULL) {
-    // This assumes that task runtime increases by
-    // quincy_interference_runtime_increase * 100 percent * num_tasks_colocated
-    // when the task is colocated with num_tasks_colocated.
-    uint64_t task_end_time = current_time_us +
-      TraceTimeToTimeWithInterference(*runtime_ptr, num_tasks_colocated);
-    task_end_runtimes.set_current_end_time(task_end_time);
-    td_ptr->set_finish_time(task_end_time);
+    machine_tasks->remaining_work.push_back(*runtime_ptr);
   } else {
     // The task didn't finish in the trace. Set the task's end event to the
-    // the timestamp just after the end of the simulation.
+    // the timestamp just after the end of the simulation. The task still
+    // slows down the other tasks on the machine.
+    machine_tasks->remaining_work.push_back(
+        numeric_limits<double>::infinity());
     uint64_t task_end_time = FLAGS_runtime / FLAGS_trace_speed_up + 1;
+    TaskEndRuntimes task_end_runtimes(task_id);
     task_end_runtimes.set_current_end_time(task_end_time);
     td_ptr->set_finish_time(task_end_time);
+    tasks_end_time->push_back(task_end_runtimes);
   }
-  return task_end_runtimes;
+  // Update the runtime of the newly placed task and of the other co-located
+  // tasks.
+  RescheduleMachineEndEvent(machine_tasks, current_time_us, tasks_end_time);
 }
 
-TaskEndRuntimes QuincyTaskInterference::UpdateEndTimeForRunningTask(
-    TaskDescriptor* td_ptr,
-    uint64_t sim_task_runtime,
-    uint64_t current_time_us,
-    uint64_t prev_num_tasks_colocated,
-    uint64_t cur_num_tasks_colocated) {
-  TaskID_t task_id = td_ptr->uid();
-  TaskEndRuntimes task_end_runtimes(task_id);
-  task_end_runtimes.set_previous_end_time(td_ptr->finish_time());
-  td_ptr->set_total_run_time(ComputeTaskTotalRunTime(current_time_us, *td_ptr));
-  uint64_t task_executed_for = current_time_us - td_ptr->start_time();
-  // Transform the time task executed for under co-location interference
-  // to the time tasks would have executed for in the simulation without
-  // co-location interference.
-  uint64_t real_executed_for =
-    TimeWithInterferenceToTraceTime(task_executed_for,
-                                    prev_num_tasks_colocated);
-  // Update task_runtime_ to contain how much the task has left to execute if
-  // it were to execute without interference.
-  uint64_t time_left_to_execute = sim_task_runtime - real_executed_for;
-  InsertOrUpdate(task_runtime_, task_id, time_left_to_execute);
-  uint64_t task_end_time = current_time_us +
-    TraceTimeToTimeWithInterference(time_left_to_execute,
-                                    cur_num_tasks_colocated);
-  td_ptr->set_start_time(current_time_us);
-  task_end_runtimes.set_current_end_time(task_end_time);
-  td_ptr->set_finish_time(task_end_time);
-  return task_end_runtimes;
+void QuincyTaskInterference::AdvanceMachineTasks(MachineTasks* machine_tasks,
+                                                 uint64_t current_time_us) {
+  if (current_time_us <= machine_tasks->last_update_time) {
+    // NOTE: The synthetic task that triggers the second scheduling round is
+    // placed at its submit time, which may precede the last update.
+    return;
+  }
+  // All the tasks on the machine progress at the same rate. We update the
+  // arrays with a branch-free loop so that the compiler can vectorize it.
+  double progress = (current_time_us - machine_tasks->last_update_time) /
+    machine_tasks->slowdown;
+  double* remaining_work = machine_tasks->remaining_work.data();
+  size_t num_tasks = machine_tasks->remaining_work.size();
+  for (size_t index = 0; index < num_tasks; ++index) {
+    remaining_work[index] = max(remaining_work[index] - progress, 0.0);
+  }
+  machine_tasks->last_update_time = current_time_us;
 }
 
-void QuincyTaskInterference::UpdateOtherTasksOnMachine(
+QuincyTaskInterference::MachineTasks*
+QuincyTaskInterference::MachineTasksForResource(ResourceID_t res_id) {
+  ResourceID_t machine_res_id = MachineResIDForResource(resource_map_, res_id);
+  MachineTasks* machine_tasks = FindOrNull(machine_tasks_, machine_res_id);
+  if (machine_tasks == NULL) {
+    CHECK(InsertIfNotPresent(&machine_tasks_, machine_res_id,
+                             MachineTasks()));
+    machine_tasks = FindOrNull(machine_tasks_, machine_res_id);
+  }
+  return machine_tasks;
+}
+
+double QuincyTaskInterference::RemoveTaskFromMachine(
+    MachineTasks* machine_tasks,
+    TaskID_t task_id,
+    bool remove_end_event,
+    vector<TaskEndRuntimes>* tasks_end_time) {
+  vector<TaskID_t>& task_ids = machine_tasks->task_ids;
+  auto task_it = find(task_ids.begin(), task_ids.end(), task_id);
+  CHECK(task_it != task_ids.end());
+  size_t index = task_it - task_ids.begin();
+  double work_left = machine_tasks->remaining_work[index];
+  // Swap with the last task; the order of the tasks doesn't matter.
+  task_ids[index] = task_ids.back();
+  task_ids.pop_back();
+  machine_tasks->remaining_work[index] = machine_tasks->remaining_work.back();
+  machine_tasks->remaining_work.pop_back();
+  if (std::isinf(work_left)) {
+    if (remove_end_event) {
+      TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+      CHECK_NOTNULL(td_ptr);
+      TaskEndRuntimes task_end_runtimes(task_id);
+      task_end_runtimes.set_previous_end_time(td_ptr->finish_time());
+      tasks_end_time->push_back(task_end_runtimes);
+    }
+  } else if (machine_tasks->has_end_event &&
+             machine_tasks->end_event_task_id == task_id) {
+    if (remove_end_event) {
+      TaskEndRuntimes task_end_runtimes(task_id);
+      task_end_runtimes.set_previous_end_time(machine_tasks->end_event_time);
+      tasks_end_time->push_back(task_end_runtimes);
+    }
+    machine_tasks->has_end_event = false;
+  }
+  return work_left;
+}
+
+void QuincyTaskInterference::RescheduleMachineEndEvent(
+    MachineTasks* machine_tasks,
     uint64_t current_time_us,
-    uint64_t prev_num_tasks_colocated,
-    uint64_t cur_num_tasks_colocated,
-    const vector<TaskID_t>& colocated_on_pu,
-    const vector<TaskID_t>& colocated_on_machine,
     vector<TaskEndRuntimes>* tasks_end_time) {
-  for (auto& task_id : colocated_on_pu) {
-    uint64_t* runtime_ptr = FindOrNull(*task_runtime_, task_id);
-    if (runtime_ptr != NULL) {
-      TaskDescriptor* cur_td_ptr = FindPtrOrNull(*task_map_, task_id);
-      CHECK_NOTNULL(cur_td_ptr);
-      tasks_end_time->push_back(
-          UpdateEndTimeForRunningTask(cur_td_ptr,
-                                      *runtime_ptr,
-                                      current_time_us,
-                                      prev_num_tasks_colocated,
-                                      cur_num_tasks_colocated));
+  // This assumes that task runtime increases by
+  // quincy_interference_runtime_increase * 100 percent * num_tasks_colocated
+  // when the task is colocated with num_tasks_colocated.
+  machine_tasks->slowdown = 1 + FLAGS_quincy_interference_runtime_increase *
+    machine_tasks->task_ids.size();
+  current_time_us = max(current_time_us, machine_tasks->last_update_time);
+  machine_tasks->slowdown_start_time = current_time_us;
+  // Find the task that finishes first. The tasks that didn't finish in the
+  // trace keep their end event at the end of the simulation.
+  const double* remaining_work = machine_tasks->remaining_work.data();
+  size_t num_tasks = machine_tasks->remaining_work.size();
+  size_t first_index = 0;
+  for (size_t index = 1; index < num_tasks; ++index) {
+    if (remaining_work[index] < remaining_work[first_index]) {
+      first_index = index;
     }
   }
-  for (auto& task_id : colocated_on_machine) {
-    uint64_t* runtime_ptr = FindOrNull(*task_runtime_, task_id);
-    if (runtime_ptr != NULL) {
-      TaskDescriptor* cur_td_ptr = FindPtrOrNull(*task_map_, task_id);
-      CHECK_NOTNULL(cur_td_ptr);
-      tasks_end_time->push_back(
-          UpdateEndTimeForRunningTask(cur_td_ptr,
-                                      *runtime_ptr,
-                                      current_time_us,
-                                      prev_num_tasks_colocated,
-                                      cur_num_tasks_colocated));
+  bool has_end_event =
+    num_tasks > 0 && !std::isinf(remaining_work[first_index]);
+  TaskID_t task_id = has_end_event ? machine_tasks->task_ids[first_index] : 0;
+  uint64_t task_end_time = has_end_event ? current_time_us +
+    TraceTimeToTimeWithInterference(remaining_work[first_index],
+                                    machine_tasks->slowdown) : 0;
+  if (machine_tasks->has_end_event) {
+    if (has_end_event && machine_tasks->end_event_task_id == task_id &&
+        machine_tasks->end_event_time == task_end_time) {
+      // The end event is already in the right place.
+      return;
     }
+    TaskEndRuntimes task_end_runtimes(machine_tasks->end_event_task_id);
+    task_end_runtimes.set_previous_end_time(machine_tasks->end_event_time);
+    tasks_end_time->push_back(task_end_runtimes);
+  }
+  machine_tasks->has_end_event = has_end_event;
+  if (has_end_event) {
+    machine_tasks->end_event_task_id = task_id;
+    machine_tasks->end_event_time = task_end_time;
+    TaskEndRuntimes task_end_runtimes(task_id);
+    task_end_runtimes.set_current_end_time(task_end_time);
+    tasks_end_time->push_back(task_end_runtimes);
+  }
+}
+
+void QuincyTaskInterference::UpdateTaskRunTime(
+    const MachineTasks& machine_tasks,
+    TaskDescriptor* td_ptr) {
+  // Tasks that didn't finish in the trace keep their start time.
+  uint64_t* runtime_ptr = FindOrNull(*task_runtime_, td_ptr->uid());
+  if (runtime_ptr == NULL ||
+      td_ptr->start_time() >= machine_tasks.slowdown_start_time) {
+    return;
   }
+  td_ptr->set_total_run_time(
+      ComputeTaskTotalRunTime(machine_tasks.slowdown_start_time, *td_ptr));
+  td_ptr->set_start_time(machine_tasks.slowdown_start_time);
+}
+
+uint64_t QuincyTaskInterference::TraceTimeToTimeWithInterference(
+    double time,
+    double slowdown) {
+  return static_cast<uint64_t>(round(time * slowdown));
 }
 
 }  // namespace sim
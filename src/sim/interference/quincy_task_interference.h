@@ -21,9 +21,13 @@
 #ifndef FIRMAMENT_SIM_INTERFERENCE_QUINCY_TASK_INTERFERENCE_H
 #define FIRMAMENT_SIM_INTERFERENCE_QUINCY_TASK_INTERFERENCE_H
 
+#include <limits>
+#include <vector>
+
 #include "sim/interference/task_interference_interface.h"
 
-#include "scheduling/scheduler_interface.h"
+#include "base/common.h"
+#include "base/types.h"
 
 namespace firmament {
 namespace sim {
@@ -31,8 +35,6 @@ namespace sim {
 class QuincyTaskInterference : public TaskInterferenceInterface {
  public:
   QuincyTaskInterference(
-      scheduler::SchedulerInterface* scheduler,
-      multimap<ResourceID_t, ResourceDescriptor*>* machine_res_id_pus,
       shared_ptr<ResourceMap_t> resource_map,
       shared_ptr<TaskMap_t> task_map,
       unordered_map<TaskID_t, uint64_t>* task_runtime);
@@ -57,45 +59,78 @@ class QuincyTaskInterference : public TaskInterferenceInterface {
                        vector<TaskEndRuntimes>* tasks_end_time);
 
  private:
+  // The tasks running on a machine, stored as parallel arrays. All the tasks
+  // on a machine are slowed down by the same factor, so they finish in the
+  // order of their remaining work. Only the task with the least remaining
+  // work has an end event in the simulator's event queue. The tasks'
+  // descriptors and runtimes are only updated when they leave the machine.
+  struct MachineTasks {
+    MachineTasks() : slowdown(1.0), slowdown_start_time(0),
+      last_update_time(0), has_end_event(false), end_event_task_id(0),
+      end_event_time(0) {
+    }
+    vector<TaskID_t> task_ids;
+    // The time each task has left to run without interference. Set to
+    // infinity for tasks that didn't finish in the trace.
+    vector<double> remaining_work;
+    // The factor by which the runtime of the tasks is currently increased.
+    double slowdown;
+    // The time at which the number of tasks, and thus the slowdown, last
+    // changed.
+    uint64_t slowdown_start_time;
+    // The time up to which remaining_work has been updated.
+    uint64_t last_update_time;
+    bool has_end_event;
+    TaskID_t end_event_task_id;
+    uint64_t end_event_time;
+  };
+
   /**
-   * Get the tasks that are co-located on the PU and on the machine.
-   * @param the id of the PU resource
-   * @param vector to store tasks co-located on the PU
-   * @param vector to store tasks co-located on the machine, but not on the PU
+   * Updates the remaining work of all the tasks on the machine to account
+   * for the time they've run since the last update.
+   * @param machine_tasks the tasks running on the machine
+   * @param current_time_us the current simulation time
    */
-  void GetColocatedTasks(ResourceID_t pu_res_id,
-                         vector<TaskID_t>* colocated_on_pu,
-                         vector<TaskID_t>* colocated_on_machine);
-
-  uint64_t TimeWithInterferenceToTraceTime(uint64_t time,
-                                           uint64_t num_tasks_colocated);
-  uint64_t TraceTimeToTimeWithInterference(uint64_t time,
-                                           uint64_t num_tasks_colocated);
-  TaskEndRuntimes UpdateEndTimeForPlacedTask(TaskDescriptor* td_ptr,
-                                             uint64_t current_time_us,
-                                             uint64_t num_tasks_colocated);
-  TaskEndRuntimes UpdateEndTimeForRunningTask(TaskDescriptor* td_ptr,
-                                              uint64_t previous_end_time,
-                                              uint64_t current_time_us,
-                                              uint64_t prev_num_tasks_colocated,
-                                              uint64_t cur_num_tasks_colocated);
-  void UpdateOtherTasksOnMachine(uint64_t current_time_us,
-                                 uint64_t prev_num_tasks_colocated,
-                                 uint64_t cur_num_tasks_colocated,
-                                 const vector<TaskID_t>& colocated_on_pu,
-                                 const vector<TaskID_t>& colocated_on_machine,
+  void AdvanceMachineTasks(MachineTasks* machine_tasks,
+                           uint64_t current_time_us);
+  MachineTasks* MachineTasksForResource(ResourceID_t res_id);
+  /**
+   * Removes a task from the machine's arrays. Removes the task's end event
+   * if it has one.
+   * @return the time the task had left to run without interference
+   */
+  double RemoveTaskFromMachine(MachineTasks* machine_tasks, TaskID_t task_id,
+                               bool remove_end_event,
+                               vector<TaskEndRuntimes>* tasks_end_time);
+  /**
+   * Updates the machine's slowdown factor after tasks have been added or
+   * removed and moves the machine's end event to the task that will finish
+   * first, if it changed.
+   */
+  void RescheduleMachineEndEvent(MachineTasks* machine_tasks,
+                                 uint64_t current_time_us,
                                  vector<TaskEndRuntimes>* tasks_end_time);
+  /**
+   * Accounts the running time of a task that is leaving the machine up to
+   * the last change of the machine's slowdown, and sets the task's start
+   * time to the time of that change. This yields the run time and start
+   * time the task would have if they were updated on every change.
+   * @param machine_tasks the tasks running on the machine
+   * @param td_ptr the descriptor of the task
+   */
+  void UpdateTaskRunTime(const MachineTasks& machine_tasks,
+                         TaskDescriptor* td_ptr);
+  uint64_t TraceTimeToTimeWithInterference(double time, double slowdown);
 
-  scheduler::SchedulerInterface* scheduler_;
-  // Multimap storing the mapping between machine resource ids and their PU
-  // resource descriptors.
-  multimap<ResourceID_t, ResourceDescriptor*>* machine_res_id_pus_;
   // Map from ResourceID_t to ResourceStatus*
   shared_ptr<ResourceMap_t> resource_map_;
   // Map from TaskID_t to TaskDescriptor*
   shared_ptr<TaskMap_t> task_map_;
   // Map holding the per-task runtime information
   unordered_map<TaskID_t, uint64_t>* task_runtime_;
+  // The tasks running on each machine.
+  unordered_map<ResourceID_t, MachineTasks,
+    boost::hash<boost::uuids::uuid>> machine_tasks_;
 };
 
 }  // namespace sim
@@ -0,0 +1,238 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the Quincy task interference model. The expected end times and
+// run times are those of the original model, which rescheduled every
+// co-located task when the number of tasks on a machine changed.
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_status.h"
+#include "misc/map-util.h"
+#include "misc/utils.h"
+#include "sim/interference/quincy_task_interference.h"
+
+DEFINE_string(scheduler, "flow", "The scheduler to use for tests.");
+DECLARE_double(quincy_interference_runtime_increase);
+DECLARE_uint64(runtime);
+
+namespace firmament {
+namespace sim {
+
+class QuincyTaskInterferenceTest : public ::testing::Test {
+ protected:
+  QuincyTaskInterferenceTest()
+    : resource_map_(new ResourceMap_t),
+      task_map_(new TaskMap_t) {
+    // Every co-located task increases the runtime by half, which keeps the
+    // expected end times exact.
+    FLAGS_quincy_interference_runtime_increase = 0.5;
+    ResourceDescriptor* machine_rd = machine_rtnd_.mutable_resource_desc();
+    machine_rd->set_uuid(to_string(GenerateResourceID()));
+    machine_rd->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    AddResourceStatus(&machine_rtnd_);
+    for (uint32_t index = 0; index < 2; ++index) {
+      ResourceTopologyNodeDescriptor* pu_rtnd = machine_rtnd_.add_children();
+      ResourceDescriptor* pu_rd = pu_rtnd->mutable_resource_desc();
+      pu_rd->set_uuid(to_string(GenerateResourceID()));
+      pu_rd->set_type(ResourceDescriptor::RESOURCE_PU);
+      pu_rtnd->set_parent_id(machine_rd->uuid());
+      pu_res_ids_.push_back(ResourceIDFromString(pu_rd->uuid()));
+    }
+    for (auto& pu_rtnd : *machine_rtnd_.mutable_children()) {
+      AddResourceStatus(&pu_rtnd);
+    }
+    interference_.reset(
+        new QuincyTaskInterference(resource_map_, task_map_, &task_runtime_));
+  }
+
+  virtual ~QuincyTaskInterferenceTest() {
+    FLAGS_quincy_interference_runtime_increase = 0.1;
+    for (auto& res_id_status : *resource_map_) {
+      delete res_id_status.second;
+    }
+  }
+
+  void AddResourceStatus(ResourceTopologyNodeDescriptor* rtnd_ptr) {
+    ResourceDescriptor* rd_ptr = rtnd_ptr->mutable_resource_desc();
+    CHECK(InsertIfNotPresent(resource_map_.get(),
+                             ResourceIDFromString(rd_ptr->uuid()),
+                             new ResourceStatus(rd_ptr, rtnd_ptr, "", 0)));
+  }
+
+  TaskDescriptor* AddTask(TaskID_t task_id, uint64_t runtime) {
+    tasks_.push_back(TaskDescriptor());
+    TaskDescriptor* td_ptr = &tasks_.back();
+    td_ptr->set_uid(task_id);
+    CHECK(InsertIfNotPresent(task_map_.get(), task_id, td_ptr));
+    CHECK(InsertIfNotPresent(&task_runtime_, task_id, runtime));
+    return td_ptr;
+  }
+
+  // Applies the end time updates to end_events_ the way the simulator
+  // updates its event queue.
+  void UpdateEndEvents(const vector<TaskEndRuntimes>& tasks_end_time) {
+    for (auto& task_end_time : tasks_end_time) {
+      if (task_end_time.has_previous_end_time()) {
+        uint64_t* end_time = FindOrNull(end_events_, task_end_time.task_id_);
+        CHECK_NOTNULL(end_time);
+        CHECK_EQ(*end_time, task_end_time.get_previous_end_time());
+        end_events_.erase(task_end_time.task_id_);
+      }
+      if (task_end_time.has_current_end_time()) {
+        InsertOrUpdate(&end_events_, task_end_time.task_id_,
+                       task_end_time.get_current_end_time());
+      }
+    }
+  }
+
+  void Place(uint64_t current_time, TaskDescriptor* td_ptr, uint32_t pu) {
+    td_ptr->set_submit_time(current_time);
+    vector<TaskEndRuntimes> tasks_end_time;
+    interference_->OnTaskPlacement(current_time, td_ptr, pu_res_ids_[pu],
+                                   &tasks_end_time);
+    UpdateEndEvents(tasks_end_time);
+  }
+
+  // Completes the task whose end event is the earliest and returns the time
+  // at which it completes.
+  uint64_t CompleteNextTask(TaskID_t expected_task_id) {
+    CHECK(!end_events_.empty());
+    auto next_it = end_events_.begin();
+    for (auto it = end_events_.begin(); it != end_events_.end(); ++it) {
+      if (it->second < next_it->second) {
+        next_it = it;
+      }
+    }
+    CHECK_EQ(next_it->first, expected_task_id);
+    uint64_t current_time = next_it->second;
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, next_it->first);
+    CHECK_NOTNULL(td_ptr);
+    // The simulator removes the end event of a completed task.
+    end_events_.erase(next_it);
+    vector<TaskEndRuntimes> tasks_end_time;
+    interference_->OnTaskCompletion(current_time, td_ptr, pu_res_ids_[0],
+                                    &tasks_end_time);
+    UpdateEndEvents(tasks_end_time);
+    return current_time;
+  }
+
+  ResourceTopologyNodeDescriptor machine_rtnd_;
+  vector<ResourceID_t> pu_res_ids_;
+  shared_ptr<ResourceMap_t> resource_map_;
+  shared_ptr<TaskMap_t> task_map_;
+  unordered_map<TaskID_t, uint64_t> task_runtime_;
+  deque<TaskDescriptor> tasks_;
+  scoped_ptr<QuincyTaskInterference> interference_;
+  // The end event of each task, as queued in the simulator.
+  unordered_map<TaskID_t, uint64_t> end_events_;
+};
+
+// Tests that placing a task slows down the task already on the machine and
+// that the other task speeds up again when the first one completes.
+TEST_F(QuincyTaskInterferenceTest, PlaceAndComplete) {
+  TaskDescriptor* td_a = AddTask(1, 600);
+  TaskDescriptor* td_b = AddTask(2, 1200);
+  // A runs alone with a slowdown of 1.5.
+  Place(0, td_a, 0);
+  CHECK_EQ(td_a->start_time(), 0);
+  CHECK_EQ(*FindOrNull(end_events_, 1), 900);
+  // At 300, A has done 200 of its 600. With B co-located, the slowdown is 2.
+  Place(300, td_b, 1);
+  CHECK_EQ(*FindOrNull(end_events_, 1), 1100);
+  CHECK(FindOrNull(end_events_, 2) == NULL);
+  CHECK_EQ(td_b->start_time(), 300);
+  // A's descriptor and runtime are only updated when it leaves the machine.
+  CHECK_EQ(td_a->start_time(), 0);
+  CHECK_EQ(task_runtime_[1], 600);
+  // A completes first. B has done 400 of its 1200 and runs alone again.
+  CHECK_EQ(CompleteNextTask(1), 1100);
+  CHECK_EQ(td_a->start_time(), 300);
+  CHECK_EQ(td_a->finish_time(), 1100);
+  CHECK_EQ(td_a->total_run_time(), 1100);
+  CHECK_EQ(*FindOrNull(end_events_, 2), 2300);
+  CHECK_EQ(CompleteNextTask(2), 2300);
+  CHECK_EQ(td_b->start_time(), 1100);
+  CHECK_EQ(td_b->finish_time(), 2300);
+  CHECK_EQ(td_b->total_run_time(), 2000);
+  CHECK(end_events_.empty());
+}
+
+// Tests that evicting a task saves its work and speeds up the co-located
+// task.
+TEST_F(QuincyTaskInterferenceTest, Evict) {
+  TaskDescriptor* td_a = AddTask(1, 600);
+  TaskDescriptor* td_b = AddTask(2, 1200);
+  Place(0, td_a, 0);
+  Place(0, td_b, 1);
+  CHECK_EQ(*FindOrNull(end_events_, 1), 1200);
+  // At 600, both tasks have done 300 of their work.
+  vector<TaskEndRuntimes> tasks_end_time;
+  interference_->OnTaskEviction(600, td_b, pu_res_ids_[1], &tasks_end_time);
+  UpdateEndEvents(tasks_end_time);
+  CHECK_EQ(task_runtime_[2], 900);
+  CHECK_EQ(td_b->total_run_time(), 600);
+  CHECK_EQ(td_b->start_time(), 0);
+  CHECK_EQ(td_b->submit_time(), 600);
+  CHECK(FindOrNull(end_events_, 2) == NULL);
+  CHECK_EQ(*FindOrNull(end_events_, 1), 1050);
+  CHECK_EQ(CompleteNextTask(1), 1050);
+  CHECK_EQ(td_a->start_time(), 600);
+  CHECK_EQ(td_a->total_run_time(), 1050);
+  // B is placed again and runs its remaining work alone.
+  Place(1100, td_b, 0);
+  CHECK_EQ(*FindOrNull(end_events_, 2), 2450);
+  CHECK_EQ(CompleteNextTask(2), 2450);
+  CHECK_EQ(td_b->total_run_time(), 1950);
+}
+
+// Tests that a task that doesn't finish in the trace slows down the other
+// tasks on the machine, but keeps its end event at the end of the
+// simulation.
+TEST_F(QuincyTaskInterferenceTest, TaskNotFinishingInTrace) {
+  FLAGS_runtime = 1000000;
+  TaskDescriptor* td_a = AddTask(1, 600);
+  tasks_.push_back(TaskDescriptor());
+  TaskDescriptor* td_b = &tasks_.back();
+  td_b->set_uid(2);
+  CHECK(InsertIfNotPresent(task_map_.get(), 2, td_b));
+  Place(0, td_a, 0);
+  Place(0, td_b, 1);
+  uint64_t end_of_simulation = td_b->finish_time();
+  CHECK_EQ(end_of_simulation, 1000001);
+  CHECK_EQ(*FindOrNull(end_events_, 2), end_of_simulation);
+  CHECK_EQ(*FindOrNull(end_events_, 1), 1200);
+  CHECK_EQ(CompleteNextTask(1), 1200);
+  CHECK_EQ(*FindOrNull(end_events_, 2), end_of_simulation);
+  CHECK(FindOrNull(task_runtime_, 2) == NULL);
+  FLAGS_runtime = UINT64_MAX;
+}
+
+}  // namespace sim
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
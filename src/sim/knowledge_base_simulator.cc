@@ -58,51 +58,35 @@ KnowledgeBaseSimulator::KnowledgeBaseSimulator(
 
 void KnowledgeBaseSimulator::AddMachineSample(
     uint64_t current_simulation_time,
-    ResourceDescriptor* rd_ptr,
-    const unordered_map<TaskID_t, ResourceDescriptor*>& task_id_to_rd) {
+    ResourceDescriptor* rd_ptr) {
+  ResourceID_t machine_res_id = ResourceIDFromString(rd_ptr->uuid());
   ResourceStats machine_stats;
   machine_stats.set_resource_id(rd_ptr->uuid());
   machine_stats.set_timestamp(current_simulation_time);
-  uint64_t mem_usage = 0;
   uint64_t num_cores =
     lexical_cast<uint64_t>(rd_ptr->resource_capacity().cpu_cores());
-  vector<double> cpus_usage(num_cores, 1.0);
-  for (auto& task_id_rd : task_id_to_rd) {
-    TraceTaskStats* task_stat = FindOrNull(task_stats_, task_id_rd.first);
-    if (!task_stat) {
-      // We don't have any stats for the task. Ignore it.
-      continue;
-    }
-    if (task_stat->avg_canonical_mem_usage_ > 0 ||
-        task_stat->avg_unmapped_page_cache_ > 0 ||
-        task_stat->avg_total_page_cache_ > 0) {
-      mem_usage += task_stat->avg_canonical_mem_usage_ +
-        task_stat->avg_unmapped_page_cache_ -
-        task_stat->avg_total_page_cache_;
-    }
-    string label = task_id_rd.second->friendly_name();
-    uint64_t idx = label.find("PU #");
-    CHECK_NE(idx, string::npos)
-      << "PU label does not contain core id for resource: "
-      << task_id_rd.second->uuid();
-    string core_id_substr = label.substr(idx + 4, label.size() - idx - 4);
-    int64_t core_id = strtoll(core_id_substr.c_str(), 0, 10);
-    // TODO(ionel): In the Google trace a task might require more than one
-    // core. Change the code to handle this case as well.
+  MachineUtilization* machine_util =
+    FindOrNull(machine_utilization_, machine_res_id);
+  uint64_t mem_usage = 0;
+  if (machine_util) {
     // TODO(ionel): This assumes that all the machines in the trace are the
     // same. The reported cpu_usage is relative to the machine type. Fix!
-    CHECK_LT(core_id, num_cores);
-    cpus_usage[core_id] -= task_stat->avg_mean_cpu_usage_;
+    CHECK_LE(machine_util->cpus_usage_.size(), num_cores);
+    mem_usage = static_cast<uint64_t>(machine_util->mem_usage_);
   }
   // RAM stats
   machine_stats.set_mem_capacity(rd_ptr->resource_capacity().ram_cap());
   machine_stats.set_mem_utilization(mem_usage);
   // CPU stats
-  for (auto& usage : cpus_usage) {
+  for (uint64_t core_id = 0; core_id < num_cores; ++core_id) {
     CpuStats* cpu_stats = machine_stats.add_cpus_stats();
     // Capacity is 1000 millicores
     cpu_stats->set_cpu_capacity(1000);
-    cpu_stats->set_cpu_utilization(1.0 - usage);
+    if (machine_util && core_id < machine_util->cpus_usage_.size()) {
+      cpu_stats->set_cpu_utilization(machine_util->cpus_usage_[core_id]);
+    } else {
+      cpu_stats->set_cpu_utilization(0.0);
+    }
     // We don't have information to fill in the other fields.
   }
   // Disk stats
@@ -115,6 +99,38 @@ void KnowledgeBaseSimulator::AddMachineSample(
   KnowledgeBase::AddMachineSample(machine_stats);
 }
 
+void KnowledgeBaseSimulator::AddTaskUtilization(TaskID_t task_id,
+                                                ResourceID_t machine_res_id,
+                                                uint64_t core_id) {
+  TraceTaskStats* task_stat = FindOrNull(task_stats_, task_id);
+  if (!task_stat) {
+    // We don't have any stats for the task. Ignore it.
+    return;
+  }
+  TaskUtilization task_util;
+  task_util.machine_res_id_ = machine_res_id;
+  task_util.core_id_ = core_id;
+  task_util.mem_usage_ = 0;
+  if (task_stat->avg_canonical_mem_usage_ > 0 ||
+      task_stat->avg_unmapped_page_cache_ > 0 ||
+      task_stat->avg_total_page_cache_ > 0) {
+    task_util.mem_usage_ = task_stat->avg_canonical_mem_usage_ +
+      task_stat->avg_unmapped_page_cache_ -
+      task_stat->avg_total_page_cache_;
+  }
+  // TODO(ionel): In the Google trace a task might require more than one
+  // core. Change the code to handle this case as well.
+  task_util.cpu_usage_ = task_stat->avg_mean_cpu_usage_;
+  CHECK(InsertIfNotPresent(&task_utilization_, task_id, task_util))
+    << "Utilization of task " << task_id << " is already accounted for";
+  MachineUtilization* machine_util = &machine_utilization_[machine_res_id];
+  if (machine_util->cpus_usage_.size() <= core_id) {
+    machine_util->cpus_usage_.resize(core_id + 1, 0.0);
+  }
+  machine_util->mem_usage_ += task_util.mem_usage_;
+  machine_util->cpus_usage_[core_id] += task_util.cpu_usage_;
+}
+
 void KnowledgeBaseSimulator::EraseTraceTaskStats(TaskID_t task_id) {
   task_stats_.erase(task_id);
 }
@@ -153,6 +169,63 @@ void KnowledgeBaseSimulator::PopulateTaskFinalReport(TaskDescriptor* td_ptr,
   }
 }
 
+void KnowledgeBaseSimulator::RemoveMachineUtilization(
+    ResourceID_t machine_res_id) {
+  machine_utilization_.erase(machine_res_id);
+}
+
+void KnowledgeBaseSimulator::RemoveTaskUtilization(TaskID_t task_id) {
+  TaskUtilization* task_util = FindOrNull(task_utilization_, task_id);
+  if (!task_util) {
+    // The task had no stats when it was placed.
+    return;
+  }
+  MachineUtilization* machine_util =
+    FindOrNull(machine_utilization_, task_util->machine_res_id_);
+  if (machine_util) {
+    machine_util->mem_usage_ -= task_util->mem_usage_;
+    machine_util->cpus_usage_[task_util->core_id_] -= task_util->cpu_usage_;
+  }
+  task_utilization_.erase(task_id);
+}
+
+void KnowledgeBaseSimulator::RestoreCheckpoint(
+    const KnowledgeBaseCheckpoint& checkpoint) {
+  boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
+  for (auto& machine_samples : checkpoint.machine_samples()) {
+    deque<ResourceStats>& samples =
+      machine_map_[ResourceIDFromString(machine_samples.machine_uuid())];
+    samples.assign(machine_samples.samples().begin(),
+                   machine_samples.samples().end());
+  }
+  for (auto& final_reports : checkpoint.task_final_reports()) {
+    deque<TaskFinalReport>& reports = task_exec_reports_[final_reports.id()];
+    reports.assign(final_reports.reports().begin(),
+                   final_reports.reports().end());
+  }
+}
+
+void KnowledgeBaseSimulator::SaveCheckpoint(
+    KnowledgeBaseCheckpoint* checkpoint) {
+  boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
+  for (auto& machine_samples : machine_map_) {
+    MachineSamplesDescriptor* machine_samples_desc =
+      checkpoint->add_machine_samples();
+    machine_samples_desc->set_machine_uuid(to_string(machine_samples.first));
+    for (auto& sample : machine_samples.second) {
+      machine_samples_desc->add_samples()->CopyFrom(sample);
+    }
+  }
+  for (auto& final_reports : task_exec_reports_) {
+    TaskFinalReportsDescriptor* final_reports_desc =
+      checkpoint->add_task_final_reports();
+    final_reports_desc->set_id(final_reports.first);
+    for (auto& report : final_reports.second) {
+      final_reports_desc->add_reports()->CopyFrom(report);
+    }
+  }
+}
+
 void KnowledgeBaseSimulator::SetTaskType(TaskDescriptor* td_ptr) {
   // The classification works as follows:
   // low CPI, low MAI (lots of compute, but little memory access) => rabbit
@@ -24,20 +24,70 @@
 #include "scheduling/knowledge_base.h"
 
 #include "scheduling/data_layer_manager_interface.h"
+#include "sim/simulator_checkpoint.pb.h"
 #include "sim/trace_utils.h"
 
 namespace firmament {
 namespace sim {
 
+// Utilization accumulated from the tasks running on a machine.
+struct MachineUtilization {
+  MachineUtilization() : mem_usage_(0) {
+  }
+  double mem_usage_;
+  // CPU usage indexed by PU core id.
+  vector<double> cpus_usage_;
+};
+
+// Contribution of a running task to its machine's utilization.
+struct TaskUtilization {
+  ResourceID_t machine_res_id_;
+  uint64_t core_id_;
+  double mem_usage_;
+  double cpu_usage_;
+};
+
 class KnowledgeBaseSimulator : public KnowledgeBase {
  public:
   KnowledgeBaseSimulator();
   KnowledgeBaseSimulator(DataLayerManagerInterface* data_layer_manager);
 
-  void AddMachineSample(
-      uint64_t current_simulation_time,
-      ResourceDescriptor* rd_ptr,
-      const unordered_map<TaskID_t, ResourceDescriptor*>& task_id_to_rd);
+  /**
+   * Adds a machine sample built from the machine's utilization accumulator.
+   * @param current_simulation_time the timestamp of the sample
+   * @param rd_ptr the descriptor of the machine
+   */
+  void AddMachineSample(uint64_t current_simulation_time,
+                        ResourceDescriptor* rd_ptr);
+  /**
+   * Adds the usage of a task that started running on a machine's core to
+   * the machine's utilization accumulator.
+   * @param task_id the id of the task
+   * @param machine_res_id the resource id of the machine
+   * @param core_id the index of the PU on which the task runs
+   */
+  void AddTaskUtilization(TaskID_t task_id, ResourceID_t machine_res_id,
+                          uint64_t core_id);
+  void RemoveMachineUtilization(ResourceID_t machine_res_id);
+  /**
+   * Subtracts the usage of a task that stopped running from its machine's
+   * utilization accumulator.
+   * @param task_id the id of the task
+   */
+  void RemoveTaskUtilization(TaskID_t task_id);
+  /**
+   * Restores the machine samples and the task final reports from a
+   * checkpoint.
+   * @param checkpoint the knowledge base state saved with SaveCheckpoint
+   */
+  void RestoreCheckpoint(const KnowledgeBaseCheckpoint& checkpoint);
+  /**
+   * Saves the machine samples and the task final reports. The utilization
+   * accumulators and the trace task stats are not saved because they are
+   * rebuilt when the running tasks are restored.
+   * @param checkpoint the protobuf in which to save the state
+   */
+  void SaveCheckpoint(KnowledgeBaseCheckpoint* checkpoint);
   void EraseTraceTaskStats(TaskID_t task_id);
   uint64_t GetRuntimeForTask(TaskID_t task_id);
   void PopulateTaskFinalReport(TaskDescriptor* td_ptr, TaskFinalReport* report);
@@ -45,7 +95,11 @@ class KnowledgeBaseSimulator : public KnowledgeBase {
   void SetTraceTaskStats(TaskID_t task_id, const TraceTaskStats& task_stat);
 
  private:
+  FRIEND_TEST(SimulatorBridgeTest, SaveAndRestoreCheckpoint);
   unordered_map<TaskID_t, TraceTaskStats> task_stats_;
+  unordered_map<ResourceID_t, MachineUtilization,
+    boost::hash<boost::uuids::uuid> > machine_utilization_;
+  unordered_map<TaskID_t, TaskUtilization> task_utilization_;
 };
 
 } // namespace sim
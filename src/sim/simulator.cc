@@ -22,8 +22,10 @@
 
 #include "sim/simulator.h"
 
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <boost/algorithm/string.hpp>
@@ -58,6 +60,13 @@ DEFINE_double(trace_speed_up, 1, "Factor by which to speed up events");
 DEFINE_bool(enable_task_interference, false,
             "True if task runtimes should be affected by co-location "
             "interference");
+DEFINE_uint64(checkpoint_at, UINT64_MAX,
+              "Simulated time (in microseconds) after which to save a "
+              "checkpoint of the simulation to --checkpoint_file");
+DEFINE_string(checkpoint_file, "",
+              "File to which to save the simulation checkpoint");
+DEFINE_string(restore_checkpoint_file, "",
+              "Checkpoint file from which to resume the simulation");
 
 DECLARE_uint64(heartbeat_interval);
 DECLARE_uint64(max_solver_runtime);
@@ -102,7 +111,8 @@ static const bool simulation_validator =
 namespace firmament {
 namespace sim {
 
-Simulator::Simulator() {
+Simulator::Simulator(const TraceEventStore* trace_event_store)
+  : trace_event_store_(trace_event_store) {
   event_manager_ = new EventManager(&simulated_time_);
   bridge_ = new SimulatorBridge(event_manager_, &simulated_time_);
   scheduler_run_cnt_ = 0;
@@ -113,23 +123,46 @@ Simulator::~Simulator() {
   delete event_manager_;
 }
 
-void Simulator::ReplaySimulation() {
-  // Load the trace ingredients
+TraceLoader* Simulator::NewTraceLoader(EventManager* event_manager) {
   TraceLoader* trace_loader = NULL;
   if (!FLAGS_simulation.compare("google")) {
-    trace_loader = new GoogleTraceLoader(event_manager_);
+    trace_loader = new GoogleTraceLoader(event_manager);
   } else if (!FLAGS_simulation.compare("synthetic")) {
-    trace_loader = new SyntheticTraceLoader(event_manager_);
+    trace_loader = new SyntheticTraceLoader(event_manager);
   }
   CHECK_NOTNULL(trace_loader);
-  bridge_->LoadTraceData(trace_loader);
+  return trace_loader;
+}
 
+void Simulator::ReplaySimulation() {
+  // Load the trace ingredients
+  TraceLoader* trace_loader = NULL;
+  if (trace_event_store_) {
+    trace_loader = new StoredTraceLoader(event_manager_, *trace_event_store_);
+  } else {
+    trace_loader = NewTraceLoader(event_manager_);
+  }
   uint64_t run_scheduler_at = 0;
   uint64_t current_heartbeat_time = 0;
   uint64_t num_scheduling_rounds = 0;
   bool loaded_initial_machines = false;
+  bool saved_checkpoint = FLAGS_checkpoint_file.empty();
+
+  if (FLAGS_restore_checkpoint_file.empty()) {
+    bridge_->LoadTraceData(trace_loader);
+  } else {
+    RestoreCheckpoint(trace_loader, &run_scheduler_at, &current_heartbeat_time,
+                      &num_scheduling_rounds);
+    // The initial machines are part of the checkpoint.
+    loaded_initial_machines = true;
+  }
 
   while (!event_manager_->HasSimulationCompleted(num_scheduling_rounds)) {
+    if (!saved_checkpoint && run_scheduler_at >= FLAGS_checkpoint_at) {
+      SaveCheckpoint(trace_loader, run_scheduler_at, current_heartbeat_time,
+                     num_scheduling_rounds);
+      saved_checkpoint = true;
+    }
     // Make sure to process all the initial machine additions before we add
     // tasks.
     if (!loaded_initial_machines) {
@@ -173,6 +206,35 @@ void Simulator::ReplaySimulation() {
   delete trace_loader;
 }
 
+void Simulator::RestoreCheckpoint(TraceLoader* trace_loader,
+                                  uint64_t* run_scheduler_at,
+                                  uint64_t* current_heartbeat_time,
+                                  uint64_t* num_scheduling_rounds) {
+  LOG(INFO) << "Restoring checkpoint from " << FLAGS_restore_checkpoint_file;
+  int fd = open(FLAGS_restore_checkpoint_file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PLOG(FATAL) << "Could not open " << FLAGS_restore_checkpoint_file;
+  }
+  SimulatorCheckpoint checkpoint;
+  if (!checkpoint.ParseFromFileDescriptor(fd)) {
+    LOG(FATAL) << "Could not parse checkpoint "
+               << FLAGS_restore_checkpoint_file;
+  }
+  close(fd);
+  simulated_time_.UpdateCurrentTimestamp(checkpoint.timestamp());
+  for (auto& timed_event : checkpoint.events()) {
+    event_manager_->AddEvent(timed_event.timestamp(), timed_event.event());
+  }
+  event_manager_->set_num_events_processed(checkpoint.num_events_processed());
+  trace_loader->RestoreState(checkpoint.trace_loader());
+  bridge_->RestoreCheckpoint(checkpoint, trace_loader);
+  *run_scheduler_at = checkpoint.run_scheduler_at();
+  *current_heartbeat_time = checkpoint.current_heartbeat_time();
+  *num_scheduling_rounds = checkpoint.num_scheduling_rounds();
+  scheduler_run_cnt_ = checkpoint.scheduler_run_cnt();
+  LOG(INFO) << "Resuming simulation at " << checkpoint.timestamp();
+}
+
 void Simulator::Run() {
   FLAGS_flow_scheduling_solver = FLAGS_solver;
   if (!FLAGS_solver.compare("flowlessly")) {
@@ -193,6 +255,37 @@ void Simulator::Run() {
             << " duplicate task ids";
 }
 
+void Simulator::SaveCheckpoint(TraceLoader* trace_loader,
+                               uint64_t run_scheduler_at,
+                               uint64_t current_heartbeat_time,
+                               uint64_t num_scheduling_rounds) {
+  LOG(INFO) << "Saving checkpoint at " << simulated_time_.GetCurrentTimestamp()
+            << " to " << FLAGS_checkpoint_file;
+  SimulatorCheckpoint checkpoint;
+  checkpoint.set_timestamp(simulated_time_.GetCurrentTimestamp());
+  checkpoint.set_run_scheduler_at(run_scheduler_at);
+  checkpoint.set_current_heartbeat_time(current_heartbeat_time);
+  checkpoint.set_num_scheduling_rounds(num_scheduling_rounds);
+  checkpoint.set_scheduler_run_cnt(scheduler_run_cnt_);
+  checkpoint.set_num_events_processed(event_manager_->num_events_processed());
+  for (auto& time_event : event_manager_->events()) {
+    TimedEventDescriptor* timed_event = checkpoint.add_events();
+    timed_event->set_timestamp(time_event.first);
+    timed_event->mutable_event()->CopyFrom(time_event.second);
+  }
+  trace_loader->SaveState(checkpoint.mutable_trace_loader());
+  bridge_->SaveCheckpoint(&checkpoint);
+  int fd = open(FLAGS_checkpoint_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    PLOG(FATAL) << "Could not open " << FLAGS_checkpoint_file;
+  }
+  if (!checkpoint.SerializeToFileDescriptor(fd)) {
+    LOG(FATAL) << "Could not write checkpoint to " << FLAGS_checkpoint_file;
+  }
+  close(fd);
+}
+
 uint64_t Simulator::ScheduleJobsHelper(uint64_t run_scheduler_at) {
   boost::timer::cpu_timer timer;
   scheduler::SchedulerStats scheduler_stats;
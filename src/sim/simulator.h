@@ -33,6 +33,8 @@
 #include "sim/event_manager.h"
 #include "sim/simulated_wall_time.h"
 #include "sim/simulator_bridge.h"
+#include "sim/stored_trace_loader.h"
+#include "sim/trace_loader.h"
 #include "sim/trace_utils.h"
 
 DECLARE_string(flow_scheduling_binary);
@@ -44,14 +46,58 @@ namespace sim {
 
 class Simulator {
  public:
-  explicit Simulator();
+  /**
+   * @param trace_event_store optional trace that has already been loaded
+   * into memory. If NULL, the simulator reads the trace itself.
+   */
+  explicit Simulator(const TraceEventStore* trace_event_store = NULL);
   virtual ~Simulator();
   void Run();
   static void SchedulerTimeoutHandler(int sig);
 
+  /**
+   * Creates the trace loader for the type of simulation that is run.
+   * @param event_manager the event manager to which the loader adds events
+   * @return a pointer to the loader, which is owned by the caller
+   */
+  static TraceLoader* NewTraceLoader(EventManager* event_manager);
+
+  uint64_t get_num_duplicate_task_ids() {
+    return bridge_->get_num_duplicate_task_ids();
+  }
+
+  uint64_t get_scheduler_run_cnt() {
+    return scheduler_run_cnt_;
+  }
+
  private:
   void ReplaySimulation();
 
+  /**
+   * Restores the simulation from --restore_checkpoint_file.
+   * @param trace_loader the loader to resume loading task events from
+   * @param run_scheduler_at set to the time of the next scheduler run
+   * @param current_heartbeat_time set to the time of the next heartbeat
+   * @param num_scheduling_rounds set to the number of rounds run so far
+   */
+  void RestoreCheckpoint(TraceLoader* trace_loader,
+                         uint64_t* run_scheduler_at,
+                         uint64_t* current_heartbeat_time,
+                         uint64_t* num_scheduling_rounds);
+
+  /**
+   * Saves a checkpoint of the simulation to --checkpoint_file. The method
+   * must be called in between scheduler runs.
+   * @param trace_loader the loader from which task events are loaded
+   * @param run_scheduler_at the time of the next scheduler run
+   * @param current_heartbeat_time the time of the next heartbeat
+   * @param num_scheduling_rounds the number of rounds run so far
+   */
+  void SaveCheckpoint(TraceLoader* trace_loader,
+                      uint64_t run_scheduler_at,
+                      uint64_t current_heartbeat_time,
+                      uint64_t num_scheduling_rounds);
+
   /**
    * Runs the scheduler.
    * @param the time when the scheduler should run
@@ -64,6 +110,7 @@ class Simulator {
   EventManager* event_manager_;
   SimulatedWallTime simulated_time_;
   uint64_t scheduler_run_cnt_;
+  const TraceEventStore* trace_event_store_;
 };
 
 }  // namespace sim
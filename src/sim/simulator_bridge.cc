@@ -48,6 +48,7 @@ using boost::hash;
 DECLARE_uint64(runtime);
 DECLARE_string(scheduler);
 DECLARE_uint64(sim_machine_max_ram);
+DECLARE_string(sim_machine_topology);
 DECLARE_int32(flow_scheduling_cost_model);
 DECLARE_double(trace_speed_up);
 DECLARE_bool(enable_task_interference);
@@ -60,7 +61,8 @@ SimulatorBridge::SimulatorBridge(EventManager* event_manager,
     : event_manager_(event_manager), simulated_time_(simulated_time),
     job_map_(new JobMap_t),
     resource_map_(new ResourceMap_t), task_map_(new TaskMap_t),
-    num_duplicate_task_ids_(0) {
+    topology_manager_(new machine::topology::TopologyManager),
+    num_duplicate_task_ids_(0), restoring_checkpoint_(false) {
   trace_generator_ = new TraceGenerator(simulated_time_);
   if (FLAGS_flow_scheduling_cost_model == COST_MODEL_QUINCY) {
     // We're running Quincy => simulate the DFS.
@@ -86,9 +88,7 @@ SimulatorBridge::SimulatorBridge(EventManager* event_manager,
         job_map_, resource_map_, &rtn_root_,
         shared_ptr<store::ObjectStoreInterface>(
             new store::SimpleObjectStore(root_uuid)),
-        task_map_, knowledge_base_,
-        shared_ptr<machine::topology::TopologyManager>(
-            new machine::topology::TopologyManager),
+        task_map_, knowledge_base_, topology_manager_,
         messaging_adapter_, this, root_uuid, "http://localhost",
         simulated_time_, trace_generator_, NULL, NULL);
   } else {
@@ -96,20 +96,20 @@ SimulatorBridge::SimulatorBridge(EventManager* event_manager,
         job_map_, resource_map_, &rtn_root_,
         shared_ptr<store::ObjectStoreInterface>(
             new store::SimpleObjectStore(root_uuid)),
-        task_map_, knowledge_base_,
-        shared_ptr<machine::topology::TopologyManager>(
-            new machine::topology::TopologyManager),
+        task_map_, knowledge_base_, topology_manager_,
         messaging_adapter_, this, root_uuid, "http://localhost",
         simulated_time_, trace_generator_);
   }
-  // Import a fictional machine resource topology
-  LoadMachineTemplate(&machine_tmpl_);
+  // Import a fictional machine resource topology, unless the machines are
+  // synthetic.
+  if (FLAGS_sim_machine_topology.empty()) {
+    LoadMachineTemplate(&machine_tmpl_);
+  }
   scheduler_->RegisterResource(&rtn_root_, false, true);
   if (FLAGS_enable_task_interference) {
     if (FLAGS_flow_scheduling_cost_model == COST_MODEL_QUINCY) {
       task_interference_model_ =
-        new QuincyTaskInterference(scheduler_, &machine_res_id_pus_,
-                                   resource_map_, task_map_, &task_runtime_);
+        new QuincyTaskInterference(resource_map_, task_map_, &task_runtime_);
     } else {
       LOG(FATAL) << "--enable_task_interference set, but cost model doesn't "
                  << "have interference model";
@@ -145,7 +145,14 @@ ResourceDescriptor* SimulatorBridge::AddMachine(
     uint64_t machine_id) {
   // Create a new machine topology descriptor.
   ResourceTopologyNodeDescriptor* new_machine = rtn_root_.add_children();
-  new_machine->CopyFrom(machine_tmpl_);
+  if (FLAGS_sim_machine_topology.empty()) {
+    new_machine->CopyFrom(machine_tmpl_);
+  } else {
+    // The topology manager caches the tree, so hwloc only runs for the first
+    // machine.
+    topology_manager_->SyntheticTopologyAsProtobuf(FLAGS_sim_machine_topology,
+                                                   new_machine);
+  }
   const string& root_uuid = rtn_root_.resource_desc().uuid();
   string hostname = "firmament_simulation_machine_" +
     lexical_cast<string>(machine_id);
@@ -168,27 +175,12 @@ ResourceDescriptor* SimulatorBridge::AddMachine(
 }
 
 void SimulatorBridge::AddMachineSamples(uint64_t current_time) {
+  // The per-machine utilization is kept up to date by the task placement,
+  // completion, eviction and migration callbacks. Hence, we don't have to
+  // visit the tasks running on each machine here.
   for (auto& machine_id_rtnd : trace_machine_id_to_rtnd_) {
-    ResourceDescriptor* machine_rd_ptr =
-      machine_id_rtnd.second->mutable_resource_desc();
-    unordered_map<TaskID_t, ResourceDescriptor*> running_task_id_to_rd;
-    vector<ResourceDescriptor*> pu_rds;
-    pair<multimap<ResourceID_t, ResourceDescriptor*>::iterator,
-         multimap<ResourceID_t, ResourceDescriptor*>::iterator> range_it =
-      machine_res_id_pus_.equal_range(
-          ResourceIDFromString(machine_rd_ptr->uuid()));
-    for (; range_it.first != range_it.second; range_it.first++) {
-      pu_rds.push_back(range_it.first->second);
-    }
-    for (auto& rd_ptr : pu_rds) {
-      vector<TaskID_t> tasks =
-        scheduler_->BoundTasksForResource(ResourceIDFromString(rd_ptr->uuid()));
-      for (auto& task : tasks) {
-        CHECK(InsertIfNotPresent(&running_task_id_to_rd, task, rd_ptr));
-      }
-    }
-    knowledge_base_->AddMachineSample(current_time, machine_rd_ptr,
-                                      running_task_id_to_rd);
+    knowledge_base_->AddMachineSample(
+        current_time, machine_id_rtnd.second->mutable_resource_desc());
   }
 }
 
@@ -263,6 +255,19 @@ bool SimulatorBridge::AddTask(const TraceTaskIdentifier& task_identifier,
   return true;
 }
 
+void SimulatorBridge::AddTaskUtilization(TaskID_t task_id,
+                                         ResourceDescriptor* rd_ptr) {
+  ResourceID_t pu_res_id = ResourceIDFromString(rd_ptr->uuid());
+  pair<ResourceID_t, uint64_t>* machine_core =
+    FindOrNull(pu_res_id_to_machine_core_, pu_res_id);
+  if (!machine_core) {
+    // The task is not running on a PU. Its utilization is not sampled.
+    return;
+  }
+  knowledge_base_->AddTaskUtilization(task_id, machine_core->first,
+                                      machine_core->second);
+}
+
 void SimulatorBridge::AddTaskStats(
     const TraceTaskIdentifier& trace_task_identifier,
     TaskID_t task_id) {
@@ -461,6 +466,7 @@ void SimulatorBridge::OnTaskCompletion(TaskDescriptor* td_ptr,
       ResourceIDFromString(rd_ptr->uuid()),
       &tasks_end_time);
   UpdateTaskEndEvents(tasks_end_time);
+  knowledge_base_->RemoveTaskUtilization(task_id);
   TraceTaskIdentifier* ti_ptr = FindOrNull(task_id_to_identifier_, task_id);
   CHECK_NOTNULL(ti_ptr);
   trace_task_id_to_td_.erase(*ti_ptr);
@@ -486,6 +492,7 @@ void SimulatorBridge::OnTaskEviction(TaskDescriptor* td_ptr,
       ResourceIDFromString(rd_ptr->uuid()),
       &tasks_end_time);
   UpdateTaskEndEvents(tasks_end_time);
+  knowledge_base_->RemoveTaskUtilization(td_ptr->uid());
 }
 
 void SimulatorBridge::OnTaskFailure(TaskDescriptor* td_ptr,
@@ -505,10 +512,18 @@ void SimulatorBridge::OnTaskMigration(TaskDescriptor* td_ptr,
       ResourceIDFromString(rd_ptr->uuid()),
       &tasks_end_time);
   UpdateTaskEndEvents(tasks_end_time);
+  knowledge_base_->RemoveTaskUtilization(td_ptr->uid());
+  AddTaskUtilization(td_ptr->uid(), rd_ptr);
 }
 
 void SimulatorBridge::OnTaskPlacement(TaskDescriptor* td_ptr,
                                       ResourceDescriptor* rd_ptr) {
+  if (restoring_checkpoint_) {
+    // The task was already running when the checkpoint was taken. Its start
+    // time and its end event have been restored.
+    AddTaskUtilization(td_ptr->uid(), rd_ptr);
+    return;
+  }
   vector<TaskEndRuntimes> tasks_end_time;
   TraceTaskIdentifier* ti_ptr = FindOrNull(task_id_to_identifier_, td_ptr->uid());
   CHECK_NOTNULL(ti_ptr);
@@ -534,6 +549,7 @@ void SimulatorBridge::OnTaskPlacement(TaskDescriptor* td_ptr,
         &tasks_end_time);
     UpdateTaskEndEvents(tasks_end_time);
   }
+  AddTaskUtilization(td_ptr->uid(), rd_ptr);
 }
 
 JobDescriptor* SimulatorBridge::PopulateJob(uint64_t trace_job_id) {
@@ -562,8 +578,21 @@ void SimulatorBridge::RemoveMachine(uint64_t machine_id) {
     FindPtrOrNull(trace_machine_id_to_rtnd_, machine_id);
   CHECK_NOTNULL(rtnd_ptr);
   ResourceID_t res_id = ResourceIDFromString(rtnd_ptr->resource_desc().uuid());
+  vector<ResourceID_t> pu_res_ids;
+  pair<multimap<ResourceID_t, ResourceDescriptor*>::iterator,
+       multimap<ResourceID_t, ResourceDescriptor*>::iterator> range_it =
+    machine_res_id_pus_.equal_range(res_id);
+  for (; range_it.first != range_it.second; range_it.first++) {
+    pu_res_ids.push_back(ResourceIDFromString(range_it.first->second->uuid()));
+  }
   machine_res_id_pus_.erase(res_id);
   scheduler_->DeregisterResource(rtnd_ptr);
+  // The PU mappings are only removed after the resource has been deregistered
+  // because the tasks running on the machine are evicted while deregistering.
+  for (auto& pu_res_id : pu_res_ids) {
+    pu_res_id_to_machine_core_.erase(pu_res_id);
+  }
+  knowledge_base_->RemoveMachineUtilization(res_id);
   trace_machine_id_to_rtnd_.erase(machine_id);
   // We only free the ResourceTopologyNodeDescriptor in the destructor.
 }
@@ -590,6 +619,196 @@ void SimulatorBridge::RemoveTaskFromSpawned(
   }
 }
 
+ResourceDescriptor* SimulatorBridge::ResourceDescriptorForCore(
+    uint64_t machine_id,
+    uint64_t core_id) {
+  ResourceTopologyNodeDescriptor* rtnd_ptr =
+    FindPtrOrNull(trace_machine_id_to_rtnd_, machine_id);
+  CHECK_NOTNULL(rtnd_ptr);
+  ResourceID_t res_id = ResourceIDFromString(rtnd_ptr->resource_desc().uuid());
+  pair<multimap<ResourceID_t, ResourceDescriptor*>::iterator,
+       multimap<ResourceID_t, ResourceDescriptor*>::iterator> range_it =
+    machine_res_id_pus_.equal_range(res_id);
+  for (; range_it.first != range_it.second; range_it.first++) {
+    pair<ResourceID_t, uint64_t>* machine_core =
+      FindOrNull(pu_res_id_to_machine_core_,
+                 ResourceIDFromString(range_it.first->second->uuid()));
+    CHECK_NOTNULL(machine_core);
+    if (machine_core->second == core_id) {
+      return range_it.first->second;
+    }
+  }
+  LOG(FATAL) << "Machine " << machine_id << " does not have core " << core_id;
+  return NULL;
+}
+
+void SimulatorBridge::RestoreCheckpoint(const SimulatorCheckpoint& checkpoint,
+                                        TraceLoader* trace_loader) {
+  if (data_layer_manager_ || FLAGS_enable_task_interference) {
+    LOG(FATAL) << "Checkpoints are not supported for simulations of the DFS "
+               << "or of task interference";
+  }
+  // Reload the per-task trace data. The machine and task events are part
+  // of the event manager's checkpointed state.
+  trace_loader->LoadTasksRunningTime(&task_runtime_);
+  trace_loader->LoadTaskUtilizationStats(&task_id_to_stats_, task_runtime_);
+  for (auto& task_runtime : checkpoint.task_runtimes()) {
+    InsertOrUpdate(&task_runtime_, task_runtime.task_id(),
+                   task_runtime.runtime());
+  }
+  for (auto& job_num_tasks : checkpoint.job_num_tasks()) {
+    CHECK(InsertIfNotPresent(&job_num_tasks_, job_num_tasks.job_id(),
+                             job_num_tasks.num_tasks()));
+    CHECK(InsertIfNotPresent(&immutable_job_num_tasks_, job_num_tasks.job_id(),
+                             job_num_tasks.immutable_num_tasks()));
+  }
+  for (auto& submitted_task : checkpoint.submitted_tasks()) {
+    TraceTaskIdentifier task_identifier;
+    task_identifier.job_id = submitted_task.job_id();
+    task_identifier.task_index = submitted_task.task_index();
+    submitted_tasks_.insert(task_identifier);
+  }
+  num_duplicate_task_ids_ = checkpoint.num_duplicate_task_ids();
+  for (auto& machine_id : checkpoint.machine_ids()) {
+    AddMachine(machine_id);
+  }
+  knowledge_base_->RestoreCheckpoint(checkpoint.knowledge_base());
+  unordered_map<TaskID_t, const TaskPlacementDescriptor*> task_placements;
+  for (auto& placement : checkpoint.placements()) {
+    CHECK(InsertIfNotPresent(&task_placements, placement.task_id(),
+                             &placement));
+  }
+  vector<JobDescriptor*> jd_ptr_vect;
+  vector<pair<TaskDescriptor*, ResourceDescriptor*> > placements;
+  for (auto& jd : checkpoint.jobs()) {
+    JobID_t job_id = JobIDFromString(jd.uuid());
+    CHECK(InsertIfNotPresent(job_map_.get(), job_id, jd));
+    // Get the new value of the pointer because jd has been copied.
+    JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
+    uint64_t trace_job_id = jd_ptr->root_task().trace_job_id();
+    CHECK(InsertIfNotPresent(&trace_job_id_to_jd_, trace_job_id, jd_ptr));
+    InsertOrUpdate(&job_id_to_trace_job_id_, job_id, trace_job_id);
+    vector<TaskDescriptor*> td_ptr_vect;
+    td_ptr_vect.push_back(jd_ptr->mutable_root_task());
+    for (auto& td : *jd_ptr->mutable_root_task()->mutable_spawned()) {
+      td_ptr_vect.push_back(&td);
+    }
+    for (auto& td_ptr : td_ptr_vect) {
+      bool was_running = td_ptr->state() == TaskDescriptor::RUNNING;
+      if (!RestoreTask(jd_ptr, td_ptr) || !was_running) {
+        continue;
+      }
+      const TaskPlacementDescriptor* placement =
+        FindPtrOrNull(task_placements, td_ptr->uid());
+      CHECK_NOTNULL(placement);
+      placements.push_back(pair<TaskDescriptor*, ResourceDescriptor*>(
+          td_ptr, ResourceDescriptorForCore(placement->machine_id(),
+                                            placement->core_id())));
+    }
+    jd_ptr_vect.push_back(jd_ptr);
+  }
+  // RestoreTask has moved the stats of the submitted tasks that are still
+  // live to the knowledge base. The remaining submitted tasks have completed
+  // and no longer need their stats.
+  for (auto& task_identifier : submitted_tasks_) {
+    task_id_to_stats_.erase(GenerateTaskIDFromTraceIdentifier(task_identifier));
+  }
+  for (auto& jd_ptr : jd_ptr_vect) {
+    scheduler_->AddJob(jd_ptr);
+  }
+  restoring_checkpoint_ = true;
+  scheduler_->RestoreTaskPlacements(placements);
+  restoring_checkpoint_ = false;
+}
+
+bool SimulatorBridge::RestoreTask(JobDescriptor* jd_ptr,
+                                  TaskDescriptor* td_ptr) {
+  if (td_ptr->state() == TaskDescriptor::COMPLETED) {
+    // Only the root task of a job is kept after completion.
+    if (td_ptr == jd_ptr->mutable_root_task()) {
+      CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+    }
+    return false;
+  }
+  TraceTaskIdentifier task_identifier;
+  task_identifier.job_id = td_ptr->trace_job_id();
+  task_identifier.task_index = td_ptr->trace_task_id();
+  CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+  CHECK(InsertIfNotPresent(&task_id_to_identifier_, td_ptr->uid(),
+                           task_identifier));
+  CHECK(InsertIfNotPresent(&trace_task_id_to_td_, task_identifier, td_ptr));
+  AddTaskStats(task_identifier, td_ptr->uid());
+  knowledge_base_->SetTaskType(td_ptr);
+  // The scheduler recomputes the runnable tasks once the job is added, and
+  // the running tasks are placed again on their PUs.
+  td_ptr->set_state(TaskDescriptor::CREATED);
+  td_ptr->clear_scheduled_to_resource();
+  return true;
+}
+
+void SimulatorBridge::SaveCheckpoint(SimulatorCheckpoint* checkpoint) {
+  if (data_layer_manager_ || FLAGS_enable_task_interference) {
+    LOG(FATAL) << "Checkpoints are not supported for simulations of the DFS "
+               << "or of task interference";
+  }
+  unordered_map<ResourceID_t, uint64_t, boost::hash<boost::uuids::uuid> >
+    machine_res_id_to_trace_machine_id;
+  for (auto& machine_id_rtnd : trace_machine_id_to_rtnd_) {
+    checkpoint->add_machine_ids(machine_id_rtnd.first);
+    CHECK(InsertIfNotPresent(
+        &machine_res_id_to_trace_machine_id,
+        ResourceIDFromString(machine_id_rtnd.second->resource_desc().uuid()),
+        machine_id_rtnd.first));
+  }
+  for (auto& job_id_jd : *job_map_) {
+    checkpoint->add_jobs()->CopyFrom(job_id_jd.second);
+  }
+  // task_id_to_identifier_ only contains the tasks that have not completed.
+  for (auto& task_id_identifier : task_id_to_identifier_) {
+    TaskID_t task_id = task_id_identifier.first;
+    uint64_t* runtime_ptr = FindOrNull(task_runtime_, task_id);
+    if (runtime_ptr) {
+      TaskRuntimeDescriptor* task_runtime = checkpoint->add_task_runtimes();
+      task_runtime->set_task_id(task_id);
+      task_runtime->set_runtime(*runtime_ptr);
+    }
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    CHECK_NOTNULL(td_ptr);
+    if (td_ptr->state() != TaskDescriptor::RUNNING) {
+      continue;
+    }
+    pair<ResourceID_t, uint64_t>* machine_core =
+      FindOrNull(pu_res_id_to_machine_core_,
+                 ResourceIDFromString(td_ptr->scheduled_to_resource()));
+    CHECK_NOTNULL(machine_core);
+    uint64_t* machine_id =
+      FindOrNull(machine_res_id_to_trace_machine_id, machine_core->first);
+    CHECK_NOTNULL(machine_id);
+    TaskPlacementDescriptor* placement = checkpoint->add_placements();
+    placement->set_task_id(task_id);
+    placement->set_machine_id(*machine_id);
+    placement->set_core_id(machine_core->second);
+  }
+  for (auto& job_id_num_tasks : job_num_tasks_) {
+    JobNumTasksDescriptor* job_num_tasks = checkpoint->add_job_num_tasks();
+    job_num_tasks->set_job_id(job_id_num_tasks.first);
+    job_num_tasks->set_num_tasks(job_id_num_tasks.second);
+    uint64_t* immutable_num_tasks =
+      FindOrNull(immutable_job_num_tasks_, job_id_num_tasks.first);
+    if (immutable_num_tasks) {
+      job_num_tasks->set_immutable_num_tasks(*immutable_num_tasks);
+    }
+  }
+  for (auto& task_identifier : submitted_tasks_) {
+    TraceTaskIdentifierDescriptor* submitted_task =
+      checkpoint->add_submitted_tasks();
+    submitted_task->set_job_id(task_identifier.job_id);
+    submitted_task->set_task_index(task_identifier.task_index);
+  }
+  checkpoint->set_num_duplicate_task_ids(num_duplicate_task_ids_);
+  knowledge_base_->SaveCheckpoint(checkpoint->mutable_knowledge_base());
+}
+
 void SimulatorBridge::SetupMachine(
     ResourceTopologyNodeDescriptor* rtnd,
     ResourceVector* machine_res_cap,
@@ -638,6 +857,16 @@ void SimulatorBridge::SetupMachine(
     machine_res_cap->set_cpu_cores(cpu_cores);
     machine_res_id_pus_.insert(
         pair<ResourceID_t, ResourceDescriptor*>(machine_res_id, rd));
+    // Extract the core id from the PU label once, so that machine samples do
+    // not have to parse it for every running task.
+    const string& label = rd->friendly_name();
+    size_t idx = label.find("PU #");
+    CHECK_NE(idx, string::npos)
+      << "PU label does not contain core id for resource: " << rd->uuid();
+    uint64_t core_id = strtoull(label.c_str() + idx + 4, NULL, 10);
+    CHECK(InsertIfNotPresent(
+        &pu_res_id_to_machine_core_, ResourceIDFromString(rd->uuid()),
+        pair<ResourceID_t, uint64_t>(machine_res_id, core_id)));
   }
 }
 
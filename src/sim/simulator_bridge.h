@@ -38,6 +38,7 @@
 #include "sim/interference/task_interference_interface.h"
 #include "sim/knowledge_base_simulator.h"
 #include "sim/simulated_wall_time.h"
+#include "sim/simulator_checkpoint.pb.h"
 #include "sim/trace_loader.h"
 #include "sim/trace_utils.h"
 #include "storage/object_store_interface.h"
@@ -154,6 +155,24 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
    */
   void RemoveMachine(uint64_t machine_id);
 
+  /**
+   * Restores the simulator's jobs, tasks, machines and knowledge base from a
+   * checkpoint. The flow graph is not part of the checkpoint; it is rebuilt
+   * by re-adding the machines and jobs, and by pinning the running tasks to
+   * the PUs they were running on.
+   * @param checkpoint the checkpoint from which to restore
+   * @param trace_loader the loader used to reload the per-task trace data
+   */
+  void RestoreCheckpoint(const SimulatorCheckpoint& checkpoint,
+                         TraceLoader* trace_loader);
+
+  /**
+   * Saves the simulator's jobs, tasks, machines and knowledge base state.
+   * The method must be called in between scheduler runs.
+   * @param checkpoint the protobuf in which to save the state
+   */
+  void SaveCheckpoint(SimulatorCheckpoint* checkpoint);
+
   void ScheduleJobs(SchedulerStats* scheduler_stats);
 
   /**
@@ -173,12 +192,15 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
 
  private:
   FRIEND_TEST(SimulatorBridgeTest, AddMachine);
+  FRIEND_TEST(SimulatorBridgeTest, AddMachineSamples);
+  FRIEND_TEST(SimulatorBridgeTest, AddSyntheticMachine);
   FRIEND_TEST(SimulatorBridgeTest, AddTask);
   FRIEND_TEST(SimulatorBridgeTest, OnJobCompletion);
   FRIEND_TEST(SimulatorBridgeTest, OnTaskCompletion);
   FRIEND_TEST(SimulatorBridgeTest, OnTaskEviction);
   FRIEND_TEST(SimulatorBridgeTest, OnTaskPlacement);
   FRIEND_TEST(SimulatorBridgeTest, RemoveMachine);
+  FRIEND_TEST(SimulatorBridgeTest, SaveAndRestoreCheckpoint);
 
   /**
    * Add task statistics to the knowledge base.
@@ -188,6 +210,13 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
   void AddTaskStats(const TraceTaskIdentifier& trace_task_identifier,
                     TaskID_t task_id);
 
+  /**
+   * Accounts for the utilization of a task in its machine's samples.
+   * @param task_id the Firmament task id
+   * @param rd_ptr the descriptor of the PU on which the task runs
+   */
+  void AddTaskUtilization(TaskID_t task_id, ResourceDescriptor* rd_ptr);
+
   /**
    * Creates a new task for a job.
    * @param jd_ptr the job descriptor of the job for which to create a new task
@@ -212,6 +241,22 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
   void RemoveTaskFromSpawned(JobDescriptor* jd_ptr,
                              const TaskDescriptor& td_to_remove);
 
+  /**
+   * Returns the descriptor of a machine's PU.
+   * @param machine_id the simulator id of the machine
+   * @param core_id the core id of the PU on the machine
+   */
+  ResourceDescriptor* ResourceDescriptorForCore(uint64_t machine_id,
+                                                uint64_t core_id);
+
+  /**
+   * Adds a task restored from a checkpoint to the simulator's mappings.
+   * @param jd_ptr the descriptor of the task's job
+   * @param td_ptr the descriptor of the task
+   * @return true if the task has not completed
+   */
+  bool RestoreTask(JobDescriptor* jd_ptr, TaskDescriptor* td_ptr);
+
   /**
    * The resource topology is built from the same protobuf file. The function
    * changes the uuids to make sure that there's no two identical uuids.
@@ -254,6 +299,10 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
   // Multimap storing the mapping between machine resource ids and their PU
   // resource descriptors.
   multimap<ResourceID_t, ResourceDescriptor*> machine_res_id_pus_;
+  // Map from PU resource id to the resource id of its machine and the PU's
+  // core id on the machine.
+  unordered_map<ResourceID_t, pair<ResourceID_t, uint64_t>,
+    boost::hash<boost::uuids::uuid> > pu_res_id_to_machine_core_;
 
   platform::sim::SimulatedMessagingAdapter<BaseMessage>* messaging_adapter_;
 
@@ -291,13 +340,19 @@ class SimulatorBridge : public scheduler::SchedulingEventNotifierInterface {
   // Map used to convert between the new uuids assigned to the machine nodes and
   // the old uuids read from the machine topology file.
   unordered_map<string, string> uuid_conversion_map_;
-  // The template topology descriptor of the new machine.
+  // The template topology descriptor of the new machine. Unused if the
+  // machines are built from --sim_machine_topology.
   ResourceTopologyNodeDescriptor machine_tmpl_;
+  // Builds the synthetic machine topologies, and is shared with the scheduler.
+  shared_ptr<machine::topology::TopologyManager> topology_manager_;
   // Counter used to store the number of duplicate task ids seed in the trace.
   uint64_t num_duplicate_task_ids_;
   // Object used to get task interference information.
   TaskInterferenceInterface* task_interference_model_;
   TraceGenerator* trace_generator_;
+  // True while the running tasks of a checkpoint are being placed. Their
+  // start times and end events are already part of the checkpoint.
+  bool restoring_checkpoint_;
 };
 
 }  // namespace sim
@@ -29,11 +29,58 @@
 #include "sim/trace_utils.h"
 
 DECLARE_string(machine_tmpl_file);
+DECLARE_string(sim_machine_topology);
 DEFINE_string(scheduler, "flow", "The scheduler to use for tests.");
 
 namespace firmament {
 namespace sim {
 
+// Trace loader without any trace data, used to restore checkpoints.
+class EmptyTraceLoader : public TraceLoader {
+ public:
+  explicit EmptyTraceLoader(EventManager* event_manager)
+    : TraceLoader(event_manager) {
+  }
+  void LoadJobsNumTasks(unordered_map<uint64_t, uint64_t>* job_num_tasks) {
+  }
+  void LoadMachineEvents(multimap<uint64_t, EventDescriptor>* machine_events) {
+  }
+  bool LoadTaskEvents(uint64_t events_up_to_time,
+                      unordered_map<uint64_t, uint64_t>* job_num_tasks) {
+    return false;
+  }
+  void LoadTaskUtilizationStats(
+      unordered_map<TaskID_t, TraceTaskStats>* task_id_to_stats,
+      const unordered_map<TaskID_t, uint64_t>& task_runtimes) {
+  }
+  void LoadTasksRunningTime(unordered_map<TaskID_t, uint64_t>* task_runtime) {
+  }
+  void RestoreState(const TraceLoaderCheckpoint& state) {
+  }
+  void SaveState(TraceLoaderCheckpoint* state) {
+  }
+};
+
+// Trace loader that only provides the utilization stats of some tasks.
+class StatsTraceLoader : public EmptyTraceLoader {
+ public:
+  explicit StatsTraceLoader(EventManager* event_manager)
+    : EmptyTraceLoader(event_manager) {
+  }
+  void AddTaskStats(TaskID_t task_id, const TraceTaskStats& task_stats) {
+    CHECK(InsertIfNotPresent(&task_id_to_stats_, task_id, task_stats));
+  }
+  void LoadTaskUtilizationStats(
+      unordered_map<TaskID_t, TraceTaskStats>* task_id_to_stats,
+      const unordered_map<TaskID_t, uint64_t>& task_runtimes) {
+    task_id_to_stats->insert(task_id_to_stats_.begin(),
+                             task_id_to_stats_.end());
+  }
+
+ private:
+  unordered_map<TaskID_t, TraceTaskStats> task_id_to_stats_;
+};
+
 class SimulatorBridgeTest : public ::testing::Test {
  protected:
   SimulatorBridgeTest() {
@@ -85,6 +132,73 @@ TEST_F(SimulatorBridgeTest, AddMachine) {
   CHECK_EQ(bridge_->machine_res_id_pus_.size(), 16);
 }
 
+TEST_F(SimulatorBridgeTest, AddSyntheticMachine) {
+  FLAGS_sim_machine_topology = "socket:2 core:2 pu:2";
+  // A machine, 2 sockets, 4 cores and 8 PUs.
+  bridge_->AddMachine(1);
+  CHECK_EQ(bridge_->resource_map_->size(), 16);
+  CHECK_EQ(bridge_->machine_res_id_pus_.size(), 8);
+  // The second machine is cloned from the cached topology, but gets its own
+  // resource IDs.
+  bridge_->AddMachine(2);
+  CHECK_EQ(bridge_->resource_map_->size(), 31);
+  CHECK_EQ(bridge_->trace_machine_id_to_rtnd_.size(), 2);
+  CHECK_EQ(bridge_->machine_res_id_pus_.size(), 16);
+  FLAGS_sim_machine_topology = "";
+}
+
+TEST_F(SimulatorBridgeTest, AddMachineSamples) {
+  TraceTaskIdentifier trace_task_id;
+  trace_task_id.job_id = 1;
+  trace_task_id.task_index = 1;
+  TaskID_t task_id = GenerateTaskIDFromTraceIdentifier(trace_task_id);
+  TraceTaskStats task_stats;
+  task_stats.avg_mean_cpu_usage_ = 0.5;
+  task_stats.avg_canonical_mem_usage_ = 100;
+  CHECK(InsertIfNotPresent(&bridge_->task_id_to_stats_, task_id, task_stats));
+  EventDescriptor event_desc;
+  event_desc.set_type(EventDescriptor::TASK_SUBMIT);
+  event_desc.set_requested_ram(1024);
+  event_desc.set_requested_cpu_cores(1000);
+  ResourceDescriptor* machine_rd_ptr = bridge_->AddMachine(1);
+  ResourceID_t machine_res_id = ResourceIDFromString(machine_rd_ptr->uuid());
+  bridge_->AddTask(trace_task_id, event_desc);
+  TaskDescriptor* td_ptr =
+    FindPtrOrNull(bridge_->trace_task_id_to_td_, trace_task_id);
+  ResourceDescriptor* pu_rd_ptr = bridge_->machine_res_id_pus_.begin()->second;
+  pair<ResourceID_t, uint64_t>* machine_core =
+    FindOrNull(bridge_->pu_res_id_to_machine_core_,
+               ResourceIDFromString(pu_rd_ptr->uuid()));
+  CHECK_NOTNULL(machine_core);
+  CHECK_EQ(machine_core->first, machine_res_id);
+  CHECK(InsertIfNotPresent(&bridge_->job_num_tasks_, trace_task_id.job_id, 1));
+  CHECK(InsertIfNotPresent(&bridge_->task_runtime_, task_id, 10));
+  bridge_->OnTaskPlacement(td_ptr, pu_rd_ptr);
+  bridge_->AddMachineSamples(5);
+  ResourceStats stats;
+  CHECK(bridge_->knowledge_base_->GetLatestStatsForMachine(machine_res_id,
+                                                           &stats));
+  CHECK_EQ(stats.timestamp(), 5);
+  CHECK_EQ(stats.mem_utilization(), 100);
+  CHECK_EQ(stats.cpus_stats_size(), 8);
+  for (int32_t core_id = 0; core_id < stats.cpus_stats_size(); ++core_id) {
+    if (static_cast<uint64_t>(core_id) == machine_core->second) {
+      CHECK_DOUBLE_EQ(stats.cpus_stats(core_id).cpu_utilization(), 0.5);
+    } else {
+      CHECK_DOUBLE_EQ(stats.cpus_stats(core_id).cpu_utilization(), 0.0);
+    }
+  }
+  // The task's usage must not be accounted for after it completes.
+  bridge_->OnTaskCompletion(td_ptr, pu_rd_ptr);
+  bridge_->AddMachineSamples(10);
+  CHECK(bridge_->knowledge_base_->GetLatestStatsForMachine(machine_res_id,
+                                                           &stats));
+  CHECK_EQ(stats.timestamp(), 10);
+  CHECK_EQ(stats.mem_utilization(), 0);
+  CHECK_DOUBLE_EQ(
+      stats.cpus_stats(machine_core->second).cpu_utilization(), 0.0);
+}
+
 TEST_F(SimulatorBridgeTest, AddTask) {
   TraceTaskIdentifier trace_task_id;
   trace_task_id.job_id = 1;
@@ -261,6 +375,93 @@ TEST_F(SimulatorBridgeTest, RemoveMachine) {
   CHECK_EQ(bridge_->machine_res_id_pus_.size(), 0);
 }
 
+TEST_F(SimulatorBridgeTest, SaveAndRestoreCheckpoint) {
+  TraceTaskIdentifier running_task_id;
+  running_task_id.job_id = 1;
+  running_task_id.task_index = 1;
+  TraceTaskIdentifier runnable_task_id;
+  runnable_task_id.job_id = 1;
+  runnable_task_id.task_index = 2;
+  EventDescriptor event_desc;
+  event_desc.set_type(EventDescriptor::TASK_SUBMIT);
+  bridge_->AddMachine(1);
+  CHECK(InsertIfNotPresent(&bridge_->job_num_tasks_, 1, 2));
+  CHECK(InsertIfNotPresent(&bridge_->immutable_job_num_tasks_, 1, 2));
+  CHECK(bridge_->AddTask(running_task_id, event_desc));
+  CHECK(bridge_->AddTask(runnable_task_id, event_desc));
+  TaskDescriptor* td_ptr =
+    FindPtrOrNull(bridge_->trace_task_id_to_td_, running_task_id);
+  CHECK_NOTNULL(td_ptr);
+  ResourceDescriptor* pu_rd_ptr = bridge_->machine_res_id_pus_.begin()->second;
+  pair<ResourceID_t, uint64_t>* machine_core =
+    FindOrNull(bridge_->pu_res_id_to_machine_core_,
+               ResourceIDFromString(pu_rd_ptr->uuid()));
+  CHECK_NOTNULL(machine_core);
+  vector<pair<TaskDescriptor*, ResourceDescriptor*> > placements;
+  placements.push_back(
+      pair<TaskDescriptor*, ResourceDescriptor*>(td_ptr, pu_rd_ptr));
+  bridge_->scheduler_->RestoreTaskPlacements(placements);
+  CHECK_EQ(td_ptr->state(), TaskDescriptor::RUNNING);
+  SimulatorCheckpoint checkpoint;
+  bridge_->SaveCheckpoint(&checkpoint);
+  CHECK_EQ(checkpoint.machine_ids_size(), 1);
+  CHECK_EQ(checkpoint.jobs_size(), 1);
+  CHECK_EQ(checkpoint.submitted_tasks_size(), 2);
+  CHECK_EQ(checkpoint.placements_size(), 1);
+  CHECK_EQ(checkpoint.placements(0).task_id(), td_ptr->uid());
+  CHECK_EQ(checkpoint.placements(0).machine_id(), 1);
+  CHECK_EQ(checkpoint.placements(0).core_id(), machine_core->second);
+  // Restore the checkpoint in a new bridge. The running task must be bound
+  // to the same core, even though the PUs have new resource ids.
+  SimulatorBridge restored_bridge(event_manager_, simulated_time_);
+  // The trace stats are not checkpointed, but reloaded from the trace.
+  StatsTraceLoader trace_loader(event_manager_);
+  TraceTaskStats running_task_stats;
+  running_task_stats.avg_mean_cpu_usage_ = 0.5;
+  running_task_stats.avg_canonical_mem_usage_ = 100;
+  trace_loader.AddTaskStats(GenerateTaskIDFromTraceIdentifier(running_task_id),
+                            running_task_stats);
+  TraceTaskStats runnable_task_stats;
+  runnable_task_stats.avg_mean_cpu_usage_ = 0.25;
+  trace_loader.AddTaskStats(
+      GenerateTaskIDFromTraceIdentifier(runnable_task_id),
+      runnable_task_stats);
+  restored_bridge.RestoreCheckpoint(checkpoint, &trace_loader);
+  CHECK_EQ(restored_bridge.trace_machine_id_to_rtnd_.size(), 1);
+  CHECK_EQ(restored_bridge.task_map_->size(), 2);
+  CHECK_EQ(restored_bridge.submitted_tasks_.size(), 2);
+  CHECK_EQ(restored_bridge.job_num_tasks_[1], 2);
+  TaskDescriptor* restored_td_ptr =
+    FindPtrOrNull(restored_bridge.trace_task_id_to_td_, running_task_id);
+  CHECK_NOTNULL(restored_td_ptr);
+  CHECK_EQ(restored_td_ptr->state(), TaskDescriptor::RUNNING);
+  CHECK_EQ(restored_td_ptr->start_time(), td_ptr->start_time());
+  ResourceID_t* res_id_ptr =
+    restored_bridge.scheduler_->BoundResourceForTask(restored_td_ptr->uid());
+  CHECK_NOTNULL(res_id_ptr);
+  pair<ResourceID_t, uint64_t>* restored_machine_core =
+    FindOrNull(restored_bridge.pu_res_id_to_machine_core_, *res_id_ptr);
+  CHECK_NOTNULL(restored_machine_core);
+  CHECK_EQ(restored_machine_core->second, machine_core->second);
+  TaskDescriptor* runnable_td_ptr =
+    FindPtrOrNull(restored_bridge.trace_task_id_to_td_, runnable_task_id);
+  CHECK_NOTNULL(runnable_td_ptr);
+  CHECK_EQ(runnable_td_ptr->state(), TaskDescriptor::RUNNABLE);
+  // The stats of both live tasks survive the restore and have been moved to
+  // the knowledge base.
+  CHECK(restored_bridge.task_id_to_stats_.empty());
+  const unordered_map<TaskID_t, TraceTaskStats>& kb_task_stats =
+    restored_bridge.knowledge_base_->task_stats_;
+  const TraceTaskStats* restored_stats =
+    FindOrNull(kb_task_stats, restored_td_ptr->uid());
+  CHECK_NOTNULL(restored_stats);
+  CHECK_DOUBLE_EQ(restored_stats->avg_mean_cpu_usage_, 0.5);
+  CHECK_DOUBLE_EQ(restored_stats->avg_canonical_mem_usage_, 100);
+  restored_stats = FindOrNull(kb_task_stats, runnable_td_ptr->uid());
+  CHECK_NOTNULL(restored_stats);
+  CHECK_DOUBLE_EQ(restored_stats->avg_mean_cpu_usage_, 0.25);
+}
+
 } // namespace sim
 } // namespace firmament
 
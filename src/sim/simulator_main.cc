@@ -20,12 +20,20 @@
 
 #include "base/common.h"
 #include "sim/simulator.h"
+#include "sim/simulator_sweep.h"
+
+DECLARE_string(sweep_scenarios_file);
 
 using namespace firmament;  // NOLINT
 
 int main(int argc, char *argv[]) {
   VLOG(1) << "Calling common::InitFirmament";
   common::InitFirmament(argc, argv);
+  if (!FLAGS_sweep_scenarios_file.empty()) {
+    sim::SimulatorSweep sweep;
+    sweep.Run();
+    return 0;
+  }
   //HeapProfilerStart("ts");
   sim::Simulator simulator;
   //HeapProfilerStop();
@@ -0,0 +1,249 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Runs several simulations of the same trace with different flag settings.
+
+#include "sim/simulator_sweep.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+#include "misc/wall_time.h"
+#include "sim/simulated_wall_time.h"
+#include "sim/simulator.h"
+
+using boost::algorithm::is_any_of;
+using boost::token_compress_on;
+
+DEFINE_string(sweep_scenarios_file, "",
+              "File describing the scenarios to simulate. Each line contains "
+              "a scenario name followed by --flag=value settings. If set, the "
+              "simulator runs a sweep over these scenarios.");
+DEFINE_uint64(sweep_parallelism, 0,
+              "Maximum number of scenarios to simulate concurrently. 0 means "
+              "one per core.");
+DEFINE_string(sweep_output_dir, "sweep",
+              "Directory in which the per-scenario traces and the sweep "
+              "summary are written.");
+
+DECLARE_string(checkpoint_file);
+DECLARE_bool(generate_trace);
+DECLARE_string(generated_trace_path);
+DECLARE_string(restore_checkpoint_file);
+
+namespace firmament {
+namespace sim {
+
+SimulatorSweep::SimulatorSweep() {
+}
+
+void SimulatorSweep::LoadScenarios() {
+  ifstream scenarios_file(FLAGS_sweep_scenarios_file.c_str());
+  CHECK(scenarios_file.good()) << "Failed to open: "
+                               << FLAGS_sweep_scenarios_file;
+  string line;
+  while (getline(scenarios_file, line)) {
+    boost::trim(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    vector<string> tokens;
+    boost::split(tokens, line, is_any_of(" \t"), token_compress_on);
+    SweepScenario scenario;
+    scenario.name_ = tokens[0];
+    // The name is used as a directory below --sweep_output_dir, so it must
+    // not be able to point elsewhere.
+    CHECK(scenario.name_.find('/') == string::npos &&
+          scenario.name_ != "." && scenario.name_ != "..")
+      << "Scenario name " << scenario.name_ << " is not a valid directory "
+      << "name";
+    for (auto& other_scenario : scenarios_) {
+      CHECK_NE(other_scenario.name_, scenario.name_)
+        << "Scenario " << scenario.name_ << " is defined more than once";
+    }
+    for (uint64_t i = 1; i < tokens.size(); ++i) {
+      string flag = tokens[i];
+      if (flag.compare(0, 2, "--") == 0) {
+        flag = flag.substr(2);
+      }
+      size_t equals_pos = flag.find('=');
+      CHECK_NE(equals_pos, string::npos)
+        << "Flag " << tokens[i] << " of scenario " << scenario.name_
+        << " is not of the form --flag=value";
+      scenario.flags_.push_back(pair<string, string>(
+          flag.substr(0, equals_pos), flag.substr(equals_pos + 1)));
+    }
+    scenarios_.push_back(scenario);
+  }
+  CHECK_GT(scenarios_.size(), 0) << "No scenarios in "
+                                 << FLAGS_sweep_scenarios_file;
+}
+
+void SimulatorSweep::ReadScenarioSummary(SweepScenario* scenario) {
+  string path = FLAGS_sweep_output_dir + "/" + scenario->name_ +
+    "/scenario_summary.csv";
+  FILE* summary_file = fopen(path.c_str(), "r");
+  if (summary_file == NULL) {
+    LOG(ERROR) << "Scenario " << scenario->name_ << " did not write a summary";
+    return;
+  }
+  if (fscanf(summary_file, "%ju,%ju", &scenario->scheduler_run_cnt_,
+             &scenario->num_duplicate_task_ids_) != 2) {
+    LOG(ERROR) << "Unexpected structure of " << path;
+  }
+  fclose(summary_file);
+}
+
+void SimulatorSweep::Run() {
+  if (!FLAGS_checkpoint_file.empty() ||
+      !FLAGS_restore_checkpoint_file.empty()) {
+    LOG(FATAL) << "Checkpoints are not supported in sweep mode";
+  }
+  LoadScenarios();
+  MkdirIfNotPresent(FLAGS_sweep_output_dir);
+  // Load the trace once. The forked simulators share it copy-on-write.
+  SimulatedWallTime simulated_time;
+  EventManager event_manager(&simulated_time);
+  TraceLoader* trace_loader = Simulator::NewTraceLoader(&event_manager);
+  trace_event_store_.Load(trace_loader, &event_manager);
+  delete trace_loader;
+  uint64_t parallelism = FLAGS_sweep_parallelism;
+  if (parallelism == 0) {
+    parallelism = max(boost::thread::hardware_concurrency(), 1U);
+  }
+  LOG(INFO) << "Simulating " << scenarios_.size() << " scenarios, "
+            << parallelism << " at a time";
+  WallTime wall_time;
+  // Map from the pid of a running simulator to the index of its scenario.
+  map<pid_t, uint64_t> running_scenarios;
+  map<pid_t, uint64_t> start_times;
+  uint64_t next_scenario = 0;
+  while (next_scenario < scenarios_.size() || !running_scenarios.empty()) {
+    while (next_scenario < scenarios_.size() &&
+           running_scenarios.size() < parallelism) {
+      // Flush the buffered output so that the children don't repeat it.
+      fflush(NULL);
+      pid_t pid = fork();
+      if (pid < 0) {
+        PLOG(FATAL) << "Failed to fork simulator for scenario "
+                    << scenarios_[next_scenario].name_;
+      } else if (pid == 0) {
+        RunScenario(scenarios_[next_scenario]);
+        exit(0);
+      }
+      VLOG(1) << "Started scenario " << scenarios_[next_scenario].name_
+              << " in process " << pid;
+      CHECK(InsertIfNotPresent(&running_scenarios, pid, next_scenario));
+      CHECK(InsertIfNotPresent(&start_times, pid,
+                               wall_time.GetCurrentTimestamp()));
+      next_scenario++;
+    }
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(FATAL) << "Failed to wait for simulators";
+    }
+    uint64_t* scenario_index = FindOrNull(running_scenarios, pid);
+    if (!scenario_index) {
+      // Not one of our simulators (e.g., a solver process).
+      continue;
+    }
+    SweepScenario* scenario = &scenarios_[*scenario_index];
+    scenario->wall_time_ =
+      wall_time.GetCurrentTimestamp() - start_times[pid];
+    if (WIFEXITED(status)) {
+      scenario->exit_status_ = WEXITSTATUS(status);
+    } else {
+      LOG(ERROR) << "Scenario " << scenario->name_ << " was terminated";
+    }
+    if (scenario->exit_status_ == 0) {
+      ReadScenarioSummary(scenario);
+    }
+    LOG(INFO) << "Scenario " << scenario->name_ << " finished with status "
+              << scenario->exit_status_;
+    running_scenarios.erase(pid);
+    start_times.erase(pid);
+  }
+  WriteSummary();
+}
+
+void SimulatorSweep::RunScenario(const SweepScenario& scenario) {
+  for (auto& flag : scenario.flags_) {
+    if (google::SetCommandLineOption(flag.first.c_str(),
+                                     flag.second.c_str()).empty()) {
+      LOG(FATAL) << "Failed to set --" << flag.first << "=" << flag.second
+                 << " for scenario " << scenario.name_;
+    }
+  }
+  string scenario_dir = FLAGS_sweep_output_dir + "/" + scenario.name_;
+  FLAGS_generate_trace = true;
+  FLAGS_generated_trace_path = scenario_dir;
+  Simulator simulator(&trace_event_store_);
+  simulator.Run();
+  string path = scenario_dir + "/scenario_summary.csv";
+  FILE* summary_file = fopen(path.c_str(), "w");
+  CHECK(summary_file != NULL) << "Failed to open: " << path;
+  fprintf(summary_file, "%ju,%ju\n", simulator.get_scheduler_run_cnt(),
+          simulator.get_num_duplicate_task_ids());
+  fclose(summary_file);
+}
+
+void SimulatorSweep::WriteSummary() {
+  string path = FLAGS_sweep_output_dir + "/summary.csv";
+  FILE* summary_file = fopen(path.c_str(), "w");
+  CHECK(summary_file != NULL) << "Failed to open: " << path;
+  fprintf(summary_file, "scenario,exit_status,wall_time,scheduler_runs,"
+          "duplicate_task_ids,flags\n");
+  for (auto& scenario : scenarios_) {
+    string flags;
+    for (auto& flag : scenario.flags_) {
+      if (!flags.empty()) {
+        flags += " ";
+      }
+      flags += "--" + flag.first + "=" + flag.second;
+    }
+    fprintf(summary_file, "%s,%d,%ju,%ju,%ju,%s\n", scenario.name_.c_str(),
+            scenario.exit_status_, scenario.wall_time_,
+            scenario.scheduler_run_cnt_, scenario.num_duplicate_task_ids_,
+            flags.c_str());
+    LOG(INFO) << scenario.name_ << ": status " << scenario.exit_status_
+              << ", wall time " << scenario.wall_time_ << " us, "
+              << scenario.scheduler_run_cnt_ << " scheduler runs";
+  }
+  fclose(summary_file);
+}
+
+}  // namespace sim
+}  // namespace firmament
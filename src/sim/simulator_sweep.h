@@ -0,0 +1,82 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Runs several simulations of the same trace with different flag settings.
+
+#ifndef FIRMAMENT_SIM_SIMULATOR_SWEEP_H
+#define FIRMAMENT_SIM_SIMULATOR_SWEEP_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "sim/stored_trace_loader.h"
+
+namespace firmament {
+namespace sim {
+
+struct SweepScenario {
+  SweepScenario() : exit_status_(-1), wall_time_(0), scheduler_run_cnt_(0),
+    num_duplicate_task_ids_(0) {
+  }
+  string name_;
+  // Flag name and value pairs that are set for this scenario.
+  vector<pair<string, string> > flags_;
+  // Results of the scenario's simulation.
+  int32_t exit_status_;
+  uint64_t wall_time_;
+  uint64_t scheduler_run_cnt_;
+  uint64_t num_duplicate_task_ids_;
+};
+
+/**
+ * The sweep loads the trace into memory once and then forks a simulator
+ * process for every scenario. Every simulator has its own scheduler, flow
+ * graph and solver, but reads the trace from the shared copy-on-write
+ * TraceEventStore. We use processes rather than threads because the
+ * scheduler reads its configuration from global flags.
+ * N.B. Flags that affect how the trace is loaded (e.g., trace_speed_up) must
+ * not be changed by the scenarios.
+ */
+class SimulatorSweep {
+ public:
+  SimulatorSweep();
+  void Run();
+
+ private:
+  FRIEND_TEST(SimulatorSweepTest, LoadScenarios);
+  FRIEND_TEST(SimulatorSweepTest, RejectsDuplicateScenarioNames);
+  FRIEND_TEST(SimulatorSweepTest, RejectsEmptyScenariosFile);
+  FRIEND_TEST(SimulatorSweepTest, RejectsFlagsWithoutValue);
+  FRIEND_TEST(SimulatorSweepTest, RejectsNamesOutsideOutputDir);
+  void LoadScenarios();
+  void ReadScenarioSummary(SweepScenario* scenario);
+  void RunScenario(const SweepScenario& scenario);
+  void WriteSummary();
+
+  TraceEventStore trace_event_store_;
+  vector<SweepScenario> scenarios_;
+};
+
+}  // namespace sim
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SIM_SIMULATOR_SWEEP_H
@@ -0,0 +1,121 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for parsing the simulator sweep's scenarios.
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "sim/simulator_sweep.h"
+
+DECLARE_string(sweep_scenarios_file);
+DEFINE_string(scheduler, "flow", "The scheduler to use for tests.");
+
+namespace firmament {
+namespace sim {
+
+class SimulatorSweepTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    char path[] = "/tmp/simulator_sweep_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK_GE(fd, 0);
+    CHECK_EQ(close(fd), 0);
+    FLAGS_sweep_scenarios_file = path;
+  }
+
+  virtual void TearDown() {
+    CHECK_EQ(unlink(FLAGS_sweep_scenarios_file.c_str()), 0);
+    FLAGS_sweep_scenarios_file = "";
+  }
+
+  void WriteScenarios(const string& scenarios) {
+    ofstream scenarios_file(FLAGS_sweep_scenarios_file.c_str());
+    scenarios_file << scenarios;
+  }
+};
+
+TEST_F(SimulatorSweepTest, LoadScenarios) {
+  WriteScenarios("# Comments and empty lines are skipped\n"
+                 "\n"
+                 "baseline\n"
+                 "  fast\t--flow_scheduling_solver=flowlessly  max_tasks=4 \n");
+  SimulatorSweep sweep;
+  sweep.LoadScenarios();
+  CHECK_EQ(sweep.scenarios_.size(), 2);
+  CHECK_EQ(sweep.scenarios_[0].name_, "baseline");
+  CHECK(sweep.scenarios_[0].flags_.empty());
+  CHECK_EQ(sweep.scenarios_[1].name_, "fast");
+  CHECK_EQ(sweep.scenarios_[1].flags_.size(), 2);
+  CHECK_EQ(sweep.scenarios_[1].flags_[0].first, "flow_scheduling_solver");
+  CHECK_EQ(sweep.scenarios_[1].flags_[0].second, "flowlessly");
+  // The leading dashes are optional.
+  CHECK_EQ(sweep.scenarios_[1].flags_[1].first, "max_tasks");
+  CHECK_EQ(sweep.scenarios_[1].flags_[1].second, "4");
+}
+
+TEST_F(SimulatorSweepTest, RejectsDuplicateScenarioNames) {
+  WriteScenarios("baseline\n"
+                 "baseline --max_tasks=4\n");
+  SimulatorSweep sweep;
+  EXPECT_DEATH(sweep.LoadScenarios(), "more than once");
+}
+
+TEST_F(SimulatorSweepTest, RejectsFlagsWithoutValue) {
+  WriteScenarios("baseline --max_tasks\n");
+  SimulatorSweep sweep;
+  EXPECT_DEATH(sweep.LoadScenarios(), "not of the form");
+}
+
+// The scenario names are used as directories below --sweep_output_dir.
+TEST_F(SimulatorSweepTest, RejectsNamesOutsideOutputDir) {
+  const char* invalid_names[] = {"..", ".", "../escaped", "/tmp/escaped",
+                                 "nested/scenario"};
+  for (auto& name : invalid_names) {
+    WriteScenarios(string(name) + " --max_tasks=4\n");
+    SimulatorSweep sweep;
+    EXPECT_DEATH(sweep.LoadScenarios(), "not a valid directory name");
+  }
+  // Dots are fine as long as the name is not a path component of its own.
+  WriteScenarios("run..1\n");
+  SimulatorSweep sweep;
+  sweep.LoadScenarios();
+  CHECK_EQ(sweep.scenarios_[0].name_, "run..1");
+}
+
+TEST_F(SimulatorSweepTest, RejectsEmptyScenariosFile) {
+  WriteScenarios("# Only a comment\n");
+  SimulatorSweep sweep;
+  EXPECT_DEATH(sweep.LoadScenarios(), "No scenarios");
+}
+
+}  // namespace sim
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  FLAGS_logtostderr = true;
+  FLAGS_stderrthreshold = 0;
+  return RUN_ALL_TESTS();
+}
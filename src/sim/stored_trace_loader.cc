@@ -0,0 +1,138 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Trace loader that replays a trace which has been loaded into memory once.
+
+#include "sim/stored_trace_loader.h"
+
+#include "misc/map-util.h"
+
+namespace firmament {
+namespace sim {
+
+TraceEventStore::TraceEventStore() {
+}
+
+void TraceEventStore::Load(TraceLoader* trace_loader,
+                           EventManager* event_manager) {
+  CHECK_EQ(event_manager->GetTimeOfNextEvent(), UINT64_MAX)
+    << "The event manager used to load the trace must be empty";
+  trace_loader->LoadMachineEvents(&machine_events_);
+  trace_loader->LoadJobsNumTasks(&job_num_tasks_);
+  trace_loader->LoadTasksRunningTime(&task_runtime_);
+  trace_loader->LoadTaskUtilizationStats(&task_id_to_stats_, task_runtime_);
+  // The trace loader adds the task events to its event manager. We drain
+  // them from there in timestamp order.
+  unordered_map<uint64_t, uint64_t> job_num_unfiltered_tasks = job_num_tasks_;
+  trace_loader->LoadTaskEvents(UINT64_MAX, &job_num_unfiltered_tasks);
+  while (event_manager->GetTimeOfNextEvent() != UINT64_MAX) {
+    task_events_.push_back(event_manager->GetNextEvent());
+  }
+  for (auto& job_num_tasks : job_num_tasks_) {
+    uint64_t* num_unfiltered_tasks =
+      FindOrNull(job_num_unfiltered_tasks, job_num_tasks.first);
+    CHECK_NOTNULL(num_unfiltered_tasks);
+    if (*num_unfiltered_tasks < job_num_tasks.second) {
+      CHECK(InsertIfNotPresent(&job_num_filtered_tasks_, job_num_tasks.first,
+                               job_num_tasks.second - *num_unfiltered_tasks));
+    }
+  }
+  LOG(INFO) << "Loaded " << machine_events_.size() << " machine events and "
+            << task_events_.size() << " task events into memory";
+}
+
+StoredTraceLoader::StoredTraceLoader(EventManager* event_manager,
+                                     const TraceEventStore& trace_event_store)
+  : TraceLoader(event_manager), trace_event_store_(trace_event_store),
+    next_task_event_index_(0), applied_filtered_tasks_(false) {
+}
+
+void StoredTraceLoader::LoadJobsNumTasks(
+    unordered_map<uint64_t, uint64_t>* job_num_tasks) {
+  for (auto& job_num_tasks_it : trace_event_store_.job_num_tasks()) {
+    InsertOrUpdate(job_num_tasks, job_num_tasks_it.first,
+                   job_num_tasks_it.second);
+  }
+}
+
+void StoredTraceLoader::LoadMachineEvents(
+    multimap<uint64_t, EventDescriptor>* machine_events) {
+  machine_events->insert(trace_event_store_.machine_events().begin(),
+                         trace_event_store_.machine_events().end());
+}
+
+bool StoredTraceLoader::LoadTaskEvents(
+    uint64_t events_up_to_time,
+    unordered_map<uint64_t, uint64_t>* job_num_tasks) {
+  if (!applied_filtered_tasks_) {
+    // The filtered tasks are discounted when the first task events are
+    // loaded, just like the other trace loaders do when they encounter them.
+    for (auto& job_filtered_tasks :
+         trace_event_store_.job_num_filtered_tasks()) {
+      uint64_t* num_tasks = FindOrNull(*job_num_tasks,
+                                       job_filtered_tasks.first);
+      CHECK_NOTNULL(num_tasks);
+      *num_tasks -= job_filtered_tasks.second;
+    }
+    applied_filtered_tasks_ = true;
+  }
+  const vector<pair<uint64_t, EventDescriptor> >& task_events =
+    trace_event_store_.task_events();
+  bool loaded_event = false;
+  for (; next_task_event_index_ < task_events.size() &&
+         task_events[next_task_event_index_].first <= events_up_to_time;
+       ++next_task_event_index_) {
+    event_manager_->AddEvent(task_events[next_task_event_index_].first,
+                             task_events[next_task_event_index_].second);
+    loaded_event = true;
+  }
+  return loaded_event || next_task_event_index_ < task_events.size();
+}
+
+void StoredTraceLoader::LoadTaskUtilizationStats(
+    unordered_map<TaskID_t, TraceTaskStats>* task_id_to_stats,
+    const unordered_map<TaskID_t, uint64_t>& task_runtimes) {
+  for (auto& task_stats : trace_event_store_.task_id_to_stats()) {
+    InsertOrUpdate(task_id_to_stats, task_stats.first, task_stats.second);
+  }
+}
+
+void StoredTraceLoader::LoadTasksRunningTime(
+    unordered_map<TaskID_t, uint64_t>* task_runtime) {
+  for (auto& task_runtime_it : trace_event_store_.task_runtime()) {
+    InsertOrUpdate(task_runtime, task_runtime_it.first,
+                   task_runtime_it.second);
+  }
+}
+
+void StoredTraceLoader::RestoreState(const TraceLoaderCheckpoint& state) {
+  CHECK_LE(state.next_task_event_index(),
+           trace_event_store_.task_events().size());
+  next_task_event_index_ = state.next_task_event_index();
+  applied_filtered_tasks_ = state.applied_filtered_tasks();
+}
+
+void StoredTraceLoader::SaveState(TraceLoaderCheckpoint* state) {
+  state->set_next_task_event_index(next_task_event_index_);
+  state->set_applied_filtered_tasks(applied_filtered_tasks_);
+}
+
+}  // namespace sim
+}  // namespace firmament
@@ -0,0 +1,111 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Trace loader that replays a trace which has been loaded into memory once.
+// A TraceEventStore is populated from another trace loader before the
+// simulations start and is only read afterwards. Hence, several simulations
+// can share it.
+
+#ifndef FIRMAMENT_SIM_STORED_TRACE_LOADER_H
+#define FIRMAMENT_SIM_STORED_TRACE_LOADER_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "sim/event_manager.h"
+#include "sim/trace_loader.h"
+#include "sim/trace_utils.h"
+
+namespace firmament {
+namespace sim {
+
+class TraceEventStore {
+ public:
+  TraceEventStore();
+
+  /**
+   * Loads the entire trace from a trace loader.
+   * @param trace_loader the loader from which to read the trace
+   * @param event_manager the empty event manager the trace loader adds the
+   * task events to
+   */
+  void Load(TraceLoader* trace_loader, EventManager* event_manager);
+
+  const unordered_map<uint64_t, uint64_t>& job_num_tasks() const {
+    return job_num_tasks_;
+  }
+  const unordered_map<uint64_t, uint64_t>& job_num_filtered_tasks() const {
+    return job_num_filtered_tasks_;
+  }
+  const multimap<uint64_t, EventDescriptor>& machine_events() const {
+    return machine_events_;
+  }
+  const vector<pair<uint64_t, EventDescriptor> >& task_events() const {
+    return task_events_;
+  }
+  const unordered_map<TaskID_t, TraceTaskStats>& task_id_to_stats() const {
+    return task_id_to_stats_;
+  }
+  const unordered_map<TaskID_t, uint64_t>& task_runtime() const {
+    return task_runtime_;
+  }
+
+ private:
+  // Number of tasks each job has in the trace.
+  unordered_map<uint64_t, uint64_t> job_num_tasks_;
+  // Number of tasks of each job that the trace loader has filtered out while
+  // loading the task events.
+  unordered_map<uint64_t, uint64_t> job_num_filtered_tasks_;
+  multimap<uint64_t, EventDescriptor> machine_events_;
+  // Task events sorted by timestamp.
+  vector<pair<uint64_t, EventDescriptor> > task_events_;
+  unordered_map<TaskID_t, TraceTaskStats> task_id_to_stats_;
+  unordered_map<TaskID_t, uint64_t> task_runtime_;
+};
+
+class StoredTraceLoader : public TraceLoader {
+ public:
+  StoredTraceLoader(EventManager* event_manager,
+                    const TraceEventStore& trace_event_store);
+  void LoadJobsNumTasks(unordered_map<uint64_t, uint64_t>* job_num_tasks);
+  void LoadMachineEvents(multimap<uint64_t, EventDescriptor>* machine_events);
+  bool LoadTaskEvents(uint64_t events_up_to_time,
+                      unordered_map<uint64_t, uint64_t>* job_num_tasks);
+  void LoadTaskUtilizationStats(
+      unordered_map<TaskID_t, TraceTaskStats>* task_id_to_stats,
+      const unordered_map<TaskID_t, uint64_t>& task_runtimes);
+  void LoadTasksRunningTime(
+      unordered_map<TaskID_t, uint64_t>* task_runtime);
+
+  void RestoreState(const TraceLoaderCheckpoint& state);
+  void SaveState(TraceLoaderCheckpoint* state);
+
+ private:
+  const TraceEventStore& trace_event_store_;
+  // Index of the next task event to add to the event manager.
+  uint64_t next_task_event_index_;
+  bool applied_filtered_tasks_;
+};
+
+}  // namespace sim
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SIM_STORED_TRACE_LOADER_H
@@ -0,0 +1,227 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the trace event store and the loader replaying it.
+
+#include <gtest/gtest.h>
+
+#include "misc/map-util.h"
+#include "sim/event_manager.h"
+#include "sim/simulated_wall_time.h"
+#include "sim/stored_trace_loader.h"
+
+DEFINE_string(scheduler, "flow", "The scheduler to use for tests.");
+
+namespace firmament {
+namespace sim {
+
+// Trace loader that returns a small fixed trace. It adds the task events
+// out of timestamp order and filters out the last task of job 1.
+class FixedTraceLoader : public TraceLoader {
+ public:
+  explicit FixedTraceLoader(EventManager* event_manager)
+    : TraceLoader(event_manager) {
+  }
+
+  void LoadJobsNumTasks(unordered_map<uint64_t, uint64_t>* job_num_tasks) {
+    InsertOrUpdate(job_num_tasks, 1, 3);
+    InsertOrUpdate(job_num_tasks, 2, 1);
+  }
+
+  void LoadMachineEvents(multimap<uint64_t, EventDescriptor>* machine_events) {
+    EventDescriptor event_desc;
+    event_desc.set_type(EventDescriptor::ADD_MACHINE);
+    event_desc.set_machine_id(7);
+    machine_events->insert(pair<uint64_t, EventDescriptor>(0, event_desc));
+  }
+
+  bool LoadTaskEvents(uint64_t events_up_to_time,
+                      unordered_map<uint64_t, uint64_t>* job_num_tasks) {
+    AddTaskSubmit(30, 1, 0);
+    AddTaskSubmit(10, 2, 0);
+    AddTaskSubmit(20, 1, 1);
+    AddTaskSubmit(20, 2, 1);
+    // The trace loader filters out task 2 of job 1.
+    (*job_num_tasks)[1]--;
+    return false;
+  }
+
+  void LoadTaskUtilizationStats(
+      unordered_map<TaskID_t, TraceTaskStats>* task_id_to_stats,
+      const unordered_map<TaskID_t, uint64_t>& task_runtimes) {
+    TraceTaskStats task_stats;
+    task_stats.avg_mean_cpu_usage_ = 0.5;
+    task_stats.total_runtime_ = 100;
+    InsertOrUpdate(task_id_to_stats, 42, task_stats);
+  }
+
+  void LoadTasksRunningTime(unordered_map<TaskID_t, uint64_t>* task_runtime) {
+    InsertOrUpdate(task_runtime, 42, 100);
+  }
+
+  void RestoreState(const TraceLoaderCheckpoint& state) {
+  }
+
+  void SaveState(TraceLoaderCheckpoint* state) {
+  }
+
+ private:
+  void AddTaskSubmit(uint64_t timestamp, uint64_t job_id,
+                     uint64_t task_index) {
+    EventDescriptor event_desc;
+    event_desc.set_type(EventDescriptor::TASK_SUBMIT);
+    event_desc.set_job_id(job_id);
+    event_desc.set_task_index(task_index);
+    event_manager_->AddEvent(timestamp, event_desc);
+  }
+};
+
+class StoredTraceLoaderTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    SimulatedWallTime simulated_time;
+    EventManager event_manager(&simulated_time);
+    FixedTraceLoader trace_loader(&event_manager);
+    trace_event_store_.Load(&trace_loader, &event_manager);
+  }
+
+  TraceEventStore trace_event_store_;
+};
+
+TEST_F(StoredTraceLoaderTest, StoreLoadsEntireTrace) {
+  CHECK_EQ(trace_event_store_.machine_events().size(), 1);
+  CHECK_EQ(trace_event_store_.machine_events().begin()->second.machine_id(),
+           7);
+  CHECK_EQ(trace_event_store_.job_num_tasks().size(), 2);
+  CHECK_EQ(trace_event_store_.job_num_tasks().at(1), 3);
+  // Only job 1 has a filtered task.
+  CHECK_EQ(trace_event_store_.job_num_filtered_tasks().size(), 1);
+  CHECK_EQ(trace_event_store_.job_num_filtered_tasks().at(1), 1);
+  CHECK_EQ(trace_event_store_.task_runtime().at(42), 100);
+  CHECK_EQ(trace_event_store_.task_id_to_stats().at(42).total_runtime_, 100);
+  // The task events are stored in timestamp order.
+  const vector<pair<uint64_t, EventDescriptor> >& task_events =
+    trace_event_store_.task_events();
+  CHECK_EQ(task_events.size(), 4);
+  for (uint64_t index = 1; index < task_events.size(); ++index) {
+    CHECK_LE(task_events[index - 1].first, task_events[index].first);
+  }
+}
+
+TEST_F(StoredTraceLoaderTest, LoadReturnsStoredTrace) {
+  SimulatedWallTime simulated_time;
+  EventManager event_manager(&simulated_time);
+  StoredTraceLoader trace_loader(&event_manager, trace_event_store_);
+  unordered_map<uint64_t, uint64_t> job_num_tasks;
+  trace_loader.LoadJobsNumTasks(&job_num_tasks);
+  CHECK_EQ(job_num_tasks.size(), 2);
+  CHECK_EQ(job_num_tasks[1], 3);
+  CHECK_EQ(job_num_tasks[2], 1);
+  multimap<uint64_t, EventDescriptor> machine_events;
+  trace_loader.LoadMachineEvents(&machine_events);
+  CHECK_EQ(machine_events.size(), 1);
+  CHECK_EQ(machine_events.begin()->second.machine_id(), 7);
+  unordered_map<TaskID_t, uint64_t> task_runtime;
+  trace_loader.LoadTasksRunningTime(&task_runtime);
+  CHECK_EQ(task_runtime.size(), 1);
+  CHECK_EQ(task_runtime[42], 100);
+  unordered_map<TaskID_t, TraceTaskStats> task_id_to_stats;
+  trace_loader.LoadTaskUtilizationStats(&task_id_to_stats, task_runtime);
+  CHECK_EQ(task_id_to_stats.size(), 1);
+  CHECK_EQ(task_id_to_stats[42].avg_mean_cpu_usage_, 0.5);
+}
+
+TEST_F(StoredTraceLoaderTest, ReplaysTaskEventsInOrder) {
+  SimulatedWallTime simulated_time;
+  EventManager event_manager(&simulated_time);
+  StoredTraceLoader trace_loader(&event_manager, trace_event_store_);
+  unordered_map<uint64_t, uint64_t> job_num_tasks;
+  trace_loader.LoadJobsNumTasks(&job_num_tasks);
+  CHECK(trace_loader.LoadTaskEvents(15, &job_num_tasks));
+  // The filtered tasks are discounted with the first events.
+  CHECK_EQ(job_num_tasks[1], 2);
+  CHECK_EQ(job_num_tasks[2], 1);
+  pair<uint64_t, EventDescriptor> event = event_manager.GetNextEvent();
+  CHECK_EQ(event.first, 10);
+  CHECK_EQ(event.second.job_id(), 2);
+  CHECK_EQ(event_manager.GetTimeOfNextEvent(), UINT64_MAX);
+  // Events with equal timestamps keep the order the trace loader added them.
+  CHECK(trace_loader.LoadTaskEvents(25, &job_num_tasks));
+  CHECK_EQ(job_num_tasks[1], 2);
+  event = event_manager.GetNextEvent();
+  CHECK_EQ(event.first, 20);
+  CHECK_EQ(event.second.job_id(), 1);
+  CHECK_EQ(event.second.task_index(), 1);
+  event = event_manager.GetNextEvent();
+  CHECK_EQ(event.first, 20);
+  CHECK_EQ(event.second.job_id(), 2);
+  CHECK_EQ(event.second.task_index(), 1);
+  CHECK_EQ(event_manager.GetTimeOfNextEvent(), UINT64_MAX);
+  // Loading up to the same time again adds nothing.
+  CHECK(trace_loader.LoadTaskEvents(25, &job_num_tasks));
+  CHECK_EQ(event_manager.GetTimeOfNextEvent(), UINT64_MAX);
+  CHECK(trace_loader.LoadTaskEvents(UINT64_MAX, &job_num_tasks));
+  event = event_manager.GetNextEvent();
+  CHECK_EQ(event.first, 30);
+  CHECK_EQ(event.second.job_id(), 1);
+  CHECK_EQ(event.second.task_index(), 0);
+  CHECK(!trace_loader.LoadTaskEvents(UINT64_MAX, &job_num_tasks));
+}
+
+// Simulations sharing a store replay it independently of each other, and a
+// restored loader continues where the saved one stopped.
+TEST_F(StoredTraceLoaderTest, SaveAndRestoreState) {
+  SimulatedWallTime simulated_time;
+  EventManager event_manager(&simulated_time);
+  StoredTraceLoader trace_loader(&event_manager, trace_event_store_);
+  unordered_map<uint64_t, uint64_t> job_num_tasks;
+  trace_loader.LoadJobsNumTasks(&job_num_tasks);
+  CHECK(trace_loader.LoadTaskEvents(20, &job_num_tasks));
+  TraceLoaderCheckpoint state;
+  trace_loader.SaveState(&state);
+  CHECK_EQ(state.next_task_event_index(), 3);
+  CHECK(state.applied_filtered_tasks());
+  EventManager restored_event_manager(&simulated_time);
+  StoredTraceLoader restored_trace_loader(&restored_event_manager,
+                                          trace_event_store_);
+  restored_trace_loader.RestoreState(state);
+  // The restored job task counts already have the filtered tasks discounted.
+  unordered_map<uint64_t, uint64_t> restored_job_num_tasks = job_num_tasks;
+  CHECK(restored_trace_loader.LoadTaskEvents(UINT64_MAX,
+                                             &restored_job_num_tasks));
+  CHECK_EQ(restored_job_num_tasks[1], 2);
+  pair<uint64_t, EventDescriptor> event =
+    restored_event_manager.GetNextEvent();
+  CHECK_EQ(event.first, 30);
+  CHECK_EQ(restored_event_manager.GetTimeOfNextEvent(), UINT64_MAX);
+  // The original loader is unaffected.
+  CHECK(trace_loader.LoadTaskEvents(UINT64_MAX, &job_num_tasks));
+  CHECK_EQ(event_manager.GetNextEvent().first, 10);
+}
+
+}  // namespace sim
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  FLAGS_logtostderr = true;
+  FLAGS_stderrthreshold = 0;
+  return RUN_ALL_TESTS();
+}
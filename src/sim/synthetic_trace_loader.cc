@@ -280,5 +280,13 @@ void SyntheticTraceLoader::LoadTasksRunningTime(
   }
 }
 
+void SyntheticTraceLoader::RestoreState(const TraceLoaderCheckpoint& state) {
+  last_generated_job_id_ = state.last_generated_job_id();
+}
+
+void SyntheticTraceLoader::SaveState(TraceLoaderCheckpoint* state) {
+  state->set_last_generated_job_id(last_generated_job_id_);
+}
+
 } // namespace sim
 } // namespace firmament
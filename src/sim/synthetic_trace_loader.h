@@ -41,6 +41,9 @@ class SyntheticTraceLoader : public TraceLoader {
       const unordered_map<TaskID_t, uint64_t>& task_runtimes);
   void LoadTasksRunningTime(
       unordered_map<TaskID_t, uint64_t>* task_runtime);
+
+  void RestoreState(const TraceLoaderCheckpoint& state);
+  void SaveState(TraceLoaderCheckpoint* state);
  private:
   void GetNumberOfSlots(const ResourceTopologyNodeDescriptor& rtnd,
                         uint64_t* num_slots);
@@ -25,6 +25,7 @@
 
 #include "base/common.h"
 #include "sim/event_manager.h"
+#include "sim/simulator_checkpoint.pb.h"
 #include "sim/trace_utils.h"
 
 namespace firmament {
@@ -70,6 +71,19 @@ class TraceLoader {
   virtual void LoadTasksRunningTime(
       unordered_map<TaskID_t, uint64_t>* task_runtime) = 0;
 
+  /**
+   * Restores the position up to which task events have been loaded.
+   * @param state the state previously saved with SaveState
+   */
+  virtual void RestoreState(const TraceLoaderCheckpoint& state) = 0;
+
+  /**
+   * Saves the position up to which task events have been loaded. The events
+   * loaded so far are part of the event manager's state.
+   * @param state the protobuf in which to save the state
+   */
+  virtual void SaveState(TraceLoaderCheckpoint* state) = 0;
+
  protected:
   EventManager* event_manager_;
 };
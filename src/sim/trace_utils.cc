@@ -35,6 +35,10 @@ DEFINE_string(machine_tmpl_file,
               "../../tests/testdata/machine_2numa_2sockets_3cores_2pus.pbin",
               "File specifying machine topology. (Note: the given path must be "
               "relative to the directory of the binary)");
+DEFINE_string(sim_machine_topology, "",
+              "hwloc synthetic topology description of the simulated "
+              "machines (e.g. \"socket:2 core:4 pu:2\"). If set, it is used "
+              "instead of --machine_tmpl_file.");
 
 namespace firmament {
 namespace sim {
@@ -1,6 +0,0 @@
-{
-  {{#JOB_DATA}}
-  "{{JOB_FRIENDLY_NAME}}": "{{JOB_ID}}"{{#JOB_DATA_separator}}, {{/JOB_DATA_separator}}
-  {{/JOB_DATA}}
-}
-
@@ -1,5 +0,0 @@
-[ 
-  {{#TASK_DATA}}
-  {{TASK_ID}}{{#TASK_DATA_separator}}, {{/TASK_DATA_separator}}
-  {{/TASK_DATA}}
-]